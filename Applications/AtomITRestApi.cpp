@@ -31,16 +31,24 @@
 
 #include "AtomITRestApi.h"
 
+#include "../Framework/TimeSeries/TimeSeriesAggregator.h"
+#include "../Framework/TimeSeries/TimeSeriesArchive.h"
 #include "../Framework/TimeSeries/TimeSeriesReader.h"
 #include "../Framework/TimeSeries/TimeSeriesWriter.h"
 
 #include <Core/Logging.h>
 #include <Core/OrthancException.h>
+#include <Core/Toolbox.h>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include <boost/math/special_functions/round.hpp>
 
+#include <cassert>
+#include <json/writer.h>
+#include <limits>
+
 
 namespace AtomIT
 {
@@ -48,6 +56,18 @@ namespace AtomIT
   {
     return dynamic_cast<AtomITRestApi&>(call.GetContext()).serverContext_.GetManager();
   }
+
+
+  TimeSeriesAccessorCache& AtomITRestApi::GetAccessors(Orthanc::RestApiCall& call)
+  {
+    return dynamic_cast<AtomITRestApi&>(call.GetContext()).serverContext_.GetAccessorCache();
+  }
+
+
+  SubscribersLimiter& AtomITRestApi::GetSubscribers(Orthanc::RestApiCall& call)
+  {
+    return dynamic_cast<AtomITRestApi&>(call.GetContext()).serverContext_.GetSubscribersLimiter();
+  }
     
 
   void AtomITRestApi::ServeRoot(Orthanc::RestApiGetCall& call)
@@ -82,49 +102,48 @@ namespace AtomIT
     Json::Value& content = result["content"];
 
     unsigned int limit = boost::lexical_cast<unsigned int>(call.GetArgument("limit", "10"));
-    bool done = false;
+    bool done = true;
+
+    std::vector<Message> messages;
 
     {
-      TimeSeriesReader reader(GetManager(call), name, false);
-      TimeSeriesReader::Transaction transaction(reader);
+      TimeSeriesAccessorCache::ReaderPointer reader = GetAccessors(call).GetReader(name);
+      TimeSeriesReader::Transaction transaction(*reader);
+
+      int64_t start = std::numeric_limits<int64_t>::min();
+      bool empty = false;
 
       if (call.HasArgument("since"))
       {
-        done = !transaction.SeekNearest(boost::lexical_cast<uint64_t>(call.GetArgument("since", "")));
+        start = boost::lexical_cast<uint64_t>(call.GetArgument("since", ""));
       }
       else if (call.HasArgument("last"))
       {
-        done = !transaction.SeekLast();
+        empty = !(transaction.SeekLast() &&
+                  transaction.GetTimestamp(start));
       }
-      else
+
+      if (!empty)
       {
-        done = !transaction.SeekFirst();
+        // Read one more item than the limit, to know whether the end
+        // of the time series is reached
+        transaction.Scan(messages, start, std::numeric_limits<int64_t>::max(),
+                         limit == 0 ? 0 : limit + 1);
       }
+    }
 
-      while (!done &&
-             (limit == 0 || content.size() < limit))
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      if (limit != 0 &&
+          i == limit)
       {
-        int64_t timestamp;
-        std::string metadata, data;
-          
-        if (transaction.GetTimestamp(timestamp) &&
-            transaction.Read(metadata, data))
-        {
-          Message message;
-          message.SetTimestamp(timestamp);
-          message.SwapMetadata(metadata);
-          message.SwapValue(data);
-
-          Json::Value json;
-          message.Format(json);
-          content.append(json);
-        }
-
-        if (!transaction.SeekNext())
-        {
-          done = true;
-        }
+        done = false;
+        break;
       }
+
+      Json::Value json;
+      messages[i].Format(json);
+      content.append(json);
     }
 
     result["name"] = name;
@@ -140,8 +159,8 @@ namespace AtomIT
     int64_t timestamp = boost::lexical_cast<uint64_t>(call.GetUriComponent("timestamp", ""));
 
     {
-      TimeSeriesReader reader(GetManager(call), name, false);
-      TimeSeriesReader::Transaction transaction(reader);
+      TimeSeriesAccessorCache::ReaderPointer reader = GetAccessors(call).GetReader(name);
+      TimeSeriesReader::Transaction transaction(*reader);
 
       transaction.Seek(timestamp);
         
@@ -174,8 +193,8 @@ namespace AtomIT
     LOG(INFO) << "Deleting timestamp " << timestamp << " in time series \"" << name << "\"";
       
     {
-      TimeSeriesWriter writer(GetManager(call), name);
-      TimeSeriesWriter::Transaction transaction(writer);
+      TimeSeriesAccessorCache::WriterPointer writer = GetAccessors(call).GetWriter(name);
+      TimeSeriesWriter::Transaction transaction(*writer);
       transaction.DeleteRange(timestamp, timestamp + 1);
     }
 
@@ -189,8 +208,8 @@ namespace AtomIT
     LOG(INFO) << "Deleting whole content of time series \"" << name << "\"";
       
     {
-      TimeSeriesWriter writer(GetManager(call), name);
-      TimeSeriesWriter::Transaction transaction(writer);
+      TimeSeriesAccessorCache::WriterPointer writer = GetAccessors(call).GetWriter(name);
+      TimeSeriesWriter::Transaction transaction(*writer);
       transaction.ClearContent();
     }
 
@@ -220,22 +239,65 @@ namespace AtomIT
               << message.FormatValue() << "\"";
 
     {
-      TimeSeriesWriter writer(GetManager(call), name);
-      writer.Append(message);
+      GetAccessors(call).GetWriter(name)->Append(message);
     }
 
     call.GetOutput().AnswerBuffer("{}", "application/json");
   }
   
 
+  void AtomITRestApi::AppendMessages(Orthanc::RestApiPostCall& call)
+  {
+    std::string name = call.GetUriComponent("name", "");
+
+    Json::Value body;
+    if (!call.ParseJsonRequest(body))
+    {
+      LOG(ERROR) << "The body of the request must be a JSON array of messages";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+    }
+
+    // Accept both the raw array, and the output of "GetTimeSeriesContent()"
+    const Json::Value& content = (body.type() == Json::objectValue && body.isMember("content") ?
+                                  body["content"] : body);
+
+    if (content.type() != Json::arrayValue)
+    {
+      LOG(ERROR) << "The body of the request must be a JSON array of messages";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+    }
+
+    std::vector<Message> messages(content.size());
+
+    for (Json::Value::ArrayIndex i = 0; i < content.size(); i++)
+    {
+      messages[i].Parse(content[i]);
+    }
+
+    LOG(INFO) << messages.size() << " message(s) appended through REST API to time series \""
+              << name << "\"";
+
+    size_t count;
+
+    {
+      count = GetAccessors(call).GetWriter(name)->Append(messages);
+    }
+
+    Json::Value result = Json::objectValue;
+    result["appended"] = static_cast<unsigned int>(count);
+
+    call.GetOutput().AnswerJson(result);
+  }
+  
+
   void AtomITRestApi::GetTimeSeriesStatistics(Orthanc::RestApiGetCall& call)
   {
     std::string name = call.GetUriComponent("name", "");
     uint64_t length, size;
       
     {
-      TimeSeriesReader reader(GetManager(call), name, false);
-      TimeSeriesReader::Transaction transaction(reader);
+      TimeSeriesAccessorCache::ReaderPointer reader = GetAccessors(call).GetReader(name);
+      TimeSeriesReader::Transaction transaction(*reader);
       transaction.GetStatistics(length, size);
     }
 
@@ -250,8 +312,401 @@ namespace AtomIT
   }
 
 
-  AtomITRestApi::AtomITRestApi(ServerContext& serverContext) :
-    serverContext_(serverContext)
+  void AtomITRestApi::SubscribeTimeSeries(Orthanc::RestApiGetCall& call)
+  {
+    // Bound the time during which one thread of the HTTP server is
+    // blocked by one subscriber
+    static const unsigned int MAX_TIMEOUT = 30;  // In seconds
+
+    std::string name = call.GetUriComponent("name", "");
+    unsigned int limit = boost::lexical_cast<unsigned int>(call.GetArgument("limit", "100"));
+    unsigned int timeout = boost::lexical_cast<unsigned int>(call.GetArgument("timeout", "30"));
+
+    if (timeout > MAX_TIMEOUT)
+    {
+      timeout = MAX_TIMEOUT;
+    }
+
+    // The number of pending subscriptions is bounded, so that they
+    // cannot starve the other requests to the REST API
+    SubscribersLimiter::Slot slot(GetSubscribers(call));
+    if (!slot.IsAcquired())
+    {
+      LOG(WARNING) << "Too many pending subscriptions, rejecting the one to time series: " << name;
+      call.GetOutput().SignalError(Orthanc::HttpStatus_503_ServiceUnavailable);
+      return;
+    }
+
+    // This reader is not taken from the shared cache, as the
+    // detection of the modifications is specific to each subscriber.
+    // Any modification after its creation wakes up "WaitModification()".
+    TimeSeriesReader reader(GetManager(call), name, true);
+
+    // The subscriber receives the messages strictly after "since"
+    int64_t start;
+
+    {
+      TimeSeriesReader::Transaction transaction(reader);
+
+      bool hasStart;
+      if (call.HasArgument("since"))
+      {
+        start = boost::lexical_cast<int64_t>(call.GetArgument("since", ""));
+        hasStart = true;
+      }
+      else
+      {
+        // By default, only wait for the messages to come
+        hasStart = (transaction.SeekLast() &&
+                    transaction.GetTimestamp(start));
+      }
+
+      if (!hasStart)
+      {
+        start = std::numeric_limits<int64_t>::min();
+      }
+      else if (start == std::numeric_limits<int64_t>::max())
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+      }
+      else
+      {
+        start++;
+      }
+    }
+
+    const boost::posix_time::ptime deadline =
+      boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(timeout);
+
+    std::vector<Message> messages;
+
+    for (;;)
+    {
+      {
+        TimeSeriesReader::Transaction transaction(reader);
+        transaction.Scan(messages, start, std::numeric_limits<int64_t>::max(), limit);
+      }
+
+      const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+        
+      if (!messages.empty() ||
+          now >= deadline)
+      {
+        break;
+      }
+
+      reader.WaitModification(static_cast<unsigned int>((deadline - now).total_milliseconds()));
+    }
+
+    // Newline-delimited JSON, one message per line. An empty answer
+    // means that the timeout has elapsed.
+    std::string answer;
+    Json::FastWriter writer;
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      Json::Value json;
+      messages[i].Format(json);
+      answer += writer.write(json);
+    }
+
+    call.GetOutput().AnswerBuffer(answer, "application/x-ndjson");
+  }
+
+
+  void AtomITRestApi::AggregateTimeSeries(Orthanc::RestApiGetCall& call)
+  {
+    // Bound the size of the answer, and the memory of the aggregator
+    static const unsigned int MAX_BUCKETS = 10000;
+
+    std::string name = call.GetUriComponent("name", "");
+    unsigned int buckets = boost::lexical_cast<unsigned int>(call.GetArgument("buckets", "100"));
+
+    if (buckets == 0 ||
+        buckets > MAX_BUCKETS)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    TimeSeriesAggregator::Decimation decimation;
+
+    std::string s = call.GetArgument("decimation", "none");
+    if (s == "none")
+    {
+      decimation = TimeSeriesAggregator::Decimation_None;
+    }
+    else if (s == "minmax")
+    {
+      decimation = TimeSeriesAggregator::Decimation_MinMax;
+    }
+    else if (s == "lttb")
+    {
+      decimation = TimeSeriesAggregator::Decimation_LTTB;
+    }
+    else
+    {
+      LOG(ERROR) << "Unknown decimation: " << s;
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    std::vector<std::string> functions;
+    Orthanc::Toolbox::TokenizeString(functions, call.GetArgument("fn", "min,max,mean,count,last"), ',');
+
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+      if (functions[i] != "min" &&
+          functions[i] != "max" &&
+          functions[i] != "mean" &&
+          functions[i] != "count" &&
+          functions[i] != "last")
+      {
+        LOG(ERROR) << "Unknown aggregation function: " << functions[i];
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+      }
+    }
+
+    std::auto_ptr<TimeSeriesAggregator> aggregator;
+
+    {
+      TimeSeriesAccessorCache::ReaderPointer reader = GetAccessors(call).GetReader(name);
+      TimeSeriesReader::Transaction transaction(*reader);
+
+      // By default, the range covers the whole time series
+      int64_t from, to;
+
+      if (call.HasArgument("from"))
+      {
+        from = boost::lexical_cast<int64_t>(call.GetArgument("from", ""));
+      }
+      else if (!(transaction.SeekFirst() &&
+                 transaction.GetTimestamp(from)))
+      {
+        from = 0;
+      }
+
+      if (call.HasArgument("to"))
+      {
+        to = boost::lexical_cast<int64_t>(call.GetArgument("to", ""));
+      }
+      else if (transaction.SeekLast() &&
+               transaction.GetTimestamp(to) &&
+               to != std::numeric_limits<int64_t>::max())
+      {
+        to++;  // The range is exclusive
+      }
+      else
+      {
+        to = std::numeric_limits<int64_t>::max();
+      }
+
+      if (from >= to)
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+      }
+
+      // Single scan over the range, without building the messages
+      aggregator.reset(new TimeSeriesAggregator(from, to, buckets, decimation));
+      transaction.Scan(from, to, 0, *aggregator);
+    }
+
+    aggregator->Finalize();
+
+    Json::Value result = Json::objectValue;
+    result["name"] = name;
+    result["from"] = static_cast<Json::Value::UInt64>(aggregator->GetFrom());
+    result["to"] = static_cast<Json::Value::UInt64>(aggregator->GetTo());
+    result["width"] = static_cast<Json::Value::UInt64>(aggregator->GetBucketWidth());
+    result["ignored"] = static_cast<Json::Value::UInt64>(aggregator->GetIgnoredCount());
+
+    // The answer is made of parallel arrays (one value per non-empty
+    // bucket, or per decimated point), which is more compact than an
+    // array of objects
+    Json::Value& timestamps = result["timestamp"];
+    timestamps = Json::arrayValue;
+
+    if (decimation == TimeSeriesAggregator::Decimation_None)
+    {
+      const std::vector<TimeSeriesAggregator::Bucket>& content = aggregator->GetBuckets();
+
+      for (size_t i = 0; i < content.size(); i++)
+      {
+        timestamps.append(static_cast<Json::Value::UInt64>(content[i].start_));
+      }
+
+      for (size_t i = 0; i < functions.size(); i++)
+      {
+        Json::Value& values = result[functions[i]];
+        values = Json::arrayValue;
+
+        for (size_t j = 0; j < content.size(); j++)
+        {
+          if (functions[i] == "min")
+          {
+            values.append(content[j].min_);
+          }
+          else if (functions[i] == "max")
+          {
+            values.append(content[j].max_);
+          }
+          else if (functions[i] == "mean")
+          {
+            values.append(content[j].GetMean());
+          }
+          else if (functions[i] == "count")
+          {
+            values.append(static_cast<Json::Value::UInt64>(content[j].count_));
+          }
+          else
+          {
+            assert(functions[i] == "last");
+            values.append(content[j].last_);
+          }
+        }
+      }
+    }
+    else
+    {
+      const std::vector<TimeSeriesAggregator::Point>& points = aggregator->GetPoints();
+
+      Json::Value& values = result["value"];
+      values = Json::arrayValue;
+
+      for (size_t i = 0; i < points.size(); i++)
+      {
+        timestamps.append(static_cast<Json::Value::UInt64>(points[i].timestamp_));
+        values.append(points[i].value_);
+      }
+    }
+
+    call.GetOutput().AnswerJson(result);
+  }
+
+
+  void AtomITRestApi::ExportArchive(Orthanc::RestApiGetCall& call)
+  {
+    std::string name = call.GetUriComponent("name", "");
+
+    int64_t from = std::numeric_limits<int64_t>::min();
+    int64_t to = std::numeric_limits<int64_t>::max();
+
+    if (call.HasArgument("from"))
+    {
+      from = boost::lexical_cast<int64_t>(call.GetArgument("from", ""));
+    }
+
+    if (call.HasArgument("to"))
+    {
+      to = boost::lexical_cast<int64_t>(call.GetArgument("to", ""));
+    }
+
+    // The archive is directly encoded by the scan, without creating
+    // the intermediate messages
+    ArchiveWriter archive(true);
+
+    {
+      TimeSeriesAccessorCache::ReaderPointer reader = GetAccessors(call).GetReader(name);
+      TimeSeriesReader::Transaction transaction(*reader);
+      transaction.Scan(from, to, 0, archive);
+    }
+
+    LOG(INFO) << archive.GetCount() << " message(s) exported from time series \"" << name << "\"";
+
+    std::string buffer;
+    archive.Flush(buffer);
+    call.GetOutput().AnswerBuffer(buffer, "application/octet-stream");
+  }
+
+
+  void AtomITRestApi::ImportArchive(Orthanc::RestApiPutCall& call)
+  {
+    // Number of messages that are appended by one transaction
+    static const size_t BATCH_SIZE = 10000;
+
+    std::string name = call.GetUriComponent("name", "");
+
+    // The whole archive is decoded before appending anything, so that
+    // a corrupted or truncated upload leaves the time series untouched
+    std::vector<Message> messages;
+
+    {
+      ArchiveReader archive;
+      archive.AddChunk(call.GetBodyData(), call.GetBodySize());
+
+      Message message;
+      while (archive.ReadMessage(message))
+      {
+        messages.push_back(message);
+      }
+
+      if (!archive.IsDone())
+      {
+        LOG(ERROR) << "Truncated archive, nothing is imported into time series \"" << name << "\"";
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+    }
+
+    TimeSeriesAccessorCache::WriterPointer writer = GetAccessors(call).GetWriter(name);
+
+    uint64_t appended = 0;
+
+    for (size_t start = 0; start < messages.size(); start += BATCH_SIZE)
+    {
+      const size_t end = std::min(start + BATCH_SIZE, messages.size());
+      appended += writer->Append(std::vector<Message>(messages.begin() + start,
+                                                      messages.begin() + end));
+    }
+
+    LOG(INFO) << appended << " message(s) imported into time series \"" << name << "\"";
+
+    Json::Value result = Json::objectValue;
+    result["count"] = boost::lexical_cast<std::string>(messages.size());
+    result["appended"] = boost::lexical_cast<std::string>(appended);
+
+    call.GetOutput().AnswerJson(result);
+  }
+
+
+  void AtomITRestApi::GetSQLiteStatistics(Orthanc::RestApiGetCall& call)
+  {
+    Json::Value result;
+    dynamic_cast<AtomITRestApi&>(call.GetContext()).factory_.GetSQLiteStatistics(result);
+    call.GetOutput().AnswerJson(result);
+  }
+
+
+  void AtomITRestApi::ListFilters(Orthanc::RestApiGetCall& call)
+  {
+    std::set<std::string> filters;
+    dynamic_cast<AtomITRestApi&>(call.GetContext()).serverContext_.ListFilters(filters);
+
+    Json::Value result = Json::arrayValue;
+
+    for (std::set<std::string>::const_iterator it = filters.begin();
+         it != filters.end(); ++it)
+    {
+      result.append(*it);
+    }
+
+    call.GetOutput().AnswerJson(result);
+  }
+
+
+  void AtomITRestApi::GetFilterStatistics(Orthanc::RestApiGetCall& call)
+  {
+    std::string name = call.GetUriComponent("name", "");
+
+    Json::Value result;
+    if (dynamic_cast<AtomITRestApi&>(call.GetContext()).serverContext_.FormatFilterStatistics(result, name))
+    {
+      call.GetOutput().AnswerJson(result);
+    }
+  }
+
+
+  AtomITRestApi::AtomITRestApi(ServerContext& serverContext,
+                               MainTimeSeriesFactory& factory) :
+    serverContext_(serverContext),
+    factory_(factory)
   {
     Register("/", ServeRoot);
     Register("/series", ListTimeSeries);
@@ -259,9 +714,18 @@ namespace AtomIT
     Register("/series/{name}", AppendMessage<Orthanc::RestApiPostCall>);
     Register("/series/{name}/content", GetTimeSeriesContent);
     Register("/series/{name}/content", DeleteContent);
+    Register("/series/{name}/content", AppendMessages);
     Register("/series/{name}/content/{timestamp}", GetRawValue);
     Register("/series/{name}/content/{timestamp}", DeleteTimestamp);
     Register("/series/{name}/content/{timestamp}", AppendMessage<Orthanc::RestApiPutCall>);
     Register("/series/{name}/statistics", GetTimeSeriesStatistics);
+    Register("/series/{name}/subscribe", SubscribeTimeSeries);
+    Register("/series/{name}/aggregate", AggregateTimeSeries);
+    Register("/series/{name}/archive", ExportArchive);
+    Register("/series/{name}/archive", ImportArchive);
+    Register("/sqlite", GetSQLiteStatistics);
+    Register("/filters", ListFilters);
+    Register("/filters/{name}", AutoListChildren);
+    Register("/filters/{name}/statistics", GetFilterStatistics);
   }
 }
@@ -31,6 +31,7 @@
 
 #pragma once
 
+#include "MainTimeSeriesFactory.h"
 #include "ServerContext.h"
 
 #include <Core/RestApi/RestApi.h>
@@ -40,9 +41,14 @@ namespace AtomIT
   class AtomITRestApi : public Orthanc::RestApi
   {
   private:
-    ServerContext&  serverContext_;
+    ServerContext&          serverContext_;
+    MainTimeSeriesFactory&  factory_;
     
     static ITimeSeriesManager& GetManager(Orthanc::RestApiCall& call);
+
+    static TimeSeriesAccessorCache& GetAccessors(Orthanc::RestApiCall& call);
+
+    static SubscribersLimiter& GetSubscribers(Orthanc::RestApiCall& call);
     
     static void ServeRoot(Orthanc::RestApiGetCall& call);
  
@@ -59,9 +65,26 @@ namespace AtomIT
     template <typename Call>
     static void AppendMessage(Call& call);
 
+    static void AppendMessages(Orthanc::RestApiPostCall& call);
+
     static void GetTimeSeriesStatistics(Orthanc::RestApiGetCall& call);
+
+    static void SubscribeTimeSeries(Orthanc::RestApiGetCall& call);
+
+    static void AggregateTimeSeries(Orthanc::RestApiGetCall& call);
+
+    static void ExportArchive(Orthanc::RestApiGetCall& call);
+
+    static void ImportArchive(Orthanc::RestApiPutCall& call);
+
+    static void GetSQLiteStatistics(Orthanc::RestApiGetCall& call);
+
+    static void ListFilters(Orthanc::RestApiGetCall& call);
+
+    static void GetFilterStatistics(Orthanc::RestApiGetCall& call);
     
   public:
-    explicit AtomITRestApi(ServerContext& serverContext);
+    AtomITRestApi(ServerContext& serverContext,
+                  MainTimeSeriesFactory& factory);
   };
 }
@@ -31,6 +31,8 @@
 
 #include "FilterFactory.h"
 
+#include "../Framework/Filters/ArchiveSinkFilter.h"
+#include "../Framework/Filters/ArchiveSourceFilter.h"
 #include "../Framework/Filters/CSVFileSinkFilter.h"
 #include "../Framework/Filters/CSVFileSourceFilter.h"
 #include "../Framework/Filters/CounterSourceFilter.h"
@@ -41,6 +43,7 @@
 #include "../Framework/Filters/LuaFilter.h"
 #include "../Framework/Filters/MQTTSinkFilter.h"
 #include "../Framework/Filters/MQTTSourceFilter.h"
+#include "../Framework/Filters/RollupFilter.h"
 
 #include <Core/Logging.h>
 #include <Core/OrthancException.h>
@@ -69,9 +72,38 @@ namespace AtomIT
     {
       filter.SetPopInput(false);
     }
+
+    unsigned int v;
+
+    if (config.GetUnsignedIntegerParameter(v, "BatchSize"))
+    {
+      filter.SetBatchSize(v);
+    }
+
+    if (config.GetUnsignedIntegerParameter(v, "BatchLatency"))
+    {
+      filter.SetBatchLatency(v);
+    }
   }
   
 
+  static void SetCommonSourceParameters(SourceFilter& filter,
+                                        const ConfigurationSection& config)
+  {
+    unsigned int v;
+
+    if (config.GetUnsignedIntegerParameter(v, "MaxPendingMessages"))
+    {
+      filter.SetMaxPendingMessages(v);
+    }
+
+    if (config.GetUnsignedIntegerParameter(v, "BatchSize"))
+    {
+      filter.SetBatchSize(v);
+    }
+  }
+
+
   static void SetCommonFileSinkParameters(SharedFileSinkFilter& filter,
                                           const ConfigurationSection& config)
   {
@@ -91,6 +123,42 @@ namespace AtomIT
   }
   
 
+  static IFilter* LoadArchiveSourceFilter(const std::string& name,
+                                          ITimeSeriesManager& manager,
+                                          const ConfigurationSection& config)
+  {
+    std::auto_ptr<ArchiveSourceFilter> filter
+      (new ArchiveSourceFilter(name, manager,
+                               config.GetMandatoryStringParameter("Output"),
+                               config.GetMandatoryStringParameter("Path")));
+
+    SetCommonSourceParameters(*filter, config);
+
+    return filter.release();
+  }
+
+
+  static IFilter* LoadArchiveSinkFilter(const std::string& name,
+                                        ITimeSeriesManager& manager,
+                                        const ConfigurationSection& config)
+  {
+    std::auto_ptr<ArchiveSinkFilter> filter
+      (new ArchiveSinkFilter(name, manager,
+                             config.GetMandatoryStringParameter("Input"),
+                             config.GetMandatoryStringParameter("Path")));
+
+    bool b;
+    if (config.GetBooleanParameter(b, "Append"))
+    {
+      filter->SetAppend(b);
+    }
+
+    SetCommonAdapterParameters(*filter, config);
+
+    return filter.release();
+  }
+
+
   static IFilter* LoadCSVFileSourceFilter(const std::string& name,
                                           ITimeSeriesManager& manager,
                                           const ConfigurationSection& config)
@@ -100,11 +168,7 @@ namespace AtomIT
                                config.GetMandatoryStringParameter("Output"),
                                config.GetMandatoryStringParameter("Path")));
 
-    unsigned int v;
-    if (config.GetUnsignedIntegerParameter(v, "MaxPendingMessages"))
-    {
-      filter->SetMaxPendingMessages(v);
-    }
+    SetCommonSourceParameters(*filter, config);
 
     return filter.release();
   }
@@ -163,11 +227,7 @@ namespace AtomIT
                                  config.GetMandatoryStringParameter("Output"),
                                  config.GetMandatoryStringParameter("Path")));
 
-    unsigned int v;
-    if (config.GetUnsignedIntegerParameter(v, "MaxPendingMessages"))
-    {
-      filter->SetMaxPendingMessages(v);
-    }
+    SetCommonSourceParameters(*filter, config);
 
     std::string s;
     if (config.GetStringParameter(s, "Metadata"))
@@ -276,6 +336,8 @@ namespace AtomIT
       filter->SetClientId(s);
     }
 
+    SetCommonSourceParameters(*filter, config);
+
     return filter.release();
   }
 
@@ -323,6 +385,29 @@ namespace AtomIT
       filter->SetDefaultOutputTimeSeries(s);
     }
 
+    unsigned int v;
+    if (config.GetUnsignedIntegerParameter(v, "MaxPendingMessages"))
+    {
+      filter->SetMaxPendingMessages(v);
+    }
+
+    if (config.GetUnsignedIntegerParameter(v, "WriterCacheSize"))
+    {
+      filter->SetWriterCacheSize(v);
+    }
+
+    if (config.GetUnsignedIntegerParameter(v, "Concurrency"))
+    {
+      filter->SetConcurrency(v);
+
+      if (v > 1 &&
+          !config.GetUnsignedIntegerParameter(v, "BatchSize"))
+      {
+        LOG(WARNING) << "The Lua filter \"" << name << "\" has a concurrency "
+                     << "but no batch size, so its messages are not converted in parallel";
+      }
+    }
+
     SetCommonAdapterParameters(*filter, config);
 
     return filter.release();
@@ -378,6 +463,76 @@ namespace AtomIT
   }
 
 
+  static IFilter* LoadRollupFilter(const std::string& name,
+                                   ITimeSeriesManager& manager,
+                                   const ConfigurationSection& config)
+  {
+    static const char* OUTPUTS = "Outputs";
+    static const char* BUCKET_WIDTH = "BucketWidth";
+
+    int64_t width;
+    if (!config.GetInteger64Parameter(width, BUCKET_WIDTH))
+    {
+      LOG(ERROR) << "Mandatory parameter \"" << BUCKET_WIDTH << "\" is missing";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+    }
+
+    std::auto_ptr<RollupFilter> filter
+      (new RollupFilter(name, manager,
+                        config.GetMandatoryStringParameter("Input"), width));
+
+    if (!config.HasItem(OUTPUTS))
+    {
+      LOG(ERROR) << "Missing section \"" << OUTPUTS << "\" in the rollup filter \"" << name << "\"";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+    }
+
+    ConfigurationSection outputs(config, OUTPUTS);
+
+    std::set<std::string> aggregations;
+    outputs.ListMembers(aggregations);
+
+    for (std::set<std::string>::const_iterator it = aggregations.begin();
+         it != aggregations.end(); ++it)
+    {
+      RollupFilter::Aggregation aggregation;
+      if (!RollupFilter::LookupAggregation(aggregation, *it))
+      {
+        LOG(ERROR) << "Unknown aggregation in the rollup filter \"" << name << "\": " << *it;
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+
+      filter->AddOutput(aggregation, outputs.GetMandatoryStringParameter(*it));
+    }
+
+    unsigned int v;
+    if (config.GetUnsignedIntegerParameter(v, "FinalizationTimeout"))
+    {
+      filter->SetFinalizationTimeout(v);
+    }
+
+    bool b;
+    if (config.GetBooleanParameter(b, "PopInput") &&
+        b)
+    {
+      // The bucket that is open at shutdown is computed again from
+      // the input time series after a restart
+      LOG(ERROR) << "The rollup filter \"" << name << "\" cannot pop its input";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+    }
+
+    const bool replay = (!config.HasItem("ReplayHistory") ||
+                         config.GetMandatoryBooleanParameter("ReplayHistory"));
+
+    SetCommonAdapterParameters(*filter, config);
+
+    // Unlike the other filters, the history is replayed by default
+    filter->SetReplayHistory(replay);
+
+    return filter.release();
+  }
+
+
   IFilter* CreateFilter(ITimeSeriesManager& manager,
                         FileWritersPool& writers,
                         const ConfigurationSection& config)
@@ -399,7 +554,15 @@ namespace AtomIT
 
     std::auto_ptr<IFilter> filter;
 
-    if (type == "CSVSource")
+    if (type == "ArchiveSource")
+    {
+      filter.reset(LoadArchiveSourceFilter(name, manager, config));
+    }
+    else if (type == "ArchiveSink")
+    {
+      filter.reset(LoadArchiveSinkFilter(name, manager, config));
+    }
+    else if (type == "CSVSource")
     {
       filter.reset(LoadCSVFileSourceFilter(name, manager, config));
     }
@@ -441,6 +604,10 @@ namespace AtomIT
     {
       filter.reset(LoadHttpPostSinkFilter(name, manager, config));
     }
+    else if (type == "Rollup")
+    {
+      filter.reset(LoadRollupFilter(name, manager, config));
+    }
     else
     {
       LOG(ERROR) << "Unknown type for filter \"" << name << "\": " << type;
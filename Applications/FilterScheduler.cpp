@@ -0,0 +1,562 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "FilterScheduler.h"
+
+#include <Core/OrthancException.h>
+#include <Core/Logging.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <deque>
+
+namespace AtomIT
+{
+  static const unsigned int POLL_INTERVAL = 500;    // Milliseconds
+  static const unsigned int POLLER_PERIOD = 100;    // Milliseconds
+  static const unsigned int MIN_BACKOFF = 100;      // Milliseconds
+  static const unsigned int MAX_BACKOFF = 10000;    // Milliseconds
+
+
+  class FilterScheduler::Task : public boost::noncopyable
+  {
+  private:
+    boost::mutex  mutex_;
+    IFilter&      filter_;
+    size_t        home_;
+    bool          queued_;
+    bool          running_;
+    bool          dirty_;
+    bool          done_;
+    bool          backoff_;
+    unsigned int  failures_;  // Number of consecutive failed steps
+    boost::posix_time::ptime  deadline_;  // When to poll the parked task
+
+  public:
+    Task(IFilter& filter,
+         size_t home) :
+      filter_(filter),
+      home_(home),
+      queued_(false),
+      running_(false),
+      dirty_(false),
+      done_(false),
+      backoff_(false),
+      failures_(0),
+      deadline_(boost::posix_time::microsec_clock::universal_time())
+    {
+    }
+
+    IFilter& GetFilter() const
+    {
+      return filter_;
+    }
+
+    size_t GetHome() const
+    {
+      return home_;
+    }
+
+    // Returns "true" iff the task must be pushed into a queue
+    bool MarkReady()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (done_ ||
+          queued_)
+      {
+        return false;
+      }
+      else if (running_ ||
+               backoff_)
+      {
+        // Don't run the same filter twice concurrently, and don't
+        // shorten the backoff of a failing filter, but remember to
+        // execute it once again
+        dirty_ = true;
+        return false;
+      }
+      else
+      {
+        queued_ = true;
+        return true;
+      }
+    }
+
+    // Returns "true" iff the task is parked and must be polled, in
+    // which case it must be pushed into a queue
+    bool MarkPolled(const boost::posix_time::ptime& now)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (done_ ||
+          queued_ ||
+          running_ ||
+          now < deadline_)
+      {
+        return false;
+      }
+      else
+      {
+        backoff_ = false;
+        queued_ = true;
+        return true;
+      }
+    }
+
+    void MarkRunning()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      queued_ = false;
+      running_ = true;
+      dirty_ = false;
+    }
+
+    // Returns "true" iff the task must be pushed back into a queue
+    bool MarkStepped(bool isDone,
+                     bool isIdle)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      running_ = false;
+      failures_ = 0;
+
+      if (isDone)
+      {
+        done_ = true;
+        return false;
+      }
+      else if (!isIdle ||
+               dirty_)
+      {
+        queued_ = true;
+        return true;
+      }
+      else
+      {
+        // Park the filter until its next wakeup, or its next poll
+        deadline_ = (boost::posix_time::microsec_clock::universal_time() +
+                     boost::posix_time::milliseconds(POLL_INTERVAL));
+        return false;
+      }
+    }
+
+    // The step has thrown an exception: Park the filter until the end
+    // of its backoff delay, that doubles with each consecutive failure
+    unsigned int MarkFailed()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      running_ = false;
+
+      unsigned int delay = MIN_BACKOFF;
+      for (unsigned int i = 0; i < failures_ && delay < MAX_BACKOFF; i++)
+      {
+        delay *= 2;
+      }
+
+      delay = std::min(delay, MAX_BACKOFF);
+
+      failures_++;
+      backoff_ = true;
+      deadline_ = (boost::posix_time::microsec_clock::universal_time() +
+                   boost::posix_time::milliseconds(delay));
+
+      return delay;
+    }
+
+    unsigned int GetFailuresCount()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      return failures_;
+    }
+  };
+
+
+  class FilterScheduler::Queue : public boost::noncopyable
+  {
+  private:
+    boost::mutex        mutex_;
+    std::deque<Task*>   tasks_;
+
+  public:
+    void Push(Task& task)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      tasks_.push_back(&task);
+    }
+
+    // The owner of the queue takes the most recent task
+    Task* PopBack()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (tasks_.empty())
+      {
+        return NULL;
+      }
+      else
+      {
+        Task* task = tasks_.back();
+        tasks_.pop_back();
+        return task;
+      }
+    }
+
+    // The other workers steal the oldest task
+    Task* StealFront()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (tasks_.empty())
+      {
+        return NULL;
+      }
+      else
+      {
+        Task* task = tasks_.front();
+        tasks_.pop_front();
+        return task;
+      }
+    }
+  };
+
+
+  void FilterScheduler::Enqueue(Task& task,
+                                size_t queue)
+  {
+    assert(queue < queues_.size());
+    queues_[queue]->Push(task);
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      enqueued_++;
+    }
+
+    available_.notify_one();
+  }
+
+
+  void FilterScheduler::Schedule(Task& task)
+  {
+    if (task.MarkReady())
+    {
+      Enqueue(task, task.GetHome());
+    }
+  }
+
+
+  FilterScheduler::Task* FilterScheduler::Dequeue(size_t queue)
+  {
+    // Returns NULL if all the queues were found empty
+    Task* task = queues_[queue]->PopBack();
+
+    for (size_t i = 1; task == NULL && i < queues_.size(); i++)
+    {
+      task = queues_[(queue + i) % queues_.size()]->StealFront();
+    }
+
+    return task;
+  }
+
+
+  void FilterScheduler::Execute(Task& task,
+                                size_t queue)
+  {
+    IFilter& filter = task.GetFilter();
+
+    task.MarkRunning();
+
+    bool done = false;
+    bool idle = false;
+    bool failed = true;
+    std::string error;
+
+    try
+    {
+      done = !filter.TryStep(idle);
+      failed = false;
+    }
+    catch (Orthanc::OrthancException& e)
+    {
+      error = e.What();
+    }
+    catch (std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error = "Native exception";
+    }
+
+    if (failed)
+    {
+      const unsigned int delay = task.MarkFailed();
+      LOG(ERROR) << "Exception in filter " << filter.GetName() << " (failure "
+                 << task.GetFailuresCount() << " in a row, retrying in "
+                 << delay << "ms): " << error;
+    }
+    else if (task.MarkStepped(done, idle))
+    {
+      // Keep the task in the queue of this worker, as its data is
+      // likely to be hot in the cache
+      Enqueue(task, queue);
+    }
+  }
+
+
+  void FilterScheduler::Worker(FilterScheduler* that,
+                               size_t queue)
+  {
+    for (;;)
+    {
+      uint64_t enqueued;
+
+      {
+        boost::mutex::scoped_lock lock(that->mutex_);
+
+        if (!that->continue_)
+        {
+          return;
+        }
+
+        enqueued = that->enqueued_;
+      }
+
+      Task* task = that->Dequeue(queue);
+
+      if (task != NULL)
+      {
+        that->Execute(*task, queue);
+      }
+      else
+      {
+        // All the queues were empty: Sleep until some task is
+        // enqueued. If a task was enqueued during the scan of the
+        // queues, "enqueued_" has changed and the queues are scanned
+        // once again, so no wakeup can be lost.
+        boost::mutex::scoped_lock lock(that->mutex_);
+
+        while (that->continue_ &&
+               that->enqueued_ == enqueued)
+        {
+          that->available_.wait(lock);
+        }
+      }
+    }
+  }
+
+
+  void FilterScheduler::Poller(FilterScheduler* that)
+  {
+    for (;;)
+    {
+      {
+        boost::mutex::scoped_lock lock(that->mutex_);
+
+        if (that->continue_)
+        {
+          that->stopped_.timed_wait(lock, boost::posix_time::milliseconds(POLLER_PERIOD));
+        }
+
+        if (!that->continue_)
+        {
+          return;
+        }
+      }
+
+      // Wake up the parked tasks whose poll interval or backoff
+      // delay has elapsed. "tasks_" is read-only while running.
+      const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+      for (size_t i = 0; i < that->tasks_.size(); i++)
+      {
+        if (that->tasks_[i]->MarkPolled(now))
+        {
+          that->Enqueue(*that->tasks_[i], that->tasks_[i]->GetHome());
+        }
+      }
+    }
+  }
+
+
+  void FilterScheduler::WakeupTimeSeries(const std::string& name)
+  {
+    // "wakeups_" is read-only while the workers are running
+    std::pair<Wakeups::const_iterator, Wakeups::const_iterator> range = wakeups_.equal_range(name);
+
+    for (Wakeups::const_iterator it = range.first; it != range.second; ++it)
+    {
+      assert(it->second != NULL);
+      Schedule(*it->second);
+    }
+  }
+
+
+  FilterScheduler::FilterScheduler(ITimeSeriesManager& manager,
+                                   unsigned int threads) :
+    manager_(manager),
+    enqueued_(0),
+    continue_(true)
+  {
+    if (threads == 0)
+    {
+      threads = boost::thread::hardware_concurrency();
+      
+      if (threads == 0)
+      {
+        threads = 1;
+      }
+    }
+
+    queues_.resize(threads);
+
+    for (size_t i = 0; i < queues_.size(); i++)
+    {
+      queues_[i] = new Queue;
+    }
+  }
+
+
+  FilterScheduler::~FilterScheduler()
+  {
+    Stop();
+
+    for (size_t i = 0; i < tasks_.size(); i++)
+    {
+      delete tasks_[i];
+    }
+
+    for (size_t i = 0; i < queues_.size(); i++)
+    {
+      delete queues_[i];
+    }
+  }
+
+
+  void FilterScheduler::AddFilter(IFilter& filter)
+  {
+    if (!workers_.empty())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    std::string wakeup;
+    if (!filter.GetWakeupTimeSeries(wakeup))
+    {
+      LOG(ERROR) << "Filter " << filter.GetName() << " cannot be run by the filter scheduler";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    // Spread the filters evenly over the queues
+    std::auto_ptr<Task> task(new Task(filter, tasks_.size() % queues_.size()));
+    tasks_.push_back(task.get());
+    wakeups_.insert(std::make_pair(wakeup, task.release()));
+  }
+
+
+  void FilterScheduler::Start()
+  {
+    if (!workers_.empty())
+    {
+      return;  // Already running
+    }
+
+    if (!continue_)
+    {
+      // Cannot run a second time
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    for (Wakeups::const_iterator it = wakeups_.begin();
+         it != wakeups_.end(); it = wakeups_.upper_bound(it->first))
+    {
+      manager_.Register(*this, it->first);
+    }
+
+    LOG(WARNING) << "Running " << tasks_.size() << " filter(s) on a pool of "
+                 << queues_.size() << " thread(s)";
+
+    workers_.resize(queues_.size());
+
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+      workers_[i] = new boost::thread(Worker, this, i);
+    }
+
+    poller_ = boost::thread(Poller, this);
+
+    // Give each filter the opportunity to process the messages
+    // that were received before the scheduler has started
+    for (size_t i = 0; i < tasks_.size(); i++)
+    {
+      Schedule(*tasks_[i]);
+    }
+  }
+
+
+  void FilterScheduler::Stop()
+  {
+    if (workers_.empty())
+    {
+      return;
+    }
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      continue_ = false;
+    }
+
+    available_.notify_all();
+    stopped_.notify_all();
+
+    if (poller_.joinable())
+    {
+      poller_.join();
+    }
+
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+      if (workers_[i]->joinable())
+      {
+        workers_[i]->join();
+      }
+
+      delete workers_[i];
+    }
+
+    workers_.clear();
+
+    for (Wakeups::const_iterator it = wakeups_.begin();
+         it != wakeups_.end(); it = wakeups_.upper_bound(it->first))
+    {
+      manager_.Unregister(*this, it->first);
+    }
+  }
+}
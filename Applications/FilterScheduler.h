@@ -0,0 +1,120 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../Framework/Filters/IFilter.h"
+#include "../Framework/TimeSeries/ITimeSeriesManager.h"
+
+#include <boost/thread.hpp>
+#include <map>
+#include <vector>
+
+namespace AtomIT
+{
+  // Runs the event-driven filters (i.e. those that implement
+  // "IFilter::GetWakeupTimeSeries()") on a fixed-size pool of worker
+  // threads. Each worker owns a queue of ready filters, and steals
+  // from the other queues once its own queue is empty. A filter is
+  // parked as long as its wakeup time series is not modified, so idle
+  // filters don't hold any thread. Parked filters are nonetheless
+  // polled twice per second, as a modification might only become
+  // visible after it was notified (e.g. SQLite group commit), and as
+  // some filters act on timeouts (e.g. "RollupFilter"). A filter that
+  // throws an exception is retried with an exponential backoff.
+  class FilterScheduler : private ITimeSeriesObserver
+  {
+  private:
+    class Task;
+    class Queue;
+
+    typedef std::multimap<std::string, Task*>  Wakeups;
+
+    ITimeSeriesManager&          manager_;
+    std::vector<Task*>           tasks_;
+    std::vector<Queue*>          queues_;
+    std::vector<boost::thread*>  workers_;
+    boost::thread                poller_;
+    Wakeups                      wakeups_;
+    boost::mutex                 mutex_;
+    boost::condition_variable    available_;
+    boost::condition_variable    stopped_;
+    uint64_t                     enqueued_;  // Number of calls to "Enqueue()"
+    bool                         continue_;
+
+    void Enqueue(Task& task,
+                 size_t queue);
+
+    void Schedule(Task& task);
+
+    Task* Dequeue(size_t queue);
+
+    void Execute(Task& task,
+                 size_t queue);
+
+    static void Worker(FilterScheduler* that,
+                       size_t queue);
+
+    static void Poller(FilterScheduler* that);
+
+    void WakeupTimeSeries(const std::string& name);
+
+    virtual void NotifySeriesDeleted(const std::string& name)
+    {
+      WakeupTimeSeries(name);
+    }
+
+    virtual void NotifySeriesModified(const std::string& name)
+    {
+      WakeupTimeSeries(name);
+    }
+
+  public:
+    // If "threads" is zero, one worker is created per CPU core
+    FilterScheduler(ITimeSeriesManager& manager,
+                    unsigned int threads);
+
+    ~FilterScheduler();
+
+    size_t GetThreadsCount() const
+    {
+      return queues_.size();
+    }
+
+    // The filter must be started, and must provide a wakeup time
+    // series. Its ownership is not transferred.
+    void AddFilter(IFilter& filter);
+
+    void Start();
+
+    void Stop();
+  };
+}
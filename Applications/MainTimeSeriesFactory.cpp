@@ -33,6 +33,8 @@
 
 #include "../Framework/TimeSeries/SQLiteBackend/SQLiteTimeSeriesBackend.h"
 #include "../Framework/TimeSeries/MemoryBackend/MemoryTimeSeriesBackend.h"
+#include "../Framework/TimeSeries/MemoryBackend/RingTimeSeriesContent.h"
+#include "../Framework/TimeSeries/MemoryBackend/SPSCTimeSeriesBackend.h"
 
 #include <Core/OrthancException.h>
 #include <Core/Logging.h>
@@ -46,7 +48,14 @@ namespace AtomIT
     maxLength_(0),
     maxSize_(0),
     timestampType_(TimestampType_Default),
-    sqlite_(NULL)
+    sqlite_(NULL),
+    sharding_(Sharding_None),
+    shards_(0),
+    groupCommitSize_(0),
+    groupCommitDelay_(0),
+    lowWaterMark_(0),
+    blockSize_(0),
+    hasBlockSize_(false)
   {
   }
 
@@ -60,7 +69,14 @@ namespace AtomIT
     maxLength_(maxLength),
     maxSize_(maxSize),
     timestampType_(timestampType),
-    sqlite_(&sqlite)
+    sqlite_(&sqlite),
+    sharding_(Sharding_None),
+    shards_(0),
+    groupCommitSize_(0),
+    groupCommitDelay_(0),
+    lowWaterMark_(0),
+    blockSize_(0),
+    hasBlockSize_(false)
   {
   }
 
@@ -74,7 +90,14 @@ namespace AtomIT
     maxLength_(maxLength),
     maxSize_(maxSize),
     timestampType_(timestampType),
-    sqlite_(NULL)
+    sqlite_(NULL),
+    sharding_(Sharding_None),
+    shards_(0),
+    groupCommitSize_(0),
+    groupCommitDelay_(0),
+    lowWaterMark_(0),
+    blockSize_(0),
+    hasBlockSize_(false)
   {
     if (type == Backend_SQLite)
     {
@@ -84,8 +107,83 @@ namespace AtomIT
   }
 
 
+  static uint32_t HashTimeSeriesName(const std::string& name)
+  {
+    // 32-bit FNV-1a hash, that must not change across versions of
+    // Atom-IT, as it locates the time series on the disk
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < name.size(); i++)
+    {
+      hash ^= static_cast<uint8_t>(name[i]);
+      hash *= 16777619u;
+    }
+
+    return hash;
+  }
+
+
+  static boost::filesystem::path GetShardPath(const boost::filesystem::path& path,
+                                              const std::string& suffix)
+  {
+    // "/tmp/iot.db" with suffix "3" gives "/tmp/iot-3.db"
+    return (path.parent_path() /
+            (path.stem().string() + "-" + suffix + path.extension().string()));
+  }
+
+
+  SQLiteDatabase& MainTimeSeriesFactory::TimeSeriesConfiguration::
+  GetShard(MainTimeSeriesFactory& that,
+           const std::string& name) const
+  {
+    std::string suffix;
+    
+    switch (sharding_)
+    {
+      case Sharding_Hash:
+        assert(shards_ > 0);
+        suffix = boost::lexical_cast<std::string>(HashTimeSeriesName(name) % shards_);
+        break;
+
+      case Sharding_Series:
+        // Only keep the characters that are safe in a filename. Two
+        // time series whose names collide share the same file.
+        suffix = name;
+        for (size_t i = 0; i < suffix.size(); i++)
+        {
+          if (!isalnum(static_cast<unsigned char>(suffix[i])) &&
+              suffix[i] != '-' &&
+              suffix[i] != '_')
+          {
+            suffix[i] = '_';
+          }
+        }
+        break;
+
+      default:
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+
+    SQLiteDatabase& database = that.GetSQLiteDatabase(GetShardPath(path_, suffix));
+
+    if (groupCommitSize_ != 0 &&
+        !database.IsGroupCommit())
+    {
+      database.EnableGroupCommit(groupCommitSize_, groupCommitDelay_);
+    }
+
+    if (lowWaterMark_ != 0)
+    {
+      database.SetLowWaterMark(lowWaterMark_);
+    }
+
+    return database;
+  }
+
+
   ITimeSeriesBackend* MainTimeSeriesFactory::TimeSeriesConfiguration::
-  CreateTimeSeries(const std::string& name)
+  CreateTimeSeries(MainTimeSeriesFactory& that,
+                   const std::string& name)
   {
     switch (backend_)
     {
@@ -93,13 +191,29 @@ namespace AtomIT
         return NULL;
 
       case Backend_SQLite:
-        assert(sqlite_ != NULL);
-        sqlite_->CreateTimeSeries(name, maxLength_, maxSize_);
-        return new SQLiteTimeSeriesBackend(*sqlite_, name);
+      {
+        SQLiteDatabase& database = (sharding_ == Sharding_None ?
+                                    *sqlite_ : GetShard(that, name));
+        database.CreateTimeSeries(name, maxLength_, maxSize_);
+
+        if (hasBlockSize_)
+        {
+          // Otherwise, keep the layout that is stored in the database
+          database.SetBlockSize(name, blockSize_);
+        }
+
+        return new SQLiteTimeSeriesBackend(database, name);
+      }
 
       case Backend_Memory:
         return new MemoryTimeSeriesBackend(maxLength_, maxSize_);
 
+      case Backend_Ring:
+        return new MemoryTimeSeriesBackend(new RingTimeSeriesContent(maxLength_, maxSize_));
+
+      case Backend_SPSC:
+        return new SPSCTimeSeriesBackend(maxLength_, maxSize_);
+
       default:
         throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
     }
@@ -116,8 +230,34 @@ namespace AtomIT
         s = "Memory backend ";
         break;
 
+      case Backend_Ring:
+        s = "Ring memory backend ";
+        break;
+
+      case Backend_SPSC:
+        s = "SPSC memory backend ";
+        break;
+
       case Backend_SQLite:
-        s = "SQLite backend ";
+        switch (sharding_)
+        {
+          case Sharding_Hash:
+            s = "SQLite backend sharded over " + boost::lexical_cast<std::string>(shards_) + " files ";
+            break;
+
+          case Sharding_Series:
+            s = "SQLite backend with one file per time series ";
+            break;
+
+          default:
+            s = "SQLite backend ";
+            break;
+        }
+
+        if (blockSize_ != 0)
+        {
+          s += "in blocks of " + boost::lexical_cast<std::string>(blockSize_) + " messages ";
+        }
         break;
 
       default:
@@ -185,6 +325,14 @@ namespace AtomIT
       {
         config.backend_ = Backend_SQLite;
       }
+      else if (s == "Ring")
+      {
+        config.backend_ = Backend_Ring;
+      }
+      else if (s == "SPSC")
+      {
+        config.backend_ = Backend_SPSC;
+      }
       else
       {
         LOG(ERROR) << "Unsupported value for a time series backend: " << s;
@@ -198,9 +346,78 @@ namespace AtomIT
 
     if (config.backend_ == Backend_SQLite)
     {
-      if (section.GetStringParameter(s, "Path"))
+      std::string path;
+      if (section.GetStringParameter(path, "Path"))
       {
-        config.sqlite_ = &that.GetSQLiteDatabase(s);
+        config.path_ = path;
+
+        if (section.GetStringParameter(s, "Sharding"))
+        {
+          if (s == "None")
+          {
+            config.sharding_ = Sharding_None;
+          }
+          else if (s == "Hash")
+          {
+            config.sharding_ = Sharding_Hash;
+          }
+          else if (s == "Series")
+          {
+            config.sharding_ = Sharding_Series;
+          }
+          else
+          {
+            LOG(ERROR) << "Unsupported value for the sharding of SQLite: " << s;
+            throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+          }
+        }
+
+        if (config.sharding_ == Sharding_Hash)
+        {
+          if (!section.GetUnsignedIntegerParameter(config.shards_, "Shards"))
+          {
+            config.shards_ = 8;  // 8 files by default
+          }
+
+          if (config.shards_ == 0)
+          {
+            LOG(ERROR) << "The number of SQLite shards must be positive";
+            throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+          }
+        }
+
+        if (section.GetUnsignedIntegerParameter(config.groupCommitSize_, "GroupCommitSize"))
+        {
+          if (!section.GetUnsignedIntegerParameter(config.groupCommitDelay_, "GroupCommitDelay"))
+          {
+            config.groupCommitDelay_ = 100;  // 100 milliseconds by default
+          }
+        }
+
+        config.hasBlockSize_ = section.GetUnsignedIntegerParameter(config.blockSize_, "BlockSize");
+
+        if (section.GetUnsignedIntegerParameter(config.lowWaterMark_, "LowWaterMark") &&
+            (config.lowWaterMark_ == 0 ||
+             config.lowWaterMark_ > 100))
+        {
+          LOG(ERROR) << "The low-water mark of SQLite must be a percentage between 1 and 100";
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+        }
+
+        if (config.sharding_ == Sharding_None)
+        {
+          config.sqlite_ = &that.GetSQLiteDatabase(path);
+
+          if (config.groupCommitSize_ != 0)
+          {
+            config.sqlite_->EnableGroupCommit(config.groupCommitSize_, config.groupCommitDelay_);
+          }
+
+          if (config.lowWaterMark_ != 0)
+          {
+            config.sqlite_->SetLowWaterMark(config.lowWaterMark_);
+          }
+        }
       }
       else
       {
@@ -277,8 +494,15 @@ namespace AtomIT
     }
     else
     {
-      SQLiteDatabase* db = new SQLiteDatabase(path.string());
+      // All the SQLite databases share the same background thread
+      SQLiteDatabase* db = new SQLiteDatabase(path.string(), worker_);
       databases_[path] = db;
+
+      if (commitObserver_ != NULL)
+      {
+        db->RegisterObserver(*commitObserver_);
+      }
+
       return *db;
     }
   }
@@ -317,6 +541,12 @@ namespace AtomIT
   }
     
 
+  MainTimeSeriesFactory::MainTimeSeriesFactory() :
+    commitObserver_(NULL)
+  {
+  }
+
+
   MainTimeSeriesFactory::~MainTimeSeriesFactory()
   {
     for (SQLiteDatabases::iterator
@@ -384,7 +614,7 @@ namespace AtomIT
     }
     else
     {
-      return timeSeries->second.CreateTimeSeries(name);
+      return timeSeries->second.CreateTimeSeries(*this, name);
     }
   }
 
@@ -396,7 +626,7 @@ namespace AtomIT
     boost::mutex::scoped_lock lock(mutex_);
 
     timestampType = autoTimeSeries_.GetTimestampType();
-    return autoTimeSeries_.CreateTimeSeries(name);
+    return autoTimeSeries_.CreateTimeSeries(*this, name);
   }
 
 
@@ -414,6 +644,59 @@ namespace AtomIT
   }
 
 
+  void MainTimeSeriesFactory::SetCommitObserver(ITimeSeriesObserver* observer)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    for (SQLiteDatabases::iterator
+           it = databases_.begin(); it != databases_.end(); ++it)
+    {
+      assert(it->second != NULL);
+
+      if (commitObserver_ != NULL)
+      {
+        it->second->UnregisterObserver(*commitObserver_);
+      }
+
+      if (observer != NULL)
+      {
+        it->second->RegisterObserver(*observer);
+      }
+    }
+
+    commitObserver_ = observer;
+  }
+
+
+  void MainTimeSeriesFactory::GetSQLiteStatistics(Json::Value& target)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    target = Json::arrayValue;
+
+    for (SQLiteDatabases::iterator
+           it = databases_.begin(); it != databases_.end(); ++it)
+    {
+      assert(it->second != NULL);
+
+      unsigned int countTimeSeries;
+      uint64_t length, size, transactions, contentions;
+      it->second->GetStatistics(countTimeSeries, length, size, transactions, contentions);
+
+      Json::Value item = Json::objectValue;
+      item["path"] = it->first.string();
+      item["series"] = countTimeSeries;
+      item["length"] = boost::lexical_cast<std::string>(length);
+      item["size"] = boost::lexical_cast<std::string>(size);
+      item["transactions"] = boost::lexical_cast<std::string>(transactions);
+      item["contentions"] = boost::lexical_cast<std::string>(contentions);
+      item["groupCommit"] = it->second->IsGroupCommit();
+      item["lowWaterMark"] = it->second->GetLowWaterMark();
+      target.append(item);
+    }
+  }
+
+
   void MainTimeSeriesFactory::LoadConfiguration(const ConfigurationSection& config)
   {
     boost::mutex::scoped_lock lock(mutex_);
@@ -46,7 +46,16 @@ namespace AtomIT
     {
       Backend_None,
       Backend_SQLite,
-      Backend_Memory
+      Backend_Memory,
+      Backend_Ring,
+      Backend_SPSC
+    };
+
+    enum Sharding
+    {
+      Sharding_None,
+      Sharding_Hash,     // Spread the time series over a fixed number of files
+      Sharding_Series    // One file per time series
     };
 
     class TimeSeriesConfiguration
@@ -56,7 +65,20 @@ namespace AtomIT
       uint64_t         maxLength_;
       uint64_t         maxSize_;
       TimestampType    timestampType_;
-      SQLiteDatabase*  sqlite_;  // Only valid if SQLite-based
+      SQLiteDatabase*  sqlite_;  // Only valid if SQLite-based and not sharded
+
+      // Only valid if SQLite-based and sharded
+      Sharding                 sharding_;
+      boost::filesystem::path  path_;
+      unsigned int             shards_;
+      unsigned int             groupCommitSize_;
+      unsigned int             groupCommitDelay_;
+      unsigned int             lowWaterMark_;  // 0 means default
+      unsigned int             blockSize_;     // 0 means one row per message
+      bool                     hasBlockSize_;  // Whether "BlockSize" is configured
+
+      SQLiteDatabase& GetShard(MainTimeSeriesFactory& that,
+                               const std::string& name) const;
 
     public:
       TimeSeriesConfiguration();
@@ -81,7 +103,8 @@ namespace AtomIT
         return timestampType_;
       }
 
-      ITimeSeriesBackend* CreateTimeSeries(const std::string& name);
+      ITimeSeriesBackend* CreateTimeSeries(MainTimeSeriesFactory& that,
+                                           const std::string& name);
       
       std::string Format() const;
 
@@ -96,7 +119,9 @@ namespace AtomIT
     typedef std::map<std::string, TimeSeriesConfiguration>  ManualTimeSeries;
 
     boost::mutex             mutex_;
+    SQLiteWorker             worker_;  // Must outlive "databases_"
     SQLiteDatabases          databases_;
+    ITimeSeriesObserver*     commitObserver_;
     ManualTimeSeries         manualTimeSeries_;
     TimeSeriesConfiguration  autoTimeSeries_;
 
@@ -108,6 +133,8 @@ namespace AtomIT
                             const TimeSeriesConfiguration& timeSeries);
 
   public:
+    MainTimeSeriesFactory();
+
     ~MainTimeSeriesFactory();
 
     void RegisterMemoryTimeSeries(const std::string& name,
@@ -135,8 +162,13 @@ namespace AtomIT
     virtual ITimeSeriesBackend* CreateAutoTimeSeries(TimestampType& timestampType /* out */,
                                                      const std::string& name);
 
+    virtual void SetCommitObserver(ITimeSeriesObserver* observer);
+
     virtual void ListManualTimeSeries(std::map<std::string, TimestampType>& target);
 
+    // Statistics about the load of each SQLite database (shard)
+    void GetSQLiteStatistics(Json::Value& target);
+
     void LoadConfiguration(const ConfigurationSection& config);
   };
 }
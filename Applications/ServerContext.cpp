@@ -36,6 +36,10 @@
 
 namespace AtomIT
 {
+  static const size_t DEFAULT_ACCESSOR_CACHE_SIZE = 256;
+  static const unsigned int DEFAULT_MAX_SUBSCRIBERS = 10;
+
+
   bool ServerContext::StartFilter(IFilter& filter)
   {
     try
@@ -117,6 +121,11 @@ namespace AtomIT
       LOG(WARNING) << "Stopping the filters";
       continue_ = false;
 
+      if (scheduler_.get() != NULL)
+      {
+        scheduler_->Stop();
+      }
+
       for (size_t i = 0; i < threads_.size(); i++)
       {
         if (threads_[i] &&
@@ -154,7 +163,11 @@ namespace AtomIT
   ServerContext::ServerContext(ITimeSeriesManager& manager) :
     continue_(true),
     state_(State_Setup),
-    manager_(manager)
+    manager_(manager),
+    hasFilterPool_(false),
+    filterPoolSize_(0),
+    accessors_(new TimeSeriesAccessorCache(manager, DEFAULT_ACCESSOR_CACHE_SIZE)),
+    subscribers_(DEFAULT_MAX_SUBSCRIBERS)
   {
   }
 
@@ -162,6 +175,7 @@ namespace AtomIT
   ServerContext::~ServerContext()
   {
     StopInternal();
+    scheduler_.reset(NULL);
       
     for (Filters::iterator it = filters_.begin(); it != filters_.end(); ++it)
     {
@@ -170,6 +184,33 @@ namespace AtomIT
   }
 
 
+  void ServerContext::SetAccessorCacheSize(size_t size)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (state_ != State_Setup)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);        
+    }
+
+    accessors_.reset(new TimeSeriesAccessorCache(manager_, size));
+  }
+
+
+  void ServerContext::SetFilterPool(unsigned int threads)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (state_ != State_Setup)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);        
+    }
+
+    hasFilterPool_ = true;
+    filterPoolSize_ = threads;
+  }
+
+
   void ServerContext::AddFilter(IFilter* filter)
   {
     boost::mutex::scoped_lock lock(mutex_);
@@ -189,6 +230,41 @@ namespace AtomIT
   }
 
   
+  void ServerContext::ListFilters(std::set<std::string>& target)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    target.clear();
+
+    for (Filters::const_iterator it = filters_.begin(); it != filters_.end(); ++it)
+    {
+      assert(*it != NULL);
+      target.insert((*it)->GetName());
+    }
+  }
+
+
+  bool ServerContext::FormatFilterStatistics(Json::Value& target,
+                                             const std::string& name)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    for (Filters::const_iterator it = filters_.begin(); it != filters_.end(); ++it)
+    {
+      assert(*it != NULL);
+
+      if ((*it)->GetName() == name)
+      {
+        (*it)->FormatStatistics(target);
+        target["name"] = name;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  
   void ServerContext::Start()
   {
     boost::mutex::scoped_lock lock(mutex_);
@@ -224,11 +300,31 @@ namespace AtomIT
         }
       }      
 
-      threads_.reserve(filters_.size());
+      if (hasFilterPool_)
+      {
+        scheduler_.reset(new FilterScheduler(manager_, filterPoolSize_));
+      }
 
       for (Filters::iterator it = filters_.begin(); it != filters_.end(); ++it)
       {
-        threads_.push_back(new boost::thread(WorkerThread, &continue_, *it));
+        std::string wakeup;
+
+        if (scheduler_.get() != NULL &&
+            (*it)->GetWakeupTimeSeries(wakeup))
+        {
+          scheduler_->AddFilter(**it);
+        }
+        else
+        {
+          // The filters that wait for external events (such as
+          // sockets or timers) keep their dedicated thread
+          threads_.push_back(new boost::thread(WorkerThread, &continue_, *it));
+        }
+      }
+
+      if (scheduler_.get() != NULL)
+      {
+        scheduler_->Start();
       }
         
       state_ = State_Running;
@@ -31,11 +31,16 @@
 
 #pragma once
 
+#include "FilterScheduler.h"
+#include "SubscribersLimiter.h"
 #include "../Framework/FileWritersPool.h"
 #include "../Framework/Filters/IFilter.h"
 #include "../Framework/TimeSeries/ITimeSeriesManager.h"
+#include "../Framework/TimeSeries/TimeSeriesAccessorCache.h"
 
 #include <boost/thread.hpp>
+#include <memory>
+#include <set>
 
 namespace AtomIT
 {
@@ -58,6 +63,14 @@ namespace AtomIT
     Filters                      filters_;
     std::vector<boost::thread*>  threads_;
     FileWritersPool              pool_;
+    bool                         hasFilterPool_;
+    unsigned int                 filterPoolSize_;
+
+    std::auto_ptr<FilterScheduler>  scheduler_;
+
+    // Shared by the threads of the HTTP server
+    std::auto_ptr<TimeSeriesAccessorCache>  accessors_;
+    SubscribersLimiter                      subscribers_;
 
     static bool StartFilter(IFilter& filter);
 
@@ -83,7 +96,32 @@ namespace AtomIT
       return pool_;
     }
 
+    TimeSeriesAccessorCache& GetAccessorCache()
+    {
+      return *accessors_;
+    }
+
+    SubscribersLimiter& GetSubscribersLimiter()
+    {
+      return subscribers_;
+    }
+
+    // Maximum number of time series whose reader and writer are kept
+    // open for the REST API
+    void SetAccessorCacheSize(size_t size);
+
+    // Run the event-driven filters on a pool of worker threads,
+    // instead of using one thread per filter. If "threads" is zero,
+    // the pool contains one thread per CPU core.
+    void SetFilterPool(unsigned int threads);
+
     void AddFilter(IFilter* filter);
+
+    void ListFilters(std::set<std::string>& target);
+
+    // Returns "false" if no filter has this name
+    bool FormatFilterStatistics(Json::Value& target,
+                                const std::string& name);
     
     void Start();
     
@@ -33,6 +33,7 @@
 #include "MainTimeSeriesFactory.h"
 #include "AtomITRestApi.h"
 
+#include "../Framework/Filters/LuaFilter.h"
 #include "../Framework/TimeSeries/GenericTimeSeriesManager.h"
 #include "../Framework/MQTT/SynchronousClient.h"
 
@@ -69,9 +70,10 @@ namespace AtomIT
   }
 
 
-  static bool StartHttpServer(ServerContext& context)
+  static bool StartHttpServer(ServerContext& context,
+                              MainTimeSeriesFactory& factory)
   {
-    AtomITRestApi api(context);
+    AtomITRestApi api(context, factory);
 
 #if ATOMIT_STANDALONE == 1
     Orthanc::EmbeddedResourceHttpHandler staticResources
@@ -177,9 +179,43 @@ namespace AtomIT
       f->SetAutoMemory(0, 0, TimestampType_Sequence);
     }
 
+    MainTimeSeriesFactory& factory = *f;
     GenericTimeSeriesManager manager(f.release());
  
     ServerContext context(manager);    
+
+    unsigned int accessorCacheSize;
+    if (globalConfiguration_.GetUnsignedIntegerParameter(accessorCacheSize, "HttpAccessorCacheSize"))
+    {
+      context.SetAccessorCacheSize(accessorCacheSize);
+    }
+
+    unsigned int maxSubscribers;
+    if (globalConfiguration_.GetUnsignedIntegerParameter(maxSubscribers, "HttpMaxSubscribers"))
+    {
+      context.GetSubscribersLimiter().SetMaxSubscribers(maxSubscribers);
+    }
+
+    std::string scheduler;
+    if (globalConfiguration_.GetStringParameter(scheduler, "FilterScheduler") &&
+        scheduler != "Threads")
+    {
+      if (scheduler == "Pool")
+      {
+        unsigned int threads;
+        if (!globalConfiguration_.GetUnsignedIntegerParameter(threads, "FilterThreads"))
+        {
+          threads = 0;  // One thread per CPU core
+        }
+
+        context.SetFilterPool(threads);
+      }
+      else
+      {
+        LOG(ERROR) << "Unknown filter scheduler: " << scheduler;
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+      }
+    }
     
     const char* FILTERS = "Filters";
     if (globalConfiguration_.HasItem(FILTERS))
@@ -206,7 +242,7 @@ namespace AtomIT
 
     if (httpServerEnabled)
     {
-      restart = StartHttpServer(context);
+      restart = StartHttpServer(context, factory);
     }
     else
     {
@@ -383,6 +419,7 @@ int main(int argc, char* argv[])
     }
 
     LOG(WARNING) << "Atom-IT version: " << version;
+    LOG(WARNING) << "Lua engine: " << AtomIT::LuaFilter::GetEngine();
     assert(DisplayPerformanceWarning());
   }
 
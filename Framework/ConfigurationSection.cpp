@@ -39,6 +39,7 @@
 #include <boost/noncopyable.hpp>
 #include <json/reader.h>
 #include <json/value.h>
+#include <limits>
 
 
 namespace AtomIT
@@ -251,6 +252,54 @@ namespace AtomIT
   }
 
 
+  bool ConfigurationSection::GetInteger64Parameter(int64_t& value,
+                                                   const std::string& name) const
+  {
+    if (configuration_.isMember(name))
+    {
+      bool ok = false;
+        
+      if (configuration_[name].type() == Json::intValue)
+      {
+        value = configuration_[name].asInt64();
+        ok = true;
+      }
+      else if (configuration_[name].type() == Json::uintValue &&
+               configuration_[name].asUInt64() <=
+               static_cast<Json::Value::UInt64>(std::numeric_limits<int64_t>::max()))
+      {
+        value = configuration_[name].asInt64();
+        ok = true;
+      }
+      else if (configuration_[name].type() == Json::stringValue)
+      {
+        try
+        {
+          value = boost::lexical_cast<int64_t>(configuration_[name].asString());
+          ok = true;
+        }
+        catch (boost::bad_lexical_cast&)
+        {
+        }
+      }
+
+      if (ok)
+      {
+        return true;
+      }
+      else
+      {
+        LOG(ERROR) << "Parameter \"" << name << "\" should be a 64-bit integer value";
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
   bool ConfigurationSection::GetBooleanParameter(bool& value,
                                                  const std::string& name) const
   {
@@ -33,6 +33,7 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/noncopyable.hpp>
+#include <stdint.h>
 #include <json/value.h>
 #include <set>
 
@@ -83,6 +84,10 @@ namespace AtomIT
     bool GetUnsignedIntegerParameter(unsigned int& value,
                                      const std::string& name) const;
 
+    // Also accepts strings, for values that do not fit in 32 bits
+    bool GetInteger64Parameter(int64_t& value,
+                               const std::string& name) const;
+
     bool GetBooleanParameter(bool& value,
                              const std::string& name) const;
 
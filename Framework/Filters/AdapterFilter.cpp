@@ -34,6 +34,11 @@
 #include <Core/OrthancException.h>
 #include <Core/Logging.h>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cassert>
+#include <limits>
+
 namespace AtomIT
 {
   AdapterFilter::AdapterFilter(const std::string& name,
@@ -45,8 +50,180 @@ namespace AtomIT
     reader_(manager, timeSeries, true),
     replayHistory_(false),
     isValid_(false),
-    timestamp_(0)  // Dummy initialization
+    timestamp_(0),  // Dummy initialization
+    batchSize_(1),
+    batchLatency_(0),
+    waitBatch_(false),
+    hasBatchDeadline_(false)
+  {
+  }
+
+
+  size_t AdapterFilter::PushBatch(std::vector<size_t>& failures,
+                                  const std::vector<Message>& messages)
+  {
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      switch (Push(messages[i]))
+      {
+        case PushStatus_Success:
+          break;
+
+        case PushStatus_Failure:
+          failures.push_back(i);
+          break;
+
+        case PushStatus_Retry:
+          return i;
+
+        default:
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+      }
+    }
+
+    return messages.size();
+  }
+
+
+  void AdapterFilter::SetBatchSize(unsigned int size)
   {
+    if (size == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+    else
+    {
+      batchSize_ = size;
+    }
+  }
+
+
+  void AdapterFilter::ReadBatch()
+  {
+    if (batch_.size() >= batchSize_)
+    {
+      return;
+    }
+
+    std::vector<Message> next;
+
+    {
+      // Lock the input series as few as possible
+      TimeSeriesReader::Transaction transaction(reader_);
+
+      // If some messages are pending, continue after them. Otherwise,
+      // if "isValid_" is true, lookup for the items in the time series
+      // that are just after the last-consumed item. Otherwise, the
+      // input time series was empty at the time "Start()" was called
+      // (*), or the source is asked to replay the history of the time
+      // series (replayHistory_ is true).
+      int64_t start;
+      if (!batch_.empty())
+      {
+        start = batch_.back().GetTimestamp() + 1;
+      }
+      else if (isValid_)
+      {
+        start = timestamp_ + 1;
+      }
+      else
+      {
+        start = std::numeric_limits<int64_t>::min();
+      }
+
+      transaction.Scan(next, start, std::numeric_limits<int64_t>::max(),
+                       batchSize_ - batch_.size());
+    }
+
+    batch_.insert(batch_.end(), next.begin(), next.end());
+  }
+
+
+  bool AdapterFilter::IsBatchReady()
+  {
+    ReadBatch();
+
+    if (batch_.empty())
+    {
+      return false;
+    }
+    else if (batch_.size() >= batchSize_ ||
+             batchLatency_ == 0)
+    {
+      return true;
+    }
+
+    // The batch is partially filled: It is pushed once full, or once
+    // its latency has elapsed since its first message was read
+    if (!hasBatchDeadline_)
+    {
+      hasBatchDeadline_ = true;
+      batchDeadline_ = (boost::posix_time::microsec_clock::universal_time() +
+                   boost::posix_time::milliseconds(batchLatency_));
+    }
+
+    if (waitBatch_)
+    {
+      while (batch_.size() < batchSize_)
+      {
+        boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+        if (now >= batchDeadline_ ||
+            !reader_.WaitModification(static_cast<unsigned int>((batchDeadline_ - now).total_milliseconds()) + 1))
+        {
+          break;
+        }
+
+        ReadBatch();
+      }
+
+      return true;
+    }
+    else
+    {
+      return (batch_.size() >= batchSize_ ||
+              boost::posix_time::microsec_clock::universal_time() >= batchDeadline_);
+    }
+  }
+
+
+  void AdapterFilter::PopInput(const std::vector<Message>& messages,
+                               size_t count,
+                               const std::vector<size_t>& failures)
+  {
+    assert(inputPopper_.get() != NULL &&
+           count <= messages.size());
+
+    // Only pop the messages that were successfully pushed: The
+    // messages whose push has failed are kept in the input time
+    // series. Each run of successful messages is removed by one
+    // single deletion, all within the same transaction.
+    TimeSeriesWriter::Transaction transaction(*inputPopper_);
+
+    size_t start = 0;
+
+    for (size_t i = 0; i <= failures.size(); i++)
+    {
+      const size_t end = (i < failures.size() ? failures[i] : count);
+
+      if (end > count ||
+          end < start)
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+      }
+
+      if (start < end)
+      {
+        const int64_t first = messages[start].GetTimestamp();
+        const int64_t last = messages[end - 1].GetTimestamp();
+
+        LOG(INFO) << "Removing timestamps from " << first << " to " << last
+                  << " from time series \"" << timeSeries_ << "\"";
+
+        transaction.DeleteRange(first, last + 1);
+      }
+
+      start = end + 1;
+    }
   }
 
 
@@ -72,6 +249,8 @@ namespace AtomIT
   void AdapterFilter::Start()
   {
     isValid_ = false;
+    batch_.clear();
+    hasBatchDeadline_ = false;
       
     if (!replayHistory_)
     {
@@ -94,81 +273,77 @@ namespace AtomIT
   
   bool AdapterFilter::Step()
   {
-    bool ok = false;
-    int64_t timestamp = 0;  // Dummy initialization
-    std::string metadata, value;
+    // This filter has a dedicated thread: It can wait for its batch
+    waitBatch_ = true;
 
+    bool idle;
+    if (TryStep(idle) &&
+        idle)
     {
-      // Lock the input series as few as possible
-      TimeSeriesReader::Transaction transaction(reader_);
+      // The input time series is empty, wait a bit for new messages
+      reader_.WaitModification(500);
+    }
 
-      if (isValid_)
-      {
-        // Lookup for the item in the time series that is just after
-        // the last-consumed item
-        ok = transaction.SeekNearest(timestamp_ + 1);
-      }
-      else
-      {
-        // The input time series was empty at the time "Start()" was
-        // called (*), or the source is asked to replay the history of
-        // the time series (replayHistory_ is true).
-        ok = transaction.SeekFirst();
-      }
+    return true;
+  }
 
-      if (ok)
+
+  void AdapterFilter::PushPending()
+  {
+    // The batch is consumed, whatever the outcome: The messages that
+    // were not handled are read again by the next step
+    std::vector<Message> messages;
+    messages.swap(batch_);
+    hasBatchDeadline_ = false;
+
+    // Success or failure: In both cases, advance the reading head
+    // after the handled messages. The other messages will be retried.
+    std::vector<size_t> failures;
+    size_t count = PushBatch(failures, messages);
+
+    if (count > messages.size())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+    else if (count > 0)
+    {
+      isValid_ = true;
+      timestamp_ = messages[count - 1].GetTimestamp();
+
+      if (inputPopper_.get() != NULL)
       {
-        ok = (transaction.GetTimestamp(timestamp) &&
-              transaction.Read(metadata, value));
+        PopInput(messages, count, failures);
       }
     }
+  }
 
-    if (ok)
+
+  bool AdapterFilter::TryStep(bool& idle)
+  {
+    idle = !IsBatchReady();
+
+    if (!idle)
     {
-      Message message;
-      message.SetTimestamp(timestamp);
-      message.SwapMetadata(metadata);
-      message.SwapValue(value);
+      PushPending();
+    }
 
-      PushStatus status = Push(message);
+    return true;
+  }
 
-      switch (status)
-      {
-        case PushStatus_Success:
-        case PushStatus_Failure:
-          // Success or failure. In both cases, advance the reading
-          // head to the next message in the time series.
-          isValid_ = true;
-          timestamp_ = timestamp;
-          break;
 
-        case PushStatus_Retry:
-          // Will retry with the same message in the time series
-          break;
+  void AdapterFilter::FormatStatistics(Json::Value& target)
+  {
+    target = Json::objectValue;
+    target["input"] = timeSeries_;
+
+    uint64_t length, size;
 
-        default:
-          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
-      }
-        
-      if (status == PushStatus_Success)
-      {
-        if (inputPopper_.get() != NULL)
-        {
-          LOG(INFO) << "Removing timestamp " << timestamp
-                    << " from time series \"" << timeSeries_ << "\"";
-            
-          // Pop the incoming message from the input time series
-          TimeSeriesWriter::Transaction transaction(*inputPopper_);
-          transaction.DeleteRange(timestamp, timestamp + 1);
-        }
-      }
-    }
-    else
     {
-      // The input time series is empty, wait a bit for new messages
-      reader_.WaitModification(500);
+      TimeSeriesReader reader(manager_, timeSeries_, false);
+      TimeSeriesReader::Transaction transaction(reader);
+      transaction.GetStatistics(length, size);
     }
 
-    return true;
+    target["queueDepth"] = boost::lexical_cast<std::string>(length);
   }
 }
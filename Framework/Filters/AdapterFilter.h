@@ -35,7 +35,9 @@
 #include "../TimeSeries/TimeSeriesReader.h"
 #include "../TimeSeries/TimeSeriesWriter.h"
 
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <memory>
+#include <vector>
 
 namespace AtomIT
 {
@@ -50,9 +52,28 @@ namespace AtomIT
     bool                replayHistory_;
     bool                isValid_;
     int64_t             timestamp_;
+    unsigned int        batchSize_;
+    unsigned int        batchLatency_;  // In milliseconds
+    bool                waitBatch_;     // Whether to block while the batch is filled
+
+    // Batch being filled, that is kept between the calls to
+    // "TryStep()" until it is full or its latency has elapsed
+    std::vector<Message>      batch_;
+    bool                      hasBatchDeadline_;
+    boost::posix_time::ptime  batchDeadline_;
 
     std::auto_ptr<TimeSeriesWriter>  inputPopper_;
 
+    void ReadBatch();
+
+    bool IsBatchReady();
+
+    void PushPending();
+
+    void PopInput(const std::vector<Message>& messages,
+                  size_t count,
+                  const std::vector<size_t>& failures);
+
   protected:
     enum PushStatus
     {
@@ -63,6 +84,33 @@ namespace AtomIT
     
     virtual PushStatus Push(const Message& message) = 0;
 
+    // Pushes a batch of consecutive messages. Returns the number of
+    // messages, at the beginning of the batch, that were handled
+    // (either with success or failure). The remaining messages will
+    // be pushed again. The indices of the handled messages whose push
+    // has failed must be appended to "failures", by increasing order:
+    // These messages are skipped, but never popped from the input.
+    // The default implementation calls "Push()" on each message,
+    // until a retry is requested.
+    virtual size_t PushBatch(std::vector<size_t>& failures,
+                             const std::vector<Message>& messages);
+
+    // Moves the reading head, so that the next pushed message is the
+    // first one whose timestamp is after "timestamp". To be called
+    // from "Start()", after the one of the base class.
+    void SetReadingHead(int64_t timestamp)
+    {
+      isValid_ = true;
+      timestamp_ = timestamp;
+    }
+
+    // Whether some messages were read, but are not pushed yet as
+    // their batch is waiting to be filled
+    bool HasPendingBatch() const
+    {
+      return !batch_.empty();
+    }
+
   public:
     AdapterFilter(const std::string& name,
                   ITimeSeriesManager& manager,
@@ -85,6 +133,24 @@ namespace AtomIT
 
     void SetPopInput(bool pop);
 
+    void SetBatchSize(unsigned int size);
+
+    unsigned int GetBatchSize() const
+    {
+      return batchSize_;
+    }
+
+    // Maximum time to wait for a batch to be filled
+    void SetBatchLatency(unsigned int milliseconds)
+    {
+      batchLatency_ = milliseconds;
+    }
+
+    unsigned int GetBatchLatency() const
+    {
+      return batchLatency_;
+    }
+
     bool IsPopInput() const;
     
     virtual std::string GetName() const
@@ -94,7 +160,20 @@ namespace AtomIT
 
     virtual void Start();
     
+    // Blocks for at most "BatchLatency" while the batch is filled
     virtual bool Step();
+
+    virtual bool GetWakeupTimeSeries(std::string& name) const
+    {
+      name = timeSeries_;
+      return true;
+    }
+
+    // Never blocks: A partially filled batch is kept, and "idle" is
+    // set until the batch is full or its latency has elapsed
+    virtual bool TryStep(bool& idle);
+
+    virtual void FormatStatistics(Json::Value& target);
     
     virtual void Stop()
     {
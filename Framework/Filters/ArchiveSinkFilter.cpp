@@ -0,0 +1,103 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "ArchiveSinkFilter.h"
+
+#include <Core/OrthancException.h>
+
+namespace AtomIT
+{
+  AdapterFilter::PushStatus ArchiveSinkFilter::Push(const Message& message)
+  {
+    std::vector<size_t> failures;
+    PushBatch(failures, std::vector<Message>(1, message));
+    return PushStatus_Success;
+  }
+    
+
+  size_t ArchiveSinkFilter::PushBatch(std::vector<size_t>& failures,
+                                      const std::vector<Message>& messages)
+  {
+    if (file_.get() == NULL ||
+        archive_.get() == NULL)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    // The whole batch is written at once
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      archive_->Add(messages[i].GetTimestamp(), messages[i].GetMetadata(), messages[i].GetValue());
+    }
+
+    std::string buffer;
+    archive_->Flush(buffer);
+
+    if (!buffer.empty())
+    {
+      file_->Write(buffer);
+    }
+
+    return messages.size();
+  }
+    
+
+  ArchiveSinkFilter::ArchiveSinkFilter(const std::string& name,
+                                       ITimeSeriesManager& manager,
+                                       const std::string& timeSeries,
+                                       const boost::filesystem::path& path) :
+    AdapterFilter(name, manager, timeSeries),
+    path_(path),
+    append_(false)
+  {
+  }
+
+
+  void ArchiveSinkFilter::Start()
+  {
+    file_.reset(new Toolbox::FileWriter(path_, append_, true /* binary */));
+
+    // When appending to an existing archive, the header is replaced
+    // by a "reset" record
+    archive_.reset(new ArchiveWriter(file_->IsEmpty()));
+
+    AdapterFilter::Start();
+  }
+
+
+  void ArchiveSinkFilter::Stop()
+  {
+    AdapterFilter::Stop();
+
+    archive_.reset(NULL);
+    file_.reset(NULL);
+  }
+}
@@ -0,0 +1,76 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "AdapterFilter.h"
+#include "../AtomITToolbox.h"
+#include "../TimeSeries/TimeSeriesArchive.h"
+
+namespace AtomIT
+{
+  // Writes the content of a time series to a binary archive (cf.
+  // "ArchiveWriter"), that can be read back by "ArchiveSourceFilter"
+  class ArchiveSinkFilter : public AdapterFilter
+  {
+  private:
+    boost::filesystem::path            path_;
+    bool                               append_;
+    std::auto_ptr<Toolbox::FileWriter> file_;
+    std::auto_ptr<ArchiveWriter>       archive_;
+
+  protected:
+    virtual PushStatus Push(const Message& message);
+
+    virtual size_t PushBatch(std::vector<size_t>& failures,
+                             const std::vector<Message>& messages);
+
+  public:
+    ArchiveSinkFilter(const std::string& name,
+                      ITimeSeriesManager& manager,
+                      const std::string& timeSeries,
+                      const boost::filesystem::path& path);
+
+    void SetAppend(bool append)
+    {
+      append_ = append;
+    }
+
+    bool IsAppend() const
+    {
+      return append_;
+    }
+
+    virtual void Start();
+
+    virtual void Stop();
+  };
+}
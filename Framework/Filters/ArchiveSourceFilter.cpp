@@ -0,0 +1,101 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "ArchiveSourceFilter.h"
+
+#include <Core/Logging.h>
+#include <Core/OrthancException.h>
+
+namespace AtomIT
+{
+  static const size_t CHUNK_SIZE = 1024 * 1024;
+
+
+  SourceFilter::FetchStatus
+  ArchiveSourceFilter::ReadMessage(Message& message,
+                                   boost::filesystem::ifstream& stream)
+  {
+    if (reader_.get() == NULL)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    try
+    {
+      for (;;)
+      {
+        if (reader_->ReadMessage(message))
+        {
+          return FetchStatus_Success;
+        }
+
+        // Read the file by large chunks
+        stream.read(&chunk_[0], chunk_.size());
+
+        if (stream.gcount() <= 0)
+        {
+          if (!reader_->IsDone())
+          {
+            LOG(ERROR) << "Truncated archive: " << GetPath();
+          }
+
+          return FetchStatus_Done;
+        }
+
+        reader_->AddChunk(chunk_.c_str(), static_cast<size_t>(stream.gcount()));
+      }
+    }
+    catch (Orthanc::OrthancException&)
+    {
+      // The reader cannot resynchronize after a corruption
+      LOG(ERROR) << "Corrupted archive: " << GetPath();
+      return FetchStatus_Done;
+    }
+  }
+
+    
+  ArchiveSourceFilter::ArchiveSourceFilter(const std::string& name,
+                                           ITimeSeriesManager& manager,
+                                           const std::string& timeSeries,
+                                           const boost::filesystem::path& path) :
+    FileReaderFilter(name, manager, timeSeries, path),
+    chunk_(CHUNK_SIZE, '\0')
+  {
+    SetBinary(true);
+  }
+
+
+  void ArchiveSourceFilter::Start()
+  {
+    reader_.reset(new ArchiveReader);
+    FileReaderFilter::Start();
+  }
+}
@@ -33,83 +33,428 @@
 
 #include <Core/OrthancException.h>
 #include <Core/Logging.h>
-#include <Core/Toolbox.h>
 
-#include <boost/algorithm/string/replace.hpp>
-#include <boost/lexical_cast.hpp>
+#include <limits>
  
 namespace AtomIT
 {
-  static void Unescape(std::string& result,
-                       const std::string& source)
+  static const size_t CHUNK_SIZE = 1024 * 1024;
+
+
+  static bool IsBlank(char c)
+  {
+    return (c == ' ' || c == '\t');
+  }
+
+
+  static bool ParseTimestamp(int64_t& target,
+                             const char* begin,
+                             const char* end)
   {
-    if (!source.empty() &&
-        source[0] == '\"' &&
-        source[source.size() - 1] == '\"')
+    while (begin < end && IsBlank(*begin))
+    {
+      begin++;
+    }
+
+    while (end > begin && IsBlank(*(end - 1)))
+    {
+      end--;
+    }
+
+    bool negative = false;
+    if (begin < end &&
+        (*begin == '-' || *begin == '+'))
+    {
+      negative = (*begin == '-');
+      begin++;
+    }
+
+    if (begin == end)
+    {
+      return false;
+    }
+
+    // Accumulate as a negative number, whose range is larger
+    int64_t value = 0;
+
+    for (; begin < end; begin++)
     {
-      result = source.substr(1, source.size() - 2);
+      if (*begin < '0' ||
+          *begin > '9')
+      {
+        return false;
+      }
+
+      const int digit = *begin - '0';
+
+      if (value < (std::numeric_limits<int64_t>::min() + digit) / 10)
+      {
+        return false;  // Overflow
+      }
+
+      value = value * 10 - digit;
+    }
+
+    if (negative)
+    {
+      target = value;
+      return true;
+    }
+    else if (value == std::numeric_limits<int64_t>::min())
+    {
+      return false;  // Overflow
     }
     else
     {
-      result = source;
+      target = -value;
+      return true;
     }
-          
-    boost::replace_all(result, "\"\"", "\"");
   }
 
-  
-  bool CSVFileSourceFilter::Decode(Message& message,
-                                   const std::string& line) const
+
+  static int DecodeBase64Character(char c)
+  {
+    if (c >= 'A' && c <= 'Z')
+    {
+      return c - 'A';
+    }
+    else if (c >= 'a' && c <= 'z')
+    {
+      return c - 'a' + 26;
+    }
+    else if (c >= '0' && c <= '9')
+    {
+      return c - '0' + 52;
+    }
+    else if (c == '+')
+    {
+      return 62;
+    }
+    else if (c == '/')
+    {
+      return 63;
+    }
+    else
+    {
+      return -1;
+    }
+  }
+
+
+  static bool DecodeBase64(std::string& target,
+                           const char* begin,
+                           const char* end)
   {
-    std::vector<std::string> columns;
-    Orthanc::Toolbox::TokenizeString(columns, line, ',');
+    static const int INVALID = -1;
 
-    if (columns.size() != 4)
+    const size_t size = end - begin;
+    if (size % 4 != 0)
     {
-      LOG(ERROR) << "CSV files must have 4 columns: " << GetPath();
       return false;
     }
 
-    std::string series, metadata, value, tmp;
-    int64_t timestamp;
+    // Decode directly into the target string, that is shrunk at the end
+    target.resize(size / 4 * 3);
+    char* output = (target.empty() ? NULL : &target[0]);
 
-    Unescape(series, columns[0]);
-    Unescape(tmp, columns[1]);
-    Unescape(metadata, columns[2]);
-    Unescape(value, columns[3]);
-      
-    try
+    for (const char* p = begin; p < end; p += 4)
     {
-      timestamp = boost::lexical_cast<int64_t>(tmp);
+      const int a = DecodeBase64Character(p[0]);
+      const int b = DecodeBase64Character(p[1]);
+
+      if (a == INVALID ||
+          b == INVALID)
+      {
+        return false;
+      }
+
+      *output++ = static_cast<char>((a << 2) | (b >> 4));
+
+      if (p[2] == '=')
+      {
+        // Padding is only allowed at the end
+        target.resize(output - &target[0]);
+        return (p + 4 == end &&
+                p[3] == '=');
+      }
+
+      const int c = DecodeBase64Character(p[2]);
+      if (c == INVALID)
+      {
+        return false;
+      }
+
+      *output++ = static_cast<char>(((b & 0x0f) << 4) | (c >> 2));
+
+      if (p[3] == '=')
+      {
+        target.resize(output - &target[0]);
+        return (p + 4 == end);
+      }
+
+      const int d = DecodeBase64Character(p[3]);
+      if (d == INVALID)
+      {
+        return false;
+      }
+
+      *output++ = static_cast<char>(((c & 0x03) << 6) | d);
     }
-    catch (boost::bad_lexical_cast&)
+
+    return true;
+  }
+
+
+  bool CSVFileSourceFilter::Refill(boost::filesystem::ifstream& stream)
+  {
+    // Keep the beginning of the record that is being parsed
+    buffer_.erase(0, position_);
+    position_ = 0;
+
+    const size_t size = buffer_.size();
+    buffer_.resize(size + CHUNK_SIZE);
+    stream.read(&buffer_[size], CHUNK_SIZE);
+
+    const std::streamsize count = stream.gcount();
+    buffer_.resize(size + (count > 0 ? static_cast<size_t>(count) : 0));
+
+    return (count > 0);
+  }
+
+
+  CSVFileSourceFilter::ParseStatus CSVFileSourceFilter::ParseRecord(size_t& count,
+                                                                    bool& malformed)
+  {
+    enum State
     {
-      LOG(ERROR) << "Cannot decode timestamp: \"" << tmp << "\"";
-      return false;
+      State_FieldStart,
+      State_Unquoted,
+      State_Quoted,
+      State_QuoteInQuoted  // A double quote was read in a quoted field
+    };
+
+    const char* data = buffer_.c_str();
+    const size_t size = buffer_.size();
+
+    // Skip the empty lines (this also skips the "\n" of "\r\n")
+    while (position_ < size &&
+           (data[position_] == '\r' || data[position_] == '\n'))
+    {
+      position_++;
     }
 
-    message.SetTimestamp(timestamp);
-    message.SwapMetadata(metadata);
+    if (position_ == size)
+    {
+      return (eof_ ? ParseStatus_End : ParseStatus_Incomplete);
+    }
 
-    if (base64_)
+    State state = State_FieldStart;
+    size_t begin = position_;
+    bool unescape = false;
+
+    count = 0;
+    malformed = false;
+
+    for (size_t i = position_; ; i++)
     {
-      try
+      bool endOfField = false;
+      bool endOfRecord = false;
+      size_t end = i;
+
+      if (i == size)
+      {
+        if (!eof_)
+        {
+          return ParseStatus_Incomplete;
+        }
+
+        // The last record of the file has no line break
+        if (state == State_FieldStart)
+        {
+          begin = i;  // Empty last field
+        }
+        else if (state == State_Quoted)
+        {
+          malformed = true;  // Unterminated quoted field
+        }
+        else if (state == State_QuoteInQuoted)
+        {
+          end = i - 1;
+        }
+
+        endOfField = true;
+        endOfRecord = true;
+      }
+      else
+      {
+        const char c = data[i];
+
+        switch (state)
+        {
+          case State_FieldStart:
+            if (c == '"')
+            {
+              state = State_Quoted;
+              begin = i + 1;
+            }
+            else if (c == ',')
+            {
+              begin = i;
+              endOfField = true;
+            }
+            else if (c == '\r' || c == '\n')
+            {
+              begin = i;
+              endOfField = true;
+              endOfRecord = true;
+            }
+            else
+            {
+              state = State_Unquoted;
+              begin = i;
+            }
+            break;
+
+          case State_Unquoted:
+            if (c == ',')
+            {
+              endOfField = true;
+            }
+            else if (c == '\r' || c == '\n')
+            {
+              endOfField = true;
+              endOfRecord = true;
+            }
+            break;
+
+          case State_Quoted:
+            if (c == '"')
+            {
+              state = State_QuoteInQuoted;
+            }
+            break;
+
+          case State_QuoteInQuoted:
+            if (c == '"')
+            {
+              // Escaped double quote
+              state = State_Quoted;
+              unescape = true;
+            }
+            else if (c == ',')
+            {
+              end = i - 1;
+              endOfField = true;
+            }
+            else if (c == '\r' || c == '\n')
+            {
+              end = i - 1;
+              endOfField = true;
+              endOfRecord = true;
+            }
+            else
+            {
+              // Characters after the closing double quote
+              malformed = true;
+              state = State_Unquoted;
+            }
+            break;
+
+          default:
+            throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+
+      if (endOfField)
+      {
+        if (count < COLUMNS)
+        {
+          fields_[count].begin_ = begin;
+          fields_[count].end_ = (end < begin ? begin : end);
+          fields_[count].unescape_ = unescape;
+        }
+
+        count++;
+        state = State_FieldStart;
+        unescape = false;
+      }
+
+      if (endOfRecord)
       {
-        Orthanc::Toolbox::DecodeBase64(tmp, value);
+        position_ = (i == size ? i : i + 1);
+        return ParseStatus_Record;
       }
-      catch (Orthanc::OrthancException&)
+    }
+  }
+
+
+  void CSVFileSourceFilter::Unescape(Field& field)
+  {
+    if (field.unescape_)
+    {
+      // Replace pairs of double quotes by one double quote, in place
+      char* data = &buffer_[0];
+      size_t target = field.begin_;
+
+      for (size_t source = field.begin_; source < field.end_; source++)
+      {
+        data[target++] = data[source];
+
+        if (data[source] == '"')
+        {
+          source++;  // Skip the second double quote
+        }
+      }
+
+      field.end_ = target;
+      field.unescape_ = false;
+    }
+  }
+
+  
+  bool CSVFileSourceFilter::Decode(Message& message)
+  {
+    for (size_t i = 0; i < COLUMNS; i++)
+    {
+      Unescape(fields_[i]);
+    }
+
+    const char* data = buffer_.c_str();
+
+    // The first column (name of the time series) is ignored
+    const Field& timestamp = fields_[1];
+    const Field& metadata = fields_[2];
+    const Field& value = fields_[3];
+
+    int64_t t;
+    if (!ParseTimestamp(t, data + timestamp.begin_, data + timestamp.end_))
+    {
+      LOG(ERROR) << "Cannot decode timestamp: \""
+                 << std::string(data + timestamp.begin_, data + timestamp.end_) << "\"";
+      return false;
+    }
+
+    std::string s;
+
+    if (base64_)
+    {
+      if (!DecodeBase64(s, data + value.begin_, data + value.end_))
       {
         LOG(ERROR) << "The content is not encoded as base64";
         return false;
       }
-        
-      message.SwapValue(tmp);
     }
     else
     {
-      message.SwapValue(value);
+      s.assign(data + value.begin_, data + value.end_);
     }
 
+    message.SetTimestamp(t);
+    message.SwapValue(s);
+
+    s.assign(data + metadata.begin_, data + metadata.end_);
+    message.SwapMetadata(s);
+
     return true;
   }
 
@@ -118,23 +463,59 @@ namespace AtomIT
   CSVFileSourceFilter::ReadMessage(Message& message,
                                    boost::filesystem::ifstream& stream)
   {
-    std::string line;
-      
-    if (std::getline(stream, line))
+    for (;;)
     {
-      if (Decode(message, Orthanc::Toolbox::StripSpaces(line)))
-      {
-        return FetchStatus_Success;
-      }
-      else
+      size_t count;
+      bool malformed;
+
+      switch (ParseRecord(count, malformed))
       {
-        return FetchStatus_Invalid;
+        case ParseStatus_Incomplete:
+          if (!Refill(stream))
+          {
+            eof_ = true;
+          }
+          break;
+
+        case ParseStatus_End:
+          return FetchStatus_Done;
+
+        case ParseStatus_Record:
+        {
+          const bool isFirst = isFirst_;
+          isFirst_ = false;
+
+          if (malformed)
+          {
+            LOG(ERROR) << "Malformed CSV record in file: " << GetPath();
+            return FetchStatus_Invalid;
+          }
+          else if (count != COLUMNS)
+          {
+            LOG(ERROR) << "CSV files must have 4 columns: " << GetPath();
+            return FetchStatus_Invalid;
+          }
+          else if (isFirst &&
+                   buffer_.compare(fields_[1].begin_, fields_[1].end_ - fields_[1].begin_,
+                                   "Timestamp") == 0)
+          {
+            // Skip the optional header line written by "CSVFileSinkFilter"
+            break;
+          }
+          else if (Decode(message))
+          {
+            return FetchStatus_Success;
+          }
+          else
+          {
+            return FetchStatus_Invalid;
+          }
+        }
+
+        default:
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
       }
     }
-    else
-    {
-      return FetchStatus_Done;
-    }
   }
 
     
@@ -143,7 +524,23 @@ namespace AtomIT
                                            const std::string& timeSeries,
                                            const boost::filesystem::path& path) :
     FileReaderFilter(name, manager, timeSeries, path),
-    base64_(true)
+    base64_(true),
+    position_(0),
+    eof_(false),
+    isFirst_(true)
   {
+    // Line breaks are handled by the parser
+    SetBinary(true);
+  }
+
+
+  void CSVFileSourceFilter::Start()
+  {
+    buffer_.clear();
+    position_ = 0;
+    eof_ = false;
+    isFirst_ = true;
+
+    FileReaderFilter::Start();
   }
 }
@@ -35,13 +35,47 @@
 
 namespace AtomIT
 {
+  /**
+   * Reads back a CSV file written by "CSVFileSinkFilter". The file is
+   * read by large chunks, that are parsed in place by a state machine
+   * following RFC 4180 (quoted fields may contain commas, double
+   * quotes and line breaks). The Base64 values are decoded directly
+   * from the buffer.
+   **/
   class CSVFileSourceFilter : public FileReaderFilter
   {
   private:
-    bool  base64_;
+    enum ParseStatus
+    {
+      ParseStatus_Record,      // A whole record is available
+      ParseStatus_Incomplete,  // More data must be read from the file
+      ParseStatus_End          // End of file
+    };
+
+    struct Field
+    {
+      size_t  begin_;     // Offsets in "buffer_"
+      size_t  end_;
+      bool    unescape_;  // Contains escaped double quotes
+    };
+
+    static const size_t COLUMNS = 4;
+
+    bool         base64_;
+    std::string  buffer_;      // Chunk of the file being parsed
+    size_t       position_;    // Start of the next record in the buffer
+    bool         eof_;
+    bool         isFirst_;     // Whether the next record is the first one
+    Field        fields_[COLUMNS];
 
-    bool Decode(Message& message,
-                const std::string& line) const;
+    bool Refill(boost::filesystem::ifstream& stream);
+
+    ParseStatus ParseRecord(size_t& count,
+                            bool& malformed);
+
+    void Unescape(Field& field);
+
+    bool Decode(Message& message);
     
   protected:
     virtual FetchStatus ReadMessage(Message& message,
@@ -62,5 +96,7 @@ namespace AtomIT
     {
       return base64_;
     }
+
+    virtual void Start();
   };
 }
@@ -32,27 +32,208 @@
 #include "DemultiplexerFilter.h"
 
 #include <Core/Logging.h>
+#include <Core/OrthancException.h>
+
+#include <boost/lexical_cast.hpp>
 
 namespace AtomIT
 {
+  static const size_t DEFAULT_WRITER_CACHE_SIZE = 64;
+  static const unsigned int CREDITS_TIMEOUT = 100;  // Milliseconds
+
+
+  void DemultiplexerFilter::AppendGroup(const std::string& timeSeries,
+                                        const std::vector<Message>& messages)
+  {
+    try
+    {
+      TimeSeriesWriter& writer = writers_->GetWriter(timeSeries);
+      size_t count = writer.Append(messages);
+
+      if (count == 0 &&
+          writer.IsDeleted())
+      {
+        // The time series was deleted since its writer was cached:
+        // Retry with a fresh writer. Otherwise, the messages were
+        // rejected (e.g. their timestamps are not increasing), and
+        // the cached writer is kept.
+        writers_->Invalidate(timeSeries);
+        count = writers_->GetWriter(timeSeries).Append(messages);
+      }
+
+      if (count != messages.size())
+      {
+        LOG(ERROR) << "Cannot demux " << (messages.size() - count)
+                   << " message(s) to time series: " << timeSeries;
+      }
+    }
+    catch (Orthanc::OrthancException& e)
+    {
+      // Don't propagate the error, as the other groups of this batch
+      // might already be appended
+      writers_->Invalidate(timeSeries);
+      LOG(ERROR) << "Cannot demux message to time series \"" << timeSeries
+                 << "\": " << e.What();
+    }
+  }
+
+
+  size_t DemultiplexerFilter::Write(const std::vector<ConvertedMessages>& outputs)
+  {
+    typedef std::map<std::string, std::vector<Message> >  Groups;
+    typedef std::map<std::string, unsigned int>           Credits;
+
+    Groups   groups;
+    Credits  credits;
+    size_t   count = 0;
+
+    while (count < outputs.size())
+    {
+      const ConvertedMessages& current = outputs[count];
+
+      if (flowControl_.IsEnabled())
+      {
+        // Check all the outputs before accepting the message, so that
+        // a retried message is never appended twice. The credits of
+        // each output are only retrieved once per batch.
+        bool hasCredits = true;
+
+        for (ConvertedMessages::const_iterator it = current.begin();
+             it != current.end() && hasCredits; ++it)
+        {
+          Credits::iterator found = credits.find(it->first);
+
+          if (found == credits.end())
+          {
+            unsigned int c = flowControl_.WaitForCredits(writers_->GetWriter(it->first),
+                                                         creditsTimeout_);
+            found = credits.insert(std::make_pair(it->first, c)).first;
+          }
+
+          hasCredits = (found->second > 0);
+        }
+
+        if (!hasCredits)
+        {
+          break;
+        }
+
+        for (ConvertedMessages::const_iterator it = current.begin();
+             it != current.end(); ++it)
+        {
+          credits[it->first]--;
+        }
+      }
+
+      // Group the outputs by time series, so that each output time
+      // series is written within one single transaction per batch
+      for (ConvertedMessages::const_iterator it = current.begin();
+           it != current.end(); ++it)
+      {
+        groups[it->first].push_back(it->second);
+      }
+
+      count++;
+    }
+
+    for (Groups::const_iterator it = groups.begin(); it != groups.end(); ++it)
+    {
+      AppendGroup(it->first, it->second);
+    }
+
+    return count;
+  }
+
+
+  void DemultiplexerFilter::DemuxBatch(std::vector<ConvertedMessages>& outputs,
+                                       const std::vector<Message>& sources)
+  {
+    outputs.resize(sources.size());
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+      Demux(outputs[i], sources[i]);
+    }
+  }
+
+
   AdapterFilter::PushStatus DemultiplexerFilter::Push(const Message& message)
   {
-    ConvertedMessages outputs;
+    std::vector<ConvertedMessages> outputs(1);
       
-    Demux(outputs, message);
+    Demux(outputs[0], message);
 
-    for (ConvertedMessages::const_iterator it = outputs.begin();
-         it != outputs.end(); ++it)
+    if (Write(outputs) == 1)
+    {
+      return PushStatus_Success;
+    }
+    else
     {
-      TimeSeriesWriter writer(manager_, it->first);
+      return PushStatus_Retry;
+    }
+  }
 
-      if (!writer.Append(it->second))
+
+  bool DemultiplexerFilter::IsPending(const std::vector<Message>& messages) const
+  {
+    if (pending_.empty() ||
+        pendingTimestamps_.size() > messages.size())
+    {
+      return false;
+    }
+
+    for (size_t i = 0; i < pendingTimestamps_.size(); i++)
+    {
+      if (messages[i].GetTimestamp() != pendingTimestamps_[i])
       {
-        LOG(ERROR) << "Cannot demux message to time series: " << it->first;
+        return false;
       }
     }
 
-    return PushStatus_Success;
+    return true;
+  }
+
+
+  size_t DemultiplexerFilter::PushBatch(std::vector<size_t>& failures,
+                                        const std::vector<Message>& messages)
+  {
+    std::vector<ConvertedMessages> outputs;
+
+    if (IsPending(messages))
+    {
+      // Retry after a stall: Only write the messages that were
+      // already converted, the next ones are left to the next batch
+      outputs.swap(pending_);
+    }
+    else
+    {
+      DemuxBatch(outputs, messages);
+
+      if (outputs.size() != messages.size())
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+      }
+    }
+
+    pending_.clear();
+    pendingTimestamps_.clear();
+
+    const size_t count = Write(outputs);
+
+    if (count < outputs.size())
+    {
+      stalled_ = true;
+
+      pending_.assign(outputs.begin() + count, outputs.end());
+      pendingTimestamps_.reserve(pending_.size());
+
+      for (size_t i = count; i < outputs.size(); i++)
+      {
+        pendingTimestamps_.push_back(messages[i].GetTimestamp());
+      }
+    }
+
+    return count;
   }
     
 
@@ -60,7 +241,59 @@ namespace AtomIT
                                            ITimeSeriesManager& manager,
                                            const std::string& inputTimeSeries) :
     AdapterFilter(name, manager, inputTimeSeries),
-    manager_(manager)
+    manager_(manager),
+    writers_(new TimeSeriesWriterCache(manager, DEFAULT_WRITER_CACHE_SIZE)),
+    creditsTimeout_(0),
+    stalled_(false)
   {
   }
+
+
+  void DemultiplexerFilter::SetWriterCacheSize(size_t size)
+  {
+    writers_.reset(new TimeSeriesWriterCache(manager_, size));
+  }
+
+
+  bool DemultiplexerFilter::Step()
+  {
+    creditsTimeout_ = CREDITS_TIMEOUT;
+    return AdapterFilter::Step();
+  }
+
+
+  bool DemultiplexerFilter::TryStep(bool& idle)
+  {
+    stalled_ = false;
+
+    const bool result = AdapterFilter::TryStep(idle);
+
+    if (stalled_ &&
+        creditsTimeout_ == 0)
+    {
+      // Don't requeue the filter at once, as it would spin until
+      // the consumers of its outputs pop messages
+      idle = true;
+    }
+
+    return result;
+  }
+
+
+  void DemultiplexerFilter::FormatStatistics(Json::Value& target)
+  {
+    AdapterFilter::FormatStatistics(target);
+    flowControl_.Format(target["flowControl"]);
+
+    size_t size;
+    uint64_t hits, misses;
+    writers_->GetStatistics(size, hits, misses);
+
+    Json::Value cache = Json::objectValue;
+    cache["size"] = static_cast<unsigned int>(size);
+    cache["capacity"] = static_cast<unsigned int>(writers_->GetCapacity());
+    cache["hits"] = boost::lexical_cast<std::string>(hits);
+    cache["misses"] = boost::lexical_cast<std::string>(misses);
+    target["writerCache"] = cache;
+  }
 }
@@ -32,6 +32,8 @@
 #pragma once
 
 #include "AdapterFilter.h"
+#include "FlowControl.h"
+#include "../TimeSeries/TimeSeriesWriterCache.h"
 
 namespace AtomIT
 {
@@ -41,17 +43,77 @@ namespace AtomIT
     typedef std::map<std::string, Message>  ConvertedMessages;
     
   private:
-    ITimeSeriesManager&  manager_;
-    
+    ITimeSeriesManager&                   manager_;
+    FlowControl                           flowControl_;
+    std::auto_ptr<TimeSeriesWriterCache>  writers_;
+    unsigned int                          creditsTimeout_;  // In milliseconds
+    bool                                  stalled_;
+
+    // Outputs of the source messages that could not be written by
+    // the last batch because of the flow control, together with the
+    // timestamps of these messages. They are reused if the same
+    // messages are pushed again, so that they are not converted twice.
+    std::vector<ConvertedMessages>        pending_;
+    std::vector<int64_t>                  pendingTimestamps_;
+
+    bool IsPending(const std::vector<Message>& messages) const;
+
+    void AppendGroup(const std::string& timeSeries,
+                     const std::vector<Message>& messages);
+
+    // Returns the number of source messages whose outputs were
+    // written, which is smaller than the size of "outputs" if some
+    // output time series has no credit left
+    size_t Write(const std::vector<ConvertedMessages>& outputs);
+
   protected:
     virtual void Demux(ConvertedMessages& outputs,
                        const Message& source) = 0;
 
+    // Converts a whole batch of messages. The default implementation
+    // calls "Demux()" on each message. The outputs are appended in the
+    // order of the source messages, whatever the order of conversion.
+    virtual void DemuxBatch(std::vector<ConvertedMessages>& outputs,
+                            const std::vector<Message>& sources);
+
     virtual PushStatus Push(const Message& message);
+
+    virtual size_t PushBatch(std::vector<size_t>& failures,
+                             const std::vector<Message>& messages);
     
   public:
     DemultiplexerFilter(const std::string& name,
                         ITimeSeriesManager& manager,
                         const std::string& inputTimeSeries);
+
+    // Backpressure: The messages are not consumed as long as one of
+    // the output time series has too many pending messages
+    void SetMaxPendingMessages(unsigned int count)
+    {
+      flowControl_.SetMaxPendingMessages(count);
+    }
+
+    unsigned int GetMaxPendingMessages() const
+    {
+      return flowControl_.GetMaxPendingMessages();
+    }
+
+    // Maximum number of output time series whose writer is kept open
+    void SetWriterCacheSize(size_t size);
+
+    size_t GetWriterCacheSize() const
+    {
+      return writers_->GetCapacity();
+    }
+
+    // Run by a dedicated thread, that can block for credits
+    virtual bool Step();
+
+    // Run by the scheduler pool: Never blocks for credits, and reports
+    // the filter as idle if its outputs are stalled, so that it is
+    // polled later on instead of holding a worker
+    virtual bool TryStep(bool& idle);
+
+    virtual void FormatStatistics(Json::Value& target);
   };
 }
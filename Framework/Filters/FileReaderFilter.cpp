@@ -61,14 +61,22 @@ namespace AtomIT
                                      const boost::filesystem::path& path) :
     SourceFilter(name, manager, timeSeries),
     path_(path),
-    line_(0)
+    line_(0),
+    binary_(false)
   {
   }
 
 
   void FileReaderFilter::Start()
   {
-    stream_.open(path_);
+    if (binary_)
+    {
+      stream_.open(path_, std::ios_base::in | std::ios_base::binary);
+    }
+    else
+    {
+      stream_.open(path_);
+    }
 
     if (!stream_.is_open())
     {
@@ -43,6 +43,7 @@ namespace AtomIT
     boost::filesystem::path      path_;
     boost::filesystem::ifstream  stream_;
     uint64_t                     line_;
+    bool                         binary_;
 
   protected:
     virtual FetchStatus ReadMessage(Message& message,
@@ -61,6 +62,16 @@ namespace AtomIT
       return path_;
     }
 
+    void SetBinary(bool binary)
+    {
+      binary_ = binary;
+    }
+
+    bool IsBinary() const
+    {
+      return binary_;
+    }
+
     virtual void Start();
 
     virtual void Stop();
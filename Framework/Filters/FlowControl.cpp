@@ -0,0 +1,111 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "FlowControl.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <limits>
+
+namespace AtomIT
+{
+  FlowControl::FlowControl() :
+    maxPending_(0),
+    queueDepth_(0),
+    stalls_(0),
+    stallTime_(0)
+  {
+  }
+
+
+  void FlowControl::SetMaxPendingMessages(unsigned int count)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    maxPending_ = count;
+  }
+
+
+  unsigned int FlowControl::GetMaxPendingMessages() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return maxPending_;
+  }
+
+
+  unsigned int FlowControl::WaitForCredits(TimeSeriesWriter& writer,
+                                           unsigned int milliseconds)
+  {
+    const unsigned int maxPending = GetMaxPendingMessages();
+
+    if (maxPending == 0)
+    {
+      return std::numeric_limits<unsigned int>::max();
+    }
+
+    uint64_t length;
+    uint64_t credits = writer.WaitForCredits(length, maxPending, 0);
+
+    const bool stalled = (credits == 0);
+    uint64_t stall = 0;
+
+    if (stalled)
+    {
+      const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+      credits = writer.WaitForCredits(length, maxPending, milliseconds);
+      stall = (boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds();
+    }
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      queueDepth_ = length;
+
+      if (stalled)
+      {
+        stalls_++;
+        stallTime_ += stall;
+      }
+    }
+
+    return static_cast<unsigned int>(credits);
+  }
+
+
+  void FlowControl::Format(Json::Value& target) const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    target["maxPendingMessages"] = maxPending_;
+    target["queueDepth"] = boost::lexical_cast<std::string>(queueDepth_);
+    target["stalls"] = boost::lexical_cast<std::string>(stalls_);
+    target["stallTime"] = boost::lexical_cast<std::string>(stallTime_);
+  }
+}
@@ -0,0 +1,76 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../TimeSeries/TimeSeriesWriter.h"
+
+#include <boost/thread/mutex.hpp>
+#include <json/value.h>
+
+namespace AtomIT
+{
+  // Credit-based flow control of the output time series of a filter:
+  // The filter stalls as long as one of its outputs contains at least
+  // "MaxPendingMessages" messages, that were not popped by the
+  // consumers yet. This class is thread-safe, so that its statistics
+  // can be monitored.
+  class FlowControl : public boost::noncopyable
+  {
+  private:
+    mutable boost::mutex  mutex_;
+    unsigned int          maxPending_;
+    uint64_t              queueDepth_;
+    uint64_t              stalls_;
+    uint64_t              stallTime_;  // In milliseconds
+
+  public:
+    FlowControl();
+
+    // Zero means no flow control
+    void SetMaxPendingMessages(unsigned int count);
+
+    unsigned int GetMaxPendingMessages() const;
+
+    bool IsEnabled() const
+    {
+      return GetMaxPendingMessages() != 0;
+    }
+
+    // Returns the number of messages that can be appended to the
+    // output time series of "writer". Waits for at most
+    // "milliseconds" if no credit is available.
+    unsigned int WaitForCredits(TimeSeriesWriter& writer,
+                                unsigned int milliseconds);
+
+    void Format(Json::Value& target) const;
+  };
+}
@@ -76,5 +76,12 @@ namespace AtomIT
     {
       client_.SetCredentials(username, password);
     }
+
+    // Each HTTP request blocks for up to the timeout of the client,
+    // which must not stall the workers of the filter scheduler
+    virtual bool GetWakeupTimeSeries(std::string& name) const
+    {
+      return false;
+    }
   };
 }
@@ -32,6 +32,7 @@
 #pragma once
 
 #include <boost/noncopyable.hpp>
+#include <json/value.h>
 #include <string>
 
 namespace AtomIT
@@ -55,5 +56,31 @@ namespace AtomIT
     virtual bool Step() = 0; 
 
     virtual void Stop() = 0;
+
+    // Optional support for event-driven scheduling. A filter that is
+    // only woken up by the modifications of one single time series
+    // can return "true" and store the name of this series. The filter
+    // scheduler will then call "TryStep()" instead of "Step()", and
+    // park the filter until this series is modified.
+    virtual bool GetWakeupTimeSeries(std::string& name) const
+    {
+      return false;
+    }
+
+    // Same as "Step()", but must never block waiting for new input:
+    // If there is nothing to process, "idle" is set to "true".
+    virtual bool TryStep(bool& idle)
+    {
+      idle = false;
+      return Step();
+    }
+
+    // Monitoring of the filter (e.g. its queue depth). This method
+    // can be called from another thread than the one running the
+    // filter.
+    virtual void FormatStatistics(Json::Value& target)
+    {
+      target = Json::objectValue;
+    }
   };
 }
@@ -40,11 +40,62 @@
 #include <Core/Toolbox.h>
 #include <Core/SystemToolbox.h>
 
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cassert>
+
+#if !defined(ATOMIT_ENABLE_LUAJIT)
+#  error The macro ATOMIT_ENABLE_LUAJIT must be defined to use this file
+#endif
+
+#if ATOMIT_ENABLE_LUAJIT == 1
+extern "C"
+{
+#  include <luajit.h>
+}
+#endif
+
 static const char* CONVERT_CALLBACK = "Convert";
+static const char* CONVERT_BATCH_CALLBACK = "ConvertBatch";
 
 
 namespace AtomIT
 {
+  // Stores a callback into the Lua registry, so that the conversion of
+  // one message does not check for its existence
+  class LuaFilter::CallbackPinning : public Orthanc::LuaFunctionCall
+  {
+  private:
+    int  reference_;
+
+  public:
+    CallbackPinning(Orthanc::LuaContext& context,
+                    const char* name,
+                    int previous) :
+      LuaFunctionCall(context, name),
+      reference_(LUA_NOREF)
+    {
+      if (previous != LUA_NOREF)
+      {
+        luaL_unref(GetState(), LUA_REGISTRYINDEX, previous);
+      }
+
+      if (lua_isfunction(GetState(), -1))
+      {
+        // This pops the function from the stack
+        reference_ = luaL_ref(GetState(), LUA_REGISTRYINDEX);
+      }
+
+      lua_settop(GetState(), 0);
+    }
+
+    int GetReference() const
+    {
+      return reference_;
+    }
+  };
+
+
   class LuaFilter::OutputParser : public Orthanc::LuaFunctionCall
   {
   private:
@@ -229,34 +280,50 @@ namespace AtomIT
     
   public:
     OutputParser(Orthanc::LuaContext& context,
+                 int convert,
                  const Message& original,
                  const std::string& defaultTimeSeries) :
       LuaFunctionCall(context, CONVERT_CALLBACK),
       success_(false)
     {
+      // Call the pinned callback, even if the script has modified the
+      // global variable "Convert" in the meantime
+      lua_settop(GetState(), 0);
+      lua_rawgeti(GetState(), LUA_REGISTRYINDEX, convert);
+
       PushInteger(original.GetTimestamp());
       PushString(original.GetMetadata());
       PushString(original.GetValue());
       ExecuteInternal(1);
 
-      if (lua_isnil(GetState(), 1))
+      success_ = ParseOutputs(outputs_, GetState(), 1, original, defaultTimeSeries);
+    }
+
+    // Parses the value that is returned by "Convert()" for one message
+    static bool ParseOutputs(DemultiplexerFilter::ConvertedMessages& outputs,
+                             lua_State* lua,
+                             int index,
+                             const Message& original,
+                             const std::string& defaultTimeSeries)
+    {
+      if (lua_isnil(lua, index))
       {
         // The message must be discarded
         LOG(INFO) << "The Lua filter has skipped one input message";
-        success_ = true;
+        return true;
       }
       else
       {
         MessageVisitor visitor(original, defaultTimeSeries);
-        if (ITableVisitor::Apply(GetState(), visitor, 1))
+        if (ITableVisitor::Apply(lua, visitor, index))
         {
-          outputs_[visitor.GetTimeSeries()] = visitor.GetMessage();
-          success_ = true;
+          outputs[visitor.GetTimeSeries()] = visitor.GetMessage();
+          return true;
         }
         else
         {
-          ArrayVisitor visitor(outputs_, original, defaultTimeSeries);
-          success_ = ITableVisitor::Apply(GetState(), visitor, 1);
+          ArrayVisitor visitor(outputs, original, defaultTimeSeries);
+          return ITableVisitor::Apply(lua, visitor, index);
         }
       }
     }
@@ -273,6 +340,78 @@ namespace AtomIT
   };
   
   
+  class LuaFilter::BatchParser : public Orthanc::LuaFunctionCall
+  {
+  public:
+    BatchParser(std::vector<ConvertedMessages>& outputs,
+                Orthanc::LuaContext& context,
+                int convertBatch,
+                const std::vector<Message>& sources,
+                size_t start,
+                size_t end,
+                const std::string& defaultTimeSeries) :
+      LuaFunctionCall(context, CONVERT_BATCH_CALLBACK)
+    {
+      assert(start <= end && end <= sources.size());
+      
+      lua_settop(GetState(), 0);
+      lua_rawgeti(GetState(), LUA_REGISTRYINDEX, convertBatch);
+
+      // Build the array of input messages, without going through JSON
+      // in order to preserve binary values
+      lua_createtable(GetState(), static_cast<int>(end - start), 0);
+
+      for (size_t i = start; i < end; i++)
+      {
+        const Message& message = sources[i];
+
+        lua_createtable(GetState(), 0, 3);
+
+        lua_pushnumber(GetState(), static_cast<lua_Number>(message.GetTimestamp()));
+        lua_setfield(GetState(), -2, "timestamp");
+
+        lua_pushlstring(GetState(), message.GetMetadata().c_str(), message.GetMetadata().size());
+        lua_setfield(GetState(), -2, "metadata");
+
+        lua_pushlstring(GetState(), message.GetValue().c_str(), message.GetValue().size());
+        lua_setfield(GetState(), -2, "value");
+
+        lua_rawseti(GetState(), -2, static_cast<int>(i - start + 1));
+      }
+
+      ExecuteInternal(1);
+
+      if (!lua_istable(GetState(), 1))
+      {
+        LOG(ERROR) << "The \"" << CONVERT_BATCH_CALLBACK << "()\" Lua callback "
+                   << "must return an array, the batch is discarded";
+        return;
+      }
+
+      // The i-th item of the returned array corresponds to the i-th
+      // input message, and has the same format as the value returned
+      // by "Convert()"
+      for (size_t i = start; i < end; i++)
+      {
+        lua_rawgeti(GetState(), 1, static_cast<int>(i - start + 1));
+
+        ConvertedMessages converted;
+        if (OutputParser::ParseOutputs(converted, GetState(), -1, sources[i], defaultTimeSeries))
+        {
+          outputs[i].swap(converted);
+        }
+        else
+        {
+          LOG(ERROR) << "Bad output for message " << (i - start + 1) << " in \""
+                     << CONVERT_BATCH_CALLBACK << "()\"";
+        }
+
+        lua_pop(GetState(), 1);
+      }
+    }
+  };
+  
+  
   int LuaFilter::ApplyStringConverter(lua_State *state,
                                       void (*func) (std::string&, const std::string&),
                                       const char* name)
@@ -398,42 +537,327 @@ namespace AtomIT
   }
 
 
-  void LuaFilter::Demux(ConvertedMessages& outputs,
-                        const Message& source)
+  class LuaFilter::Worker : public boost::noncopyable
   {
-    std::auto_ptr<OutputParser> parser;
-      
+  private:
+    const LuaFilter&                  filter_;
+    Orthanc::LuaContext               lua_;
+    int                               convert_;
+    int                               convertBatch_;
+    boost::mutex                      mutex_;
+    boost::condition_variable         condition_;
+    bool                              continue_;
+    bool                              hasJob_;
+    std::vector<ConvertedMessages>*   outputs_;
+    const std::vector<Message>*       sources_;
+    size_t                            start_;
+    size_t                            end_;
+    boost::thread                     thread_;
+
+    static void Loop(Worker* that)
+    {
+      for (;;)
+      {
+        {
+          boost::mutex::scoped_lock lock(that->mutex_);
+          while (that->continue_ &&
+                 !that->hasJob_)
+          {
+            that->condition_.wait(lock);
+          }
+
+          if (!that->continue_)
+          {
+            return;
+          }
+        }
+
+        // The job is only modified by "Submit()" while "hasJob_" is
+        // false, so it can be read without the mutex
+        try
+        {
+          that->filter_.ConvertRange(*that->outputs_, that->lua_, that->convert_,
+                                     that->convertBatch_, *that->sources_,
+                                     that->start_, that->end_);
+        }
+        catch (...)
+        {
+          LOG(ERROR) << "Unhandled exception in a Lua worker of filter: "
+                     << that->filter_.GetName();
+        }
+
+        {
+          boost::mutex::scoped_lock lock(that->mutex_);
+          that->hasJob_ = false;
+          that->condition_.notify_all();
+        }
+      }
+    }
+
+  public:
+    Worker(const LuaFilter& filter) :
+      filter_(filter),
+      convert_(LUA_NOREF),
+      convertBatch_(LUA_NOREF),
+      continue_(true),
+      hasJob_(false),
+      outputs_(NULL),
+      sources_(NULL),
+      start_(0),
+      end_(0)
+    {
+      RegisterFunctions(lua_);
+
+      // The thread must be started once all the members are initialized
+      thread_ = boost::thread(Loop, this);
+    }
+
+    ~Worker()
+    {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        continue_ = false;
+        condition_.notify_all();
+      }
+
+      if (thread_.joinable())
+      {
+        thread_.join();
+      }
+    }
+
+    // Must only be called while the worker is idle
+    void LoadChunk(const std::string& chunk)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      assert(!hasJob_);
+      LuaFilter::LoadChunk(lua_, convert_, convertBatch_, chunk);
+    }
+
+    void Submit(std::vector<ConvertedMessages>& outputs,
+                const std::vector<Message>& sources,
+                size_t start,
+                size_t end)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      assert(!hasJob_);
+
+      outputs_ = &outputs;
+      sources_ = &sources;
+      start_ = start;
+      end_ = end;
+      hasJob_ = true;
+      condition_.notify_all();
+    }
+
+    void Wait()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (hasJob_)
+      {
+        condition_.wait(lock);
+      }
+    }
+  };
+
+
+  void LuaFilter::RegisterFunctions(Orthanc::LuaContext& lua)
+  {
+    lua.RegisterFunction("DecodeBase64", LuaDecodeBase64);
+    lua.RegisterFunction("EncodeBase64", LuaEncodeBase64);
+    lua.RegisterFunction("FormatHexadecimal", LuaFormatHexadecimal);
+    lua.RegisterFunction("ParseHexadecimal", LuaParseHexadecimal);
+    lua.RegisterFunction("ParseXml", ParseXml);
+  }
+
+
+  void LuaFilter::LoadChunk(Orthanc::LuaContext& lua,
+                            int& convert,
+                            int& convertBatch,
+                            const std::string& chunk)
+  {
+    // "luaL_loadbuffer()" accepts both source code and precompiled
+    // bytecode, the latter starting with the signature "\033Lua"
+    // (or "\033LJ" for LuaJIT)
+    lua.Execute(chunk);
+
+    {
+      CallbackPinning pinning(lua, CONVERT_CALLBACK, convert);
+      convert = pinning.GetReference();
+    }
+
+    {
+      CallbackPinning pinning(lua, CONVERT_BATCH_CALLBACK, convertBatch);
+      convertBatch = pinning.GetReference();
+    }
+  }
+
+
+  void LuaFilter::Convert(ConvertedMessages& outputs,
+                          Orthanc::LuaContext& lua,
+                          int convert,
+                          const Message& source) const
+  {
+    if (convert == LUA_NOREF)
+    {
+      return;  // No "Convert()" callback was defined by the script
+    }
+
     try
     {
-      if (lua_.IsExistingFunction(CONVERT_CALLBACK))
+      OutputParser parser(lua, convert, source, defaultTimeSeries_);
+
+      if (parser.IsSuccess())
       {
-        parser.reset(new OutputParser(lua_, source, defaultTimeSeries_));
+        outputs = parser.GetOutputs();
       }
     }
     catch (Orthanc::OrthancException& e)
     {
       LOG(ERROR) << "Error in Lua function: " << e.What();
-      parser.reset(NULL);
+    }
+  }
+
+
+  void LuaFilter::ConvertRange(std::vector<ConvertedMessages>& outputs,
+                               Orthanc::LuaContext& lua,
+                               int convert,
+                               int convertBatch,
+                               const std::vector<Message>& sources,
+                               size_t start,
+                               size_t end) const
+  {
+    if (start >= end)
+    {
+      return;
+    }
+    
+    if (convertBatch == LUA_NOREF)
+    {
+      for (size_t i = start; i < end; i++)
+      {
+        Convert(outputs[i], lua, convert, sources[i]);
+      }
+    }
+    else
+    {
+      try
+      {
+        BatchParser parser(outputs, lua, convertBatch, sources,
+                           start, end, defaultTimeSeries_);
+      }
+      catch (Orthanc::OrthancException& e)
+      {
+        LOG(ERROR) << "Error in Lua function: " << e.What();
+      }
+    }
+  }
+
+
+  void LuaFilter::ClearWorkers()
+  {
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+      assert(workers_[i] != NULL);
+      delete workers_[i];
+    }
+
+    workers_.clear();
+  }
+
+
+  void LuaFilter::WaitWorkers(size_t count)
+  {
+    assert(count <= workers_.size());
+
+    for (size_t i = 0; i < count; i++)
+    {
+      workers_[i]->Wait();
+    }
+  }
+
+
+  void LuaFilter::Demux(ConvertedMessages& outputs,
+                        const Message& source)
+  {
+    if (convertBatch_ == LUA_NOREF)
+    {
+      Convert(outputs, lua_, convert_, source);
+    }
+    else
+    {
+      std::vector<ConvertedMessages> tmp(1);
+      ConvertRange(tmp, lua_, convert_, convertBatch_,
+                   std::vector<Message>(1, source), 0, 1);
+      outputs.swap(tmp[0]);
+    }
+  }
+
+
+  void LuaFilter::DemuxBatch(std::vector<ConvertedMessages>& outputs,
+                             const std::vector<Message>& sources)
+  {
+    outputs.clear();
+    outputs.resize(sources.size());
+
+    if (workers_.empty() ||
+        sources.size() < 2)
+    {
+      ConvertRange(outputs, lua_, convert_, convertBatch_, sources, 0, sources.size());
+      return;
     }
 
-    if (parser.get() != NULL &&
-        parser->IsSuccess())
+    // Split the batch into contiguous chunks. The first chunk is
+    // converted by the filter thread, using the main Lua state. Each
+    // message writes into its own slot of "outputs", which resequences
+    // the results by construction.
+    const size_t countChunks = std::min(workers_.size() + 1, sources.size());
+    const size_t chunkSize = (sources.size() + countChunks - 1) / countChunks;
+
+    size_t countSubmitted = 0;
+    for (size_t i = 1; i < countChunks; i++)
+    {
+      const size_t start = i * chunkSize;
+      const size_t end = std::min(start + chunkSize, sources.size());
+
+      if (start < end)
+      {
+        workers_[i - 1]->Submit(outputs, sources, start, end);
+        countSubmitted = i;
+      }
+    }
+
+    try
+    {
+      ConvertRange(outputs, lua_, convert_, convertBatch_, sources,
+                   0, std::min(chunkSize, sources.size()));
+    }
+    catch (...)
     {
-      outputs = parser->GetOutputs();
+      // The workers are still writing into "outputs" and reading
+      // "sources": They must be done before the exception unwinds
+      WaitWorkers(countSubmitted);
+      throw;
     }
+
+    WaitWorkers(countSubmitted);
   }
 
  
   LuaFilter::LuaFilter(const std::string& name,
                        ITimeSeriesManager& manager,
                        const std::string& inputTimeSeries) :
-    DemultiplexerFilter(name, manager, inputTimeSeries)
+    DemultiplexerFilter(name, manager, inputTimeSeries),
+    convert_(LUA_NOREF),
+    convertBatch_(LUA_NOREF)
   {
-    lua_.RegisterFunction("DecodeBase64", LuaDecodeBase64);
-    lua_.RegisterFunction("EncodeBase64", LuaEncodeBase64);
-    lua_.RegisterFunction("FormatHexadecimal", LuaFormatHexadecimal);
-    lua_.RegisterFunction("ParseHexadecimal", LuaParseHexadecimal);
-    lua_.RegisterFunction("ParseXml", ParseXml);
+    RegisterFunctions(lua_);
+  }
+
+
+  LuaFilter::~LuaFilter()
+  {
+    ClearWorkers();
   }
 
   
@@ -441,6 +865,54 @@ namespace AtomIT
   {
     std::string f;
     Orthanc::SystemToolbox::ReadFile(f, path.string());
-    lua_.Execute(f);
+
+    if (!f.empty() &&
+        f[0] == '\033')
+    {
+      LOG(INFO) << "Loading precompiled Lua bytecode: " << path.string();
+    }
+
+    LoadChunk(lua_, convert_, convertBatch_, f);
+
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+      workers_[i]->LoadChunk(f);
+    }
+
+    chunks_.push_back(f);
+  }
+
+
+  void LuaFilter::SetConcurrency(unsigned int concurrency)
+  {
+    if (concurrency == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    ClearWorkers();
+
+    for (unsigned int i = 1; i < concurrency; i++)
+    {
+      std::auto_ptr<Worker> worker(new Worker(*this));
+
+      // Replay the chunks that were already loaded into the main state
+      for (size_t j = 0; j < chunks_.size(); j++)
+      {
+        worker->LoadChunk(chunks_[j]);
+      }
+
+      workers_.push_back(worker.release());
+    }
+  }
+
+
+  const char* LuaFilter::GetEngine()
+  {
+#if ATOMIT_ENABLE_LUAJIT == 1
+    return LUAJIT_VERSION;
+#else
+    return LUA_RELEASE;
+#endif
   }
 }
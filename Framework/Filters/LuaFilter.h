@@ -42,10 +42,44 @@ namespace AtomIT
   class LuaFilter : public DemultiplexerFilter
   {
   private:
+    class BatchParser;
+    class CallbackPinning;
     class OutputParser;
+    class Worker;
     
-    std::string          defaultTimeSeries_;
-    Orthanc::LuaContext  lua_;
+    std::string               defaultTimeSeries_;
+    Orthanc::LuaContext       lua_;
+    int                       convert_;       // Registry reference
+    int                       convertBatch_;  // Registry reference
+    std::vector<std::string>  chunks_;
+    std::vector<Worker*>      workers_;
+
+    static void RegisterFunctions(Orthanc::LuaContext& lua);
+
+    static void LoadChunk(Orthanc::LuaContext& lua,
+                          int& convert,
+                          int& convertBatch,
+                          const std::string& chunk);
+
+    void Convert(ConvertedMessages& outputs,
+                 Orthanc::LuaContext& lua,
+                 int convert,
+                 const Message& source) const;
+
+    // Uses "ConvertBatch()" if the script defines it, or falls back
+    // to one call to "Convert()" per message
+    void ConvertRange(std::vector<ConvertedMessages>& outputs,
+                      Orthanc::LuaContext& lua,
+                      int convert,
+                      int convertBatch,
+                      const std::vector<Message>& sources,
+                      size_t start,
+                      size_t end) const;
+
+    void ClearWorkers();
+
+    // Waits for the jobs submitted to the first "count" workers
+    void WaitWorkers(size_t count);
 
     static int ApplyStringConverter(lua_State *state,
                                     void (*func) (std::string&, const std::string&),
@@ -67,14 +101,37 @@ namespace AtomIT
   protected:
     virtual void Demux(ConvertedMessages& outputs,
                        const Message& source);
+
+    virtual void DemuxBatch(std::vector<ConvertedMessages>& outputs,
+                            const std::vector<Message>& sources);
     
   public:
     LuaFilter(const std::string& name,
               ITimeSeriesManager& manager,
               const std::string& inputTimeSeries);
 
+    virtual ~LuaFilter();
+
+    // The file can either contain Lua source code, or bytecode that
+    // was precompiled by "luac" (or by "luajit -b" if Atom-IT is linked
+    // against LuaJIT)
     void ExecuteFile(const boost::filesystem::path& path);
 
+    // Number of independent Lua states that convert the messages of
+    // one batch in parallel. The outputs are still appended in the
+    // order of the input messages. The Lua global variables are NOT
+    // shared between the states.
+    void SetConcurrency(unsigned int concurrency);
+
+    unsigned int GetConcurrency() const
+    {
+      return workers_.size() + 1;
+    }
+
+    // Name and version of the Lua engine (either the standard Lua
+    // interpreter, or LuaJIT if "ATOMIT_ENABLE_LUAJIT" is set)
+    static const char* GetEngine();
+
     void SetDefaultOutputTimeSeries(const std::string& timeSeries)
     {
       defaultTimeSeries_ = timeSeries;
@@ -57,6 +57,33 @@ namespace AtomIT
     }
   }
 
+
+  size_t MQTTSinkFilter::PushBatch(std::vector<size_t>& failures,
+                                   const std::vector<Message>& messages)
+  {
+    // Only lock the MQTT client once for the whole batch
+    MQTT::MQTTClientWrapper::Accessor  accessor(client_);
+
+    if (accessor.IsConnected())
+    {
+      for (size_t i = 0; i < messages.size(); i++)
+      {
+        LOG(INFO) << "MQTT message sent by filter " << GetName() << ": \""
+                  << messages[i].FormatValue() << "\" (topic " << messages[i].GetMetadata() << ")";
+        accessor.GetClient().Publish(messages[i].GetMetadata(), messages[i].GetValue(), 100);
+      }
+
+      return messages.size();
+    }
+    else
+    {
+      // Failure during the connection attempt: Wait 1s before
+      // trying reconnecting
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1000));
+      return 0;
+    }
+  }
+
     
   MQTTSinkFilter::MQTTSinkFilter(const std::string& name,
                                  ITimeSeriesManager& manager,
@@ -43,6 +43,9 @@ namespace AtomIT
 
   protected:
     virtual PushStatus Push(const Message& message);
+
+    virtual size_t PushBatch(std::vector<size_t>& failures,
+                             const std::vector<Message>& messages);
     
   public:
     MQTTSinkFilter(const std::string& name,
@@ -62,5 +65,13 @@ namespace AtomIT
     virtual void Start();
 
     virtual void Stop();
+
+    // Pushing can block while the remote server is unreachable: This
+    // filter keeps its dedicated thread, and never runs on the shared
+    // pool of the filter scheduler
+    virtual bool GetWakeupTimeSeries(std::string& name) const
+    {
+      return false;
+    }
   };
 }
@@ -0,0 +1,464 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "RollupFilter.h"
+
+#include "../TimeSeries/TimeSeriesAggregator.h"
+
+#include <Core/Logging.h>
+#include <Core/OrthancException.h>
+
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <sstream>
+
+namespace AtomIT
+{
+  static const char* const METADATA = "text/plain";
+
+
+  static std::string FormatDouble(double value)
+  {
+    // 17 significant digits ("max_digits10" in C++11) are needed for
+    // the sums to be parsed back to the very same double
+    std::ostringstream s;
+    s.precision(std::numeric_limits<double>::digits10 + 2);
+    s << value;
+    return s.str();
+  }
+
+
+  class RollupFilter::Output : public boost::noncopyable
+  {
+  private:
+    Aggregation       aggregation_;
+    std::string       timeSeries_;
+    TimeSeriesWriter  writer_;
+    bool              hasLast_;
+    int64_t           last_;  // Start of the last bucket in the output
+
+  public:
+    Output(ITimeSeriesManager& manager,
+           Aggregation aggregation,
+           const std::string& timeSeries) :
+      aggregation_(aggregation),
+      timeSeries_(timeSeries),
+      writer_(manager, timeSeries),
+      hasLast_(false),
+      last_(0)
+    {
+    }
+
+    const std::string& GetTimeSeries() const
+    {
+      return timeSeries_;
+    }
+
+    void Refresh()
+    {
+      TimeSeriesWriter::Transaction transaction(writer_);
+      hasLast_ = transaction.GetLastTimestamp(last_);
+    }
+
+    bool GetLast(int64_t& last) const
+    {
+      last = last_;
+      return hasLast_;
+    }
+
+    void Write(const std::vector<Bucket>& buckets)
+    {
+      std::vector<Message> messages;
+      messages.reserve(buckets.size());
+
+      for (size_t i = 0; i < buckets.size(); i++)
+      {
+        const Bucket& bucket = buckets[i];
+
+        if (hasLast_ &&
+            bucket.start_ <= last_)
+        {
+          // This bucket was already written before a restart
+          continue;
+        }
+
+        messages.push_back(Message());
+        messages.back().SetTimestamp(bucket.start_);
+        messages.back().SetMetadata(METADATA);
+
+        switch (aggregation_)
+        {
+          case Aggregation_Count:
+            messages.back().SetValue(boost::lexical_cast<std::string>(bucket.count_));
+            break;
+
+          case Aggregation_Sum:
+            messages.back().SetValue(FormatDouble(bucket.sum_));
+            break;
+
+          case Aggregation_Min:
+            messages.back().SetValue(bucket.minValue_);
+            break;
+
+          case Aggregation_Max:
+            messages.back().SetValue(bucket.maxValue_);
+            break;
+
+          case Aggregation_Last:
+            messages.back().SetValue(bucket.lastValue_);
+            break;
+
+          default:
+            throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+
+      if (!messages.empty())
+      {
+        if (writer_.Append(messages) != messages.size())
+        {
+          LOG(ERROR) << "Cannot write all the buckets to the rollup time series \""
+                     << timeSeries_ << "\"";
+        }
+
+        hasLast_ = true;
+        last_ = messages.back().GetTimestamp();
+      }
+    }
+  };
+
+
+  int64_t RollupFilter::GetBucketStart(int64_t timestamp) const
+  {
+    // Round towards minus infinity, to cope with negative timestamps
+    int64_t q = timestamp / width_;
+    if (timestamp % width_ < 0)
+    {
+      q--;
+    }
+
+    return q * width_;
+  }
+
+
+  void RollupFilter::Accumulate(std::vector<Bucket>& finalized,
+                                const Message& message)
+  {
+    const int64_t timestamp = message.GetTimestamp();
+
+    if (hasFinalized_ &&
+        timestamp < finalizedEnd_)
+    {
+      lateMessages_++;
+      return;
+    }
+
+    double value;
+    if (!TimeSeriesAggregator::ParseValue(value, message.GetValue()))
+    {
+      ignoredMessages_++;
+      return;
+    }
+
+    const int64_t start = GetBucketStart(timestamp);
+
+    if (hasCurrent_ &&
+        start != current_.start_)
+    {
+      Finalize(finalized);
+    }
+
+    if (hasCurrent_)
+    {
+      current_.count_ += 1;
+      current_.sum_ += value;
+
+      if (value < current_.min_)
+      {
+        current_.min_ = value;
+        current_.minValue_ = message.GetValue();
+      }
+
+      if (value > current_.max_)
+      {
+        current_.max_ = value;
+        current_.maxValue_ = message.GetValue();
+      }
+    }
+    else
+    {
+      hasCurrent_ = true;
+      current_.start_ = start;
+      current_.count_ = 1;
+      current_.sum_ = value;
+      current_.min_ = value;
+      current_.max_ = value;
+      current_.minValue_ = message.GetValue();
+      current_.maxValue_ = message.GetValue();
+    }
+
+    current_.lastValue_ = message.GetValue();
+  }
+
+
+  void RollupFilter::Finalize(std::vector<Bucket>& finalized)
+  {
+    if (hasCurrent_)
+    {
+      finalized.push_back(current_);
+
+      hasCurrent_ = false;
+      hasFinalized_ = true;
+
+      if (current_.start_ > std::numeric_limits<int64_t>::max() - width_)
+      {
+        finalizedEnd_ = std::numeric_limits<int64_t>::max();
+      }
+      else
+      {
+        finalizedEnd_ = current_.start_ + width_;
+      }
+    }
+  }
+
+
+  void RollupFilter::Write(const std::vector<Bucket>& finalized)
+  {
+    if (!finalized.empty())
+    {
+      for (size_t i = 0; i < outputs_.size(); i++)
+      {
+        outputs_[i]->Write(finalized);
+      }
+
+      finalizedBuckets_ += finalized.size();
+    }
+  }
+
+
+  AdapterFilter::PushStatus RollupFilter::Push(const Message& message)
+  {
+    std::vector<size_t> failures;
+    PushBatch(failures, std::vector<Message>(1, message));
+    return PushStatus_Success;
+  }
+
+
+  size_t RollupFilter::PushBatch(std::vector<size_t>& failures,
+                                 const std::vector<Message>& messages)
+  {
+    std::vector<Bucket> finalized;
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      Accumulate(finalized, messages[i]);
+    }
+
+    // The buckets that are finalized by the batch are written with
+    // one transaction per output
+    Write(finalized);
+
+    if (!messages.empty())
+    {
+      lastActivity_ = boost::posix_time::microsec_clock::universal_time();
+    }
+
+    return messages.size();
+  }
+
+
+  RollupFilter::RollupFilter(const std::string& name,
+                             ITimeSeriesManager& manager,
+                             const std::string& inputTimeSeries,
+                             int64_t bucketWidth) :
+    AdapterFilter(name, manager, inputTimeSeries),
+    manager_(manager),
+    width_(bucketWidth),
+    finalizationTimeout_(0),
+    hasCurrent_(false),
+    hasFinalized_(false),
+    finalizedEnd_(0),
+    finalizedBuckets_(0),
+    lateMessages_(0),
+    ignoredMessages_(0)
+  {
+    if (bucketWidth <= 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    // By default, aggregate the messages that are already stored
+    SetReplayHistory(true);
+  }
+
+
+  RollupFilter::~RollupFilter()
+  {
+    for (size_t i = 0; i < outputs_.size(); i++)
+    {
+      assert(outputs_[i] != NULL);
+      delete outputs_[i];
+    }
+  }
+
+
+  void RollupFilter::AddOutput(Aggregation aggregation,
+                               const std::string& timeSeries)
+  {
+    outputs_.push_back(new Output(manager_, aggregation, timeSeries));
+  }
+
+
+  void RollupFilter::Start()
+  {
+    AdapterFilter::Start();
+
+    hasCurrent_ = false;
+    hasFinalized_ = false;
+    lastActivity_ = boost::posix_time::microsec_clock::universal_time();
+
+    if (outputs_.empty())
+    {
+      LOG(ERROR) << "The rollup filter \"" << GetName() << "\" has no output";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    // Resume after the last bucket that is written to all the
+    // outputs. The bucket that is still open at the time of the
+    // shutdown is computed again from the input time series.
+    bool resume = true;
+    int64_t last = std::numeric_limits<int64_t>::max();
+
+    for (size_t i = 0; i < outputs_.size(); i++)
+    {
+      outputs_[i]->Refresh();
+
+      int64_t tmp;
+      if (outputs_[i]->GetLast(tmp))
+      {
+        last = std::min(last, tmp);
+      }
+      else
+      {
+        resume = false;
+      }
+    }
+
+    if (resume)
+    {
+      const int64_t end = (last > std::numeric_limits<int64_t>::max() - width_ ?
+                           std::numeric_limits<int64_t>::max() :
+                           GetBucketStart(last) + width_);
+
+      LOG(INFO) << "Rollup filter \"" << GetName() << "\" resumes at timestamp " << end;
+
+      hasFinalized_ = true;
+      finalizedEnd_ = end;
+      SetReadingHead(end - 1);
+    }
+  }
+
+
+  bool RollupFilter::TryStep(bool& idle)
+  {
+    if (!AdapterFilter::TryStep(idle))
+    {
+      return false;
+    }
+
+    if (idle &&
+        !HasPendingBatch() &&
+        hasCurrent_ &&
+        finalizationTimeout_ > 0 &&
+        boost::posix_time::microsec_clock::universal_time() >=
+        lastActivity_ + boost::posix_time::milliseconds(finalizationTimeout_))
+    {
+      std::vector<Bucket> finalized;
+      Finalize(finalized);
+      Write(finalized);
+    }
+
+    return true;
+  }
+
+
+  void RollupFilter::FormatStatistics(Json::Value& target)
+  {
+    AdapterFilter::FormatStatistics(target);
+
+    target["bucketWidth"] = boost::lexical_cast<std::string>(width_);
+    target["finalizedBuckets"] = boost::lexical_cast<std::string>(finalizedBuckets_.load());
+    target["lateMessages"] = boost::lexical_cast<std::string>(lateMessages_.load());
+    target["ignoredMessages"] = boost::lexical_cast<std::string>(ignoredMessages_.load());
+
+    Json::Value outputs = Json::arrayValue;
+    for (size_t i = 0; i < outputs_.size(); i++)
+    {
+      outputs.append(outputs_[i]->GetTimeSeries());
+    }
+
+    target["outputs"] = outputs;
+  }
+
+
+  bool RollupFilter::LookupAggregation(Aggregation& target,
+                                       const std::string& name)
+  {
+    if (name == "count")
+    {
+      target = Aggregation_Count;
+    }
+    else if (name == "sum")
+    {
+      target = Aggregation_Sum;
+    }
+    else if (name == "min")
+    {
+      target = Aggregation_Min;
+    }
+    else if (name == "max")
+    {
+      target = Aggregation_Max;
+    }
+    else if (name == "last")
+    {
+      target = Aggregation_Last;
+    }
+    else
+    {
+      return false;
+    }
+
+    return true;
+  }
+}
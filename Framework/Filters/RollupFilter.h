@@ -0,0 +1,152 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "AdapterFilter.h"
+
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace AtomIT
+{
+  /**
+   * Incrementally maintains time-bucketed aggregates (continuous
+   * aggregates) of the numeric values of one input time series. Each
+   * aggregation is written to its own output time series, with one
+   * message per bucket whose timestamp is the start of the bucket.
+   * The buckets are aligned on the multiples of their width.
+   *
+   * A bucket is finalized (i.e. written) as soon as a message of a
+   * later bucket is received, or after some inactivity if a
+   * finalization timeout is set. The messages of an already finalized
+   * bucket are dropped. On restart, the filter resumes right after the
+   * last bucket that was written to all of its outputs, which makes
+   * it restart-safe with persistent (SQLite) output time series. The
+   * buckets that are computed again are not duplicated.
+   **/
+  class RollupFilter : public AdapterFilter
+  {
+  public:
+    enum Aggregation
+    {
+      Aggregation_Count,
+      Aggregation_Sum,
+      Aggregation_Min,
+      Aggregation_Max,
+      Aggregation_Last
+    };
+
+  private:
+    struct Bucket
+    {
+      int64_t      start_;
+      uint64_t     count_;
+      double       sum_;
+      double       min_;
+      double       max_;
+
+      // The textual values are kept, to be written verbatim
+      std::string  minValue_;
+      std::string  maxValue_;
+      std::string  lastValue_;
+    };
+
+    class Output;
+
+    ITimeSeriesManager&       manager_;
+    int64_t                   width_;
+    unsigned int              finalizationTimeout_;  // In milliseconds
+    std::vector<Output*>      outputs_;
+    bool                      hasCurrent_;
+    Bucket                    current_;
+    bool                      hasFinalized_;
+    int64_t                   finalizedEnd_;  // End of the last finalized bucket
+    boost::posix_time::ptime  lastActivity_;
+
+    boost::atomic<uint64_t>   finalizedBuckets_;
+    boost::atomic<uint64_t>   lateMessages_;
+    boost::atomic<uint64_t>   ignoredMessages_;
+
+    int64_t GetBucketStart(int64_t timestamp) const;
+
+    void Accumulate(std::vector<Bucket>& finalized,
+                    const Message& message);
+
+    void Finalize(std::vector<Bucket>& finalized);
+
+    void Write(const std::vector<Bucket>& finalized);
+
+  protected:
+    virtual PushStatus Push(const Message& message);
+
+    virtual size_t PushBatch(std::vector<size_t>& failures,
+                             const std::vector<Message>& messages);
+
+  public:
+    RollupFilter(const std::string& name,
+                 ITimeSeriesManager& manager,
+                 const std::string& inputTimeSeries,
+                 int64_t bucketWidth);
+
+    virtual ~RollupFilter();
+
+    void AddOutput(Aggregation aggregation,
+                   const std::string& timeSeries);
+
+    int64_t GetBucketWidth() const
+    {
+      return width_;
+    }
+
+    // Finalizes the current bucket if no message was received during
+    // this delay. Zero (the default) means that the current bucket
+    // is only finalized once a message of a later bucket is received.
+    void SetFinalizationTimeout(unsigned int milliseconds)
+    {
+      finalizationTimeout_ = milliseconds;
+    }
+
+    unsigned int GetFinalizationTimeout() const
+    {
+      return finalizationTimeout_;
+    }
+
+    virtual void Start();
+
+    virtual bool TryStep(bool& idle);
+
+    virtual void FormatStatistics(Json::Value& target);
+
+    static bool LookupAggregation(Aggregation& target,
+                                  const std::string& name);
+  };
+}
@@ -56,6 +56,39 @@ namespace AtomIT
   }
     
 
+  size_t SharedFileSinkFilter::PushBatch(std::vector<size_t>& failures,
+                                         const std::vector<Message>& messages)
+  {
+    if (writer_.get() == NULL)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    // Write the whole batch at once, so as to lock the shared file
+    // only once. Messages that cannot be encoded are skipped.
+    std::string buffer, encoded;
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      if (Encode(encoded, GetInputTimeSeries(), messages[i]))
+      {
+        buffer += encoded;
+      }
+      else
+      {
+        failures.push_back(i);
+      }
+    }
+
+    if (!buffer.empty())
+    {
+      writer_->Write(buffer);
+    }
+
+    return messages.size();
+  }
+    
+
   SharedFileSinkFilter::SharedFileSinkFilter(const std::string& name,
                                              ITimeSeriesManager& manager,
                                              const std::string& timeSeries,
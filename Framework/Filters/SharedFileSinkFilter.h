@@ -53,6 +53,9 @@ namespace AtomIT
                         const Message& message) = 0;
 
     virtual PushStatus Push(const Message& message);
+
+    virtual size_t PushBatch(std::vector<size_t>& failures,
+                             const std::vector<Message>& messages);
     
   public:
     SharedFileSinkFilter(const std::string& name,
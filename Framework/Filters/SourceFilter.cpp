@@ -31,39 +31,19 @@
 
 #include "SourceFilter.h"
 
-#include "../TimeSeries/TimeSeriesReader.h"
 
 #include <Core/OrthancException.h>
 #include <Core/Logging.h>
 
+#include <algorithm>
+
 namespace AtomIT
 {
-  bool SourceFilter::WaitForRoom()
+  unsigned int SourceFilter::WaitForRoom()
   {
-    if (maxMessages_ != 0)
-    {
-      TimeSeriesReader reader(manager_, timeSeries_, true);
-
-      {
-        uint64_t length, size;
-
-        TimeSeriesReader::Transaction transaction(reader);
-        transaction.GetStatistics(length, size);
-
-        if (length < maxMessages_)
-        {
-          return true;
-        }
-      }
-
-      // Too many pending messages in the output stream, wait a bit
-      reader.WaitModification(100);
-      return false;
-    }
-    else
-    {
-      return true;
-    }
+    // If there are too many pending messages in the output stream,
+    // wait a bit for the consumers
+    return std::min(batchSize_, flowControl_.WaitForCredits(writer_, 100));
   }
 
 
@@ -71,10 +51,9 @@ namespace AtomIT
                              ITimeSeriesManager& manager,
                              const std::string& timeSeries) :
     name_(name),
-    manager_(manager),
     timeSeries_(timeSeries),
     writer_(manager, timeSeries),
-    maxMessages_(0),
+    batchSize_(1),
     defaultTimestampType_(TimestampType_Default)
   {
   }
@@ -95,9 +74,28 @@ namespace AtomIT
   }
 
 
+  void SourceFilter::SetBatchSize(unsigned int size)
+  {
+    if (size == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    batchSize_ = size;
+  }
+
+
   bool SourceFilter::Step()
   {
-    if (WaitForRoom())
+    unsigned int room = WaitForRoom();
+
+    std::vector<Message> batch;
+    batch.reserve(room);
+
+    bool done = false;
+
+    while (!done &&
+           batch.size() < room)
     {
       Message message;
       message.SetTimestampType(defaultTimestampType_);
@@ -110,15 +108,19 @@ namespace AtomIT
           LOG(INFO) << "Message received by filter " << GetName() << ": \""
                     << message.FormatValue()
                     << "\" (metadata \"" << message.GetMetadata() << "\")";
-            
-          writer_.Append(message);
+
+          batch.push_back(message);
           break;
 
         case FetchStatus_Invalid:
+          // No message is pending (or the message was invalid), flush
+          // the current batch to keep latency low
+          room = 0;
           break;
 
         case FetchStatus_Done:
-          return false;
+          done = true;
+          break;
 
         default:
           throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
@@ -126,6 +128,23 @@ namespace AtomIT
       }
     }
 
-    return true;
+    if (batch.size() == 1)
+    {
+      writer_.Append(batch.front());
+    }
+    else if (!batch.empty())
+    {
+      writer_.Append(batch);
+    }
+
+    return !done;
+  }
+
+
+  void SourceFilter::FormatStatistics(Json::Value& target)
+  {
+    target = Json::objectValue;
+    target["output"] = timeSeries_;
+    flowControl_.Format(target["flowControl"]);
   }
 }
@@ -31,8 +31,8 @@
 
 #pragma once
 
+#include "FlowControl.h"
 #include "IFilter.h"
-#include "../TimeSeries/TimeSeriesWriter.h"
 
 namespace AtomIT
 {
@@ -41,13 +41,13 @@ namespace AtomIT
   {
   private:
     std::string             name_;
-    ITimeSeriesManager&     manager_;
     std::string             timeSeries_;
     TimeSeriesWriter        writer_;
-    unsigned int            maxMessages_;
+    FlowControl             flowControl_;
+    unsigned int            batchSize_;
     TimestampType           defaultTimestampType_;
 
-    bool WaitForRoom();
+    unsigned int WaitForRoom();
 
   protected:
     enum FetchStatus
@@ -76,12 +76,22 @@ namespace AtomIT
 
     void SetMaxPendingMessages(unsigned int count)
     {
-      maxMessages_ = count;
+      flowControl_.SetMaxPendingMessages(count);
     }
 
     unsigned int GetMaxPendingMessages() const
     {
-      return maxMessages_;
+      return flowControl_.GetMaxPendingMessages();
+    }
+
+    // Maximum number of messages that are fetched by one call to
+    // "Step()", then appended to the output time series within one
+    // single transaction
+    void SetBatchSize(unsigned int size);
+
+    unsigned int GetBatchSize() const
+    {
+      return batchSize_;
     }
     
     virtual std::string GetName() const
@@ -98,5 +108,7 @@ namespace AtomIT
     virtual void Stop()
     {
     }
+
+    virtual void FormatStatistics(Json::Value& target);
   };
 }
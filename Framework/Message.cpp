@@ -114,4 +114,47 @@ namespace AtomIT
       result["base64"] = true;
     }
   }
+
+
+  void Message::Parse(const Json::Value& source)
+  {
+    static const char* TIMESTAMP = "timestamp";
+    static const char* METADATA = "metadata";
+    static const char* VALUE = "value";
+    static const char* BASE64 = "base64";
+
+    if (source.type() != Json::objectValue ||
+        !source.isMember(VALUE) ||
+        source[VALUE].type() != Json::stringValue ||
+        (source.isMember(TIMESTAMP) && !source[TIMESTAMP].isIntegral()) ||
+        (source.isMember(METADATA) && source[METADATA].type() != Json::stringValue) ||
+        (source.isMember(BASE64) && source[BASE64].type() != Json::booleanValue))
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+    }
+
+    if (source.isMember(TIMESTAMP))
+    {
+      SetTimestamp(source[TIMESTAMP].asInt64());
+    }
+
+    if (source.isMember(METADATA))
+    {
+      metadata_ = source[METADATA].asString();
+    }
+    else
+    {
+      metadata_.clear();
+    }
+
+    if (source.isMember(BASE64) &&
+        source[BASE64].asBool())
+    {
+      Orthanc::Toolbox::DecodeBase64(value_, source[VALUE].asString());
+    }
+    else
+    {
+      value_ = source[VALUE].asString();
+    }
+  }
 }
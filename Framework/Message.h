@@ -94,5 +94,8 @@ namespace AtomIT
     std::string FormatValue() const;
 
     void Format(Json::Value& result) const;
+
+    // Reverse operation of "Format()"
+    void Parse(const Json::Value& source);
   };
 }
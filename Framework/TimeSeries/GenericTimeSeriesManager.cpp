@@ -87,6 +87,18 @@ namespace AtomIT
       LOG(INFO) << "Time series deleted: " << name_;
     }
 
+    // Notifies the observers of a modification that was not done
+    // through an accessor (e.g. the commit of a group by SQLite)
+    void NotifyCommitted()
+    {
+      BackendLock lock(mutex_);
+
+      if (backend_.get() != NULL)
+      {
+        NotifyModification(lock);
+      }
+    }
+
     void Delete()
     {
       ExclusiveLock lock(mutex_);
@@ -133,8 +145,14 @@ namespace AtomIT
     void RegisterObserver(ITimeSeriesObserver& observer)
     {
       ExclusiveLock lock(mutex_);
-        
-      if (observers_.find(&observer) != observers_.end())
+
+      if (backend_.get() == NULL)
+      {
+        // The lookup of the series by the manager raced with its
+        // deletion: The observer would never be notified
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InexistentItem);
+      }
+      else if (observers_.find(&observer) != observers_.end())
       {
         LOG(ERROR) << "Cannot register twice the same observer";
         throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
@@ -247,7 +265,7 @@ namespace AtomIT
     {
       boost::mutex::scoped_lock lock(mutex_);
       isModified_ = true;
-      condition_.notify_one();
+      condition_.notify_all();
     }
       
     virtual void NotifySeriesDeleted(const std::string& name)
@@ -290,40 +308,162 @@ namespace AtomIT
     }
   };
 
-    
-  boost::shared_ptr<GenericTimeSeriesManager::TimeSeries>&
-  GenericTimeSeriesManager::GetTimeSeries(const std::string& name)
+
+  class GenericTimeSeriesManager::ReadySet :
+    public ISeriesReadySet,
+    private ITimeSeriesObserver
   {
-    Content::iterator found = content_.find(name);
+  private:
+    typedef std::map< std::string, boost::shared_ptr<TimeSeries> >  Watched;
+
+    GenericTimeSeriesManager&  manager_;
+    Watched                    watched_;  // Only accessed by the owner thread
+    boost::mutex               mutex_;
+    boost::condition_variable  condition_;
+    std::set<std::string>      ready_;
+
+    void NotifyModification(const std::string& name)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      ready_.insert(name);
+      condition_.notify_all();
+    }
+
+    virtual void NotifySeriesDeleted(const std::string& name)
+    {
+      NotifyModification(name);
+    }
+
+    virtual void NotifySeriesModified(const std::string& name)
+    {
+      NotifyModification(name);
+    }
 
-    if (found == content_.end())
+  public:
+    explicit ReadySet(GenericTimeSeriesManager& manager) :
+      manager_(manager)
     {
-      TimestampType timestampType;
-      std::auto_ptr<ITimeSeriesBackend> backend
-        (factory_->CreateAutoTimeSeries(timestampType, name));
+    }
 
-      if (backend.get() != NULL)
+    virtual ~ReadySet()
+    {
+      for (Watched::iterator it = watched_.begin(); it != watched_.end(); ++it)
       {
-        LOG(WARNING) << "Auto-creation of time series: " << name;
-        boost::shared_ptr<TimeSeries> series
-          (new TimeSeries(name, backend.release(), timestampType));
-        content_[name] = series;
-        return content_[name];
+        it->second->UnregisterObserver(*this);
       }
-      else
+    }
+
+    virtual void Add(const std::string& name)
+    {
+      if (watched_.find(name) == watched_.end())
       {
-        LOG(ERROR) << "Unknown time series: " << name;
-        throw Orthanc::OrthancException(Orthanc::ErrorCode_InexistentItem);
+        boost::shared_ptr<TimeSeries> series = manager_.GetTimeSeries(name);
+        series->RegisterObserver(*this);
+        watched_[name] = series;
       }
     }
-    else
+
+    virtual void Remove(const std::string& name)
+    {
+      Watched::iterator found = watched_.find(name);
+
+      if (found != watched_.end())
+      {
+        found->second->UnregisterObserver(*this);
+        watched_.erase(found);
+
+        boost::mutex::scoped_lock lock(mutex_);
+        ready_.erase(name);
+      }
+    }
+
+    virtual bool Wait(std::set<std::string>& ready,
+                      unsigned int milliseconds)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      ready.clear();
+
+      while (ready_.empty())
+      {
+        if (!condition_.timed_wait(lock, boost::posix_time::milliseconds(milliseconds)))
+        {
+          return false;
+        }
+      }
+
+      ready.swap(ready_);
+      return true;
+    }
+  };
+
+    
+  boost::shared_ptr<const GenericTimeSeriesManager::Content>
+  GenericTimeSeriesManager::GetSnapshot() const
+  {
+    return boost::atomic_load(&content_);
+  }
+
+
+  void GenericTimeSeriesManager::Publish(Content* content)
+  {
+    boost::shared_ptr<const Content> snapshot(content);
+    boost::atomic_store(&content_, snapshot);
+  }
+
+    
+  boost::shared_ptr<GenericTimeSeriesManager::TimeSeries>
+  GenericTimeSeriesManager::GetTimeSeries(const std::string& name)
+  {
+    {
+      // Fast path: Lookup of an existing series, without locking
+      boost::shared_ptr<const Content> snapshot = GetSnapshot();
+
+      Content::const_iterator found = snapshot->find(name);
+      if (found != snapshot->end())
+      {
+        return found->second;
+      }
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // Check again, as another thread might have auto-created the
+    // series in the meantime
+    boost::shared_ptr<const Content> snapshot = GetSnapshot();
+
+    Content::const_iterator found = snapshot->find(name);
+    if (found != snapshot->end())
     {
       return found->second;
     }
+
+    TimestampType timestampType;
+    std::auto_ptr<ITimeSeriesBackend> backend
+      (factory_->CreateAutoTimeSeries(timestampType, name));
+
+    if (backend.get() != NULL)
+    {
+      LOG(WARNING) << "Auto-creation of time series: " << name;
+      boost::shared_ptr<TimeSeries> series
+        (new TimeSeries(name, backend.release(), timestampType));
+
+      std::auto_ptr<Content> content(new Content(*snapshot));
+      (*content) [name] = series;
+      Publish(content.release());
+
+      return series;
+    }
+    else
+    {
+      LOG(ERROR) << "Unknown time series: " << name;
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InexistentItem);
+    }
   }
     
   
   GenericTimeSeriesManager::GenericTimeSeriesManager(ITimeSeriesFactory* factory) :
+    content_(new Content),
     factory_(factory)
   {
     if (factory == NULL)
@@ -340,15 +480,28 @@ namespace AtomIT
     {
       CreateTimeSeries(it->first, it->second);
     }
+
+    factory->SetCommitObserver(this);
   }
 
   
   GenericTimeSeriesManager::~GenericTimeSeriesManager()
   {
-    for (Content::iterator it = content_.begin();
-         it != content_.end(); ++it)
+    // Unregister before the factory (and its backends) are destroyed
+    factory_->SetCommitObserver(NULL);
+    content_.reset();
+  }
+
+
+  void GenericTimeSeriesManager::NotifySeriesModified(const std::string& name)
+  {
+    // Don't use "GetTimeSeries()", as it could auto-create the series
+    boost::shared_ptr<const Content> snapshot = GetSnapshot();
+
+    Content::const_iterator found = snapshot->find(name);
+    if (found != snapshot->end())
     {
-      it->second.reset();
+      found->second->NotifyCommitted();
     }
   }
   
@@ -356,8 +509,6 @@ namespace AtomIT
   void GenericTimeSeriesManager::Register(ITimeSeriesObserver& observer,
                                           const std::string& timeSeries)
   {
-    boost::mutex::scoped_lock lock(mutex_);
-
     try
     {
       GetTimeSeries(timeSeries)->RegisterObserver(observer);
@@ -372,8 +523,6 @@ namespace AtomIT
   void GenericTimeSeriesManager::Unregister(ITimeSeriesObserver& observer,
                                             const std::string& timeSeries)
   {
-    boost::mutex::scoped_lock lock(mutex_);
-
     try
     {
       GetTimeSeries(timeSeries)->UnregisterObserver(observer);
@@ -387,12 +536,12 @@ namespace AtomIT
 
   void GenericTimeSeriesManager::ListTimeSeries(std::set<std::string>& target)
   {
-    boost::mutex::scoped_lock lock(mutex_);
+    boost::shared_ptr<const Content> snapshot = GetSnapshot();
 
     target.clear();
 
-    for (Content::const_iterator it = content_.begin();
-         it != content_.end(); ++it)
+    for (Content::const_iterator it = snapshot->begin();
+         it != snapshot->end(); ++it)
     {
       target.insert(it->first);
     }
@@ -406,7 +555,9 @@ namespace AtomIT
 
     LOG(WARNING) << "Creating time series: " << name;
 
-    if (content_.find(name) != content_.end())
+    boost::shared_ptr<const Content> snapshot = GetSnapshot();
+
+    if (snapshot->find(name) != snapshot->end())
     {
       LOG(ERROR) << "Cannot create twice the same time series: " << name;
       throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
@@ -415,7 +566,10 @@ namespace AtomIT
     {
       std::auto_ptr<ITimeSeriesBackend> backend(factory_->CreateManualTimeSeries(name));
       boost::shared_ptr<TimeSeries> series(new TimeSeries(name, backend.release(), timestampType));
-      content_[name] = series;
+
+      std::auto_ptr<Content> content(new Content(*snapshot));
+      (*content) [name] = series;
+      Publish(content.release());
     }
   }
 
@@ -424,17 +578,22 @@ namespace AtomIT
   {
     boost::mutex::scoped_lock lock(mutex_);
 
-    Content::iterator found = content_.find(name);
+    std::auto_ptr<Content> content(new Content(*GetSnapshot()));
+
+    Content::iterator found = content->find(name);
 
-    if (found == content_.end())
+    if (found == content->end())
     {
       LOG(ERROR) << "Unknown time series: " << name;
       throw Orthanc::OrthancException(Orthanc::ErrorCode_InexistentItem);
     }
     else
     {
+      // The threads that have looked up the series before its removal
+      // from the snapshot will see an accessor without backend
       found->second->Delete();
-      content_.erase(found);
+      content->erase(found);
+      Publish(content.release());
     }
   }
 
@@ -442,8 +601,6 @@ namespace AtomIT
   ITimeSeriesAccessor* GenericTimeSeriesManager::CreateAccessor(const std::string& name,
                                                                 bool hasSynchronousWait)
   {
-    boost::mutex::scoped_lock lock(mutex_);
-
     boost::shared_ptr<TimeSeries> series(GetTimeSeries(name));
 
     if (hasSynchronousWait)
@@ -455,4 +612,11 @@ namespace AtomIT
       return new Accessor(series);
     }
   }
+
+
+  
+  ISeriesReadySet* GenericTimeSeriesManager::CreateReadySet()
+  {
+    return new ReadySet(*this);
+  }
 }
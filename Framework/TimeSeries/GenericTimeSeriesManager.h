@@ -35,24 +35,47 @@
 #include "ITimeSeriesManager.h"
 
 #include <map>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 
 namespace AtomIT
 {
-  class GenericTimeSeriesManager : public ITimeSeriesManager
+  class GenericTimeSeriesManager :
+    public ITimeSeriesManager,
+    private ITimeSeriesObserver
   {
   private:
     class TimeSeries;
     class Accessor;
     class SynchronousAccessor;
+    class ReadySet;
 
     typedef std::map< std::string, boost::shared_ptr<TimeSeries> >   Content;
-    
+
+    /**
+     * The content is a copy-on-write snapshot: The lookups only
+     * atomically load the current snapshot, and never take
+     * "mutex_". This mutex serializes the creations and deletions of
+     * time series, that publish a modified copy of the snapshot.
+     **/
     boost::mutex                       mutex_;
-    Content                            content_;
+    boost::shared_ptr<const Content>   content_;  // Use "GetSnapshot()"
     std::auto_ptr<ITimeSeriesFactory>  factory_;
+
+    boost::shared_ptr<const Content> GetSnapshot() const;
+
+    // The caller must hold "mutex_"
+    void Publish(Content* content);
     
-    boost::shared_ptr<TimeSeries>& GetTimeSeries(const std::string& name);
+    boost::shared_ptr<TimeSeries> GetTimeSeries(const std::string& name);
+
+    // Notifications from the factory, once delayed modifications
+    // (e.g. SQLite group commit) become visible to the readers
+    virtual void NotifySeriesDeleted(const std::string& name)
+    {
+    }
+
+    virtual void NotifySeriesModified(const std::string& name);
     
   public:
     explicit GenericTimeSeriesManager(ITimeSeriesFactory* factory);
@@ -74,5 +97,7 @@ namespace AtomIT
     
     virtual ITimeSeriesAccessor* CreateAccessor(const std::string& name,
                                                 bool hasSynchronousWait);
+
+    virtual ISeriesReadySet* CreateReadySet();
   };
 }
@@ -31,8 +31,12 @@
 
 #pragma once
 
+#include "ITimeSeriesVisitor.h"
+#include "../Message.h"
+
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include <boost/noncopyable.hpp>
 
 namespace AtomIT
@@ -70,15 +74,39 @@ namespace AtomIT
                         std::string& value,
                         int64_t timestamp) = 0;
 
+      // Visits, by increasing timestamps, the items whose timestamp
+      // lies in the range [start, end[. If "limit" is not zero, at
+      // most "limit" items are visited. Returns the number of
+      // visited items.
+      virtual size_t Scan(int64_t start,
+                          int64_t end,
+                          size_t limit,
+                          ITimeSeriesVisitor& visitor) = 0;
+
       // Returns "false" if not enough space, or if "timestamp <= SeekLast()"
       virtual bool Append(int64_t timestamp,
                           const std::string& metadata,
                           const std::string& value) = 0;
 
+      // All the messages must have a fixed timestamp. Messages that
+      // would be rejected by "Append()" are skipped. Returns the
+      // number of messages that were appended.
+      virtual size_t AppendBatch(const std::vector<Message>& messages) = 0;
+
       virtual void GetStatistics(uint64_t& length,
                                  uint64_t& size) = 0;
 
       virtual bool GetLastTimestamp(int64_t& timestamp) = 0;
+
+      // Optional support for delayed durability (e.g. group commit).
+      // Returns the ticket of the commit of this transaction, that
+      // can be given to "ITimeSeriesBackend::WaitDurable()" once the
+      // transaction is released. Zero means that the changes are
+      // durable as soon as the transaction is released.
+      virtual uint64_t GetDurabilityTicket()
+      {
+        return 0;
+      }
     };
     
     virtual ~ITimeSeriesBackend()
@@ -86,5 +114,12 @@ namespace AtomIT
     }
 
     virtual ITransaction* CreateTransaction(bool isReadOnly) = 0;
+
+    // Waits until the transaction with the given ticket is durably
+    // stored. Throws an exception if the transaction was eventually
+    // rolled back by the backend.
+    virtual void WaitDurable(uint64_t ticket)
+    {
+    }
   };
 }
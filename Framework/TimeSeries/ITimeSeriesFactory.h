@@ -32,6 +32,7 @@
 #pragma once
 
 #include "ITimeSeriesBackend.h"
+#include "ITimeSeriesObserver.h"
 #include "../AtomITEnumerations.h"
 
 #include <map>
@@ -51,5 +52,14 @@ namespace AtomIT
 
     virtual ITimeSeriesBackend* CreateAutoTimeSeries(TimestampType& timestampType /* out */,
                                                      const std::string& name) = 0;
+
+    // Optional support for the backends whose modifications only
+    // become visible to the readers some time after the writer has
+    // released its transaction (e.g. SQLite group commit). The
+    // factory must then call "NotifySeriesModified()" on this
+    // observer (if not NULL) once the modifications are visible.
+    virtual void SetCommitObserver(ITimeSeriesObserver* observer)
+    {
+    }
   };
 }
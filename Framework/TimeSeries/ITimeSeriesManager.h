@@ -33,6 +33,7 @@
 
 #include "ITimeSeriesAccessor.h"
 #include "ITimeSeriesObserver.h"
+#include "ISeriesReadySet.h"
 #include "../AtomITEnumerations.h"
 
 #include <set>
@@ -61,5 +62,7 @@ namespace AtomIT
 
     virtual ITimeSeriesAccessor* CreateAccessor(const std::string& name,
                                                 bool hasSynchronousWait) = 0;
+
+    virtual ISeriesReadySet* CreateReadySet() = 0;
   };
 }
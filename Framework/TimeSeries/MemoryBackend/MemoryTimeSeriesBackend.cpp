@@ -39,13 +39,13 @@ namespace AtomIT
     public ITimeSeriesBackend::ITransaction
   {
   private:
-    ReadLock                        lock_;
-    const MemoryTimeSeriesContent&  content_;
+    ReadLock                         lock_;
+    const IMemoryTimeSeriesContent&  content_;
 
   public:
     explicit ReadOnlyTransaction(MemoryTimeSeriesBackend& that) :
       lock_(that.mutex_),
-      content_(that.content_)
+      content_(*that.content_)
     {
     }
 
@@ -95,6 +95,14 @@ namespace AtomIT
       return content_.Read(metadata, value, timestamp);
     }
 
+    virtual size_t Scan(int64_t start,
+                        int64_t end,
+                        size_t limit,
+                        ITimeSeriesVisitor& visitor)
+    {
+      return content_.Scan(start, end, limit, visitor);
+    }
+
     virtual bool Append(int64_t timestamp,
                         const std::string& metadata,
                         const std::string& value)
@@ -102,6 +110,11 @@ namespace AtomIT
       throw Orthanc::OrthancException(Orthanc::ErrorCode_ReadOnly);
     }
 
+    virtual size_t AppendBatch(const std::vector<Message>& messages)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ReadOnly);
+    }
+
     virtual void GetStatistics(uint64_t& length,
                                uint64_t& size)
     {
@@ -119,13 +132,13 @@ namespace AtomIT
     public ITimeSeriesBackend::ITransaction
   {
   private:
-    WriteLock                 lock_;
-    MemoryTimeSeriesContent&  content_;
+    WriteLock                  lock_;
+    IMemoryTimeSeriesContent&  content_;
 
   public:
     explicit ReadWriteTransaction(MemoryTimeSeriesBackend& that) :
       lock_(that.mutex_),
-      content_(that.content_)
+      content_(*that.content_)
     {
     }
 
@@ -175,6 +188,14 @@ namespace AtomIT
       return content_.Read(metadata, value, timestamp);
     }
 
+    virtual size_t Scan(int64_t start,
+                        int64_t end,
+                        size_t limit,
+                        ITimeSeriesVisitor& visitor)
+    {
+      return content_.Scan(start, end, limit, visitor);
+    }
+
     virtual bool Append(int64_t timestamp,
                         const std::string& metadata,
                         const std::string& value)
@@ -182,6 +203,11 @@ namespace AtomIT
       return content_.Append(timestamp, metadata, value);
     }
 
+    virtual size_t AppendBatch(const std::vector<Message>& messages)
+    {
+      return content_.AppendBatch(messages);
+    }
+
     virtual void GetStatistics(uint64_t& length,
                                uint64_t& size)
     {
@@ -195,6 +221,16 @@ namespace AtomIT
   };
 
 
+  MemoryTimeSeriesBackend::MemoryTimeSeriesBackend(IMemoryTimeSeriesContent* content) :
+    content_(content)
+  {
+    if (content == NULL)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_NullPointer);
+    }
+  }
+
+
   ITimeSeriesBackend::ITransaction*  MemoryTimeSeriesBackend::CreateTransaction(bool isReadOnly)
   {
     if (isReadOnly)
@@ -35,6 +35,7 @@
 #include "../ITimeSeriesBackend.h"
 
 #include <boost/thread.hpp>
+#include <memory>
 
 namespace AtomIT
 {
@@ -48,16 +49,19 @@ namespace AtomIT
     typedef boost::shared_lock<Mutex>  ReadLock;
     typedef boost::unique_lock<Mutex>  WriteLock;
 
-    Mutex                     mutex_;
-    MemoryTimeSeriesContent   content_;
+    Mutex                                     mutex_;
+    std::auto_ptr<IMemoryTimeSeriesContent>   content_;
 
   public:
     MemoryTimeSeriesBackend(uint64_t maxLength,
                             uint64_t maxSize) :
-      content_(maxLength, maxSize)
+      content_(new MemoryTimeSeriesContent(maxLength, maxSize))
     {
     }
 
+    // Takes the ownership of "content"
+    explicit MemoryTimeSeriesBackend(IMemoryTimeSeriesContent* content);
+
     virtual ITransaction* CreateTransaction(bool isReadOnly);
   };
 }
@@ -39,18 +39,18 @@ namespace AtomIT
   class MemoryTimeSeriesContent::Item : public boost::noncopyable
   {
   private:
-    std::string   metadata_;
+    uint32_t      metadata_;  // Index in the dictionary
     std::string   value_;
 
   public:
-    Item(const std::string& metadata,
+    Item(uint32_t metadata,
          const std::string& value) :
       metadata_(metadata),
       value_(value)
     {
     }
 
-    const std::string& GetMetadata() const
+    uint32_t GetMetadata() const
     {
       return metadata_;
     }
@@ -60,7 +60,7 @@ namespace AtomIT
       return value_;
     }
 
-    void SetValue(const std::string& metadata,
+    void SetValue(uint32_t metadata,
                   const std::string& value)
     {
       metadata_ = metadata;
@@ -75,6 +75,7 @@ namespace AtomIT
     {
       Content::iterator oldest = content_.begin();
       size_t oldestSize = oldest->second->GetValue().size();
+      dictionary_.Release(oldest->second->GetMetadata());
       delete oldest->second;
       content_.erase(oldest);
       size_ -= oldestSize;
@@ -123,13 +124,15 @@ namespace AtomIT
         throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
       }
 
-      content_[timestamp] = new Item(metadata, value);
+      content_[timestamp] = new Item(dictionary_.Acquire(metadata), value);
       size_ += value.size();
     }
     else
     {
       size_t oldSize = found->second->GetValue().size();
-      found->second->SetValue(metadata, value);
+      uint32_t id = dictionary_.Acquire(metadata);
+      dictionary_.Release(found->second->GetMetadata());
+      found->second->SetValue(id, value);
       size_ = size_ - oldSize + value.size();
     }
   }
@@ -149,6 +152,7 @@ namespace AtomIT
     for (Content::iterator it = from; it != to; ++it)
     {
       size_ -= it->second->GetValue().size();
+      dictionary_.Release(it->second->GetMetadata());
       delete it->second;
     }
       
@@ -264,13 +268,37 @@ namespace AtomIT
     }
     else
     {
-      metadata.assign(found->second->GetMetadata());
+      metadata.assign(dictionary_.GetValue(found->second->GetMetadata()));
       value.assign(found->second->GetValue());
       return true;
     }
   }
     
 
+  size_t MemoryTimeSeriesContent::Scan(int64_t start,
+                                       int64_t end,
+                                       size_t limit,
+                                       ITimeSeriesVisitor& visitor) const
+  {
+    size_t count = 0;
+
+    for (Content::const_iterator it = content_.lower_bound(start);
+         it != content_.end() && it->first < end; ++it)
+    {
+      count++;
+
+      if (!visitor.Visit(it->first, dictionary_.GetValue(it->second->GetMetadata()),
+                         it->second->GetValue()) ||
+          count == limit)
+      {
+        break;
+      }
+    }
+
+    return count;
+  }
+    
+
   bool MemoryTimeSeriesContent::Append(int64_t timestamp,
                                        const std::string& metadata,
                                        const std::string& value)
@@ -322,6 +350,22 @@ namespace AtomIT
   }
 
 
+  size_t MemoryTimeSeriesContent::AppendBatch(const std::vector<Message>& messages)
+  {
+    size_t count = 0;
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      if (Append(messages[i].GetTimestamp(), messages[i].GetMetadata(), messages[i].GetValue()))
+      {
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+
   void MemoryTimeSeriesContent::GetStatistics(uint64_t& length,
                                               uint64_t& size) const
   {
@@ -339,6 +383,7 @@ namespace AtomIT
     }
 
     content_.clear();
+    dictionary_.Clear();
 
     size_ = 0;
   }
@@ -31,27 +31,28 @@
 
 #pragma once
 
-#include <string>
-#include <stdint.h>
-#include <boost/noncopyable.hpp>
+#include "IMemoryTimeSeriesContent.h"
+#include "MetadataDictionary.h"
+
 #include <map>
 
 namespace AtomIT
 {
   // WARNING: This class is *not* thread-safe
-  class MemoryTimeSeriesContent : public boost::noncopyable
+  class MemoryTimeSeriesContent : public IMemoryTimeSeriesContent
   {
   private:
     class Item;
     
     typedef std::map<int64_t, Item*>  Content;
 
-    Content    content_;
-    uint64_t   size_;
-    uint64_t   maxLength_;
-    uint64_t   maxSize_;
-    bool       hasLastTimestamp_;
-    int64_t    lastTimestamp_;
+    Content             content_;
+    MetadataDictionary  dictionary_;
+    uint64_t            size_;
+    uint64_t            maxLength_;
+    uint64_t            maxSize_;
+    bool                hasLastTimestamp_;
+    int64_t             lastTimestamp_;
 
     void RemoveOldest();
 
@@ -65,35 +66,42 @@ namespace AtomIT
 
     virtual ~MemoryTimeSeriesContent();
     
-    void DeleteRange(int64_t start,
-                     int64_t end);
+    virtual void DeleteRange(int64_t start,
+                             int64_t end);
     
-    bool SeekFirst(int64_t& result) const;
+    virtual bool SeekFirst(int64_t& result) const;
 
-    bool SeekLast(int64_t& result) const;
+    virtual bool SeekLast(int64_t& result) const;
     
-    bool SeekNearest(int64_t& result,
-                     int64_t timestamp) const;
+    virtual bool SeekNearest(int64_t& result,
+                             int64_t timestamp) const;
 
-    bool SeekNext(int64_t& result,
-                  int64_t timestamp) const;
+    virtual bool SeekNext(int64_t& result,
+                          int64_t timestamp) const;
     
-    bool SeekPrevious(int64_t& result,
+    virtual bool SeekPrevious(int64_t& result,
+                              int64_t timestamp) const;
+
+    virtual bool Read(std::string& metadata,
+                      std::string& value,
                       int64_t timestamp) const;
 
-    bool Read(std::string& metadata,
-              std::string& value,
-              int64_t timestamp) const;
+    virtual size_t Scan(int64_t start,
+                        int64_t end,
+                        size_t limit,
+                        ITimeSeriesVisitor& visitor) const;
+
+    virtual bool Append(int64_t timestamp,
+                        const std::string& metadata,
+                        const std::string& value);
 
-    bool Append(int64_t timestamp,
-                const std::string& metadata,
-                const std::string& value);
+    virtual size_t AppendBatch(const std::vector<Message>& messages);
 
-    void GetStatistics(uint64_t& length,
-                       uint64_t& size) const;
+    virtual void GetStatistics(uint64_t& length,
+                               uint64_t& size) const;
 
-    void ClearContent();
+    virtual void ClearContent();
 
-    bool GetLastTimestamp(int64_t& result) const;
+    virtual bool GetLastTimestamp(int64_t& result) const;
   };
 }
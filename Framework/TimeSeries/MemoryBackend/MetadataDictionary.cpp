@@ -0,0 +1,96 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "MetadataDictionary.h"
+
+#include <Core/OrthancException.h>
+
+#include <cassert>
+
+namespace AtomIT
+{
+  uint32_t MetadataDictionary::Acquire(const std::string& metadata)
+  {
+    Index::iterator found = index_.find(metadata);
+
+    if (found != index_.end())
+    {
+      entries_[found->second].references_++;
+      return found->second;
+    }
+
+    uint32_t id;
+
+    if (free_.empty())
+    {
+      id = static_cast<uint32_t>(entries_.size());
+      entries_.push_back(Entry());
+    }
+    else
+    {
+      id = free_.back();
+      free_.pop_back();
+    }
+
+    entries_[id].value_ = metadata;
+    entries_[id].references_ = 1;
+    index_[metadata] = id;
+
+    return id;
+  }
+
+
+  void MetadataDictionary::Release(uint32_t id)
+  {
+    if (id >= entries_.size() ||
+        entries_[id].references_ == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+
+    entries_[id].references_--;
+
+    if (entries_[id].references_ == 0)
+    {
+      index_.erase(entries_[id].value_);
+      entries_[id].value_.clear();
+      free_.push_back(id);
+    }
+  }
+
+
+  void MetadataDictionary::Clear()
+  {
+    entries_.clear();
+    index_.clear();
+    free_.clear();
+  }
+}
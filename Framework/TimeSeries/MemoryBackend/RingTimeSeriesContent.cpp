@@ -0,0 +1,463 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "RingTimeSeriesContent.h"
+
+#include <Core/Logging.h>
+#include <Core/OrthancException.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace AtomIT
+{
+  static const size_t MIN_CAPACITY = 16;
+  static const size_t MIN_ARENA_GARBAGE = 4096;
+
+
+  size_t RingTimeSeriesContent::LowerBound(int64_t timestamp) const
+  {
+    size_t first = 0;
+    size_t count = length_;
+
+    while (count > 0)
+    {
+      size_t step = count / 2;
+      if (GetTimestamp(first + step) < timestamp)
+      {
+        first += step + 1;
+        count -= step + 1;
+      }
+      else
+      {
+        count = step;
+      }
+    }
+
+    return first;
+  }
+
+
+  size_t RingTimeSeriesContent::UpperBound(int64_t timestamp) const
+  {
+    size_t first = 0;
+    size_t count = length_;
+
+    while (count > 0)
+    {
+      size_t step = count / 2;
+      if (GetTimestamp(first + step) <= timestamp)
+      {
+        first += step + 1;
+        count -= step + 1;
+      }
+      else
+      {
+        count = step;
+      }
+    }
+
+    return first;
+  }
+
+
+  void RingTimeSeriesContent::Grow()
+  {
+    size_t capacity = std::max(MIN_CAPACITY, 2 * timestamps_.size());
+
+    if (maxLength_ != 0 &&
+        capacity > maxLength_)
+    {
+      capacity = static_cast<size_t>(maxLength_);
+    }
+
+    assert(capacity > length_);
+
+    // Linearize the ring into the new arrays
+    std::vector<int64_t> timestamps(capacity);
+    std::vector<Item> items(capacity);
+
+    for (size_t i = 0; i < length_; i++)
+    {
+      size_t position = GetPosition(i);
+      timestamps[i] = timestamps_[position];
+      items[i] = items_[position];
+    }
+
+    timestamps_.swap(timestamps);
+    items_.swap(items);
+    head_ = 0;
+  }
+
+
+  void RingTimeSeriesContent::CompactArena()
+  {
+    // Copy the values that are still alive into a new arena. This is
+    // only done once the garbage exceeds the live values, which gives
+    // an amortized constant cost per appended byte.
+    std::string arena;
+    arena.reserve(2 * static_cast<size_t>(size_));
+
+    for (size_t i = 0; i < length_; i++)
+    {
+      Item& item = items_[GetPosition(i)];
+      size_t offset = arena.size();
+      arena.append(arena_, item.valueOffset_, item.valueSize_);
+      item.valueOffset_ = offset;
+    }
+
+    assert(arena.size() == size_);
+    arena_.swap(arena);
+  }
+
+
+  void RingTimeSeriesContent::RemoveOldest()
+  {
+    if (length_ == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+
+    const Item& item = items_[head_];
+    size_ -= item.valueSize_;
+    dictionary_.Release(item.metadata_);
+
+    head_ = (head_ + 1) % timestamps_.size();
+    length_--;
+  }
+
+
+  RingTimeSeriesContent::RingTimeSeriesContent(uint64_t maxLength,
+                                               uint64_t maxSize) :
+    head_(0),
+    length_(0),
+    size_(0),
+    maxLength_(maxLength),
+    maxSize_(maxSize),
+    hasLastTimestamp_(false),
+    lastTimestamp_(0)  // Dummy initialization
+  {
+  }
+
+    
+  void RingTimeSeriesContent::DeleteRange(int64_t start,
+                                          int64_t end)
+  {
+    if (start >= end)
+    {
+      return;
+    }
+
+    size_t from = LowerBound(start);
+    size_t to = LowerBound(end);
+
+    if (from >= to)
+    {
+      return;
+    }
+
+    for (size_t i = from; i < to; i++)
+    {
+      const Item& item = items_[GetPosition(i)];
+      size_ -= item.valueSize_;
+      dictionary_.Release(item.metadata_);
+    }
+
+    if (from == 0)
+    {
+      // Most common case: Popping the oldest items
+      head_ = GetPosition(to);
+    }
+    else
+    {
+      // Move the items after the deleted range
+      for (size_t i = to; i < length_; i++)
+      {
+        size_t source = GetPosition(i);
+        size_t target = GetPosition(i - (to - from));
+        timestamps_[target] = timestamps_[source];
+        items_[target] = items_[source];
+      }
+    }
+
+    length_ -= (to - from);
+
+    if (length_ == 0)
+    {
+      head_ = 0;
+      arena_.clear();
+    }
+  }
+    
+    
+  bool RingTimeSeriesContent::SeekFirst(int64_t& result) const
+  {
+    if (length_ == 0)
+    {
+      return false;
+    }
+    else
+    {
+      result = GetTimestamp(0);
+      return true;
+    }
+  }
+    
+
+  bool RingTimeSeriesContent::SeekLast(int64_t& result) const
+  {
+    if (length_ == 0)
+    {
+      return false;
+    }
+    else
+    {
+      result = GetTimestamp(length_ - 1);
+      return true;
+    }
+  }
+
+    
+  bool RingTimeSeriesContent::SeekNearest(int64_t& result,
+                                          int64_t timestamp) const
+  {
+    size_t index = LowerBound(timestamp);
+
+    if (index == length_)
+    {
+      return false;
+    }
+    else
+    {
+      result = GetTimestamp(index);
+      return true;
+    }
+  }
+    
+
+  bool RingTimeSeriesContent::SeekNext(int64_t& result,
+                                       int64_t timestamp) const
+  {
+    size_t index = UpperBound(timestamp);
+
+    if (index == length_)
+    {
+      return false;
+    }
+    else
+    {
+      result = GetTimestamp(index);
+      return true;
+    }
+  }
+
+    
+  bool RingTimeSeriesContent::SeekPrevious(int64_t& result,
+                                           int64_t timestamp) const
+  {
+    size_t index = LowerBound(timestamp);
+
+    if (index == 0)
+    {
+      return false;
+    }
+    else
+    {
+      result = GetTimestamp(index - 1);
+      return true;
+    }
+  }
+
+
+  bool RingTimeSeriesContent::Read(std::string& metadata,
+                                   std::string& value,
+                                   int64_t timestamp) const
+  {
+    size_t index = LowerBound(timestamp);
+
+    if (index == length_ ||
+        GetTimestamp(index) != timestamp)
+    {
+      return false;
+    }
+    else
+    {
+      const Item& item = items_[GetPosition(index)];
+      metadata.assign(dictionary_.GetValue(item.metadata_));
+      value.assign(arena_, item.valueOffset_, item.valueSize_);
+      return true;
+    }
+  }
+
+
+  size_t RingTimeSeriesContent::Scan(int64_t start,
+                                     int64_t end,
+                                     size_t limit,
+                                     ITimeSeriesVisitor& visitor) const
+  {
+    size_t count = 0;
+    std::string value;
+
+    for (size_t i = LowerBound(start); i < length_; i++)
+    {
+      size_t position = GetPosition(i);
+      if (timestamps_[position] >= end)
+      {
+        break;
+      }
+
+      const Item& item = items_[position];
+      value.assign(arena_, item.valueOffset_, item.valueSize_);
+
+      count++;
+
+      if (!visitor.Visit(timestamps_[position], dictionary_.GetValue(item.metadata_), value) ||
+          count == limit)
+      {
+        break;
+      }
+    }
+
+    return count;
+  }
+    
+
+  bool RingTimeSeriesContent::Append(int64_t timestamp,
+                                     const std::string& metadata,
+                                     const std::string& value)
+  {
+    if ((maxSize_ != 0 &&
+         value.size() > maxSize_) ||
+        value.size() > 0xffffffffu)
+    {
+      LOG(ERROR) << "Cannot append an observation whose size (" << value.size()
+                 << " bytes) is above the max size of the time series (" << maxSize_
+                 << " bytes)";
+      return false;
+    }
+
+    if (hasLastTimestamp_ &&
+        timestamp <= lastTimestamp_)
+    {
+      return false;
+    }
+      
+    if (maxLength_ != 0)
+    {
+      while (length_ + 1 > maxLength_)
+      {
+        RemoveOldest();
+      }
+    }
+
+    if (maxSize_ != 0)
+    {
+      while (size_ + value.size() > maxSize_)
+      {
+        RemoveOldest();
+      }
+    }
+
+    if (length_ == timestamps_.size())
+    {
+      Grow();
+    }
+
+    if (arena_.size() - size_ > std::max(static_cast<size_t>(size_), MIN_ARENA_GARBAGE))
+    {
+      CompactArena();
+    }
+
+    size_t position = GetPosition(length_);
+    timestamps_[position] = timestamp;
+    items_[position].valueOffset_ = arena_.size();
+    items_[position].valueSize_ = static_cast<uint32_t>(value.size());
+    items_[position].metadata_ = dictionary_.Acquire(metadata);
+
+    arena_.append(value);
+    size_ += value.size();
+    length_++;
+
+    hasLastTimestamp_ = true;
+    lastTimestamp_ = timestamp;
+        
+    return true;
+  }
+
+
+  size_t RingTimeSeriesContent::AppendBatch(const std::vector<Message>& messages)
+  {
+    size_t count = 0;
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      if (Append(messages[i].GetTimestamp(), messages[i].GetMetadata(), messages[i].GetValue()))
+      {
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+
+  void RingTimeSeriesContent::GetStatistics(uint64_t& length,
+                                            uint64_t& size) const
+  {
+    length = length_;
+    size = size_;
+  }
+
+  
+  void RingTimeSeriesContent::ClearContent()
+  {
+    head_ = 0;
+    length_ = 0;
+    size_ = 0;
+
+    arena_.clear();
+    dictionary_.Clear();
+  }
+
+  
+  bool RingTimeSeriesContent::GetLastTimestamp(int64_t& result) const
+  {
+    if (hasLastTimestamp_)
+    {
+      result = lastTimestamp_;
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+}
@@ -0,0 +1,138 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "IMemoryTimeSeriesContent.h"
+#include "MetadataDictionary.h"
+
+namespace AtomIT
+{
+  /**
+   * Columnar storage of a time series in RAM. As the timestamps are
+   * strictly increasing, the items are stored in a ring of
+   * contiguous arrays, which are searched by dichotomy. The values
+   * are concatenated in one byte arena, and the metadata are interned
+   * in a dictionary, as they are mostly identical in a time series.
+   *
+   * WARNING: This class is *not* thread-safe.
+   **/
+  class RingTimeSeriesContent : public IMemoryTimeSeriesContent
+  {
+  private:
+    struct Item
+    {
+      size_t    valueOffset_;  // Offset in the arena
+      uint32_t  valueSize_;
+      uint32_t  metadata_;     // Index in the dictionary
+    };
+
+    // The ring: Index "i" (with "0 <= i < length_") of the time
+    // series is stored at position "(head_ + i) % capacity".
+    std::vector<int64_t>   timestamps_;
+    std::vector<Item>      items_;
+    size_t                 head_;
+    size_t                 length_;
+
+    std::string            arena_;
+    MetadataDictionary     dictionary_;
+
+    uint64_t   size_;
+    uint64_t   maxLength_;
+    uint64_t   maxSize_;
+    bool       hasLastTimestamp_;
+    int64_t    lastTimestamp_;
+
+    size_t GetPosition(size_t index) const
+    {
+      return (head_ + index) % timestamps_.size();
+    }
+
+    int64_t GetTimestamp(size_t index) const
+    {
+      return timestamps_[GetPosition(index)];
+    }
+
+    // Index of the first item whose timestamp is >= "timestamp"
+    size_t LowerBound(int64_t timestamp) const;
+
+    // Index of the first item whose timestamp is > "timestamp"
+    size_t UpperBound(int64_t timestamp) const;
+
+    void Grow();
+
+    void CompactArena();
+
+    void RemoveOldest();
+
+  public:
+    RingTimeSeriesContent(uint64_t maxLength,
+                          uint64_t maxSize);
+
+    virtual void DeleteRange(int64_t start,
+                             int64_t end);
+    
+    virtual bool SeekFirst(int64_t& result) const;
+
+    virtual bool SeekLast(int64_t& result) const;
+    
+    virtual bool SeekNearest(int64_t& result,
+                             int64_t timestamp) const;
+
+    virtual bool SeekNext(int64_t& result,
+                          int64_t timestamp) const;
+    
+    virtual bool SeekPrevious(int64_t& result,
+                              int64_t timestamp) const;
+
+    virtual bool Read(std::string& metadata,
+                      std::string& value,
+                      int64_t timestamp) const;
+
+    virtual size_t Scan(int64_t start,
+                        int64_t end,
+                        size_t limit,
+                        ITimeSeriesVisitor& visitor) const;
+
+    virtual bool Append(int64_t timestamp,
+                        const std::string& metadata,
+                        const std::string& value);
+
+    virtual size_t AppendBatch(const std::vector<Message>& messages);
+
+    virtual void GetStatistics(uint64_t& length,
+                               uint64_t& size) const;
+
+    virtual void ClearContent();
+
+    virtual bool GetLastTimestamp(int64_t& result) const;
+  };
+}
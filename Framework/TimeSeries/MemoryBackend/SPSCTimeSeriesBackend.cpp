@@ -0,0 +1,576 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "SPSCTimeSeriesBackend.h"
+
+#include <Core/Logging.h>
+#include <Core/OrthancException.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace AtomIT
+{
+  static const size_t MIN_CAPACITY = 16;
+
+
+  class SPSCTimeSeriesBackend::Transaction : public ITimeSeriesBackend::ITransaction
+  {
+  private:
+    typedef boost::unique_lock<boost::mutex>  Lock;
+
+    SPSCTimeSeriesBackend&  that_;
+    bool                    isReadOnly_;
+    Lock                    producer_;
+    Lock                    consumer_;
+
+    // The head of the ring cannot move while the consumer lock is held
+    void LockConsumer()
+    {
+      if (!consumer_.owns_lock())
+      {
+        consumer_.lock();
+      }
+    }
+
+    // The tail of the ring is only modified by the owner of the
+    // producer lock, and the slots after the tail are reserved to it
+    void LockProducer()
+    {
+      if (isReadOnly_)
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_ReadOnly);
+      }
+
+      if (!producer_.owns_lock())
+      {
+        if (consumer_.owns_lock())
+        {
+          // Always lock the producer side first to avoid deadlocks
+          consumer_.unlock();
+          producer_.lock();
+          consumer_.lock();
+        }
+        else
+        {
+          producer_.lock();
+        }
+      }
+    }
+
+    void GetIndices(uint64_t& head,
+                    uint64_t& tail) const
+    {
+      head = that_.head_.load(boost::memory_order_acquire);
+      tail = that_.tail_.load(boost::memory_order_acquire);
+      assert(head <= tail);
+    }
+
+  public:
+    Transaction(SPSCTimeSeriesBackend& that,
+                bool isReadOnly) :
+      that_(that),
+      isReadOnly_(isReadOnly),
+      producer_(that.producerMutex_, boost::defer_lock),
+      consumer_(that.consumerMutex_, boost::defer_lock)
+    {
+      if (isReadOnly)
+      {
+        LockConsumer();
+      }
+    }
+
+    virtual void ClearContent()
+    {
+      LockProducer();
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      for (uint64_t i = head; i < tail; i++)
+      {
+        Slot& slot = that_.GetSlot(i);
+        slot.metadata_.clear();
+        slot.value_.clear();
+      }
+
+      that_.size_.store(0);
+      that_.head_.store(tail, boost::memory_order_release);
+    }
+
+    virtual void DeleteRange(int64_t start,
+                             int64_t end)
+    {
+      if (start >= end)
+      {
+        return;
+      }
+
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      uint64_t from = that_.LowerBound(head, tail, start);
+      uint64_t to = that_.LowerBound(head, tail, end);
+
+      if (from >= to)
+      {
+        return;
+      }
+
+      if (from != head)
+      {
+        // Deleting in the middle of the ring moves the tail
+        LockProducer();
+        GetIndices(head, tail);
+        from = that_.LowerBound(head, tail, start);
+        to = that_.LowerBound(head, tail, end);
+
+        if (from >= to)
+        {
+          return;
+        }
+      }
+
+      uint64_t removed = 0;
+
+      for (uint64_t i = from; i < to; i++)
+      {
+        Slot& slot = that_.GetSlot(i);
+        removed += slot.value_.size();
+        slot.metadata_.clear();
+        slot.value_.clear();
+      }
+
+      that_.size_.fetch_sub(removed);
+
+      if (from == head)
+      {
+        // Most common case: The consumer pops the oldest items, which
+        // doesn't interfere with the producer
+        that_.head_.store(to, boost::memory_order_release);
+      }
+      else
+      {
+        for (uint64_t i = to; i < tail; i++)
+        {
+          Slot& source = that_.GetSlot(i);
+          Slot& target = that_.GetSlot(i - (to - from));
+          target.timestamp_ = source.timestamp_;
+          target.metadata_.swap(source.metadata_);
+          target.value_.swap(source.value_);
+        }
+
+        that_.tail_.store(tail - (to - from), boost::memory_order_release);
+      }
+    }
+
+    virtual bool SeekFirst(int64_t& result)
+    {
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      if (head == tail)
+      {
+        return false;
+      }
+      else
+      {
+        result = that_.GetSlot(head).timestamp_;
+        return true;
+      }
+    }
+
+    virtual bool SeekLast(int64_t& result)
+    {
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      if (head == tail)
+      {
+        return false;
+      }
+      else
+      {
+        result = that_.GetSlot(tail - 1).timestamp_;
+        return true;
+      }
+    }
+
+    virtual bool SeekNearest(int64_t& result,
+                             int64_t timestamp)
+    {
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      uint64_t index = that_.LowerBound(head, tail, timestamp);
+
+      if (index == tail)
+      {
+        return false;
+      }
+      else
+      {
+        result = that_.GetSlot(index).timestamp_;
+        return true;
+      }
+    }
+
+    virtual bool SeekNext(int64_t& result,
+                          int64_t timestamp)
+    {
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      uint64_t index = that_.UpperBound(head, tail, timestamp);
+
+      if (index == tail)
+      {
+        return false;
+      }
+      else
+      {
+        result = that_.GetSlot(index).timestamp_;
+        return true;
+      }
+    }
+
+    virtual bool SeekPrevious(int64_t& result,
+                              int64_t timestamp)
+    {
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      uint64_t index = that_.LowerBound(head, tail, timestamp);
+
+      if (index == head)
+      {
+        return false;
+      }
+      else
+      {
+        result = that_.GetSlot(index - 1).timestamp_;
+        return true;
+      }
+    }
+
+    virtual bool Read(std::string& metadata,
+                      std::string& value,
+                      int64_t timestamp)
+    {
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      uint64_t index = that_.LowerBound(head, tail, timestamp);
+
+      if (index == tail ||
+          that_.GetSlot(index).timestamp_ != timestamp)
+      {
+        return false;
+      }
+      else
+      {
+        const Slot& slot = that_.GetSlot(index);
+        metadata.assign(slot.metadata_);
+        value.assign(slot.value_);
+        return true;
+      }
+    }
+
+    virtual size_t Scan(int64_t start,
+                        int64_t end,
+                        size_t limit,
+                        ITimeSeriesVisitor& visitor)
+    {
+      LockConsumer();
+
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      size_t count = 0;
+
+      for (uint64_t i = that_.LowerBound(head, tail, start); i < tail; i++)
+      {
+        const Slot& slot = that_.GetSlot(i);
+        if (slot.timestamp_ >= end)
+        {
+          break;
+        }
+
+        count++;
+
+        if (!visitor.Visit(slot.timestamp_, slot.metadata_, slot.value_) ||
+            count == limit)
+        {
+          break;
+        }
+      }
+
+      return count;
+    }
+
+    virtual bool Append(int64_t timestamp,
+                        const std::string& metadata,
+                        const std::string& value)
+    {
+      LockProducer();
+
+      if (that_.maxSize_ != 0 &&
+          value.size() > that_.maxSize_)
+      {
+        LOG(ERROR) << "Cannot append an observation whose size (" << value.size()
+                   << " bytes) is above the max size of the time series (" << that_.maxSize_
+                   << " bytes)";
+        return false;
+      }
+
+      int64_t last;
+      if (GetLastTimestamp(last) &&
+          timestamp <= last)
+      {
+        return false;
+      }
+
+      // Slow path: Evict the oldest items to enforce the quotas. The
+      // conditions are checked again once the consumer is locked, as
+      // it might have popped items in the meantime.
+      if ((that_.maxLength_ != 0 &&
+           that_.tail_.load() - that_.head_.load() + 1 > that_.maxLength_) ||
+          (that_.maxSize_ != 0 &&
+           that_.size_.load() + value.size() > that_.maxSize_))
+      {
+        LockConsumer();
+
+        while (that_.maxLength_ != 0 &&
+               that_.tail_.load() - that_.head_.load() + 1 > that_.maxLength_)
+        {
+          that_.RemoveOldest();
+        }
+
+        while (that_.maxSize_ != 0 &&
+               that_.size_.load() + value.size() > that_.maxSize_)
+        {
+          that_.RemoveOldest();
+        }
+      }
+
+      // Slow path: The ring is full
+      if (that_.tail_.load() - that_.head_.load(boost::memory_order_acquire) == that_.slots_.size())
+      {
+        LockConsumer();
+        that_.Grow();
+      }
+
+      // Fast path: Fill the slot after the tail, which cannot be
+      // accessed by the readers until the tail is moved
+      const uint64_t tail = that_.tail_.load(boost::memory_order_relaxed);
+
+      Slot& slot = that_.GetSlot(tail);
+      slot.timestamp_ = timestamp;
+      slot.metadata_.assign(metadata);
+      slot.value_.assign(value);
+
+      that_.size_.fetch_add(value.size());
+      that_.tail_.store(tail + 1, boost::memory_order_release);
+
+      that_.lastTimestamp_.store(timestamp);
+      that_.hasLastTimestamp_.store(true, boost::memory_order_release);
+
+      return true;
+    }
+
+    virtual size_t AppendBatch(const std::vector<Message>& messages)
+    {
+      size_t count = 0;
+
+      for (size_t i = 0; i < messages.size(); i++)
+      {
+        if (Append(messages[i].GetTimestamp(), messages[i].GetMetadata(), messages[i].GetValue()))
+        {
+          count++;
+        }
+      }
+
+      return count;
+    }
+
+    virtual void GetStatistics(uint64_t& length,
+                               uint64_t& size)
+    {
+      // No lock is needed, which makes it cheap to monitor the
+      // number of pending messages
+      uint64_t head, tail;
+      GetIndices(head, tail);
+
+      length = tail - head;
+      size = that_.size_.load();
+    }
+
+    virtual bool GetLastTimestamp(int64_t& result)
+    {
+      if (that_.hasLastTimestamp_.load(boost::memory_order_acquire))
+      {
+        result = that_.lastTimestamp_.load();
+        return true;
+      }
+      else
+      {
+        return false;
+      }
+    }
+  };
+
+
+  uint64_t SPSCTimeSeriesBackend::LowerBound(uint64_t head,
+                                             uint64_t tail,
+                                             int64_t timestamp)
+  {
+    uint64_t first = head;
+    uint64_t count = tail - head;
+
+    while (count > 0)
+    {
+      uint64_t step = count / 2;
+      if (GetSlot(first + step).timestamp_ < timestamp)
+      {
+        first += step + 1;
+        count -= step + 1;
+      }
+      else
+      {
+        count = step;
+      }
+    }
+
+    return first;
+  }
+
+
+  uint64_t SPSCTimeSeriesBackend::UpperBound(uint64_t head,
+                                             uint64_t tail,
+                                             int64_t timestamp)
+  {
+    uint64_t first = head;
+    uint64_t count = tail - head;
+
+    while (count > 0)
+    {
+      uint64_t step = count / 2;
+      if (GetSlot(first + step).timestamp_ <= timestamp)
+      {
+        first += step + 1;
+        count -= step + 1;
+      }
+      else
+      {
+        count = step;
+      }
+    }
+
+    return first;
+  }
+
+
+  void SPSCTimeSeriesBackend::Grow()
+  {
+    const uint64_t head = head_.load();
+    const uint64_t tail = tail_.load();
+
+    // The capacity must remain a power of two. The indices are left
+    // unchanged, so that "GetStatistics()" can run concurrently.
+    std::vector<Slot> slots(std::max(MIN_CAPACITY, 2 * slots_.size()));
+    const uint64_t mask = slots.size() - 1;
+
+    for (uint64_t i = head; i < tail; i++)
+    {
+      Slot& source = GetSlot(i);
+      Slot& target = slots[i & mask];
+      target.timestamp_ = source.timestamp_;
+      target.metadata_.swap(source.metadata_);
+      target.value_.swap(source.value_);
+    }
+
+    slots_.swap(slots);
+    mask_ = mask;
+  }
+
+
+  void SPSCTimeSeriesBackend::RemoveOldest()
+  {
+    const uint64_t head = head_.load();
+
+    if (head == tail_.load())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+
+    Slot& slot = GetSlot(head);
+    size_.fetch_sub(slot.value_.size());
+    slot.metadata_.clear();
+    slot.value_.clear();
+
+    head_.store(head + 1, boost::memory_order_release);
+  }
+
+
+  SPSCTimeSeriesBackend::SPSCTimeSeriesBackend(uint64_t maxLength,
+                                               uint64_t maxSize) :
+    mask_(0),
+    head_(0),
+    tail_(0),
+    size_(0),
+    hasLastTimestamp_(false),
+    lastTimestamp_(0),  // Dummy initialization
+    maxLength_(maxLength),
+    maxSize_(maxSize)
+  {
+  }
+
+
+  ITimeSeriesBackend::ITransaction* SPSCTimeSeriesBackend::CreateTransaction(bool isReadOnly)
+  {
+    return new Transaction(*this, isReadOnly);
+  }
+}
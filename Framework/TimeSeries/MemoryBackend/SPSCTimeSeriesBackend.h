@@ -0,0 +1,107 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../ITimeSeriesBackend.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+
+namespace AtomIT
+{
+  /**
+   * Memory backend optimized for the pipelines where one single
+   * filter appends to the time series, and one single filter consumes
+   * it. The messages are stored in a ring whose head and tail indices
+   * are atomic. The producer side (i.e. appending) and the consumer
+   * side (i.e. reading and popping the oldest messages) are protected
+   * by two distinct mutexes, so that the producer and the consumer
+   * never wait for each other, except if the ring must be grown or if
+   * the quota is reached. Additional readers (e.g. the REST API)
+   * remain possible, but are serialized with the consumer.
+   **/
+  class SPSCTimeSeriesBackend : public ITimeSeriesBackend
+  {
+  private:
+    class Transaction;
+
+    struct Slot
+    {
+      int64_t      timestamp_;
+      std::string  metadata_;
+      std::string  value_;
+    };
+
+    // The item with index "i" (with "head_ <= i < tail_") is stored
+    // in "slots_[i & mask_]". The indices never wrap around.
+    boost::mutex              producerMutex_;
+    boost::mutex              consumerMutex_;
+    std::vector<Slot>         slots_;
+    uint64_t                  mask_;
+    boost::atomic<uint64_t>   head_;
+    boost::atomic<uint64_t>   tail_;
+    boost::atomic<uint64_t>   size_;
+    boost::atomic<bool>       hasLastTimestamp_;
+    boost::atomic<int64_t>    lastTimestamp_;
+    uint64_t                  maxLength_;
+    uint64_t                  maxSize_;
+
+    Slot& GetSlot(uint64_t index)
+    {
+      return slots_[index & mask_];
+    }
+
+    // Index of the first item in [head, tail[ whose timestamp is >=
+    // "timestamp" (or "tail" if none)
+    uint64_t LowerBound(uint64_t head,
+                        uint64_t tail,
+                        int64_t timestamp);
+
+    // Index of the first item in [head, tail[ whose timestamp is >
+    // "timestamp" (or "tail" if none)
+    uint64_t UpperBound(uint64_t head,
+                        uint64_t tail,
+                        int64_t timestamp);
+
+    // The two methods below require both mutexes to be locked
+    void Grow();
+
+    void RemoveOldest();
+
+  public:
+    SPSCTimeSeriesBackend(uint64_t maxLength,
+                          uint64_t maxSize);
+
+    virtual ITransaction* CreateTransaction(bool isReadOnly);
+  };
+}
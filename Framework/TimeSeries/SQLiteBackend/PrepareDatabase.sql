@@ -10,16 +10,39 @@ CREATE TABLE TimeSeries(
        maxSize INTEGER,
        currentLength INTEGER,
        currentSize INTEGER,
-       lastTimestamp INTEGER
+       lastTimestamp INTEGER,
+       blockSize INTEGER DEFAULT 0,
+       tailLength INTEGER    -- Number of messages in "Content"
+       );
+
+-- Dictionary of the metadata, that are shared by all the time series
+CREATE TABLE Metadata(
+       id INTEGER PRIMARY KEY,
+       value TEXT UNIQUE
        );
 
 CREATE TABLE Content(
        id INTEGER REFERENCES TimeSeries(internalId) ON DELETE CASCADE,
        timestamp INTEGER,
        size INTEGER,
-       metadata TEXT,
+       metadata INTEGER REFERENCES Metadata(id),
        value TEXT,
        PRIMARY KEY(id, timestamp)
        );
        
+-- Sealed blocks of the time series using the blocked layout. The
+-- messages that are more recent than the last block are stored in
+-- "Content". The identifiers are never reused, as the decoded
+-- blocks are cached by identifier.
+CREATE TABLE Blocks(
+       blockId INTEGER PRIMARY KEY AUTOINCREMENT,
+       id INTEGER REFERENCES TimeSeries(internalId) ON DELETE CASCADE,
+       firstTimestamp INTEGER,
+       lastTimestamp INTEGER,
+       length INTEGER,
+       size INTEGER,
+       content BLOB
+       );
+
 CREATE INDEX TimeSeriesIndex ON TimeSeries(publicId);
+CREATE INDEX BlocksIndex ON Blocks(id, lastTimestamp);
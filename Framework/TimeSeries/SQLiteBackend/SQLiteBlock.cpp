@@ -0,0 +1,284 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "SQLiteBlock.h"
+
+#include <Core/Compression/ZlibCompressor.h>
+#include <Core/OrthancException.h>
+
+#include <algorithm>
+
+namespace AtomIT
+{
+  static void WriteVarint(std::string& target,
+                          uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      target.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+
+    target.push_back(static_cast<char>(value));
+  }
+
+
+  static void WriteSignedVarint(std::string& target,
+                                int64_t value)
+  {
+    // ZigZag encoding, so that small negative values stay small
+    WriteVarint(target, (static_cast<uint64_t>(value) << 1) ^
+                static_cast<uint64_t>(value >> 63));
+  }
+
+
+  namespace
+  {
+    class Reader : public boost::noncopyable
+    {
+    private:
+      const std::string&  source_;
+      size_t              position_;
+
+    public:
+      explicit Reader(const std::string& source) :
+        source_(source),
+        position_(0)
+      {
+      }
+
+      uint64_t ReadVarint()
+      {
+        uint64_t value = 0;
+
+        for (unsigned int shift = 0; shift < 64; shift += 7)
+        {
+          if (position_ >= source_.size())
+          {
+            throw Orthanc::OrthancException(Orthanc::ErrorCode_CorruptedFile);
+          }
+
+          uint8_t byte = static_cast<uint8_t>(source_[position_++]);
+          value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+          if ((byte & 0x80) == 0)
+          {
+            return value;
+          }
+        }
+
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_CorruptedFile);
+      }
+
+      int64_t ReadSignedVarint()
+      {
+        uint64_t value = ReadVarint();
+        return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+      }
+
+      void ReadString(std::string& target,
+                      uint64_t size)
+      {
+        if (size > source_.size() - position_)
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_CorruptedFile);
+        }
+
+        target.assign(source_, position_, static_cast<size_t>(size));
+        position_ += static_cast<size_t>(size);
+      }
+
+      bool IsDone() const
+      {
+        return position_ == source_.size();
+      }
+    };
+  }
+
+
+  void SQLiteBlock::Append(int64_t timestamp,
+                           const std::string& metadata,
+                           const std::string& value)
+  {
+    if (!timestamps_.empty() &&
+        timestamp <= timestamps_.back())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    // The dictionary is expected to be very small
+    uint32_t index = static_cast<uint32_t>(
+      std::find(dictionary_.begin(), dictionary_.end(), metadata) - dictionary_.begin());
+
+    if (index == dictionary_.size())
+    {
+      dictionary_.push_back(metadata);
+    }
+
+    timestamps_.push_back(timestamp);
+    metadata_.push_back(index);
+    values_.push_back(value);
+    size_ += value.size();
+  }
+
+
+  size_t SQLiteBlock::LowerBound(int64_t timestamp) const
+  {
+    return std::lower_bound(timestamps_.begin(), timestamps_.end(), timestamp) - timestamps_.begin();
+  }
+
+
+  size_t SQLiteBlock::UpperBound(int64_t timestamp) const
+  {
+    return std::upper_bound(timestamps_.begin(), timestamps_.end(), timestamp) - timestamps_.begin();
+  }
+
+
+  void SQLiteBlock::Encode(std::string& target) const
+  {
+    std::string buffer;
+    buffer.reserve(size_ + 4 * timestamps_.size() + 64);
+
+    WriteVarint(buffer, timestamps_.size());
+
+    WriteVarint(buffer, dictionary_.size());
+    for (size_t i = 0; i < dictionary_.size(); i++)
+    {
+      WriteVarint(buffer, dictionary_[i].size());
+      buffer.append(dictionary_[i]);
+    }
+
+    // Delta-of-delta encoding of the timestamps, using modular
+    // arithmetic to avoid overflows
+    uint64_t previous = 0;
+    uint64_t previousDelta = 0;
+    for (size_t i = 0; i < timestamps_.size(); i++)
+    {
+      uint64_t delta = static_cast<uint64_t>(timestamps_[i]) - previous;
+      WriteSignedVarint(buffer, static_cast<int64_t>(delta - previousDelta));
+      previous = static_cast<uint64_t>(timestamps_[i]);
+      previousDelta = delta;
+    }
+
+    for (size_t i = 0; i < metadata_.size(); i++)
+    {
+      WriteVarint(buffer, metadata_[i]);
+    }
+
+    for (size_t i = 0; i < values_.size(); i++)
+    {
+      WriteVarint(buffer, values_[i].size());
+    }
+
+    for (size_t i = 0; i < values_.size(); i++)
+    {
+      buffer.append(values_[i]);
+    }
+
+    Orthanc::ZlibCompressor compressor;
+    compressor.Compress(target, buffer.empty() ? NULL : buffer.c_str(), buffer.size());
+  }
+
+
+  void SQLiteBlock::Decode(const void* data,
+                           size_t size)
+  {
+    std::string buffer;
+
+    {
+      Orthanc::ZlibCompressor compressor;
+      compressor.Uncompress(buffer, data, size);
+    }
+
+    Reader reader(buffer);
+
+    uint64_t length = reader.ReadVarint();
+    if (length > buffer.size())  // Each item takes at least one byte
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_CorruptedFile);
+    }
+
+    timestamps_.resize(static_cast<size_t>(length));
+    metadata_.resize(static_cast<size_t>(length));
+    values_.resize(static_cast<size_t>(length));
+    size_ = 0;
+
+    uint64_t dictionarySize = reader.ReadVarint();
+    if (dictionarySize > buffer.size())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_CorruptedFile);
+    }
+
+    dictionary_.resize(static_cast<size_t>(dictionarySize));
+    for (size_t i = 0; i < dictionary_.size(); i++)
+    {
+      reader.ReadString(dictionary_[i], reader.ReadVarint());
+    }
+
+    uint64_t previous = 0;
+    uint64_t previousDelta = 0;
+    for (size_t i = 0; i < timestamps_.size(); i++)
+    {
+      uint64_t delta = previousDelta + static_cast<uint64_t>(reader.ReadSignedVarint());
+      previous += delta;
+      previousDelta = delta;
+      timestamps_[i] = static_cast<int64_t>(previous);
+    }
+
+    for (size_t i = 0; i < metadata_.size(); i++)
+    {
+      uint64_t index = reader.ReadVarint();
+      if (index >= dictionary_.size())
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_CorruptedFile);
+      }
+
+      metadata_[i] = static_cast<uint32_t>(index);
+    }
+
+    std::vector<uint64_t> sizes(values_.size());
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+      sizes[i] = reader.ReadVarint();
+    }
+
+    for (size_t i = 0; i < values_.size(); i++)
+    {
+      reader.ReadString(values_[i], sizes[i]);
+      size_ += sizes[i];
+    }
+
+    if (!reader.IsDone())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_CorruptedFile);
+    }
+  }
+}
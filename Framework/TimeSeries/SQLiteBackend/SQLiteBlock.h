@@ -0,0 +1,105 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace AtomIT
+{
+  /**
+   * Decoded content of one block of a SQLite time series that uses
+   * the blocked layout. The timestamps are encoded as
+   * delta-of-deltas, the metadata are encoded with a dictionary that
+   * is local to the block, and the whole block is compressed with
+   * zlib. Blocks are immutable once stored in the database.
+   **/
+  class SQLiteBlock : public boost::noncopyable
+  {
+  private:
+    std::vector<int64_t>      timestamps_;
+    std::vector<uint32_t>     metadata_;    // Index in "dictionary_"
+    std::vector<std::string>  dictionary_;
+    std::vector<std::string>  values_;
+    uint64_t                  size_;
+
+  public:
+    SQLiteBlock() :
+      size_(0)
+    {
+    }
+
+    size_t GetLength() const
+    {
+      return timestamps_.size();
+    }
+
+    // Sum of the sizes of the values
+    uint64_t GetSize() const
+    {
+      return size_;
+    }
+
+    int64_t GetTimestamp(size_t index) const
+    {
+      return timestamps_[index];
+    }
+
+    const std::string& GetMetadata(size_t index) const
+    {
+      return dictionary_[metadata_[index]];
+    }
+
+    const std::string& GetValue(size_t index) const
+    {
+      return values_[index];
+    }
+
+    // The timestamps must be appended in strictly increasing order
+    void Append(int64_t timestamp,
+                const std::string& metadata,
+                const std::string& value);
+
+    // Index of the first item whose timestamp is >= "timestamp"
+    size_t LowerBound(int64_t timestamp) const;
+
+    // Index of the first item whose timestamp is > "timestamp"
+    size_t UpperBound(int64_t timestamp) const;
+
+    void Encode(std::string& target) const;
+
+    void Decode(const void* data,
+                size_t size);
+  };
+}
@@ -0,0 +1,106 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "SQLiteBlockCache.h"
+
+#include <Core/OrthancException.h>
+
+namespace AtomIT
+{
+  SQLiteBlockCache::SQLiteBlockCache(size_t capacity) :
+    capacity_(capacity),
+    hits_(0),
+    misses_(0)
+  {
+    if (capacity == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  SQLiteBlockCache::BlockPointer SQLiteBlockCache::Lookup(int64_t id)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Content::iterator found = content_.find(id);
+
+    if (found == content_.end())
+    {
+      misses_++;
+      return BlockPointer();
+    }
+    else
+    {
+      hits_++;
+      recency_.splice(recency_.begin(), recency_, found->second.recency_);
+      return found->second.block_;
+    }
+  }
+
+
+  void SQLiteBlockCache::Store(int64_t id,
+                               const BlockPointer& block)
+  {
+    if (block.get() == NULL)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_NullPointer);
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (content_.find(id) != content_.end())
+    {
+      return;  // Stored in the meantime by another reader
+    }
+
+    while (content_.size() >= capacity_)
+    {
+      content_.erase(recency_.back());
+      recency_.pop_back();
+    }
+
+    recency_.push_front(id);
+
+    Entry& entry = content_[id];
+    entry.block_ = block;
+    entry.recency_ = recency_.begin();
+  }
+
+
+  void SQLiteBlockCache::GetStatistics(uint64_t& hits,
+                                       uint64_t& misses)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    hits = hits_;
+    misses = misses_;
+  }
+}
@@ -0,0 +1,85 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "SQLiteBlock.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+
+namespace AtomIT
+{
+  /**
+   * LRU cache of the decoded blocks of a SQLite database, indexed by
+   * the identifier of the block. As blocks are immutable, and as
+   * their identifiers are never reused once committed (thanks to
+   * "AUTOINCREMENT"), the cache never has to be invalidated: It must
+   * only be filled from transactions that see committed data.
+   **/
+  class SQLiteBlockCache : public boost::noncopyable
+  {
+  public:
+    typedef boost::shared_ptr<const SQLiteBlock>  BlockPointer;
+
+  private:
+    typedef std::list<int64_t>  Recency;
+
+    struct Entry
+    {
+      BlockPointer       block_;
+      Recency::iterator  recency_;
+    };
+
+    typedef std::map<int64_t, Entry>  Content;
+
+    boost::mutex  mutex_;
+    size_t        capacity_;
+    Content       content_;
+    Recency       recency_;  // Most recently used first
+    uint64_t      hits_;
+    uint64_t      misses_;
+
+  public:
+    explicit SQLiteBlockCache(size_t capacity);
+
+    // Returns a NULL pointer if the block is not cached
+    BlockPointer Lookup(int64_t id);
+
+    void Store(int64_t id,
+               const BlockPointer& block);
+
+    void GetStatistics(uint64_t& hits,
+                       uint64_t& misses);
+  };
+}
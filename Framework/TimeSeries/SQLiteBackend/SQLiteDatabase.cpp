@@ -41,40 +41,214 @@
 
 namespace AtomIT
 {
-  SQLiteDatabase::Transaction::Transaction(SQLiteDatabase& database) :
-    lock_(database.mutex_),
-    connection_(database.connection_)
+  static const char* const SAVEPOINT = "AtomIT";
+  static const size_t BLOCK_CACHE_SIZE = 64;  // Number of decoded blocks
+  static const size_t METADATA_CACHE_SIZE = 4096;  // Number of cached metadata
+
+
+  SQLiteDatabase::Transaction::Transaction(SQLiteDatabase& database,
+                                           bool isReadOnly) :
+    lock_(database.mutex_, boost::defer_lock),
+    database_(database),
+    reader_(isReadOnly ? database.AcquireReader() : NULL),
+    connection_(reader_ == NULL ? database.connection_ : *reader_),
+    savepoint_(false),
+    isReadOnly_(isReadOnly)
   {
-    transaction_.reset(new Orthanc::SQLite::Transaction(connection_));
-    transaction_->Begin();
+    if (reader_ != NULL)
+    {
+      try
+      {
+        transaction_.reset(new Orthanc::SQLite::Transaction(connection_));
+        transaction_->Begin();
+      }
+      catch (Orthanc::OrthancException&)
+      {
+        database.ReleaseReader(reader_);
+        throw;
+      }
+
+      return;
+    }
+
+    // Either a read-write transaction, or a read-only transaction
+    // on a database in memory: Lock the main connection
+    if (!lock_.try_lock())
+    {
+      lock_.lock();
+      database.contentions_++;
+    }
+
+    if (database.groupSize_ == 0)
+    {
+      transaction_.reset(new Orthanc::SQLite::Transaction(connection_));
+      transaction_->Begin();
+    }
+    else
+    {
+      if (!database.groupOpen_)
+      {
+        connection_.Execute("BEGIN");
+        database.groupOpen_ = true;
+        database.groupPending_ = 0;
+      }
+
+      connection_.Execute(std::string("SAVEPOINT ") + SAVEPOINT);
+      savepoint_ = true;
+    }
   }
 
   
   SQLiteDatabase::Transaction::~Transaction()
   {
+    if (reader_ == NULL &&
+        !isReadOnly_ &&
+        (transaction_.get() != NULL || savepoint_))
+    {
+      // The transaction is rolled back
+      database_.metadataIds_.clear();
+    }
+
     if (transaction_.get() != NULL)
     {
       transaction_->Rollback();
       transaction_.reset(NULL);
     }
+
+    if (reader_ != NULL)
+    {
+      database_.ReleaseReader(reader_);
+    }
+
+    if (savepoint_)
+    {
+      try
+      {
+        // Only undo the changes of this transaction, not those of
+        // the other pending transactions of the group
+        connection_.Execute(std::string("ROLLBACK TO ") + SAVEPOINT);
+        connection_.Execute(std::string("RELEASE ") + SAVEPOINT);
+      }
+      catch (Orthanc::OrthancException& e)
+      {
+        LOG(ERROR) << "Cannot rollback a SQLite savepoint: " << e.What();
+      }
+    }
   }
 
   
-  void SQLiteDatabase::Transaction::Commit()
+  uint64_t SQLiteDatabase::Transaction::Commit()
   {
-    if (transaction_.get() == NULL)
+    if (reader_ != NULL &&
+        transaction_.get() != NULL)
+    {
+      // Nothing was written, don't touch the tickets that are
+      // protected by the mutex of the main connection
+      transaction_->Commit();
+      transaction_.reset(NULL);
+      return 0;
+    }
+    else if (transaction_.get() != NULL)
+    {
+      transaction_->Commit();
+      transaction_.reset(NULL);
+
+      database_.lastTicket_++;
+      database_.durableTicket_ = database_.lastTicket_;
+      database_.resolvedTicket_ = database_.lastTicket_;
+      return database_.lastTicket_;
+    }
+    else if (savepoint_)
+    {
+      connection_.Execute(std::string("RELEASE ") + SAVEPOINT);
+      savepoint_ = false;
+
+      if (database_.groupPending_ == 0)
+      {
+        database_.groupStart_ = boost::posix_time::microsec_clock::universal_time();
+      }
+
+      database_.groupPending_++;
+      database_.lastTicket_++;
+
+      if (!timeSeries_.empty())
+      {
+        database_.groupSeries_.insert(timeSeries_);
+      }
+
+      if (database_.groupPending_ == 1 ||
+          database_.groupPending_ >= database_.groupSize_)
+      {
+        // Wake up the committer thread, either to commit the group,
+        // or to start the countdown of the delay
+        if (database_.worker_ != NULL)
+        {
+          database_.worker_->Wakeup();
+        }
+        else
+        {
+          database_.groupFull_.notify_one();
+        }
+      }
+
+      return database_.lastTicket_;
+    }
+    else
     {
       LOG(ERROR) << "Cannot Commit() without a transaction";
       throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
     }
+  }
+
+
+  uint64_t SQLiteDatabase::Transaction::GetNextTicket() const
+  {
+    if (reader_ != NULL)
+    {
+      return 0;  // Read-only transactions don't get a ticket
+    }
     else
     {
-      transaction_->Commit();
-      transaction_.reset(NULL);
+      return database_.lastTicket_ + 1;
+    }
+  }
+
+
+  bool SQLiteDatabase::Transaction::LookupCachedMetadata(int64_t& id,
+                                                        const std::string& metadata) const
+  {
+    assert(reader_ == NULL && !isReadOnly_);
+
+    std::map<std::string, int64_t>::const_iterator found = database_.metadataIds_.find(metadata);
+
+    if (found == database_.metadataIds_.end())
+    {
+      return false;
+    }
+    else
+    {
+      id = found->second;
+      return true;
     }
   }
 
 
+  void SQLiteDatabase::Transaction::CacheMetadata(const std::string& metadata,
+                                                  int64_t id)
+  {
+    assert(reader_ == NULL && !isReadOnly_);
+
+    if (database_.metadataIds_.size() >= METADATA_CACHE_SIZE)
+    {
+      // Most time series use a few distinct metadata: Don't let a
+      // series with unique metadata grow the cache without bound
+      database_.metadataIds_.clear();
+    }
+
+    database_.metadataIds_[metadata] = id;
+  }
+
+
   bool SQLiteDatabase::Transaction::HasTimeSeries(const std::string& name)
   {
     Orthanc::SQLite::Statement s
@@ -97,17 +271,196 @@ namespace AtomIT
       // Flush every 10 seconds
       if (count == 100)
       {
-        {
-          boost::mutex::scoped_lock lock(that->mutex_);
-          that->connection_.FlushToDisk();
-        }
-          
+        that->FlushToDisk();
         count = 0;
       }          
     }
   }
     
 
+  void SQLiteDatabase::CommitGroup(std::set<std::string>& committed)
+  {
+    // The mutex must be locked by the caller
+    bool success = true;
+
+    if (groupOpen_)
+    {
+      try
+      {
+        // "Execute()" only throws on "SQLITE_ERROR", and returns
+        // "false" on other errors (e.g. constraints or busy database)
+        if (!connection_.Execute("COMMIT"))
+        {
+          LOG(ERROR) << "Cannot commit a group of " << groupPending_
+                     << " SQLite transactions";
+          success = false;
+        }
+      }
+      catch (Orthanc::OrthancException& e)
+      {
+        LOG(ERROR) << "Cannot commit a group of " << groupPending_
+                   << " SQLite transactions: " << e.What();
+        success = false;
+      }
+
+      if (!success)
+      {
+        metadataIds_.clear();
+
+        try
+        {
+          connection_.Execute("ROLLBACK");
+        }
+        catch (Orthanc::OrthancException&)
+        {
+        }
+      }
+
+      groupOpen_ = false;
+      groupPending_ = 0;
+
+      if (success)
+      {
+        committed.swap(groupSeries_);
+      }
+
+      groupSeries_.clear();
+    }
+
+    if (resolvedTicket_ < lastTicket_)
+    {
+      if (success)
+      {
+        durableTicket_ = lastTicket_;
+      }
+      else
+      {
+        failedTickets_.push_back(std::make_pair(resolvedTicket_ + 1, lastTicket_));
+      }
+
+      resolvedTicket_ = lastTicket_;
+      durable_.notify_all();
+    }
+  }
+
+
+  bool SQLiteDatabase::IsFailedTicket(uint64_t ticket) const
+  {
+    // The mutex must be locked by the caller. Failures are expected
+    // to be rare, hence the linear search.
+    for (size_t i = 0; i < failedTickets_.size(); i++)
+    {
+      if (failedTickets_[i].first <= ticket &&
+          ticket <= failedTickets_[i].second)
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  void SQLiteDatabase::CommitWorker(SQLiteDatabase* that)
+  {
+    boost::mutex::scoped_lock lock(that->mutex_);
+
+    while (that->continue_)
+    {
+      if (that->groupPending_ == 0)
+      {
+        that->groupFull_.timed_wait(lock, boost::posix_time::milliseconds(100));
+      }
+      else
+      {
+        boost::posix_time::ptime deadline =
+          that->groupStart_ + boost::posix_time::milliseconds(that->groupDelay_);
+
+        if (that->groupPending_ >= that->groupSize_ ||
+            boost::posix_time::microsec_clock::universal_time() >= deadline)
+        {
+          std::set<std::string> committed;
+          that->CommitGroup(committed);
+
+          if (!committed.empty())
+          {
+            // Don't hold the mutex while the observers are notified,
+            // as they might start new transactions
+            lock.unlock();
+            that->NotifyCommitted(committed);
+            lock.lock();
+          }
+        }
+        else
+        {
+          that->groupFull_.timed_wait(lock, deadline);
+        }
+      }
+    }
+
+    std::set<std::string> committed;
+    that->CommitGroup(committed);
+    lock.unlock();
+    that->NotifyCommitted(committed);
+  }
+
+
+  void SQLiteDatabase::NotifyCommitted(const std::set<std::string>& committed)
+  {
+    if (committed.empty())
+    {
+      return;
+    }
+
+    boost::mutex::scoped_lock lock(observersMutex_);
+
+    for (std::set<ITimeSeriesObserver*>::const_iterator
+           observer = observers_.begin(); observer != observers_.end(); ++observer)
+    {
+      for (std::set<std::string>::const_iterator
+             name = committed.begin(); name != committed.end(); ++name)
+      {
+        (*observer)->NotifySeriesModified(*name);
+      }
+    }
+  }
+
+
+  Orthanc::SQLite::Connection* SQLiteDatabase::AcquireReader()
+  {
+    boost::mutex::scoped_lock lock(readersMutex_);
+
+    if (path_.empty())
+    {
+      return NULL;  // Database in memory, cannot be shared by connections
+    }
+    else if (readers_.empty())
+    {
+      std::auto_ptr<Orthanc::SQLite::Connection> reader(new Orthanc::SQLite::Connection);
+      reader->Open(path_);
+      reader->Execute("PRAGMA QUERY_ONLY=1;");
+
+      LOG(INFO) << "New read-only connection to SQLite database: " << path_;
+      return reader.release();
+    }
+    else
+    {
+      Orthanc::SQLite::Connection* reader = readers_.back();
+      readers_.pop_back();
+      return reader;
+    }
+  }
+
+
+  void SQLiteDatabase::ReleaseReader(Orthanc::SQLite::Connection* reader)
+  {
+    assert(reader != NULL);
+    
+    boost::mutex::scoped_lock lock(readersMutex_);
+    readers_.push_back(reader);
+  }
+
+
   void SQLiteDatabase::SetupDatabase()
   {
     if (!connection_.DoesTableExist("GlobalProperties"))
@@ -118,31 +471,115 @@ namespace AtomIT
         (query, Orthanc::EmbeddedResources::PREPARE_SQLITE_DATABASE);
       connection_.Execute(query);
     }
+    else
+    {
+      if (!connection_.DoesTableExist("Metadata"))
+      {
+        LOG(WARNING) << "Upgrading SQLite database to the dictionary encoding of metadata";
+        std::string query;
+        Orthanc::EmbeddedResources::GetFileResource
+          (query, Orthanc::EmbeddedResources::UPGRADE_SQLITE_METADATA);
+
+        Orthanc::SQLite::Transaction transaction(connection_);
+        transaction.Begin();
+        connection_.Execute(query);
+        transaction.Commit();
+      }
+
+      if (!connection_.DoesTableExist("Blocks"))
+      {
+        LOG(WARNING) << "Upgrading SQLite database to support the blocked layout";
+        std::string query;
+        Orthanc::EmbeddedResources::GetFileResource
+          (query, Orthanc::EmbeddedResources::UPGRADE_SQLITE_BLOCKS);
+
+        Orthanc::SQLite::Transaction transaction(connection_);
+        transaction.Begin();
+        connection_.Execute(query);
+        transaction.Commit();
+      }
+    }
 
     // Performance tuning of SQLite with PRAGMAs
     // http://www.sqlite.org/pragma.html
     connection_.Execute("PRAGMA SYNCHRONOUS=OFF;");
     connection_.Execute("PRAGMA JOURNAL_MODE=WAL;");
-    connection_.Execute("PRAGMA LOCKING_MODE=EXCLUSIVE;");
+
+    // "LOCKING_MODE=EXCLUSIVE" is not set, as it would prevent the
+    // read-only connections from accessing the WAL
 
     continue_ = true;
-    flushThread_ = boost::thread(FlushWorker, this);
+
+    if (worker_ == NULL)
+    {
+      flushThread_ = boost::thread(FlushWorker, this);
+    }
 
     LOG(INFO) << "SQLite database is ready";
   }
 
 
-  SQLiteDatabase::SQLiteDatabase(const std::string& path)
+  SQLiteDatabase::SQLiteDatabase(const std::string& path) :
+    worker_(NULL),
+    groupSize_(0),
+    groupDelay_(0),
+    groupOpen_(false),
+    groupPending_(0),
+    lastTicket_(0),
+    durableTicket_(0),
+    resolvedTicket_(0),
+    contentions_(0),
+    lowWaterMark_(100),
+    blockCache_(BLOCK_CACHE_SIZE)
+  {
+    boost::filesystem::path p(path);
+    LOG(WARNING) << "Opening SQLite database from: " << p.string();
+
+    connection_.Open(p.string());
+    SetupDatabase();
+
+    path_ = p.string();  // Enables the pool of read-only connections
+  }
+
+    
+  SQLiteDatabase::SQLiteDatabase(const std::string& path,
+                                 SQLiteWorker& worker) :
+    worker_(&worker),
+    groupSize_(0),
+    groupDelay_(0),
+    groupOpen_(false),
+    groupPending_(0),
+    lastTicket_(0),
+    durableTicket_(0),
+    resolvedTicket_(0),
+    contentions_(0),
+    lowWaterMark_(100),
+    blockCache_(BLOCK_CACHE_SIZE)
   {
     boost::filesystem::path p(path);
     LOG(WARNING) << "Opening SQLite database from: " << p.string();
 
     connection_.Open(p.string());
     SetupDatabase();
+
+    path_ = p.string();  // Enables the pool of read-only connections
+
+    worker.Attach(*this);
   }
 
     
-  SQLiteDatabase::SQLiteDatabase()
+  SQLiteDatabase::SQLiteDatabase() :
+    worker_(NULL),
+    groupSize_(0),
+    groupDelay_(0),
+    groupOpen_(false),
+    groupPending_(0),
+    lastTicket_(0),
+    durableTicket_(0),
+    resolvedTicket_(0),
+    contentions_(0),
+    lowWaterMark_(100),
+    blockCache_(BLOCK_CACHE_SIZE)
   {
     LOG(WARNING) << "Opening a transient SQLite database in memory";
     connection_.OpenInMemory();
@@ -154,12 +591,224 @@ namespace AtomIT
   {
     LOG(INFO) << "Closing SQLite database";
 
-    continue_ = false;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      continue_ = false;
+      groupFull_.notify_one();
+    }
+
+    if (commitThread_.joinable())
+    {
+      commitThread_.join();  // This commits the pending transactions
+    }
 
     if (flushThread_.joinable())
     {
       flushThread_.join();
     }
+
+    if (worker_ != NULL)
+    {
+      worker_->Detach(*this);
+
+      // Commit the pending transactions, as done by "CommitWorker()"
+      std::set<std::string> committed;
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        CommitGroup(committed);
+      }
+
+      NotifyCommitted(committed);
+    }
+
+    for (size_t i = 0; i < readers_.size(); i++)
+    {
+      assert(readers_[i] != NULL);
+      delete readers_[i];
+    }
+  }
+
+
+  void SQLiteDatabase::EnableGroupCommit(unsigned int size,
+                                         unsigned int delay)
+  {
+    if (size == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (groupSize_ != 0 &&
+        (groupSize_ != size || groupDelay_ != delay))
+    {
+      LOG(WARNING) << "Changing the parameters of the group commit of a SQLite database";
+    }
+
+    LOG(WARNING) << "Group commit of SQLite transactions: at most " << size
+                 << " transactions or " << delay << "ms";
+
+    groupSize_ = size;
+    groupDelay_ = delay;
+
+    if (worker_ == NULL &&
+        !commitThread_.joinable())
+    {
+      commitThread_ = boost::thread(CommitWorker, this);
+    }
+  }
+
+
+  bool SQLiteDatabase::IsGroupCommit()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return groupSize_ != 0;
+  }
+
+
+  void SQLiteDatabase::SetLowWaterMark(unsigned int percent)
+  {
+    if (percent == 0 ||
+        percent > 100)
+    {
+      LOG(ERROR) << "The low-water mark of a SQLite database must be between 1 and 100, not "
+                 << percent;
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    lowWaterMark_ = percent;
+  }
+
+
+  unsigned int SQLiteDatabase::GetLowWaterMark()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return lowWaterMark_;
+  }
+
+
+  uint64_t SQLiteDatabase::GetLastTicket()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return lastTicket_;
+  }
+
+
+  bool SQLiteDatabase::IsDurable(uint64_t ticket)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return (ticket <= durableTicket_ &&
+            !IsFailedTicket(ticket));
+  }
+
+
+  void SQLiteDatabase::WaitDurable(uint64_t ticket)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    while (ticket > resolvedTicket_)
+    {
+      durable_.wait(lock);
+    }
+
+    if (IsFailedTicket(ticket))
+    {
+      LOG(ERROR) << "SQLite transaction " << ticket << " was rolled back, as the "
+                 << "commit of its group failed";
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_Database);
+    }
+  }
+
+
+  void SQLiteDatabase::Flush()
+  {
+    std::set<std::string> committed;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      CommitGroup(committed);
+    }
+
+    NotifyCommitted(committed);
+  }
+
+
+  void SQLiteDatabase::CommitDueGroup(const boost::posix_time::ptime& now,
+                                      boost::posix_time::ptime& wakeup)
+  {
+    std::set<std::string> committed;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (groupPending_ == 0)
+      {
+        return;
+      }
+
+      const boost::posix_time::ptime deadline =
+        groupStart_ + boost::posix_time::milliseconds(groupDelay_);
+
+      if (groupPending_ >= groupSize_ ||
+          now >= deadline)
+      {
+        CommitGroup(committed);
+      }
+      else if (deadline < wakeup)
+      {
+        wakeup = deadline;
+      }
+    }
+
+    NotifyCommitted(committed);
+  }
+
+
+  void SQLiteDatabase::FlushToDisk()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    connection_.FlushToDisk();
+  }
+
+
+  void SQLiteDatabase::RegisterObserver(ITimeSeriesObserver& observer)
+  {
+    boost::mutex::scoped_lock lock(observersMutex_);
+    observers_.insert(&observer);
+  }
+
+
+  void SQLiteDatabase::UnregisterObserver(ITimeSeriesObserver& observer)
+  {
+    boost::mutex::scoped_lock lock(observersMutex_);
+    observers_.erase(&observer);
+  }
+
+
+  void SQLiteDatabase::GetStatistics(unsigned int& countTimeSeries,
+                                     uint64_t& length,
+                                     uint64_t& size,
+                                     uint64_t& transactions,
+                                     uint64_t& contentions)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Orthanc::SQLite::Statement s(
+      connection_, SQLITE_FROM_HERE,
+      "SELECT COUNT(*), SUM(currentLength), SUM(currentSize) FROM TimeSeries");
+
+    if (!s.Step())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_Database);
+    }
+
+    countTimeSeries = static_cast<unsigned int>(s.ColumnInt(0));
+    length = static_cast<uint64_t>(s.ColumnInt64(1));  // SUM() of no row is NULL, read as 0
+    size = static_cast<uint64_t>(s.ColumnInt64(2));
+    transactions = lastTicket_;
+    contentions = contentions_;
   }
 
     
@@ -187,7 +836,7 @@ namespace AtomIT
       LOG(WARNING) << "Creating a new time series in SQLite database: " << name;
         
       Orthanc::SQLite::Statement t(connection_, SQLITE_FROM_HERE,
-                                   "INSERT INTO TimeSeries VALUES(NULL, ?, ?, ?, 0, 0, NULL)");
+                                   "INSERT INTO TimeSeries VALUES(NULL, ?, ?, ?, 0, 0, NULL, 0, NULL)");
       t.BindString(0, name);
       t.BindInt64(1, maxLength);
       t.BindInt64(2, maxSize);
@@ -219,5 +868,17 @@ namespace AtomIT
       
       SQLiteTimeSeriesTransaction::UpdateQuota(*this, name);  // (*)
     }
+
+    // In group commit mode, commit the new time series right now, as
+    // the read-only transactions would not find it until then
+    transaction.reset(NULL);
+    Flush();
+  }
+
+
+  void SQLiteDatabase::SetBlockSize(const std::string& name,
+                                    unsigned int blockSize)
+  {
+    SQLiteTimeSeriesTransaction::ChangeBlockSize(*this, name, blockSize);
   }
 }
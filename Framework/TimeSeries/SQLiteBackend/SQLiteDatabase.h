@@ -31,10 +31,19 @@
 
 #pragma once
 
+#include "SQLiteBlockCache.h"
+#include "SQLiteWorker.h"
+#include "../ITimeSeriesObserver.h"
+
 #include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <Core/SQLite/Connection.h>
 #include <Core/SQLite/Transaction.h>
 
+#include <map>
+#include <set>
+#include <vector>
+
 namespace AtomIT
 {
   class SQLiteDatabase : public boost::noncopyable
@@ -42,27 +51,105 @@ namespace AtomIT
   private:
     static void FlushWorker(SQLiteDatabase* that);
 
+    static void CommitWorker(SQLiteDatabase* that);
+
     void SetupDatabase();
 
+    // The mutex must be locked by the caller. On success, the time
+    // series that were modified by the group are moved to "committed".
+    void CommitGroup(std::set<std::string>& committed);
+
+    // The mutex must NOT be locked by the caller
+    void NotifyCommitted(const std::set<std::string>& committed);
+
+    bool IsFailedTicket(uint64_t ticket) const;
+
+    Orthanc::SQLite::Connection* AcquireReader();
+
+    void ReleaseReader(Orthanc::SQLite::Connection* reader);
+
     boost::mutex                 mutex_;
     Orthanc::SQLite::Connection  connection_;
     bool                         continue_;
     boost::thread                flushThread_;
+    SQLiteWorker*                worker_;  // If NULL, use dedicated threads
+
+    // Group commit (disabled if "groupSize_" is zero)
+    unsigned int                 groupSize_;
+    unsigned int                 groupDelay_;  // In milliseconds
+    bool                         groupOpen_;
+    unsigned int                 groupPending_;
+    boost::posix_time::ptime     groupStart_;
+    boost::condition_variable    groupFull_;
+    boost::condition_variable    durable_;
+    boost::thread                commitThread_;
+    uint64_t                     lastTicket_;
+    uint64_t                     durableTicket_;   // Last committed ticket
+    uint64_t                     resolvedTicket_;  // Last committed or failed ticket
+    std::vector< std::pair<uint64_t, uint64_t> >  failedTickets_;  // Rolled back groups
+    uint64_t                     contentions_;
+    std::set<std::string>        groupSeries_;  // Time series modified by the open group
+
+    // Observers of the time series whose modifications become visible
+    // to the read-only transactions once their group is committed
+    boost::mutex                     observersMutex_;
+    std::set<ITimeSeriesObserver*>   observers_;
+
+    // Percentage of the quotas down to which the time series are
+    // evicted, once their quota is exceeded
+    unsigned int                 lowWaterMark_;
+
+    // Decoded blocks of the time series using the blocked layout
+    SQLiteBlockCache             blockCache_;
+
+    // Cache of the dictionary of metadata, protected by "mutex_". It
+    // is cleared whenever a transaction is rolled back, as it might
+    // contain the identifiers of metadata that were never committed.
+    std::map<std::string, int64_t>  metadataIds_;
+
+    // Pool of read-only connections (not available in memory)
+    std::string                  path_;
+    boost::mutex                 readersMutex_;
+    std::vector<Orthanc::SQLite::Connection*>  readers_;
 
   public:
     class Transaction : public boost::noncopyable
     {
     private:
       boost::mutex::scoped_lock    lock_;
+      SQLiteDatabase&              database_;
+      Orthanc::SQLite::Connection* reader_;
       Orthanc::SQLite::Connection& connection_;
       std::auto_ptr<Orthanc::SQLite::Transaction> transaction_;
-  
+      bool                         savepoint_;  // In group commit mode
+      bool                         isReadOnly_;
+      std::string                  timeSeries_;  // Time series that is modified
+
     public:
-      explicit Transaction(SQLiteDatabase& database);
+      // Read-only transactions run on a snapshot of the database,
+      // using a separate connection that does not lock the writers
+      // (in group commit mode, they only see committed groups)
+      explicit Transaction(SQLiteDatabase& database,
+                           bool isReadOnly = false);
 
       ~Transaction();
 
-      void Commit();
+      // Returns the ticket of this commit, that can be given to
+      // "SQLiteDatabase::WaitDurable()"
+      uint64_t Commit();
+
+      // Records the time series that is modified by this read-write
+      // transaction, whose observers are notified once its group is
+      // committed (only used in group commit mode)
+      void SetTimeSeries(const std::string& name)
+      {
+        timeSeries_ = name;
+      }
+
+      // Returns the ticket that "Commit()" will return. As the mutex
+      // of the main connection is held by read-write transactions,
+      // no other ticket can be allocated in the meantime.
+      uint64_t GetNextTicket() const;
 
       Orthanc::SQLite::Connection& GetConnection()
       {
@@ -70,19 +157,106 @@ namespace AtomIT
       }
 
       bool HasTimeSeries(const std::string& name);
+
+      unsigned int GetLowWaterMark() const
+      {
+        return database_.lowWaterMark_;
+      }
+
+      // Whether this transaction only sees data that was committed,
+      // and that cannot be rolled back anymore
+      bool IsCommittedSnapshot() const
+      {
+        return isReadOnly_ && !savepoint_;
+      }
+
+      SQLiteBlockCache& GetBlockCache()
+      {
+        return database_.blockCache_;
+      }
+
+      // Only available to read-write transactions, that hold the mutex
+      bool LookupCachedMetadata(int64_t& id,
+                                const std::string& metadata) const;
+
+      void CacheMetadata(const std::string& metadata,
+                         int64_t id);
     };
     
     
     explicit SQLiteDatabase(const std::string& path);
 
+    // The flushes and the group commits are done by the shared
+    // "worker", instead of threads that are dedicated to this database
+    SQLiteDatabase(const std::string& path,
+                   SQLiteWorker& worker);
+
     SQLiteDatabase();  // Create SQLite database in memory
 
     ~SQLiteDatabase();
 
+    // In group commit mode, the transactions are only released into
+    // one long-running SQLite transaction, that is committed by a
+    // background thread once "size" transactions are pending, or
+    // "delay" milliseconds after the first pending transaction.
+    void EnableGroupCommit(unsigned int size,
+                           unsigned int delay);
+
+    bool IsGroupCommit();
+
+    // If a quota is exceeded, evict the oldest messages until the
+    // time series is below "percent" of its quota (100 by default),
+    // which amortizes the cost of the evictions over many appends
+    void SetLowWaterMark(unsigned int percent);
+
+    unsigned int GetLowWaterMark();
+
+    uint64_t GetLastTicket();
+
+    // Returns "false" if the transaction is still pending, or if its
+    // group was rolled back because the final COMMIT failed
+    bool IsDurable(uint64_t ticket);
+
+    // Waits for the group containing the transaction to be
+    // committed. Throws an exception if the group was rolled back.
+    void WaitDurable(uint64_t ticket);
+
+    // Commit the pending transactions right now
+    void Flush();
+
+    // In group commit mode, the observers are notified (by the thread
+    // committing the group) of the time series whose modifications
+    // have become visible to the read-only transactions
+    void RegisterObserver(ITimeSeriesObserver& observer);
+
+    void UnregisterObserver(ITimeSeriesObserver& observer);
+
+    // Used by "SQLiteWorker": Commits the group if it is due at time
+    // "now", otherwise moves "wakeup" back to the deadline of the group
+    void CommitDueGroup(const boost::posix_time::ptime& now,
+                        boost::posix_time::ptime& wakeup);
+
+    void FlushToDisk();
+
+    // "transactions" is the number of committed transactions, and
+    // "contentions" is the number of transactions that had to wait
+    // for another transaction to complete
+    void GetStatistics(unsigned int& countTimeSeries,
+                       uint64_t& length,
+                       uint64_t& size,
+                       uint64_t& transactions,
+                       uint64_t& contentions);
+
     void DeleteTimeSeries(const std::string& name);
 
     void CreateTimeSeries(const std::string& name,
                           uint64_t maxLength,
                           uint64_t maxSize);
+
+    // Switch the time series to the blocked layout, packing its
+    // messages into compressed blocks of "blockSize" messages. A
+    // value of zero switches back to one row per message.
+    void SetBlockSize(const std::string& name,
+                      unsigned int blockSize);
   };
 }
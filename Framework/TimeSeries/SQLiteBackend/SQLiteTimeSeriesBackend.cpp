@@ -32,6 +32,7 @@
 #include "SQLiteTimeSeriesBackend.h"
 
 #include <Core/Logging.h>
+#include <Core/OrthancException.h>
 
 namespace AtomIT
 {
@@ -39,21 +40,34 @@ namespace AtomIT
   {
   private:
     SQLiteTimeSeriesTransaction  transaction_;
+    bool                         isReadOnly_;
+
+    void CheckWritable() const
+    {
+      if (isReadOnly_)
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_ReadOnly);
+      }
+    }
 
   public:
-    explicit Transaction(SQLiteTimeSeriesBackend& backend) :
-      transaction_(backend.database_, backend.name_)
+    Transaction(SQLiteTimeSeriesBackend& backend,
+                bool isReadOnly) :
+      transaction_(backend.database_, backend.name_, isReadOnly),
+      isReadOnly_(isReadOnly)
     {
     }
 
     virtual void ClearContent()
     {
+      CheckWritable();
       transaction_.ClearContent();
     }
 
     virtual void DeleteRange(int64_t start,
                              int64_t end)
     {
+      CheckWritable();
       transaction_.DeleteRange(start, end);
     }
 
@@ -92,13 +106,28 @@ namespace AtomIT
       return transaction_.Read(metadata, value, timestamp);
     }
 
+    virtual size_t Scan(int64_t start,
+                        int64_t end,
+                        size_t limit,
+                        ITimeSeriesVisitor& visitor)
+    {
+      return transaction_.Scan(start, end, limit, visitor);
+    }
+
     virtual bool Append(int64_t timestamp,
                         const std::string& metadata,
                         const std::string& value)
     {
+      CheckWritable();
       return transaction_.Append(timestamp, metadata, value);
     }
 
+    virtual size_t AppendBatch(const std::vector<Message>& messages)
+    {
+      CheckWritable();
+      return transaction_.AppendBatch(messages);
+    }
+
     virtual void GetStatistics(uint64_t& length,
                                uint64_t& size)
     {
@@ -109,6 +138,11 @@ namespace AtomIT
     {
       return transaction_.GetLastTimestamp(result);
     }
+
+    virtual uint64_t GetDurabilityTicket()
+    {
+      return transaction_.GetNextTicket();
+    }
   };
 
 
@@ -123,6 +157,12 @@ namespace AtomIT
   
   ITimeSeriesBackend::ITransaction* SQLiteTimeSeriesBackend::CreateTransaction(bool isReadOnly)
   {
-    return new Transaction(*this);
+    return new Transaction(*this, isReadOnly);
+  }
+
+
+  void SQLiteTimeSeriesBackend::WaitDurable(uint64_t ticket)
+  {
+    database_.WaitDurable(ticket);
   }
 }
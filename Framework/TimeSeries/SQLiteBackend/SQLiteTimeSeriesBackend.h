@@ -49,5 +49,7 @@ namespace AtomIT
                             const std::string& name);
 
     virtual ITransaction* CreateTransaction(bool isReadOnly);
+
+    virtual void WaitDurable(uint64_t ticket);
   };
 }
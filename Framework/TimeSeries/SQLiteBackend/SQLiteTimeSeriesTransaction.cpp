@@ -34,8 +34,31 @@
 #include <Core/Logging.h>
 #include <Core/OrthancException.h>
 
+#include <algorithm>
+#include <limits>
+#include <map>
+
 namespace AtomIT
 {
+  static uint64_t ApplyPercentage(uint64_t value,
+                                  unsigned int percent)
+  {
+    // Avoid overflows for large values
+    return value / 100 * percent + value % 100 * percent / 100;
+  }
+
+
+  static bool IsAboveTarget(uint64_t current,
+                            uint64_t removed,
+                            uint64_t added,
+                            uint64_t quota,
+                            uint64_t target)
+  {
+    return (quota != 0 &&
+            current - removed + added > target);
+  }
+
+
   bool SQLiteTimeSeriesTransaction::SanityCheck()
   {
     // WARNING: This sanity check is very time-consuming, and is enabled in Debug builds
@@ -62,9 +85,17 @@ namespace AtomIT
          "SELECT COUNT(*), SUM(size) FROM Content WHERE id=?");
       s.BindInt64(0, id_);
 
+      Orthanc::SQLite::Statement t
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT COUNT(*), SUM(length), SUM(size) FROM Blocks WHERE id=?");
+      t.BindInt64(0, id_);
+
       if (!s.Step() ||
-          currentLength_ != static_cast<uint64_t>(s.ColumnInt64(0)) ||
-          currentSize_ != static_cast<uint64_t>(s.ColumnInt64(1)))
+          !t.Step() ||
+          (!IsBlocked() && t.ColumnInt64(0) != 0) ||
+          tailLength_ != static_cast<uint64_t>(s.ColumnInt64(0)) ||
+          currentLength_ != static_cast<uint64_t>(s.ColumnInt64(0) + t.ColumnInt64(1)) ||
+          currentSize_ != static_cast<uint64_t>(s.ColumnInt64(1) + t.ColumnInt64(2)))
       {
         return false;
       }
@@ -95,7 +126,8 @@ namespace AtomIT
   {
     Orthanc::SQLite::Statement s(
       transaction_.GetConnection(), SQLITE_FROM_HERE,
-      "UPDATE TimeSeries SET currentLength=?, currentSize=?, lastTimestamp=? WHERE internalId=?");
+      "UPDATE TimeSeries SET currentLength=?, currentSize=?, lastTimestamp=?, tailLength=? "
+      "WHERE internalId=?");
     s.BindInt64(0, currentLength_);
     s.BindInt64(1, currentSize_);
 
@@ -108,7 +140,8 @@ namespace AtomIT
       s.BindNull(2);
     }       
 
-    s.BindInt64(3, id_);
+    s.BindInt64(3, tailLength_);
+    s.BindInt64(4, id_);
 
     if (!s.Run())
     {
@@ -117,56 +150,466 @@ namespace AtomIT
   }
       
     
-  void SQLiteTimeSeriesTransaction::RemoveOldest()
+  int64_t SQLiteTimeSeriesTransaction::LookupMetadata(const std::string& metadata)
   {
-    int64_t timestamp;
+    int64_t id;
+    if (transaction_.LookupCachedMetadata(id, metadata))
+    {
+      return id;
+    }
 
     {
       Orthanc::SQLite::Statement s
         (transaction_.GetConnection(), SQLITE_FROM_HERE,
-         "SELECT timestamp, size FROM Content WHERE id=? ORDER BY timestamp ASC LIMIT 1");
-      s.BindInt64(0, id_);
+         "SELECT id FROM Metadata WHERE value=?");
+      s.BindString(0, metadata);
+
+      if (s.Step())
+      {
+        id = s.ColumnInt64(0);
+        transaction_.CacheMetadata(metadata, id);
+        return id;
+      }
+    }
+
+    {
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "INSERT INTO Metadata VALUES(NULL, ?)");
+      s.BindString(0, metadata);
+
+      if (!s.Run())
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+      }
+    }
+
+    id = transaction_.GetConnection().GetLastInsertRowId();
+    transaction_.CacheMetadata(metadata, id);
+    return id;
+  }
+
+    
+  SQLiteBlockCache::BlockPointer SQLiteTimeSeriesTransaction::LoadBlock(int64_t blockId)
+  {
+    SQLiteBlockCache::BlockPointer block = transaction_.GetBlockCache().Lookup(blockId);
+
+    if (block.get() == NULL)
+    {
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT content FROM Blocks WHERE blockId=?");
+      s.BindInt64(0, blockId);
 
       if (!s.Step())
       {
         throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
       }
 
-      uint64_t size = static_cast<uint64_t>(s.ColumnInt64(1));
+      std::auto_ptr<SQLiteBlock> decoded(new SQLiteBlock);
+      decoded->Decode(s.ColumnBlob(0), s.ColumnByteLength(0));
+      block.reset(decoded.release());
 
-      if (currentLength_ == 0 ||
-          currentSize_ < size)
+      // A block that was written by a pending transaction could be
+      // rolled back, and its identifier be reused
+      if (transaction_.IsCommittedSnapshot())
+      {
+        transaction_.GetBlockCache().Store(blockId, block);
+      }
+    }
+
+    return block;
+  }
+
+
+  bool SQLiteTimeSeriesTransaction::FindBlock(int64_t& blockId,
+                                              int64_t& firstTimestamp,
+                                              int64_t timestamp)
+  {
+    Orthanc::SQLite::Statement s
+      (transaction_.GetConnection(), SQLITE_FROM_HERE,
+       "SELECT blockId, firstTimestamp FROM Blocks WHERE id=? AND lastTimestamp>=? "
+       "ORDER BY lastTimestamp ASC LIMIT 1");
+    s.BindInt64(0, id_);
+    s.BindInt64(1, timestamp);
+
+    if (s.Step())
+    {
+      blockId = s.ColumnInt64(0);
+      firstTimestamp = s.ColumnInt64(1);
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+  void SQLiteTimeSeriesTransaction::StoreBlock(const SQLiteBlock& block)
+  {
+    if (block.GetLength() == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+
+    std::string content;
+    block.Encode(content);
+
+    Orthanc::SQLite::Statement s(transaction_.GetConnection(), SQLITE_FROM_HERE,
+                                 "INSERT INTO Blocks VALUES(NULL, ?, ?, ?, ?, ?, ?)");
+    s.BindInt64(0, id_);
+    s.BindInt64(1, block.GetTimestamp(0));
+    s.BindInt64(2, block.GetTimestamp(block.GetLength() - 1));
+    s.BindInt64(3, block.GetLength());
+    s.BindInt64(4, block.GetSize());
+    s.BindBlob(5, content.empty() ? NULL : content.c_str(), content.size());
+
+    if (!s.Run())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+  }
+
+
+  void SQLiteTimeSeriesTransaction::DeleteFromBlocks(uint64_t& length,
+                                                     uint64_t& size,
+                                                     int64_t first,
+                                                     int64_t last)
+  {
+    length = 0;
+    size = 0;
+
+    if (!IsBlocked() ||
+        first > last)
+    {
+      return;
+    }
+
+    std::vector<int64_t> removed, partial;
+
+    {
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT blockId, firstTimestamp, lastTimestamp, length, size FROM Blocks "
+         "WHERE id=? AND lastTimestamp>=? ORDER BY lastTimestamp ASC");
+      s.BindInt64(0, id_);
+      s.BindInt64(1, first);
+
+      while (s.Step() &&
+             s.ColumnInt64(1) <= last)
+      {
+        if (first <= s.ColumnInt64(1) &&
+            s.ColumnInt64(2) <= last)
+        {
+          removed.push_back(s.ColumnInt64(0));
+          length += static_cast<uint64_t>(s.ColumnInt64(3));
+          size += static_cast<uint64_t>(s.ColumnInt64(4));
+        }
+        else
+        {
+          partial.push_back(s.ColumnInt64(0));
+        }
+      }
+    }
+
+    // The blocks are immutable: A block that is partially removed is
+    // replaced by a new block containing the remaining messages
+    for (size_t i = 0; i < partial.size(); i++)
+    {
+      SQLiteBlockCache::BlockPointer block = LoadBlock(partial[i]);
+
+      SQLiteBlock remaining;
+      for (size_t j = 0; j < block->GetLength(); j++)
+      {
+        int64_t timestamp = block->GetTimestamp(j);
+        if (first <= timestamp &&
+            timestamp <= last)
+        {
+          length++;
+          size += block->GetValue(j).size();
+        }
+        else
+        {
+          remaining.Append(timestamp, block->GetMetadata(j), block->GetValue(j));
+        }
+      }
+
+      if (remaining.GetLength() != 0)
+      {
+        StoreBlock(remaining);
+      }
+
+      removed.push_back(partial[i]);
+    }
+
+    Orthanc::SQLite::Statement s(transaction_.GetConnection(), SQLITE_FROM_HERE,
+                                 "DELETE FROM Blocks WHERE blockId=?");
+
+    for (size_t i = 0; i < removed.size(); i++)
+    {
+      s.Reset();
+      s.BindInt64(0, removed[i]);
+
+      if (!s.Run())
       {
         throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
       }
+    }
+  }
 
-      currentSize_ -= size;
-      currentLength_--;
-      timestamp = s.ColumnInt64(0);
+
+  void SQLiteTimeSeriesTransaction::PackTail()
+  {
+    if (!IsBlocked())
+    {
+      return;
+    }
+
+    while (tailLength_ >= blockSize_)
+    {
+      SQLiteBlock block;
+
+      {
+        Orthanc::SQLite::Statement s
+          (transaction_.GetConnection(), SQLITE_FROM_HERE,
+           "SELECT Content.timestamp, Metadata.value, Content.value FROM Content "
+           "CROSS JOIN Metadata ON Metadata.id=Content.metadata "
+           "WHERE Content.id=? ORDER BY Content.timestamp ASC LIMIT ?");
+        s.BindInt64(0, id_);
+        s.BindInt64(1, blockSize_);
+
+        while (s.Step())
+        {
+          block.Append(s.ColumnInt64(0), s.ColumnString(1), s.ColumnString(2));
+        }
+      }
+
+      StoreBlock(block);
+
+      {
+        Orthanc::SQLite::Statement s
+          (transaction_.GetConnection(), SQLITE_FROM_HERE,
+           "DELETE FROM Content WHERE id=? AND timestamp<=?");
+        s.BindInt64(0, id_);
+        s.BindInt64(1, block.GetTimestamp(block.GetLength() - 1));
+
+        if (!s.Run())
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+
+      assert(block.GetLength() == blockSize_);
+      tailLength_ -= block.GetLength();
+    }
+  }
+
+
+  void SQLiteTimeSeriesTransaction::CountTail()
+  {
+    Orthanc::SQLite::Statement s
+      (transaction_.GetConnection(), SQLITE_FROM_HERE,
+       "SELECT COUNT(*) FROM Content WHERE id=?");
+    s.BindInt64(0, id_);
+
+    if (!s.Step())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
     }
 
+    tailLength_ = static_cast<uint64_t>(s.ColumnInt64(0));
+  }
+
+
+  void SQLiteTimeSeriesTransaction::UnpackBlocks()
+  {
+    std::vector<int64_t> blocks;
+
     {
       Orthanc::SQLite::Statement s
         (transaction_.GetConnection(), SQLITE_FROM_HERE,
-         "DELETE FROM Content WHERE id=? AND timestamp=?");
+         "SELECT blockId FROM Blocks WHERE id=? ORDER BY lastTimestamp ASC");
       s.BindInt64(0, id_);
-      s.BindInt64(1, timestamp);
+
+      while (s.Step())
+      {
+        blocks.push_back(s.ColumnInt64(0));
+      }
+    }
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+      SQLiteBlockCache::BlockPointer block = LoadBlock(blocks[i]);
+
+      Orthanc::SQLite::Statement s(transaction_.GetConnection(), SQLITE_FROM_HERE,
+                                   "INSERT INTO Content VALUES(?, ?, ?, ?, ?)");
+
+      for (size_t j = 0; j < block->GetLength(); j++)
+      {
+        int64_t metadataId = LookupMetadata(block->GetMetadata(j));
+
+        s.Reset();
+        s.BindInt64(0, id_);
+        s.BindInt64(1, block->GetTimestamp(j));
+        s.BindInt64(2, block->GetValue(j).size());
+        s.BindInt64(3, metadataId);
+        s.BindString(4, block->GetValue(j));
+
+        if (!s.Run())
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+
+      tailLength_ += block->GetLength();
+    }
+
+    Orthanc::SQLite::Statement s(transaction_.GetConnection(), SQLITE_FROM_HERE,
+                                 "DELETE FROM Blocks WHERE id=?");
+    s.BindInt64(0, id_);
+
+    if (!s.Run())
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+    }
+  }
+
+
+  void SQLiteTimeSeriesTransaction::MakeRoom(uint64_t length,
+                                             uint64_t size)
+  {
+    // Remove the oldest items, so that "length" new items totalling
+    // "size" bytes can be inserted without exceeding the quota. The
+    // removal is done using a single ranged "DELETE". As the length
+    // and the size of the time series are cached in the "TimeSeries"
+    // table, nothing is read from "Content" if the quota is met.
+    if ((maxLength_ == 0 || currentLength_ + length <= maxLength_) &&
+        (maxSize_ == 0 || currentSize_ + size <= maxSize_))
+    {
+      return;
+    }
+
+    // The quota is exceeded: Evict down to the low-water mark, so
+    // that the next appends don't have to evict anything
+    const unsigned int lowWaterMark = transaction_.GetLowWaterMark();
+    uint64_t targetLength = std::max(length, ApplyPercentage(maxLength_, lowWaterMark));
+    uint64_t targetSize = std::max(size, ApplyPercentage(maxSize_, lowWaterMark));
+
+    uint64_t removedLength = 0;
+    uint64_t removedSize = 0;
+    uint64_t removedTail = 0;
+    bool hasLimit = false;
+    int64_t limit = 0;  // Dummy initialization
+
+    if (IsBlocked())
+    {
+      // The oldest messages are in the blocks
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT blockId, lastTimestamp, length, size FROM Blocks WHERE id=? "
+         "ORDER BY lastTimestamp ASC");
+      s.BindInt64(0, id_);
+
+      while ((IsAboveTarget(currentLength_, removedLength, length, maxLength_, targetLength) ||
+              IsAboveTarget(currentSize_, removedSize, size, maxSize_, targetSize)) &&
+             s.Step())
+      {
+        uint64_t blockLength = static_cast<uint64_t>(s.ColumnInt64(2));
+        uint64_t blockSize = static_cast<uint64_t>(s.ColumnInt64(3));
+
+        if (IsAboveTarget(currentLength_, removedLength + blockLength, length, maxLength_, targetLength) ||
+            IsAboveTarget(currentSize_, removedSize + blockSize, size, maxSize_, targetSize))
+        {
+          // The whole block must be removed, no need to decode it
+          removedLength += blockLength;
+          removedSize += blockSize;
+          limit = s.ColumnInt64(1);
+        }
+        else
+        {
+          SQLiteBlockCache::BlockPointer block = LoadBlock(s.ColumnInt64(0));
+
+          for (size_t i = 0; (i < block->GetLength() &&
+                              (IsAboveTarget(currentLength_, removedLength, length, maxLength_, targetLength) ||
+                               IsAboveTarget(currentSize_, removedSize, size, maxSize_, targetSize))); i++)
+          {
+            removedLength++;
+            removedSize += block->GetValue(i).size();
+            limit = block->GetTimestamp(i);
+          }
+        }
+
+        hasLimit = true;
+
+        if (removedLength > currentLength_ ||
+            removedSize > currentSize_)
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+    }
+
+    {
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT timestamp, size FROM Content WHERE id=? ORDER BY timestamp ASC");
+      s.BindInt64(0, id_);
+
+      while (IsAboveTarget(currentLength_, removedLength, length, maxLength_, targetLength) ||
+             IsAboveTarget(currentSize_, removedSize, size, maxSize_, targetSize))
+      {
+        if (!s.Step())
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+
+        removedLength++;
+        removedSize += static_cast<uint64_t>(s.ColumnInt64(1));
+        removedTail++;
+        limit = s.ColumnInt64(0);
+        hasLimit = true;
+
+        if (removedLength > currentLength_ ||
+            removedSize > currentSize_)
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+    }
+
+    if (hasLimit)
+    {
+      uint64_t blocksLength, blocksSize;
+      DeleteFromBlocks(blocksLength, blocksSize, std::numeric_limits<int64_t>::min(), limit);
+
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "DELETE FROM Content WHERE id=? AND timestamp<=?");
+      s.BindInt64(0, id_);
+      s.BindInt64(1, limit);
 
       if (!s.Run())
       {
         throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
       }
+
+      currentLength_ -= removedLength;
+      currentSize_ -= removedSize;
+      tailLength_ -= removedTail;
     }
   }
-    
+
 
   SQLiteTimeSeriesTransaction::SQLiteTimeSeriesTransaction(SQLiteDatabase& database,
-                                                           const std::string& name) :
-    transaction_(database)
+                                                           const std::string& name,
+                                                           bool isReadOnly) :
+    transaction_(database, isReadOnly)
   {
     Orthanc::SQLite::Statement s
       (transaction_.GetConnection(), SQLITE_FROM_HERE, "SELECT internalId, maxLength, "
-       "maxSize, currentLength, currentSize, lastTimestamp FROM TimeSeries WHERE publicId=?");
+       "maxSize, currentLength, currentSize, lastTimestamp, blockSize, tailLength FROM TimeSeries "
+       "WHERE publicId=?");
     s.BindString(0, name);
         
     if (!s.Step())
@@ -190,6 +633,24 @@ namespace AtomIT
       lastTimestamp_ = s.ColumnInt64(5);
       hasLastTimestamp_ = true;
     }
+
+    blockSize_ = (s.ColumnIsNull(6) ? 0 : static_cast<unsigned int>(s.ColumnInt64(6)));
+
+    if (!isReadOnly)
+    {
+      transaction_.SetTimeSeries(name);
+    }
+
+    if (s.ColumnIsNull(7))
+    {
+      // Database created by a version of Atom-IT that did not track
+      // the tail: Count it once, it is stored by the next update
+      CountTail();
+    }
+    else
+    {
+      tailLength_ = static_cast<uint64_t>(s.ColumnInt64(7));
+    }
   }
 
 
@@ -208,6 +669,21 @@ namespace AtomIT
     LOG(INFO) << "Removing range [" << start << ", "
               << end << "[ in time series \"" << id_ << "\"";
 
+    if (start < end)
+    {
+      uint64_t length, size;
+      DeleteFromBlocks(length, size, start, end - 1);
+
+      if (currentLength_ < length ||
+          currentSize_ < size)
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+      }
+        
+      currentLength_ -= length;
+      currentSize_ -= size;
+    }
+
     {
       Orthanc::SQLite::Statement s
         (transaction_.GetConnection(), SQLITE_FROM_HERE,
@@ -225,13 +701,15 @@ namespace AtomIT
       uint64_t size = s.ColumnInt64(1);
 
       if (currentLength_ < length ||
-          currentSize_ < size)
+          currentSize_ < size ||
+          tailLength_ < length)
       {
         throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
       }
         
       currentLength_ -= length;
       currentSize_ -= size;
+      tailLength_ -= length;
     }
 
     {
@@ -256,6 +734,20 @@ namespace AtomIT
   {
     assert(SanityCheck());
 
+    if (IsBlocked())
+    {
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT firstTimestamp FROM Blocks WHERE id=? ORDER BY lastTimestamp ASC LIMIT 1");
+      s.BindInt64(0, id_);
+
+      if (s.Step())
+      {
+        result = s.ColumnInt64(0);
+        return true;
+      }
+    }
+
     Orthanc::SQLite::Statement s
       (transaction_.GetConnection(), SQLITE_FROM_HERE,
        "SELECT timestamp FROM Content WHERE id=? ORDER BY timestamp ASC LIMIT 1");
@@ -287,10 +779,21 @@ namespace AtomIT
       result = s.ColumnInt64(0);
       return true;
     }
-    else
+    else if (IsBlocked())
     {
-      return false;
+      Orthanc::SQLite::Statement t
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT lastTimestamp FROM Blocks WHERE id=? ORDER BY lastTimestamp DESC LIMIT 1");
+      t.BindInt64(0, id_);
+
+      if (t.Step())
+      {
+        result = t.ColumnInt64(0);
+        return true;
+      }
     }
+
+    return false;
   }
 
     
@@ -299,6 +802,23 @@ namespace AtomIT
   {
     assert(SanityCheck());
 
+    int64_t blockId, firstTimestamp;
+    if (IsBlocked() &&
+        FindBlock(blockId, firstTimestamp, timestamp))
+    {
+      if (firstTimestamp >= timestamp)
+      {
+        result = firstTimestamp;
+      }
+      else
+      {
+        SQLiteBlockCache::BlockPointer block = LoadBlock(blockId);
+        result = block->GetTimestamp(block->LowerBound(timestamp));
+      }
+
+      return true;
+    }
+
     Orthanc::SQLite::Statement s
       (transaction_.GetConnection(), SQLITE_FROM_HERE,
        "SELECT timestamp FROM Content WHERE id=? AND timestamp>=? ORDER BY timestamp ASC LIMIT 1");
@@ -322,6 +842,28 @@ namespace AtomIT
   {
     assert(SanityCheck());
 
+    if (timestamp == std::numeric_limits<int64_t>::max())
+    {
+      return false;
+    }
+
+    int64_t blockId, firstTimestamp;
+    if (IsBlocked() &&
+        FindBlock(blockId, firstTimestamp, timestamp + 1))
+    {
+      if (firstTimestamp > timestamp)
+      {
+        result = firstTimestamp;
+      }
+      else
+      {
+        SQLiteBlockCache::BlockPointer block = LoadBlock(blockId);
+        result = block->GetTimestamp(block->UpperBound(timestamp));
+      }
+
+      return true;
+    }
+
     Orthanc::SQLite::Statement s
       (transaction_.GetConnection(), SQLITE_FROM_HERE,
        "SELECT timestamp FROM Content WHERE id=? AND timestamp>? ORDER BY timestamp ASC LIMIT 1");
@@ -356,6 +898,33 @@ namespace AtomIT
       result = s.ColumnInt64(0);
       return true;
     }
+    else if (!IsBlocked())
+    {
+      return false;
+    }
+
+    int64_t blockId, firstTimestamp;
+    if (FindBlock(blockId, firstTimestamp, timestamp) &&
+        firstTimestamp < timestamp)
+    {
+      // The block contains "timestamp", or a gap around "timestamp"
+      SQLiteBlockCache::BlockPointer block = LoadBlock(blockId);
+      result = block->GetTimestamp(block->LowerBound(timestamp) - 1);
+      return true;
+    }
+
+    Orthanc::SQLite::Statement t
+      (transaction_.GetConnection(), SQLITE_FROM_HERE,
+       "SELECT lastTimestamp FROM Blocks WHERE id=? AND lastTimestamp<? "
+       "ORDER BY lastTimestamp DESC LIMIT 1");
+    t.BindInt64(0, id_);
+    t.BindInt64(1, timestamp);
+
+    if (t.Step())
+    {
+      result = t.ColumnInt64(0);
+      return true;
+    }
     else
     {
       return false;
@@ -368,10 +937,37 @@ namespace AtomIT
                                          int64_t timestamp)
   {
     assert(SanityCheck());
+
+    int64_t blockId, firstTimestamp;
+    if (IsBlocked() &&
+        FindBlock(blockId, firstTimestamp, timestamp))
+    {
+      // The messages in "Content" are all after this block
+      if (firstTimestamp > timestamp)
+      {
+        return false;
+      }
+
+      SQLiteBlockCache::BlockPointer block = LoadBlock(blockId);
+      size_t index = block->LowerBound(timestamp);
+
+      if (block->GetTimestamp(index) == timestamp)
+      {
+        metadata = block->GetMetadata(index);
+        value = block->GetValue(index);
+        return true;
+      }
+      else
+      {
+        return false;
+      }
+    }
       
     Orthanc::SQLite::Statement s
       (transaction_.GetConnection(), SQLITE_FROM_HERE,
-       "SELECT metadata, value FROM Content WHERE id=? AND timestamp=?");
+       "SELECT Metadata.value, Content.value FROM Content "
+       "INNER JOIN Metadata ON Metadata.id=Content.metadata "
+       "WHERE Content.id=? AND Content.timestamp=?");
     s.BindInt64(0, id_);
     s.BindInt64(1, timestamp);
 
@@ -388,6 +984,75 @@ namespace AtomIT
   }
     
 
+  size_t SQLiteTimeSeriesTransaction::Scan(int64_t start,
+                                           int64_t end,
+                                           size_t limit,
+                                           ITimeSeriesVisitor& visitor)
+  {
+    assert(SanityCheck());
+
+    if (start >= end)
+    {
+      return 0;
+    }
+
+    size_t count = 0;
+
+    if (IsBlocked())
+    {
+      Orthanc::SQLite::Statement s
+        (transaction_.GetConnection(), SQLITE_FROM_HERE,
+         "SELECT blockId, firstTimestamp FROM Blocks WHERE id=? AND lastTimestamp>=? "
+         "ORDER BY lastTimestamp ASC");
+      s.BindInt64(0, id_);
+      s.BindInt64(1, start);
+
+      while (s.Step() &&
+             s.ColumnInt64(1) < end)
+      {
+        SQLiteBlockCache::BlockPointer block = LoadBlock(s.ColumnInt64(0));
+
+        for (size_t i = block->LowerBound(start);
+             i < block->GetLength() && block->GetTimestamp(i) < end; i++)
+        {
+          count++;
+
+          if (!visitor.Visit(block->GetTimestamp(i), block->GetMetadata(i), block->GetValue(i)) ||
+              count == limit)
+          {
+            return count;
+          }
+        }
+      }
+    }
+      
+    // A negative LIMIT means no limit in SQLite. The "CROSS JOIN"
+    // forces SQLite to walk "Content" along its primary key.
+    Orthanc::SQLite::Statement s
+      (transaction_.GetConnection(), SQLITE_FROM_HERE,
+       "SELECT Content.timestamp, Metadata.value, Content.value FROM Content "
+       "CROSS JOIN Metadata ON Metadata.id=Content.metadata "
+       "WHERE Content.id=? AND Content.timestamp>=? AND Content.timestamp<? "
+       "ORDER BY Content.timestamp ASC LIMIT ?");
+    s.BindInt64(0, id_);
+    s.BindInt64(1, start);
+    s.BindInt64(2, end);
+    s.BindInt64(3, limit == 0 ? -1 : static_cast<int64_t>(limit - count));
+
+    while (s.Step())
+    {
+      count++;
+
+      if (!visitor.Visit(s.ColumnInt64(0), s.ColumnString(1), s.ColumnString(2)))
+      {
+        break;
+      }
+    }
+
+    return count;
+  }
+    
+
   bool SQLiteTimeSeriesTransaction::Append(int64_t timestamp,
                                            const std::string& metadata,
                                            const std::string& value)
@@ -410,29 +1075,17 @@ namespace AtomIT
       return false;
     }
     
-    if (maxLength_ != 0)
-    {
-      while (currentLength_ + 1 > maxLength_)
-      {
-        RemoveOldest();
-      }
-    }
+    MakeRoom(1, value.size());
 
-    if (maxSize_ != 0)
     {
-      while (currentSize_ + value.size() > maxSize_)
-      {
-        RemoveOldest();
-      }
-    }
+      int64_t metadataId = LookupMetadata(metadata);
 
-    {
       Orthanc::SQLite::Statement s(transaction_.GetConnection(), SQLITE_FROM_HERE,
                                    "INSERT INTO Content VALUES(?, ?, ?, ?, ?)");
       s.BindInt64(0, id_);
       s.BindInt64(1, timestamp);
       s.BindInt64(2, value.size());
-      s.BindString(3, metadata);
+      s.BindInt64(3, metadataId);
       s.BindString(4, value);
 
       if (!s.Run())
@@ -443,6 +1096,7 @@ namespace AtomIT
 
     currentLength_++;
     currentSize_ += value.size();
+    tailLength_++;
 
     if (hasLastTimestamp_)
     {
@@ -455,12 +1109,129 @@ namespace AtomIT
       lastTimestamp_ = timestamp;
     }
 
+    PackTail();
     UpdateTimeSeriesTable();
 
     return true;
   }
 
 
+  size_t SQLiteTimeSeriesTransaction::AppendBatch(const std::vector<Message>& messages)
+  {
+    assert(SanityCheck());
+
+    // Discard the messages that would be rejected by "Append()"
+    std::vector<const Message*> accepted;
+    accepted.reserve(messages.size());
+
+    bool hasLast = hasLastTimestamp_;
+    int64_t last = lastTimestamp_;
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      int64_t timestamp = messages[i].GetTimestamp();
+      
+      if (maxSize_ != 0 &&
+          messages[i].GetValue().size() > maxSize_)
+      {
+        LOG(ERROR) << "Cannot append an observation whose size (" << messages[i].GetValue().size()
+                   << " bytes) is above the max size of the time series (" << maxSize_
+                   << " bytes)";
+      }
+      else if (!hasLast ||
+               timestamp > last)
+      {
+        accepted.push_back(&messages[i]);
+        hasLast = true;
+        last = timestamp;
+      }
+    }
+
+    if (accepted.empty())
+    {
+      return 0;
+    }
+
+    // If the batch alone exceeds the quota, only its most recent
+    // messages are kept, as if they were appended one by one
+    size_t first = accepted.size();
+    uint64_t length = 0;
+    uint64_t size = 0;
+
+    while (first > 0)
+    {
+      uint64_t s = accepted[first - 1]->GetValue().size();
+
+      if ((maxLength_ != 0 && length + 1 > maxLength_) ||
+          (maxSize_ != 0 && size + s > maxSize_))
+      {
+        break;
+      }
+
+      length++;
+      size += s;
+      first--;
+    }
+
+    if (first > 0)
+    {
+      // Some messages of the batch are evicted, so are all the
+      // messages that were previously stored in the time series
+      ClearContent();
+    }
+    else
+    {
+      MakeRoom(length, size);
+    }
+
+    {
+      // The metadata of a batch are mostly identical: Avoid looking
+      // them up in the dictionary for each message
+      std::map<std::string, int64_t> metadataIds;
+
+      for (size_t i = first; i < accepted.size(); i++)
+      {
+        const std::string& metadata = accepted[i]->GetMetadata();
+        if (metadataIds.find(metadata) == metadataIds.end())
+        {
+          metadataIds[metadata] = LookupMetadata(metadata);
+        }
+      }
+
+      Orthanc::SQLite::Statement s(transaction_.GetConnection(), SQLITE_FROM_HERE,
+                                   "INSERT INTO Content VALUES(?, ?, ?, ?, ?)");
+
+      for (size_t i = first; i < accepted.size(); i++)
+      {
+        const Message& message = *accepted[i];
+
+        s.Reset();
+        s.BindInt64(0, id_);
+        s.BindInt64(1, message.GetTimestamp());
+        s.BindInt64(2, message.GetValue().size());
+        s.BindInt64(3, metadataIds[message.GetMetadata()]);
+        s.BindString(4, message.GetValue());
+
+        if (!s.Run())
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+    }
+
+    currentLength_ += length;
+    currentSize_ += size;
+    tailLength_ += length;
+    hasLastTimestamp_ = true;
+    lastTimestamp_ = last;
+
+    PackTail();
+    UpdateTimeSeriesTable();
+
+    return accepted.size();
+  }
+
+
   void SQLiteTimeSeriesTransaction::GetStatistics(uint64_t& length,
                                                   uint64_t& size)
   {
@@ -484,8 +1255,20 @@ namespace AtomIT
       }
     }
 
+    {
+      Orthanc::SQLite::Statement s(transaction_.GetConnection(), SQLITE_FROM_HERE,
+                                   "DELETE FROM Blocks WHERE id=?");
+      s.BindInt64(0, id_);
+
+      if (!s.Run())
+      {
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+      }
+    }
+
     currentLength_ = 0;
     currentSize_ = 0;
+    tailLength_ = 0;
     
     UpdateTimeSeriesTable();
   }
@@ -509,23 +1292,49 @@ namespace AtomIT
                                                 const std::string& name)
   {
     SQLiteTimeSeriesTransaction t(database, name);
-    
-    if (t.maxLength_ != 0)
+    t.MakeRoom(0, 0);
+    t.UpdateTimeSeriesTable();
+
+    assert(t.SanityCheck());
+  }
+
+
+  void SQLiteTimeSeriesTransaction::ChangeBlockSize(SQLiteDatabase& database,
+                                                    const std::string& name,
+                                                    unsigned int blockSize)
+  {
+    SQLiteTimeSeriesTransaction t(database, name);
+
+    if (t.blockSize_ == blockSize)
     {
-      while (t.currentLength_ > t.maxLength_)
-      {
-        t.RemoveOldest();
-      }
+      return;
     }
 
-    if (t.maxSize_ != 0)
+    if (blockSize == 0)
     {
-      while (t.currentSize_ > t.maxSize_)
+      LOG(WARNING) << "Unpacking the blocks of SQLite time series: " << name;
+      t.UnpackBlocks();
+    }
+    else
+    {
+      LOG(WARNING) << "Packing SQLite time series \"" << name
+                   << "\" into blocks of " << blockSize << " messages";
+    }
+
+    {
+      Orthanc::SQLite::Statement s(t.transaction_.GetConnection(), SQLITE_FROM_HERE,
+                                   "UPDATE TimeSeries SET blockSize=? WHERE internalId=?");
+      s.BindInt64(0, blockSize);
+      s.BindInt64(1, t.id_);
+
+      if (!s.Run())
       {
-        t.RemoveOldest();
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
       }
-    }    
+    }
 
+    t.blockSize_ = blockSize;
+    t.PackTail();
     t.UpdateTimeSeriesTable();
 
     assert(t.SanityCheck());
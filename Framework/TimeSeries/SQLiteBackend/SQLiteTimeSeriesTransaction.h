@@ -32,6 +32,10 @@
 #pragma once
 
 #include "SQLiteDatabase.h"
+#include "../ITimeSeriesVisitor.h"
+#include "../../Message.h"
+
+#include <vector>
 
 namespace AtomIT
 {
@@ -48,15 +52,57 @@ namespace AtomIT
     bool      hasLastTimestamp_;
     int64_t   lastTimestamp_;
 
+    // Number of messages in "Content", i.e. not packed into blocks
+    uint64_t  tailLength_;
+
+    // Blocked layout (disabled if zero). Only the messages that are
+    // more recent than the last block are stored in "Content".
+    unsigned int  blockSize_;
+
     bool SanityCheck();
 
+    bool IsBlocked() const
+    {
+      return blockSize_ != 0;
+    }
+
+    SQLiteBlockCache::BlockPointer LoadBlock(int64_t blockId);
+
+    // Looks for the first block whose last timestamp is >= "timestamp"
+    bool FindBlock(int64_t& blockId,
+                   int64_t& firstTimestamp,
+                   int64_t timestamp);
+
+    void StoreBlock(const SQLiteBlock& block);
+
+    // Removes the messages in the range [first, last] from the blocks
+    void DeleteFromBlocks(uint64_t& length,
+                          uint64_t& size,
+                          int64_t first,
+                          int64_t last);
+
+    // Moves the oldest messages of "Content" into new blocks, as long
+    // as "Content" contains at least "blockSize_" messages
+    void PackTail();
+
+    // Counts the messages in "Content" from scratch
+    void CountTail();
+
+    void UnpackBlocks();
+
     void UpdateTimeSeriesTable();
+
+    // Returns the identifier of "metadata" in the dictionary of the
+    // database, possibly registering it
+    int64_t LookupMetadata(const std::string& metadata);
     
-    void RemoveOldest();
+    void MakeRoom(uint64_t length,
+                  uint64_t size);
     
   public:
     SQLiteTimeSeriesTransaction(SQLiteDatabase& database,
-                                const std::string& name);
+                                const std::string& name,
+                                bool isReadOnly = false);
 
     ~SQLiteTimeSeriesTransaction();
 
@@ -80,10 +126,17 @@ namespace AtomIT
               std::string& value,
               int64_t timestamp);
 
+    size_t Scan(int64_t start,
+                int64_t end,
+                size_t limit,
+                ITimeSeriesVisitor& visitor);
+
     bool Append(int64_t timestamp,
                 const std::string& metadata,
                 const std::string& value);
 
+    size_t AppendBatch(const std::vector<Message>& messages);
+
     void GetStatistics(uint64_t& length,
                        uint64_t& size);
 
@@ -91,7 +144,17 @@ namespace AtomIT
 
     bool GetLastTimestamp(int64_t& result);
 
+    // Ticket that will be allocated by the commit of this transaction
+    uint64_t GetNextTicket() const
+    {
+      return transaction_.GetNextTicket();
+    }
+
     static void UpdateQuota(SQLiteDatabase& database,
                             const std::string& name);
+
+    static void ChangeBlockSize(SQLiteDatabase& database,
+                                const std::string& name,
+                                unsigned int blockSize);
   };
 }
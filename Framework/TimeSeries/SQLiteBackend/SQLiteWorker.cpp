@@ -0,0 +1,174 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "SQLiteWorker.h"
+
+#include "SQLiteDatabase.h"
+
+#include <Core/Logging.h>
+#include <Core/OrthancException.h>
+
+#include <vector>
+
+namespace AtomIT
+{
+  static const unsigned int FLUSH_PERIOD = 10;  // In seconds
+
+
+  void SQLiteWorker::Worker(SQLiteWorker* that)
+  {
+    boost::posix_time::ptime nextFlush =
+      boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(FLUSH_PERIOD);
+
+    for (;;)
+    {
+      boost::posix_time::ptime wakeup;
+
+      {
+        // Only the worker clears "wakeup_" and processes the
+        // databases, so a database attached or woken up meanwhile
+        // is processed by the next iteration
+        boost::mutex::scoped_lock processing(that->processingMutex_);
+
+        std::vector<SQLiteDatabase*> databases;
+
+        {
+          boost::mutex::scoped_lock lock(that->mutex_);
+
+          if (!that->continue_)
+          {
+            break;
+          }
+
+          that->wakeup_ = false;
+          databases.assign(that->databases_.begin(), that->databases_.end());
+        }
+
+        const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+        const bool flush = (now >= nextFlush);
+        if (flush)
+        {
+          nextFlush = now + boost::posix_time::seconds(FLUSH_PERIOD);
+        }
+
+        wakeup = nextFlush;
+
+        for (size_t i = 0; i < databases.size(); i++)
+        {
+          try
+          {
+            databases[i]->CommitDueGroup(now, wakeup);
+
+            if (flush)
+            {
+              databases[i]->FlushToDisk();
+            }
+          }
+          catch (Orthanc::OrthancException& e)
+          {
+            LOG(ERROR) << "Error in the background thread of SQLite: " << e.What();
+          }
+        }
+      }
+
+      boost::mutex::scoped_lock lock(that->mutex_);
+
+      while (that->continue_ &&
+             !that->wakeup_)
+      {
+        if (!that->condition_.timed_wait(lock, wakeup))
+        {
+          break;
+        }
+      }
+    }
+  }
+
+
+  SQLiteWorker::SQLiteWorker() :
+    continue_(true),
+    wakeup_(false)
+  {
+    thread_ = boost::thread(Worker, this);
+  }
+
+
+  SQLiteWorker::~SQLiteWorker()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      continue_ = false;
+      condition_.notify_one();
+    }
+
+    if (thread_.joinable())
+    {
+      thread_.join();
+    }
+
+    if (!databases_.empty())
+    {
+      LOG(ERROR) << "Some SQLite databases are still attached to a worker being destroyed";
+    }
+  }
+
+
+  void SQLiteWorker::Attach(SQLiteDatabase& database)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    databases_.insert(&database);
+  }
+
+
+  void SQLiteWorker::Detach(SQLiteDatabase& database)
+  {
+    // Wait for the current iteration of the worker to complete
+    boost::mutex::scoped_lock processing(processingMutex_);
+    boost::mutex::scoped_lock lock(mutex_);
+    databases_.erase(&database);
+  }
+
+
+  void SQLiteWorker::Wakeup()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    wakeup_ = true;
+    condition_.notify_one();
+  }
+
+
+  size_t SQLiteWorker::GetDatabasesCount()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return databases_.size();
+  }
+}
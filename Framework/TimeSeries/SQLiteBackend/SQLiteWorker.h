@@ -0,0 +1,83 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <set>
+
+namespace AtomIT
+{
+  class SQLiteDatabase;
+
+  /**
+   * Single background thread that commits the pending groups, and
+   * periodically flushes to the disk, of several SQLite databases
+   * (e.g. the shards of a time series configuration). This avoids
+   * running two threads per SQLite database. The worker must outlive
+   * the databases that are attached to it.
+   **/
+  class SQLiteWorker : public boost::noncopyable
+  {
+  private:
+    static void Worker(SQLiteWorker* that);
+
+    boost::mutex                 mutex_;
+    boost::condition_variable    condition_;
+    bool                         continue_;
+    bool                         wakeup_;
+    std::set<SQLiteDatabase*>    databases_;
+
+    // Held while the databases are processed, so that a database
+    // cannot be detached (hence destroyed) while being processed
+    boost::mutex                 processingMutex_;
+
+    boost::thread                thread_;
+
+  public:
+    SQLiteWorker();
+
+    ~SQLiteWorker();
+
+    // Called by the constructor and the destructor of "SQLiteDatabase"
+    void Attach(SQLiteDatabase& database);
+
+    void Detach(SQLiteDatabase& database);
+
+    // Called by "SQLiteDatabase" once a new group must be committed,
+    // or once the countdown of its delay has started. This is
+    // compatible with the mutex of the database being held.
+    void Wakeup();
+
+    size_t GetDatabasesCount();
+  };
+}
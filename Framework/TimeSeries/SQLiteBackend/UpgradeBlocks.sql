@@ -0,0 +1,17 @@
+-- Upgrade of the databases created by the versions of Atom-IT that
+-- did not support the blocked layout
+
+ALTER TABLE TimeSeries ADD COLUMN blockSize INTEGER DEFAULT 0;
+ALTER TABLE TimeSeries ADD COLUMN tailLength INTEGER;
+
+CREATE TABLE Blocks(
+       blockId INTEGER PRIMARY KEY AUTOINCREMENT,
+       id INTEGER REFERENCES TimeSeries(internalId) ON DELETE CASCADE,
+       firstTimestamp INTEGER,
+       lastTimestamp INTEGER,
+       length INTEGER,
+       size INTEGER,
+       content BLOB
+       );
+
+CREATE INDEX BlocksIndex ON Blocks(id, lastTimestamp);
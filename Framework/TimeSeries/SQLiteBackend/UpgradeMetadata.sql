@@ -0,0 +1,26 @@
+-- Upgrade of the databases created by the versions of Atom-IT that
+-- stored the metadata as plain text in each row of "Content"
+
+CREATE TABLE Metadata(
+       id INTEGER PRIMARY KEY,
+       value TEXT UNIQUE
+       );
+
+INSERT INTO Metadata(value) SELECT DISTINCT metadata FROM Content;
+
+CREATE TABLE ContentUpgrade(
+       id INTEGER REFERENCES TimeSeries(internalId) ON DELETE CASCADE,
+       timestamp INTEGER,
+       size INTEGER,
+       metadata INTEGER REFERENCES Metadata(id),
+       value TEXT,
+       PRIMARY KEY(id, timestamp)
+       );
+
+INSERT INTO ContentUpgrade
+       SELECT Content.id, Content.timestamp, Content.size, Metadata.id, Content.value
+       FROM Content INNER JOIN Metadata ON Metadata.value = Content.metadata;
+
+DROP TABLE Content;
+
+ALTER TABLE ContentUpgrade RENAME TO Content;
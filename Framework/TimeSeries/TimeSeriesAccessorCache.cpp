@@ -0,0 +1,217 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "TimeSeriesAccessorCache.h"
+
+#include <Core/OrthancException.h>
+
+#include <cassert>
+
+namespace AtomIT
+{
+  TimeSeriesAccessorCache::Entry& 
+  TimeSeriesAccessorCache::Touch(std::vector<Entry>& evicted,
+                                 const std::string& name)
+  {
+    Content::iterator found = content_.find(name);
+
+    if (found != content_.end())
+    {
+      recency_.splice(recency_.begin(), recency_, found->second.recency_);
+      return found->second;
+    }
+
+    while (content_.size() >= capacity_)
+    {
+      Content::iterator oldest = content_.find(recency_.back());
+      assert(oldest != content_.end());
+
+      evicted.push_back(oldest->second);
+      content_.erase(oldest);
+      recency_.pop_back();
+    }
+
+    recency_.push_front(name);
+
+    Entry& entry = content_[name];
+    entry.recency_ = recency_.begin();
+
+    return entry;
+  }
+
+
+  TimeSeriesAccessorCache::TimeSeriesAccessorCache(ITimeSeriesManager& manager,
+                                                   size_t capacity) :
+    manager_(manager),
+    capacity_(capacity),
+    hits_(0),
+    misses_(0)
+  {
+    if (capacity == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  TimeSeriesAccessorCache::ReaderPointer TimeSeriesAccessorCache::GetReader(const std::string& name)
+  {
+    ReaderPointer reader;
+    
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Content::iterator found = content_.find(name);
+      if (found != content_.end())
+      {
+        // Mark the entry as the most recently used one, even if the
+        // reader turns out to be deleted (it is then replaced below)
+        recency_.splice(recency_.begin(), recency_, found->second.recency_);
+        reader = found->second.reader_;
+      }
+    }
+
+    if (reader.get() != NULL &&
+        !reader->IsDeleted())
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      hits_++;
+      return reader;
+    }
+
+    // Create the reader without holding the mutex, as this involves
+    // the manager, and possibly the auto-creation of the series
+    reader.reset(new TimeSeriesReader(manager_, name, false));
+
+    std::vector<Entry> evicted;  // Destroyed after the mutex is released
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      misses_++;
+
+      Entry& entry = Touch(evicted, name);
+
+      if (entry.reader_.get() != NULL)
+      {
+        // Either the cached reader was deleted, or another thread has
+        // concurrently created a reader: Keep the fresh one
+        Entry old;
+        old.reader_ = entry.reader_;
+        evicted.push_back(old);
+      }
+
+      entry.reader_ = reader;
+    }
+
+    return reader;
+  }
+
+
+  TimeSeriesAccessorCache::WriterPointer TimeSeriesAccessorCache::GetWriter(const std::string& name)
+  {
+    WriterPointer writer;
+    
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Content::iterator found = content_.find(name);
+      if (found != content_.end())
+      {
+        // Mark the entry as the most recently used one, even if the
+        // writer turns out to be deleted (it is then replaced below)
+        recency_.splice(recency_.begin(), recency_, found->second.recency_);
+        writer = found->second.writer_;
+      }
+    }
+
+    if (writer.get() != NULL &&
+        !writer->IsDeleted())
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      hits_++;
+      return writer;
+    }
+
+    writer.reset(new TimeSeriesWriter(manager_, name));
+
+    std::vector<Entry> evicted;  // Destroyed after the mutex is released
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      misses_++;
+
+      Entry& entry = Touch(evicted, name);
+
+      if (entry.writer_.get() != NULL)
+      {
+        // Either the cached writer was deleted, or another thread has
+        // concurrently created a writer: Keep the fresh one
+        Entry old;
+        old.writer_ = entry.writer_;
+        evicted.push_back(old);
+      }
+
+      entry.writer_ = writer;
+    }
+
+    return writer;
+  }
+
+
+  void TimeSeriesAccessorCache::Invalidate(const std::string& name)
+  {
+    std::vector<Entry> evicted;  // Destroyed after the mutex is released
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Content::iterator found = content_.find(name);
+
+      if (found != content_.end())
+      {
+        evicted.push_back(found->second);
+        recency_.erase(found->second.recency_);
+        content_.erase(found);
+      }
+    }
+  }
+
+
+  void TimeSeriesAccessorCache::GetStatistics(size_t& size,
+                                              uint64_t& hits,
+                                              uint64_t& misses)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    size = content_.size();
+    hits = hits_;
+    misses = misses_;
+  }
+}
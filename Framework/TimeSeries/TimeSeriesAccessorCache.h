@@ -0,0 +1,106 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "TimeSeriesReader.h"
+#include "TimeSeriesWriter.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+
+namespace AtomIT
+{
+  /**
+   * Thread-safe LRU cache of readers and writers that are shared by
+   * several threads (typically, the threads of the HTTP server), in
+   * order to avoid the creation and registration of an accessor for
+   * each request. The shared objects are only used to create
+   * transactions: "TimeSeriesWriter::WaitForCredits()" must not be
+   * called on a shared writer. An evicted reader or writer is
+   * destroyed once its last user releases it.
+   **/
+  class TimeSeriesAccessorCache : public boost::noncopyable
+  {
+  public:
+    typedef boost::shared_ptr<TimeSeriesReader>  ReaderPointer;
+    typedef boost::shared_ptr<TimeSeriesWriter>  WriterPointer;
+
+  private:
+    typedef std::list<std::string>  Recency;
+
+    struct Entry
+    {
+      ReaderPointer      reader_;
+      WriterPointer      writer_;
+      Recency::iterator  recency_;
+    };
+
+    typedef std::map<std::string, Entry>  Content;
+
+    ITimeSeriesManager&  manager_;
+    boost::mutex         mutex_;
+    size_t               capacity_;
+    Content              content_;
+    Recency              recency_;  // Most recently used first
+    uint64_t             hits_;
+    uint64_t             misses_;
+
+    // The caller must hold "mutex_". Returns the entry, creating it if
+    // needed. The evicted entries are appended to "evicted", so that
+    // they are destroyed after "mutex_" is released.
+    Entry& Touch(std::vector<Entry>& evicted,
+                 const std::string& name);
+
+  public:
+    TimeSeriesAccessorCache(ITimeSeriesManager& manager,
+                            size_t capacity);
+
+    // Throws "ErrorCode_InexistentItem" if the time series does not
+    // exist, and cannot be auto-created
+    ReaderPointer GetReader(const std::string& name);
+
+    WriterPointer GetWriter(const std::string& name);
+
+    void Invalidate(const std::string& name);
+
+    size_t GetCapacity() const
+    {
+      return capacity_;
+    }
+
+    void GetStatistics(size_t& size,
+                       uint64_t& hits,
+                       uint64_t& misses);
+  };
+}
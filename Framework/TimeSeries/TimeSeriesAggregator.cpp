@@ -0,0 +1,364 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "TimeSeriesAggregator.h"
+
+#include <Core/OrthancException.h>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+namespace AtomIT
+{
+  void TimeSeriesAggregator::CloseBucket()
+  {
+    assert(hasCurrent_);
+    buckets_.push_back(current_);
+
+    if (decimation_ == Decimation_MinMax)
+    {
+      if (current_.minTimestamp_ < current_.maxTimestamp_)
+      {
+        points_.push_back(Point(current_.minTimestamp_, current_.min_));
+        points_.push_back(Point(current_.maxTimestamp_, current_.max_));
+      }
+      else if (current_.minTimestamp_ > current_.maxTimestamp_)
+      {
+        points_.push_back(Point(current_.maxTimestamp_, current_.max_));
+        points_.push_back(Point(current_.minTimestamp_, current_.min_));
+      }
+      else
+      {
+        // Only one value in the bucket
+        points_.push_back(Point(current_.minTimestamp_, current_.min_));
+      }
+    }
+  }
+
+
+  double TimeSeriesAggregator::GetOffset(int64_t timestamp) const
+  {
+    // Offsets are taken relative to the last selected point, which
+    // avoids losing the precision of large (e.g. nanoseconds)
+    // timestamps during the conversion to floating-point numbers
+    assert(!points_.empty() &&
+           timestamp >= points_.back().timestamp_);
+    return static_cast<double>(static_cast<uint64_t>(timestamp) -
+                               static_cast<uint64_t>(points_.back().timestamp_));
+  }
+
+
+  void TimeSeriesAggregator::SelectLargestTriangle(const std::vector<Point>& candidates,
+                                                   double nextOffset,
+                                                   double nextValue)
+  {
+    assert(!candidates.empty() &&
+           !points_.empty());
+
+    const double previousValue = points_.back().value_;
+
+    size_t best = 0;
+    double bestArea = -1;
+
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+      // Twice the area of the triangle formed by the last selected
+      // point (at offset 0), the candidate, and the next point
+      double area = std::fabs(nextOffset * (candidates[i].value_ - previousValue) -
+                              GetOffset(candidates[i].timestamp_) * (nextValue - previousValue));
+
+      if (area > bestArea)
+      {
+        best = i;
+        bestArea = area;
+      }
+    }
+
+    points_.push_back(candidates[best]);
+  }
+
+
+  void TimeSeriesAggregator::SelectWithNextBucket(const std::vector<Point>& candidates,
+                                                  const std::vector<Point>& next)
+  {
+    assert(!next.empty());
+
+    double offset = 0;
+    double value = 0;
+
+    for (size_t i = 0; i < next.size(); i++)
+    {
+      offset += GetOffset(next[i].timestamp_);
+      value += next[i].value_;
+    }
+
+    SelectLargestTriangle(candidates,
+                          offset / static_cast<double>(next.size()),
+                          value / static_cast<double>(next.size()));
+  }
+
+
+  void TimeSeriesAggregator::AddLTTB(int64_t timestamp,
+                                     double value,
+                                     bool newBucket)
+  {
+    if (points_.empty())
+    {
+      // The first point is always kept
+      points_.push_back(Point(timestamp, value));
+    }
+    else
+    {
+      if (newBucket &&
+          !currentPoints_.empty())
+      {
+        if (!previousPoints_.empty())
+        {
+          SelectWithNextBucket(previousPoints_, currentPoints_);
+        }
+
+        previousPoints_.swap(currentPoints_);
+        currentPoints_.clear();
+      }
+
+      currentPoints_.push_back(Point(timestamp, value));
+    }
+  }
+
+
+  TimeSeriesAggregator::TimeSeriesAggregator(int64_t from,
+                                             int64_t to,
+                                             unsigned int bucketsCount,
+                                             Decimation decimation) :
+    from_(from),
+    to_(to),
+    decimation_(decimation),
+    hasCurrent_(false),
+    currentIndex_(0),
+    ignored_(0),
+    done_(false)
+  {
+    if (from >= to ||
+        bucketsCount == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+
+    // Unsigned arithmetic, as "to - from" might overflow "int64_t"
+    const uint64_t range = static_cast<uint64_t>(to) - static_cast<uint64_t>(from);
+
+    width_ = range / bucketsCount;
+    if (range % bucketsCount != 0)
+    {
+      width_ += 1;
+    }
+
+    assert(width_ > 0);
+  }
+
+  
+  bool TimeSeriesAggregator::Visit(int64_t timestamp,
+                                   const std::string& metadata,
+                                   const std::string& value)
+  {
+    if (done_)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    double v;
+
+    if (timestamp < from_ ||
+        timestamp >= to_)
+    {
+      return true;
+    }
+    else if (!ParseValue(v, value))
+    {
+      ignored_++;
+      return true;
+    }
+
+    const uint64_t index = (static_cast<uint64_t>(timestamp) -
+                            static_cast<uint64_t>(from_)) / width_;
+
+    const bool newBucket = (!hasCurrent_ ||
+                            index != currentIndex_);
+
+    if (newBucket)
+    {
+      // The items are visited by increasing timestamps
+      assert(!hasCurrent_ || index > currentIndex_);
+
+      if (hasCurrent_)
+      {
+        CloseBucket();
+      }
+
+      hasCurrent_ = true;
+      currentIndex_ = index;
+      current_.start_ = static_cast<int64_t>(static_cast<uint64_t>(from_) + index * width_);
+      current_.count_ = 1;
+      current_.sum_ = v;
+      current_.min_ = v;
+      current_.max_ = v;
+      current_.last_ = v;
+      current_.minTimestamp_ = timestamp;
+      current_.maxTimestamp_ = timestamp;
+      current_.lastTimestamp_ = timestamp;
+    }
+    else
+    {
+      current_.count_ += 1;
+      current_.sum_ += v;
+      current_.last_ = v;
+      current_.lastTimestamp_ = timestamp;
+
+      if (v < current_.min_)
+      {
+        current_.min_ = v;
+        current_.minTimestamp_ = timestamp;
+      }
+
+      if (v > current_.max_)
+      {
+        current_.max_ = v;
+        current_.maxTimestamp_ = timestamp;
+      }
+    }
+
+    if (decimation_ == Decimation_LTTB)
+    {
+      AddLTTB(timestamp, v, newBucket);
+    }
+
+    return true;
+  }
+
+
+  void TimeSeriesAggregator::Finalize()
+  {
+    if (done_)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+
+    if (hasCurrent_)
+    {
+      CloseBucket();
+    }
+
+    if (decimation_ == Decimation_LTTB &&
+        !currentPoints_.empty())
+    {
+      if (!previousPoints_.empty())
+      {
+        SelectWithNextBucket(previousPoints_, currentPoints_);
+      }
+
+      // The last point is always kept, and it is used as the "next
+      // point" of the last bucket
+      const Point last = currentPoints_.back();
+      currentPoints_.pop_back();
+
+      if (!currentPoints_.empty())
+      {
+        SelectLargestTriangle(currentPoints_, GetOffset(last.timestamp_), last.value_);
+      }
+
+      points_.push_back(last);
+    }
+
+    previousPoints_.clear();
+    currentPoints_.clear();
+    done_ = true;
+  }
+
+
+  const std::vector<TimeSeriesAggregator::Bucket>& TimeSeriesAggregator::GetBuckets() const
+  {
+    if (done_)
+    {
+      return buckets_;
+    }
+    else
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+  }
+
+
+  const std::vector<TimeSeriesAggregator::Point>& TimeSeriesAggregator::GetPoints() const
+  {
+    if (done_)
+    {
+      return points_;
+    }
+    else
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadSequenceOfCalls);
+    }
+  }
+
+
+  bool TimeSeriesAggregator::ParseValue(double& target,
+                                        const std::string& value)
+  {
+    if (value.empty())
+    {
+      return false;
+    }
+
+    // "strtod()" skips the leading blanks. The value is not
+    // necessarily null-terminated in the general case, but
+    // "std::string::c_str()" guarantees it.
+    const char* start = value.c_str();
+    char* end = NULL;
+    target = strtod(start, &end);
+
+    if (end == start)
+    {
+      return false;
+    }
+
+    const char* stop = start + value.size();
+    while (end < stop &&
+           (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n'))
+    {
+      end++;
+    }
+
+    return (end == stop &&
+            boost::math::isfinite(target));
+  }
+}
@@ -0,0 +1,171 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "ITimeSeriesVisitor.h"
+
+#include <vector>
+
+namespace AtomIT
+{
+  /**
+   * Computes, in one single scan of a time series, the time-bucketed
+   * aggregates of its numeric values, or a decimated version of the
+   * time series that is suitable for plotting. The range [from, to[
+   * is divided into buckets of equal duration. The values that cannot
+   * be parsed as a finite floating-point number are ignored. As the
+   * scan visits the items by increasing timestamps, each bucket is
+   * closed as soon as the next one starts: Only the non-empty buckets
+   * are stored, and the LTTB decimation only keeps the points of two
+   * consecutive buckets in memory.
+   **/
+  class TimeSeriesAggregator : public ITimeSeriesVisitor
+  {
+  public:
+    enum Decimation
+    {
+      Decimation_None,
+      Decimation_MinMax,  // Minimum and maximum of each bucket
+      Decimation_LTTB     // Largest-Triangle-Three-Buckets
+    };
+
+    struct Bucket
+    {
+      int64_t   start_;
+      uint64_t  count_;
+      double    sum_;
+      double    min_;
+      double    max_;
+      double    last_;
+      int64_t   minTimestamp_;
+      int64_t   maxTimestamp_;
+      int64_t   lastTimestamp_;
+
+      double GetMean() const
+      {
+        return sum_ / static_cast<double>(count_);
+      }
+    };
+
+    struct Point
+    {
+      int64_t  timestamp_;
+      double   value_;
+
+      Point(int64_t timestamp,
+            double value) :
+        timestamp_(timestamp),
+        value_(value)
+      {
+      }
+    };
+
+  private:
+    int64_t             from_;
+    int64_t             to_;
+    uint64_t            width_;
+    Decimation          decimation_;
+    bool                hasCurrent_;
+    uint64_t            currentIndex_;
+    Bucket              current_;
+    uint64_t            ignored_;
+    bool                done_;
+    std::vector<Bucket> buckets_;
+    std::vector<Point>  points_;
+
+    // For LTTB, the points of the current bucket and of the previous
+    // one, whose point is selected once the current bucket is closed
+    std::vector<Point>  previousPoints_;
+    std::vector<Point>  currentPoints_;
+
+    void CloseBucket();
+
+    double GetOffset(int64_t timestamp) const;
+
+    void SelectLargestTriangle(const std::vector<Point>& candidates,
+                               double nextOffset,
+                               double nextValue);
+
+    void SelectWithNextBucket(const std::vector<Point>& candidates,
+                              const std::vector<Point>& next);
+
+    void AddLTTB(int64_t timestamp,
+                 double value,
+                 bool newBucket);
+
+  public:
+    // The range is [from, to[. "bucketsCount" must be > 0.
+    TimeSeriesAggregator(int64_t from,
+                         int64_t to,
+                         unsigned int bucketsCount,
+                         Decimation decimation);
+
+    virtual bool Visit(int64_t timestamp,
+                       const std::string& metadata,
+                       const std::string& value);
+
+    // Must be called once the scan is over
+    void Finalize();
+
+    int64_t GetFrom() const
+    {
+      return from_;
+    }
+
+    int64_t GetTo() const
+    {
+      return to_;
+    }
+
+    uint64_t GetBucketWidth() const
+    {
+      return width_;
+    }
+
+    // Number of values that are not numeric
+    uint64_t GetIgnoredCount() const
+    {
+      return ignored_;
+    }
+
+    // The non-empty buckets, by increasing start timestamp
+    const std::vector<Bucket>& GetBuckets() const;
+
+    // The decimated points, if decimation is enabled
+    const std::vector<Point>& GetPoints() const;
+
+    // Parses a finite floating-point number, possibly surrounded by
+    // blanks, without throwing exceptions
+    static bool ParseValue(double& target,
+                           const std::string& value);
+  };
+}
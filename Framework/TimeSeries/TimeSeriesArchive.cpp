@@ -0,0 +1,322 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "TimeSeriesArchive.h"
+
+#include <Core/Logging.h>
+#include <Core/OrthancException.h>
+
+#include <cassert>
+#include <string.h>
+
+namespace AtomIT
+{
+  static const char   MAGIC[] = { 'A', 'T', 'O', 'M', 'I', 'T', 'A', 'R' };
+  static const uint8_t VERSION = 1;
+
+  static const uint8_t RECORD_MESSAGE = 1;
+  static const uint8_t RECORD_RESET = 2;
+
+  static const uint64_t METADATA_INLINE = 0;
+  static const uint64_t METADATA_NEW_ENTRY = 1;
+  static const uint64_t METADATA_FIRST_ENTRY = 2;
+
+  // Bound the memory that is used by the dictionaries
+  static const size_t MAX_DICTIONARY_SIZE = 4096;
+  static const size_t MAX_INTERNED_LENGTH = 256;
+
+
+  static void WriteVarint(std::string& target,
+                          uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      target.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+
+    target.push_back(static_cast<char>(value));
+  }
+
+
+  static void WriteString(std::string& target,
+                          const std::string& value)
+  {
+    WriteVarint(target, value.size());
+    target.append(value);
+  }
+
+
+  // Returns "false" if the end of the buffer is reached
+  static bool ReadVarint(uint64_t& value,
+                         const std::string& buffer,
+                         size_t& position)
+  {
+    value = 0;
+
+    for (unsigned int shift = 0; ; shift += 7)
+    {
+      if (position >= buffer.size())
+      {
+        return false;
+      }
+
+      const uint8_t byte = static_cast<uint8_t>(buffer[position++]);
+
+      if (shift == 63 &&
+          byte > 1)
+      {
+        LOG(ERROR) << "Overflow in a varint of an archive";
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+      if ((byte & 0x80) == 0)
+      {
+        return true;
+      }
+    }
+  }
+
+
+  static bool ReadString(std::string& value,
+                         const std::string& buffer,
+                         size_t& position)
+  {
+    uint64_t size;
+    if (!ReadVarint(size, buffer, position) ||
+        size > buffer.size() - position)
+    {
+      return false;
+    }
+
+    value.assign(buffer, position, static_cast<size_t>(size));
+    position += static_cast<size_t>(size);
+    return true;
+  }
+
+
+  ArchiveWriter::ArchiveWriter(bool header) :
+    timestamp_(0),
+    count_(0)
+  {
+    if (header)
+    {
+      buffer_.assign(MAGIC, sizeof(MAGIC));
+      buffer_.push_back(static_cast<char>(VERSION));
+    }
+    else
+    {
+      buffer_.push_back(static_cast<char>(RECORD_RESET));
+    }
+  }
+
+
+  void ArchiveWriter::Add(int64_t timestamp,
+                          const std::string& metadata,
+                          const std::string& value)
+  {
+    buffer_.push_back(static_cast<char>(RECORD_MESSAGE));
+
+    // Zigzag encoding of the delta, computed with unsigned arithmetic
+    // that wraps around instead of overflowing
+    const uint64_t delta = static_cast<uint64_t>(timestamp) - static_cast<uint64_t>(timestamp_);
+    WriteVarint(buffer_, (delta << 1) ^ (static_cast<int64_t>(delta) < 0 ? ~static_cast<uint64_t>(0) : 0));
+    timestamp_ = timestamp;
+
+    Dictionary::const_iterator found = dictionary_.find(metadata);
+    if (found != dictionary_.end())
+    {
+      WriteVarint(buffer_, METADATA_FIRST_ENTRY + found->second);
+    }
+    else if (dictionary_.size() < MAX_DICTIONARY_SIZE &&
+             metadata.size() <= MAX_INTERNED_LENGTH)
+    {
+      const uint64_t index = dictionary_.size();
+      dictionary_[metadata] = index;
+      WriteVarint(buffer_, METADATA_NEW_ENTRY);
+      WriteString(buffer_, metadata);
+    }
+    else
+    {
+      WriteVarint(buffer_, METADATA_INLINE);
+      WriteString(buffer_, metadata);
+    }
+
+    WriteString(buffer_, value);
+    count_++;
+  }
+
+
+  void ArchiveWriter::Flush(std::string& target)
+  {
+    target.swap(buffer_);
+    buffer_.clear();
+  }
+
+
+  ArchiveReader::ArchiveReader() :
+    position_(0),
+    hasHeader_(false),
+    timestamp_(0)
+  {
+  }
+
+
+  void ArchiveReader::AddChunk(const void* data,
+                               size_t size)
+  {
+    if (position_ > 0)
+    {
+      // Discard the bytes that have already been decoded
+      buffer_.erase(0, position_);
+      position_ = 0;
+    }
+
+    buffer_.append(reinterpret_cast<const char*>(data), size);
+  }
+
+
+  bool ArchiveReader::ReadMessage(Message& message)
+  {
+    if (!hasHeader_)
+    {
+      if (buffer_.size() - position_ < sizeof(MAGIC) + 1)
+      {
+        return false;
+      }
+      else if (memcmp(buffer_.c_str() + position_, MAGIC, sizeof(MAGIC)) != 0)
+      {
+        LOG(ERROR) << "Not an archive of Atom-IT";
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+      else if (static_cast<uint8_t>(buffer_[position_ + sizeof(MAGIC)]) != VERSION)
+      {
+        LOG(ERROR) << "Unsupported version of archive: "
+                   << static_cast<int>(static_cast<uint8_t>(buffer_[position_ + sizeof(MAGIC)]));
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+      else
+      {
+        position_ += sizeof(MAGIC) + 1;
+        hasHeader_ = true;
+      }
+    }
+
+    for (;;)
+    {
+      if (position_ >= buffer_.size())
+      {
+        return false;
+      }
+
+      const uint8_t kind = static_cast<uint8_t>(buffer_[position_]);
+
+      if (kind == RECORD_RESET)
+      {
+        timestamp_ = 0;
+        dictionary_.clear();
+        position_++;
+      }
+      else if (kind == RECORD_MESSAGE)
+      {
+        break;
+      }
+      else
+      {
+        LOG(ERROR) << "Corrupted archive, unknown record: " << static_cast<int>(kind);
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+    }
+
+    // Decode the record without modifying the state of the reader,
+    // as it might be incomplete
+    size_t position = position_ + 1;
+    uint64_t zigzag, reference;
+    std::string metadata, value;
+
+    if (!ReadVarint(zigzag, buffer_, position) ||
+        !ReadVarint(reference, buffer_, position))
+    {
+      return false;
+    }
+
+    bool isNewEntry = false;
+
+    if (reference == METADATA_INLINE ||
+        reference == METADATA_NEW_ENTRY)
+    {
+      if (!ReadString(metadata, buffer_, position))
+      {
+        return false;
+      }
+
+      isNewEntry = (reference == METADATA_NEW_ENTRY);
+
+      if (isNewEntry &&
+          dictionary_.size() >= MAX_DICTIONARY_SIZE)
+      {
+        LOG(ERROR) << "Corrupted archive, too many entries in the dictionary";
+        throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+      }
+    }
+    else if (reference - METADATA_FIRST_ENTRY < dictionary_.size())
+    {
+      metadata = dictionary_[static_cast<size_t>(reference - METADATA_FIRST_ENTRY)];
+    }
+    else
+    {
+      LOG(ERROR) << "Corrupted archive, bad reference to metadata: " << reference;
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_BadFileFormat);
+    }
+
+    if (!ReadString(value, buffer_, position))
+    {
+      return false;
+    }
+
+    // The record is complete
+    const uint64_t delta = (zigzag >> 1) ^ (zigzag & 1 ? ~static_cast<uint64_t>(0) : 0);
+    timestamp_ = static_cast<int64_t>(static_cast<uint64_t>(timestamp_) + delta);
+    position_ = position;
+
+    if (isNewEntry)
+    {
+      dictionary_.push_back(metadata);
+    }
+
+    message.SetTimestamp(timestamp_);
+    message.SwapMetadata(metadata);
+    message.SwapValue(value);
+    return true;
+  }
+}
@@ -0,0 +1,135 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "ITimeSeriesVisitor.h"
+#include "../Message.h"
+
+#include <map>
+#include <vector>
+
+namespace AtomIT
+{
+  /**
+   * Binary archive of a sequence of messages, used to back up or
+   * migrate time series. An archive is made of a header, followed by
+   * a sequence of records. Each record starts with one byte giving
+   * its kind:
+   *
+   * - A "message" record contains the difference between its
+   *   timestamp and the one of the previous message (zigzag varint),
+   *   a reference to its metadata (varint), and its raw value
+   *   (length-prefixed). The metadata reference is 0 for an inline
+   *   metadata (length-prefixed), 1 for an inline metadata that is
+   *   added to the dictionary of the archive, or "2 + i" for the i-th
+   *   entry of the dictionary.
+   *
+   * - A "reset" record clears the dictionary and the previous
+   *   timestamp. It is used to append to an existing archive.
+   *
+   * All the integers are unsigned LEB128 varints.
+   **/
+  class ArchiveWriter : public ITimeSeriesVisitor
+  {
+  private:
+    typedef std::map<std::string, uint64_t>  Dictionary;
+
+    std::string  buffer_;
+    int64_t      timestamp_;
+    Dictionary   dictionary_;
+    uint64_t     count_;
+
+  public:
+    // If "header" is "false", the writer starts with a "reset" record
+    // instead of the header, so that its output can be appended to an
+    // existing archive
+    explicit ArchiveWriter(bool header);
+
+    void Add(int64_t timestamp,
+             const std::string& metadata,
+             const std::string& value);
+
+    virtual bool Visit(int64_t timestamp,
+                       const std::string& metadata,
+                       const std::string& value)
+    {
+      Add(timestamp, metadata, value);
+      return true;
+    }
+
+    size_t GetBufferSize() const
+    {
+      return buffer_.size();
+    }
+
+    // Moves the encoded bytes to "target", then clears the buffer
+    void Flush(std::string& target);
+
+    uint64_t GetCount() const
+    {
+      return count_;
+    }
+  };
+
+
+  /**
+   * Incremental decoder of an archive, that can be fed with chunks of
+   * arbitrary size.
+   **/
+  class ArchiveReader : public boost::noncopyable
+  {
+  private:
+    std::string               buffer_;
+    size_t                    position_;
+    bool                      hasHeader_;
+    int64_t                   timestamp_;
+    std::vector<std::string>  dictionary_;
+
+  public:
+    ArchiveReader();
+
+    void AddChunk(const void* data,
+                  size_t size);
+
+    // Returns "false" if more data is needed to decode the next
+    // message. Throws "ErrorCode_BadFileFormat" if the archive is
+    // corrupted. The timestamp of "message" is fixed.
+    bool ReadMessage(Message& message);
+
+    // Whether all the bytes received so far have been decoded. At the
+    // end of the input, "false" means that the archive is truncated.
+    bool IsDone() const
+    {
+      return position_ == buffer_.size();
+    }
+  };
+}
@@ -37,6 +37,30 @@
 
 namespace AtomIT
 {
+  class TimeSeriesReader::MessagesCollector : public ITimeSeriesVisitor
+  {
+  private:
+    std::vector<Message>&  target_;
+
+  public:
+    explicit MessagesCollector(std::vector<Message>& target) :
+      target_(target)
+    {
+    }
+
+    virtual bool Visit(int64_t timestamp,
+                       const std::string& metadata,
+                       const std::string& value)
+    {
+      target_.push_back(Message());
+      target_.back().SetTimestamp(timestamp);
+      target_.back().SetMetadata(metadata);
+      target_.back().SetValue(value);
+      return true;
+    }
+  };
+
+
   TimeSeriesReader::Transaction::Transaction(TimeSeriesReader& reader) :
     lock_(reader.accessor_->Lock()),
     valid_(false),
@@ -220,6 +244,40 @@ namespace AtomIT
   }
   
 
+  size_t TimeSeriesReader::Transaction::Scan(int64_t start,
+                                             int64_t end,
+                                             size_t limit,
+                                             ITimeSeriesVisitor& visitor)
+  {
+    if (transaction_.get() == NULL)
+    {
+      assert(!lock_->HasBackend());
+      return 0;
+    }
+    else
+    {
+      return transaction_->Scan(start, end, limit, visitor);
+    }
+  }
+  
+
+  size_t TimeSeriesReader::Transaction::Scan(std::vector<Message>& target,
+                                             int64_t start,
+                                             int64_t end,
+                                             size_t limit)
+  {
+    target.clear();
+
+    if (limit != 0)
+    {
+      target.reserve(limit);
+    }
+
+    MessagesCollector collector(target);
+    return Scan(start, end, limit, collector);
+  }
+  
+
   void TimeSeriesReader::Transaction::GetStatistics(uint64_t& length,
                                                     uint64_t& size)
   {
@@ -251,4 +309,11 @@ namespace AtomIT
   {
     return accessor_->WaitModification(milliseconds);
   }
+
+
+  bool TimeSeriesReader::IsDeleted()
+  {
+    std::auto_ptr<ITimeSeriesAccessor::ILock> lock(accessor_->Lock());
+    return !lock->HasBackend();
+  }
 }
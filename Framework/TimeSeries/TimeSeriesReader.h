@@ -40,6 +40,8 @@ namespace AtomIT
   class TimeSeriesReader : public boost::noncopyable
   {
   private:
+    class MessagesCollector;
+
     std::auto_ptr<ITimeSeriesAccessor>  accessor_;
 
   public:
@@ -76,6 +78,19 @@ namespace AtomIT
       bool Read(std::string& metadata,
                 std::string& value);
 
+      // Reads a range of items in one single pass, independently of
+      // the reading head (cf. "ITimeSeriesBackend::ITransaction::Scan()")
+      size_t Scan(int64_t start,
+                  int64_t end,
+                  size_t limit,
+                  ITimeSeriesVisitor& visitor);
+
+      // Same as above, but stores the items as messages in "target"
+      size_t Scan(std::vector<Message>& target,
+                  int64_t start,
+                  int64_t end,
+                  size_t limit);
+
       void GetStatistics(uint64_t& length,
                          uint64_t& size);
     };
@@ -86,5 +101,9 @@ namespace AtomIT
                      bool hasSynchronousWait);
 
     bool WaitModification(unsigned int milliseconds);
+
+    // Tells whether the time series was deleted after the creation
+    // of this reader, in which case all the transactions are empty
+    bool IsDeleted();
   };
 }
@@ -35,11 +35,13 @@
 
 #include <Core/Logging.h>
 #include <Core/OrthancException.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <cassert>
 
 namespace AtomIT
 {
   TimeSeriesWriter::Transaction::Transaction(TimeSeriesWriter& writer) :
+    writer_(writer),
     lock_(writer.accessor_->Lock()),
     modified_(false)
   {
@@ -57,6 +59,16 @@ namespace AtomIT
   
   TimeSeriesWriter::Transaction::~Transaction()
   {
+    if (modified_ &&
+        transaction_.get() != NULL)
+    {
+      uint64_t ticket = transaction_->GetDurabilityTicket();
+      if (ticket > writer_.ticket_)
+      {
+        writer_.ticket_ = ticket;
+      }
+    }
+
     // Unlock the write transaction so that readers can be
     // notified about modification
     transaction_.reset(NULL);
@@ -109,6 +121,29 @@ namespace AtomIT
   }
       
 
+  size_t TimeSeriesWriter::Transaction::AppendBatch(const std::vector<Message>& messages)
+  {
+    if (transaction_.get() == NULL)
+    {
+      assert(!lock_->HasBackend());
+      return 0;
+    }
+    else
+    {
+      assert(lock_->HasBackend());
+
+      size_t count = transaction_->AppendBatch(messages);
+      
+      if (count > 0)
+      {
+        modified_ = true;
+      }
+
+      return count;
+    }
+  }
+      
+
   bool TimeSeriesWriter::Transaction::DeleteRange(int64_t start,
                                                   int64_t end)
   {
@@ -148,51 +183,56 @@ namespace AtomIT
   }
 
   
-  bool TimeSeriesWriter::Append(const Message& message)
+  static int64_t GenerateTimestamp(const Message& message,
+                                   TimestampType defaultType,
+                                   bool hasLastTimestamp,
+                                   int64_t lastTimestamp)
   {
-    Transaction transaction(*this);
-
     TimestampType type = message.GetTimestampType();
     if (type == TimestampType_Default)
     {
-      type = transaction.GetDefaultTimestampType();
+      type = defaultType;
     }
 
-    int64_t timestamp;
-
     switch (type)
     {
       case TimestampType_Fixed:
-        timestamp = message.GetTimestamp();
-        break;
+        return message.GetTimestamp();
 
       case TimestampType_NanosecondsClock:
-        timestamp = Toolbox::GetNanosecondsClockTimestamp();
-        break;
+        return Toolbox::GetNanosecondsClockTimestamp();
 
       case TimestampType_MillisecondsClock:
-        timestamp = Toolbox::GetMillisecondsClockTimestamp();
-        break;
+        return Toolbox::GetMillisecondsClockTimestamp();
 
       case TimestampType_SecondsClock:
-        timestamp = Toolbox::GetSecondsClockTimestamp();
-        break;
+        return Toolbox::GetSecondsClockTimestamp();
 
       case TimestampType_Sequence:
-        if (transaction.GetLastTimestamp(timestamp))
+        if (hasLastTimestamp)
         {
-          timestamp += 1;
+          return lastTimestamp + 1;
         }
         else
         {
-          timestamp = 0;   // The sequence is empty
+          return 0;   // The sequence is empty
         }
 
-        break;
-
       default:
         throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
     }
+  }
+
+
+  bool TimeSeriesWriter::Append(const Message& message)
+  {
+    Transaction transaction(*this);
+
+    int64_t last;
+    bool hasLast = transaction.GetLastTimestamp(last);
+
+    int64_t timestamp = GenerateTimestamp(message, transaction.GetDefaultTimestampType(),
+                                          hasLast, last);
 
     if (transaction.Append(timestamp, message.GetMetadata(), message.GetValue()))
     {
@@ -205,11 +245,142 @@ namespace AtomIT
       return false;
     }
   }
+
+
+  size_t TimeSeriesWriter::Append(const std::vector<Message>& messages)
+  {
+    Transaction transaction(*this);
+
+    int64_t last;
+    bool hasLast = transaction.GetLastTimestamp(last);
+
+    std::vector<Message> batch;
+    batch.reserve(messages.size());
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+      int64_t timestamp = GenerateTimestamp(messages[i], transaction.GetDefaultTimestampType(),
+                                            hasLast, last);
+
+      batch.push_back(messages[i]);
+      batch.back().SetTimestamp(timestamp);
+
+      if (!hasLast ||
+          timestamp > last)
+      {
+        hasLast = true;
+        last = timestamp;
+      }
+    }
+
+    size_t count = transaction.AppendBatch(batch);
+
+    if (count != messages.size())
+    {
+      LOG(ERROR) << "Cannot add " << (messages.size() - count) << " out of "
+                 << messages.size() << " items, as their timestamp is not after "
+                 << "the last item of the time series";
+    }
+
+    return count;
+  }
   
     
+  uint64_t TimeSeriesWriter::GetLength()
+  {
+    std::auto_ptr<ITimeSeriesAccessor::ILock> lock(accessor_->Lock());
+
+    if (lock->HasBackend())
+    {
+      std::auto_ptr<ITimeSeriesBackend::ITransaction> transaction
+        (lock->GetBackend().CreateTransaction(true));
+
+      uint64_t length, size;
+      transaction->GetStatistics(length, size);
+      return length;
+    }
+    else
+    {
+      return 0;  // The time series was deleted, don't block the producer
+    }
+  }
+
+
+  uint64_t TimeSeriesWriter::WaitForCredits(uint64_t& length,
+                                            uint64_t maxPending,
+                                            unsigned int milliseconds)
+  {
+    length = GetLength();
+
+    if (length < maxPending)
+    {
+      return maxPending - length;  // Fast path, no credit is missing
+    }
+
+    if (milliseconds == 0)
+    {
+      return 0;
+    }
+
+    if (ready_.get() == NULL)
+    {
+      ready_.reset(manager_.CreateReadySet());
+      ready_->Add(name_);
+    }
+
+    const boost::posix_time::ptime deadline = (boost::posix_time::microsec_clock::universal_time() +
+                                               boost::posix_time::milliseconds(milliseconds));
+
+    for (;;)
+    {
+      // The length is checked once again, as the series might have
+      // been modified before the ready set was created
+      length = GetLength();
+
+      if (length < maxPending)
+      {
+        return maxPending - length;
+      }
+
+      boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+      std::set<std::string> ready;
+      if (now >= deadline ||
+          !ready_->Wait(ready, static_cast<unsigned int>((deadline - now).total_milliseconds()) + 1))
+      {
+        return 0;
+      }
+    }
+  }
+
+    
+  void TimeSeriesWriter::WaitDurable()
+  {
+    if (ticket_ != 0)
+    {
+      std::auto_ptr<ITimeSeriesAccessor::ILock> lock(accessor_->Lock());
+
+      if (lock->HasBackend())
+      {
+        lock->GetBackend().WaitDurable(ticket_);
+      }
+    }
+  }
+
+    
+  bool TimeSeriesWriter::IsDeleted()
+  {
+    std::auto_ptr<ITimeSeriesAccessor::ILock> lock(accessor_->Lock());
+    return !lock->HasBackend();
+  }
+
+
   TimeSeriesWriter::TimeSeriesWriter(ITimeSeriesManager& manager,
                                      const std::string& name) :
-    accessor_(manager.CreateAccessor(name, false))
+    manager_(manager),
+    name_(name),
+    accessor_(manager.CreateAccessor(name, false)),
+    ticket_(0)
   {
     if (accessor_.get() == NULL)
     {
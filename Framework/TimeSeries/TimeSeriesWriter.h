@@ -35,18 +35,26 @@
 #include "../Message.h"
 
 #include <memory>
+#include <vector>
 
 namespace AtomIT
 {
   class TimeSeriesWriter : public boost::noncopyable
   {
   private:
+    ITimeSeriesManager&                 manager_;
+    std::string                         name_;
     std::auto_ptr<ITimeSeriesAccessor>  accessor_;
+    std::auto_ptr<ISeriesReadySet>      ready_;  // Created on the first stall
+    uint64_t                            ticket_;  // Last modification, for "WaitDurable()"
+
+    uint64_t GetLength();
 
   public:
     class Transaction : public boost::noncopyable
     {
     private:
+      TimeSeriesWriter&                                writer_;
       std::auto_ptr<ITimeSeriesAccessor::ILock>        lock_;
       std::auto_ptr<ITimeSeriesBackend::ITransaction>  transaction_;
       bool                                             modified_;
@@ -62,6 +70,9 @@ namespace AtomIT
                   const std::string& metadata,
                   const std::string& value);
 
+      // All the messages must have a fixed timestamp
+      size_t AppendBatch(const std::vector<Message>& messages);
+
       bool DeleteRange(int64_t start,
                        int64_t end);
 
@@ -75,5 +86,28 @@ namespace AtomIT
                      const std::string& name);
 
     bool Append(const Message& message);
+
+    // Appends all the messages within one single transaction. Returns
+    // the number of messages that were appended.
+    size_t Append(const std::vector<Message>& messages);
+
+    // Credit-based flow control. Returns the number of messages that
+    // can be appended before the time series contains "maxPending"
+    // messages, and stores its current length in "length". If no
+    // credit is available, waits for at most "milliseconds" for the
+    // consumers to pop messages from the time series.
+    uint64_t WaitForCredits(uint64_t& length,
+                            uint64_t maxPending,
+                            unsigned int milliseconds);
+
+    // Waits until all the modifications done by this writer are
+    // durably stored by the backend of the time series (e.g. until
+    // the group commit of a SQLite database). Throws an exception if
+    // some of them were rolled back.
+    void WaitDurable();
+
+    // Tells whether the time series was deleted after the creation
+    // of this writer, in which case all the appends fail
+    bool IsDeleted();
   };
 }
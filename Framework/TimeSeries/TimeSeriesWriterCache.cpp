@@ -0,0 +1,141 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "TimeSeriesWriterCache.h"
+
+#include <Core/OrthancException.h>
+
+#include <cassert>
+
+namespace AtomIT
+{
+  TimeSeriesWriterCache::TimeSeriesWriterCache(ITimeSeriesManager& manager,
+                                               size_t capacity) :
+    manager_(manager),
+    capacity_(capacity),
+    hits_(0),
+    misses_(0)
+  {
+    if (capacity == 0)
+    {
+      throw Orthanc::OrthancException(Orthanc::ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  TimeSeriesWriterCache::~TimeSeriesWriterCache()
+  {
+    Clear();
+  }
+
+
+  TimeSeriesWriter& TimeSeriesWriterCache::GetWriter(const std::string& name)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Content::iterator found = content_.find(name);
+
+    if (found != content_.end())
+    {
+      hits_++;
+      recency_.splice(recency_.begin(), recency_, found->second.recency_);
+
+      assert(found->second.writer_ != NULL);
+      return *found->second.writer_;
+    }
+
+    misses_++;
+
+    // Create the writer before evicting, as this might throw
+    std::auto_ptr<TimeSeriesWriter> writer(new TimeSeriesWriter(manager_, name));
+
+    while (content_.size() >= capacity_)
+    {
+      Content::iterator oldest = content_.find(recency_.back());
+      assert(oldest != content_.end());
+
+      delete oldest->second.writer_;
+      content_.erase(oldest);
+      recency_.pop_back();
+    }
+
+    recency_.push_front(name);
+
+    Entry& entry = content_[name];
+    entry.writer_ = writer.release();
+    entry.recency_ = recency_.begin();
+
+    return *entry.writer_;
+  }
+
+
+  void TimeSeriesWriterCache::Invalidate(const std::string& name)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Content::iterator found = content_.find(name);
+
+    if (found != content_.end())
+    {
+      assert(found->second.writer_ != NULL);
+      delete found->second.writer_;
+
+      recency_.erase(found->second.recency_);
+      content_.erase(found);
+    }
+  }
+
+
+  void TimeSeriesWriterCache::Clear()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    for (Content::iterator it = content_.begin(); it != content_.end(); ++it)
+    {
+      assert(it->second.writer_ != NULL);
+      delete it->second.writer_;
+    }
+
+    content_.clear();
+    recency_.clear();
+  }
+
+
+  void TimeSeriesWriterCache::GetStatistics(size_t& size,
+                                            uint64_t& hits,
+                                            uint64_t& misses)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    size = content_.size();
+    hits = hits_;
+    misses = misses_;
+  }
+}
@@ -0,0 +1,100 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "TimeSeriesWriter.h"
+
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+
+namespace AtomIT
+{
+  /**
+   * LRU cache of the writers to a set of time series, indexed by the
+   * name of the time series. This avoids going through the time
+   * series manager (global mutex, and registration of the accessor)
+   * each time a message is appended. The writers are owned by one
+   * single thread (typically, a filter): Only "GetStatistics()" can
+   * be called from another thread.
+   *
+   * A cached writer keeps working on its time series if the latter is
+   * deleted, but all of its appends fail. In such a case, the caller
+   * must "Invalidate()" the writer, then retry with a fresh writer,
+   * that will possibly auto-create the time series again.
+   **/
+  class TimeSeriesWriterCache : public boost::noncopyable
+  {
+  private:
+    typedef std::list<std::string>  Recency;
+
+    struct Entry
+    {
+      TimeSeriesWriter*  writer_;
+      Recency::iterator  recency_;
+    };
+
+    typedef std::map<std::string, Entry>  Content;
+
+    ITimeSeriesManager&  manager_;
+    boost::mutex         mutex_;
+    size_t               capacity_;
+    Content              content_;
+    Recency              recency_;  // Most recently used first
+    uint64_t             hits_;
+    uint64_t             misses_;
+
+  public:
+    TimeSeriesWriterCache(ITimeSeriesManager& manager,
+                          size_t capacity);
+
+    ~TimeSeriesWriterCache();
+
+    // Throws "ErrorCode_InexistentItem" if the time series does not
+    // exist, and cannot be auto-created. The reference is valid until
+    // the next call to a non-const method.
+    TimeSeriesWriter& GetWriter(const std::string& name);
+
+    void Invalidate(const std::string& name);
+
+    void Clear();
+
+    size_t GetCapacity() const
+    {
+      return capacity_;
+    }
+
+    void GetStatistics(size_t& size,
+                       uint64_t& hits,
+                       uint64_t& misses);
+  };
+}
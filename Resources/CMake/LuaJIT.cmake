@@ -0,0 +1,30 @@
+# This file must be included before
+# "OrthancFrameworkConfiguration.cmake". LuaJIT implements the API of
+# Lua 5.1, and is plugged into the "FindLua" module of CMake that is
+# used by the Orthanc framework if "USE_SYSTEM_LUA" is set.
+
+if (ENABLE_LUAJIT)
+  if (STATIC_BUILD)
+    message(FATAL_ERROR "LuaJIT is only available if linking against the system libraries")
+  endif()
+
+  find_path(LUAJIT_INCLUDE_DIR luajit.h
+    PATH_SUFFIXES luajit-2.1 luajit-2.0
+    )
+
+  find_library(LUAJIT_LIBRARY
+    NAMES luajit-5.1 luajit
+    )
+
+  if (NOT LUAJIT_INCLUDE_DIR OR NOT LUAJIT_LIBRARY)
+    message(FATAL_ERROR "Please install the libluajit-5.1-dev package")
+  endif()
+
+  set(USE_SYSTEM_LUA ON CACHE BOOL "" FORCE)
+  set(LUA_INCLUDE_DIR ${LUAJIT_INCLUDE_DIR} CACHE PATH "" FORCE)
+  set(LUA_LIBRARY ${LUAJIT_LIBRARY} CACHE FILEPATH "" FORCE)
+
+  add_definitions(-DATOMIT_ENABLE_LUAJIT=1)
+else()
+  add_definitions(-DATOMIT_ENABLE_LUAJIT=0)
+endif()
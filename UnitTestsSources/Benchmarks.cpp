@@ -0,0 +1,174 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../Framework/TimeSeries/GenericTimeSeriesManager.h"
+#include "../Framework/TimeSeries/MemoryBackend/MemoryTimeSeriesBackend.h"
+
+#include <Core/Logging.h>
+
+#include <boost/atomic.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <stdio.h>
+
+
+/**
+ * Microbenchmark of the lookup of existing time series by the
+ * manager, which happens each time an accessor (hence a reader or a
+ * writer) is created. Each thread repeatedly opens accessors to its
+ * own time series, so that the only shared structure is the index of
+ * the manager.
+ **/
+
+static const unsigned int SERIES_PER_THREAD = 16;
+static const unsigned int DURATION = 1000;  // In milliseconds
+
+
+class BenchmarkFactory : public AtomIT::ITimeSeriesFactory
+{
+public:
+  virtual void ListManualTimeSeries(std::map<std::string, AtomIT::TimestampType>& target)
+  {
+    target.clear();
+  }                                      
+
+  virtual AtomIT::ITimeSeriesBackend* CreateManualTimeSeries(const std::string& name)
+  {
+    return new AtomIT::MemoryTimeSeriesBackend(0, 0);
+  }
+
+  virtual AtomIT::ITimeSeriesBackend* CreateAutoTimeSeries(AtomIT::TimestampType& timestampType,
+                                                           const std::string& name)
+  {
+    return NULL;
+  }
+};
+
+
+static std::string GetSeriesName(unsigned int thread,
+                                 unsigned int series)
+{
+  return ("t" + boost::lexical_cast<std::string>(thread) +
+          "-" + boost::lexical_cast<std::string>(series));
+}
+
+
+static void Worker(AtomIT::ITimeSeriesManager* manager,
+                   unsigned int thread,
+                   const boost::atomic<bool>* done,
+                   uint64_t* count)
+{
+  std::vector<std::string> names;
+  for (unsigned int i = 0; i < SERIES_PER_THREAD; i++)
+  {
+    names.push_back(GetSeriesName(thread, i));
+  }
+
+  uint64_t local = 0;
+
+  while (!done->load())
+  {
+    for (unsigned int i = 0; i < SERIES_PER_THREAD; i++)
+    {
+      std::auto_ptr<AtomIT::ITimeSeriesAccessor> accessor
+        (manager->CreateAccessor(names[i], false));
+    }
+
+    local += SERIES_PER_THREAD;
+  }
+
+  *count = local;
+}
+
+
+static void RunLookups(AtomIT::ITimeSeriesManager& manager,
+                       unsigned int countThreads)
+{
+  std::vector<uint64_t> counts(countThreads);
+  boost::atomic<bool> done(false);
+
+  std::vector<boost::thread*> threads(countThreads);
+  for (unsigned int i = 0; i < countThreads; i++)
+  {
+    threads[i] = new boost::thread(Worker, &manager, i,
+                                   &done, &counts[i]);
+  }
+
+  boost::this_thread::sleep(boost::posix_time::milliseconds(DURATION));
+  done.store(true);
+
+  uint64_t total = 0;
+  for (unsigned int i = 0; i < countThreads; i++)
+  {
+    threads[i]->join();
+    delete threads[i];
+    total += counts[i];
+  }
+
+  const double rate = static_cast<double>(total) * 1000.0 / static_cast<double>(DURATION);
+  printf("%3u thread(s): %12.0f lookups/s (%10.0f per thread)\n",
+         countThreads, rate, rate / static_cast<double>(countThreads));
+}
+
+
+int main(int argc, char **argv)
+{
+  Orthanc::Logging::Initialize();
+
+  unsigned int maxThreads = 64;
+  if (argc >= 2)
+  {
+    maxThreads = boost::lexical_cast<unsigned int>(argv[1]);
+  }
+
+  printf("Hardware concurrency: %u\n", boost::thread::hardware_concurrency());
+
+  {
+    AtomIT::GenericTimeSeriesManager manager(new BenchmarkFactory);
+
+    for (unsigned int i = 0; i < maxThreads; i++)
+    {
+      for (unsigned int j = 0; j < SERIES_PER_THREAD; j++)
+      {
+        manager.CreateTimeSeries(GetSeriesName(i, j), AtomIT::TimestampType_Sequence);
+      }
+    }
+
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+      RunLookups(manager, threads);
+    }
+  }
+
+  Orthanc::Logging::Finalize();
+
+  return 0;
+}
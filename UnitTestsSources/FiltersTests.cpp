@@ -0,0 +1,1126 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../Applications/FilterScheduler.h"
+#include "../Framework/Filters/AdapterFilter.h"
+#include "../Framework/Filters/CSVFileSourceFilter.h"
+#include "../Framework/Filters/DemultiplexerFilter.h"
+#include "../Framework/Filters/HttpPostSinkFilter.h"
+#include "../Framework/Filters/LuaFilter.h"
+#include "../Framework/Filters/RollupFilter.h"
+#include "../Framework/TimeSeries/GenericTimeSeriesManager.h"
+#include "../Framework/TimeSeries/TimeSeriesReader.h"
+#include "../Framework/TimeSeries/TimeSeriesWriter.h"
+#include "../Framework/TimeSeries/MemoryBackend/MemoryTimeSeriesBackend.h"
+#include "../Framework/TimeSeries/SQLiteBackend/SQLiteTimeSeriesBackend.h"
+
+#include <Core/OrthancException.h>
+#include <Core/SystemToolbox.h>
+
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <limits>
+
+
+namespace
+{
+  class MemoryFactory : public AtomIT::ITimeSeriesFactory
+  {
+  public:
+    virtual void ListManualTimeSeries(std::map<std::string, AtomIT::TimestampType>& target)
+    {
+      target.clear();
+    }
+
+    virtual AtomIT::ITimeSeriesBackend* CreateManualTimeSeries(const std::string& name)
+    {
+      return new AtomIT::MemoryTimeSeriesBackend(0, 0);
+    }
+
+    virtual AtomIT::ITimeSeriesBackend* CreateAutoTimeSeries(AtomIT::TimestampType& timestampType,
+                                                             const std::string& name)
+    {
+      timestampType = AtomIT::TimestampType_Sequence;
+      return new AtomIT::MemoryTimeSeriesBackend(0, 0);
+    }
+  };
+
+
+  class SQLiteFactory : public AtomIT::ITimeSeriesFactory
+  {
+  private:
+    AtomIT::SQLiteDatabase&        database_;
+    AtomIT::ITimeSeriesObserver*   observer_;
+
+  public:
+    explicit SQLiteFactory(AtomIT::SQLiteDatabase& database) :
+      database_(database),
+      observer_(NULL)
+    {
+    }
+
+    virtual void ListManualTimeSeries(std::map<std::string, AtomIT::TimestampType>& target)
+    {
+      target.clear();
+    }
+
+    virtual AtomIT::ITimeSeriesBackend* CreateManualTimeSeries(const std::string& name)
+    {
+      database_.CreateTimeSeries(name, 0, 0);
+      return new AtomIT::SQLiteTimeSeriesBackend(database_, name);
+    }
+
+    virtual void SetCommitObserver(AtomIT::ITimeSeriesObserver* observer)
+    {
+      if (observer_ != NULL)
+      {
+        database_.UnregisterObserver(*observer_);
+      }
+
+      if (observer != NULL)
+      {
+        database_.RegisterObserver(*observer);
+      }
+
+      observer_ = observer;
+    }
+
+    virtual AtomIT::ITimeSeriesBackend* CreateAutoTimeSeries(AtomIT::TimestampType& timestampType,
+                                                             const std::string& name)
+    {
+      return NULL;
+    }
+  };
+
+
+  void AppendValues(AtomIT::ITimeSeriesManager& manager,
+                    const std::string& timeSeries,
+                    int64_t start,
+                    int64_t end)
+  {
+    AtomIT::TimeSeriesWriter writer(manager, timeSeries);
+
+    for (int64_t i = start; i < end; i++)
+    {
+      AtomIT::Message message;
+      message.SetTimestamp(i);
+      message.SetValue(boost::lexical_cast<std::string>(i));
+      ASSERT_TRUE(writer.Append(message));
+    }
+  }
+
+
+  void AppendValue(AtomIT::ITimeSeriesManager& manager,
+                   const std::string& timeSeries,
+                   int64_t timestamp,
+                   const std::string& value)
+  {
+    AtomIT::TimeSeriesWriter writer(manager, timeSeries);
+
+    AtomIT::Message message;
+    message.SetTimestamp(timestamp);
+    message.SetValue(value);
+    ASSERT_TRUE(writer.Append(message));
+  }
+
+
+  // Steps the filter until its input is exhausted
+  void StepUntilIdle(AtomIT::IFilter& filter)
+  {
+    for (;;)
+    {
+      bool idle;
+      ASSERT_TRUE(filter.TryStep(idle));
+      if (idle)
+      {
+        break;
+      }
+    }
+  }
+
+
+  uint64_t GetLength(AtomIT::ITimeSeriesManager& manager,
+                     const std::string& timeSeries)
+  {
+    AtomIT::TimeSeriesReader reader(manager, timeSeries, false);
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+
+    uint64_t length, size;
+    transaction.GetStatistics(length, size);
+    return length;
+  }
+
+
+  // Waits for at most 5 seconds for a time series to contain
+  // "expected" messages
+  bool WaitLength(AtomIT::ITimeSeriesManager& manager,
+                  const std::string& timeSeries,
+                  uint64_t expected)
+  {
+    for (unsigned int i = 0; i < 500; i++)
+    {
+      if (GetLength(manager, timeSeries) == expected)
+      {
+        return true;
+      }
+
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+
+    return false;
+  }
+
+
+  void ReadContent(std::vector<AtomIT::Message>& content,
+                   AtomIT::ITimeSeriesManager& manager,
+                   const std::string& timeSeries)
+  {
+    AtomIT::TimeSeriesReader reader(manager, timeSeries, false);
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+    transaction.Scan(content, std::numeric_limits<int64_t>::min(),
+                     std::numeric_limits<int64_t>::max(), 0);
+  }
+
+
+  // Runs a "CSVFileSourceFilter" over the given content, and returns
+  // the messages that were accepted
+  void ReadCSV(std::vector<AtomIT::Message>& content,
+               const std::string& csv,
+               bool base64)
+  {
+    boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                    boost::filesystem::unique_path("atomit-%%%%-%%%%.csv"));
+    Orthanc::SystemToolbox::WriteFile(csv, path.string());
+
+    {
+      AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+      manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+
+      AtomIT::CSVFileSourceFilter filter("csv", manager, "output", path);
+      filter.SetBase64Encoded(base64);
+      filter.SetBatchSize(10);
+      filter.Start();
+
+      for (unsigned int i = 0; filter.Step(); i++)
+      {
+        ASSERT_LT(i, 1000u);
+      }
+
+      filter.Stop();
+      ReadContent(content, manager, "output");
+    }
+
+    boost::filesystem::remove(path);
+  }
+
+
+  // Fails on the messages whose value is a multiple of 3
+  class FailingFilter : public AtomIT::AdapterFilter
+  {
+  private:
+    std::vector<int64_t>  pushed_;
+
+  protected:
+    virtual PushStatus Push(const AtomIT::Message& message)
+    {
+      if (boost::lexical_cast<int>(message.GetValue()) % 3 == 0)
+      {
+        return PushStatus_Failure;
+      }
+      else
+      {
+        pushed_.push_back(message.GetTimestamp());
+        return PushStatus_Success;
+      }
+    }
+
+  public:
+    FailingFilter(AtomIT::ITimeSeriesManager& manager,
+                  const std::string& input) :
+      AdapterFilter("failing", manager, input)
+    {
+    }
+
+    const std::vector<int64_t>& GetPushed() const
+    {
+      return pushed_;
+    }
+  };
+
+
+  // Copies its input to its output, and counts its steps
+  class CopyFilter : public AtomIT::AdapterFilter
+  {
+  private:
+    AtomIT::TimeSeriesWriter  writer_;
+    boost::mutex              mutex_;
+    unsigned int              steps_;
+    bool                      throw_;
+
+  protected:
+    virtual PushStatus Push(const AtomIT::Message& message)
+    {
+      return writer_.Append(message) ? PushStatus_Success : PushStatus_Failure;
+    }
+
+  public:
+    CopyFilter(AtomIT::ITimeSeriesManager& manager,
+               const std::string& input,
+               const std::string& output) :
+      AdapterFilter("copy", manager, input),
+      writer_(manager, output),
+      steps_(0),
+      throw_(false)
+    {
+      SetReplayHistory(true);
+    }
+
+    void SetThrow(bool value)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      throw_ = value;
+    }
+
+    unsigned int GetStepsCount()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      return steps_;
+    }
+
+    virtual bool TryStep(bool& idle)
+    {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        steps_++;
+
+        if (throw_)
+        {
+          throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+        }
+      }
+
+      return AdapterFilter::TryStep(idle);
+    }
+  };
+
+
+  // Copies its input to "output", and counts the conversions
+  class CountingDemultiplexer : public AtomIT::DemultiplexerFilter
+  {
+  private:
+    unsigned int  conversions_;
+
+  protected:
+    virtual void Demux(ConvertedMessages& outputs,
+                       const AtomIT::Message& source)
+    {
+      conversions_++;
+      outputs["output"] = source;
+    }
+
+  public:
+    CountingDemultiplexer(AtomIT::ITimeSeriesManager& manager,
+                          const std::string& input) :
+      DemultiplexerFilter("demux", manager, input),
+      conversions_(0)
+    {
+    }
+
+    unsigned int GetConversionsCount() const
+    {
+      return conversions_;
+    }
+  };
+}
+
+
+TEST(AdapterFilter, PopInputKeepsFailures)
+{
+  for (unsigned int batchSize = 1; batchSize <= 10; batchSize += 3)
+  {
+    AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+    manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+    AppendValues(manager, "input", 0, 10);
+
+    FailingFilter filter(manager, "input");
+    filter.SetReplayHistory(true);
+    filter.SetPopInput(true);
+    filter.SetBatchSize(batchSize);
+    filter.Start();
+
+    for (;;)
+    {
+      bool idle;
+      ASSERT_TRUE(filter.TryStep(idle));
+      if (idle)
+      {
+        break;
+      }
+    }
+
+    ASSERT_EQ(6u, filter.GetPushed().size());
+
+    // The messages that failed are skipped, but not popped
+    std::vector<AtomIT::Message> content;
+    ReadContent(content, manager, "input");
+    ASSERT_EQ(4u, content.size());
+    ASSERT_EQ(0, content[0].GetTimestamp());
+    ASSERT_EQ(3, content[1].GetTimestamp());
+    ASSERT_EQ(6, content[2].GetTimestamp());
+    ASSERT_EQ(9, content[3].GetTimestamp());
+  }
+}
+
+
+TEST(CSVFileSourceFilter, Quoting)
+{
+  std::vector<AtomIT::Message> content;
+  ReadCSV(content,
+          "s,1,m,\"a,b\"\n"
+          "s,2,m,\"line1\r\nline2\"\r\n"
+          "s,3,\"m\"\"x\",\"say \"\"hi\"\"\"\n"
+          "s,4,,\n"
+          "s,5,m,plain", false);
+
+  ASSERT_EQ(5u, content.size());
+  ASSERT_EQ(1, content[0].GetTimestamp());
+  ASSERT_EQ("a,b", content[0].GetValue());
+  ASSERT_EQ("m", content[0].GetMetadata());
+  ASSERT_EQ(2, content[1].GetTimestamp());
+  ASSERT_EQ("line1\r\nline2", content[1].GetValue());
+  ASSERT_EQ(3, content[2].GetTimestamp());
+  ASSERT_EQ("m\"x", content[2].GetMetadata());
+  ASSERT_EQ("say \"hi\"", content[2].GetValue());
+  ASSERT_EQ(4, content[3].GetTimestamp());
+  ASSERT_TRUE(content[3].GetMetadata().empty());
+  ASSERT_TRUE(content[3].GetValue().empty());
+  ASSERT_EQ(5, content[4].GetTimestamp());
+  ASSERT_EQ("plain", content[4].GetValue());
+}
+
+
+TEST(CSVFileSourceFilter, Malformed)
+{
+  // Invalid records are skipped, but parsing goes on. The
+  // unterminated quote swallows the end of the file.
+  std::vector<AtomIT::Message> content;
+  ReadCSV(content,
+          "s,1,m,\"abc\"x\n"
+          "s,2,m,ok\n"
+          "s,3,m\n"
+          "s,4,m,a,b\n"
+          "s,5,m,\"ok\"\n"
+          "s,6,m,\"unterminated\n"
+          "s,7,m,lost\n", false);
+
+  ASSERT_EQ(2u, content.size());
+  ASSERT_EQ(2, content[0].GetTimestamp());
+  ASSERT_EQ("ok", content[0].GetValue());
+  ASSERT_EQ(5, content[1].GetTimestamp());
+  ASSERT_EQ("ok", content[1].GetValue());
+}
+
+
+TEST(CSVFileSourceFilter, ChunkBoundary)
+{
+  static const size_t CHUNK = 1024 * 1024;
+
+  // The first record ends just before the 1MB boundary, so that the
+  // second (quoted) record straddles it. The third record is larger
+  // than one chunk.
+  const std::string first(CHUNK - 13, 'a');
+  const std::string third(2 * CHUNK + 17, 'b');
+
+  std::string csv = "s,1,m," + first + "\n";
+  ASSERT_EQ(CHUNK - 6, csv.size());
+  csv += "s,2,m,\"x,\r\ny\"\"z\"\n";
+  csv += "s,3,m," + third + "\n";
+  csv += "s,4,m,end\n";
+
+  std::vector<AtomIT::Message> content;
+  ReadCSV(content, csv, false);
+
+  ASSERT_EQ(4u, content.size());
+  ASSERT_EQ(first, content[0].GetValue());
+  ASSERT_EQ(2, content[1].GetTimestamp());
+  ASSERT_EQ("x,\r\ny\"z", content[1].GetValue());
+  ASSERT_EQ(3, content[2].GetTimestamp());
+  ASSERT_EQ(third, content[2].GetValue());
+  ASSERT_EQ(4, content[3].GetTimestamp());
+  ASSERT_EQ("end", content[3].GetValue());
+}
+
+
+TEST(CSVFileSourceFilter, Base64)
+{
+  std::vector<AtomIT::Message> content;
+  ReadCSV(content,
+          "s,1,,aGVsbG8=\n"
+          "s,2,,aGk=\n"
+          "s,3,,YQ==\n"
+          "s,4,,\n"
+          "s,5,,abc\n"         // Length is not a multiple of 4
+          "s,6,,YQ==YQ==\n"    // Padding in the middle
+          "s,7,,a$==\n"        // Invalid character
+          "s,8,,Y===\n"        // Too much padding
+          "s,9,,d29ybGQ=\n", true);
+
+  ASSERT_EQ(5u, content.size());
+  ASSERT_EQ(1, content[0].GetTimestamp());
+  ASSERT_EQ("hello", content[0].GetValue());
+  ASSERT_EQ(2, content[1].GetTimestamp());
+  ASSERT_EQ("hi", content[1].GetValue());
+  ASSERT_EQ(3, content[2].GetTimestamp());
+  ASSERT_EQ("a", content[2].GetValue());
+  ASSERT_EQ(4, content[3].GetTimestamp());
+  ASSERT_TRUE(content[3].GetValue().empty());
+  ASSERT_EQ(9, content[4].GetTimestamp());
+  ASSERT_EQ("world", content[4].GetValue());
+}
+
+
+TEST(CSVFileSourceFilter, Timestamps)
+{
+  std::vector<AtomIT::Message> content;
+  ReadCSV(content,
+          "s,-9223372036854775808,,a\n"
+          "s,-9223372036854775809,,overflow\n"
+          "s,-5,,b\n"
+          "s, 42 ,,c\n"
+          "s,12a,,invalid\n"
+          "s,,,empty\n"
+          "s,9223372036854775808,,overflow\n"
+          "s,99999999999999999999,,overflow\n"
+          "s,9223372036854775806,,d\n", false);  // "Scan()" excludes INT64_MAX
+
+  ASSERT_EQ(4u, content.size());
+  ASSERT_EQ(std::numeric_limits<int64_t>::min(), content[0].GetTimestamp());
+  ASSERT_EQ("a", content[0].GetValue());
+  ASSERT_EQ(-5, content[1].GetTimestamp());
+  ASSERT_EQ(42, content[2].GetTimestamp());
+  ASSERT_EQ(std::numeric_limits<int64_t>::max() - 1, content[3].GetTimestamp());
+  ASSERT_EQ("d", content[3].GetValue());
+}
+
+
+TEST(CSVFileSourceFilter, Header)
+{
+  {
+    // Header written by "CSVFileSinkFilter"
+    std::vector<AtomIT::Message> content;
+    ReadCSV(content,
+            "Time series,Timestamp,Metadata,Value\r\n"
+            "s,1,,YQ==\r\n", true);
+    ASSERT_EQ(1u, content.size());
+    ASSERT_EQ(1, content[0].GetTimestamp());
+    ASSERT_EQ("a", content[0].GetValue());
+  }
+
+  {
+    // The header is only recognized on the first line
+    std::vector<AtomIT::Message> content;
+    ReadCSV(content,
+            "s,1,,a\n"
+            "Time series,Timestamp,Metadata,Value\n"
+            "s,2,,b\n", false);
+    ASSERT_EQ(2u, content.size());
+    ASSERT_EQ(1, content[0].GetTimestamp());
+    ASSERT_EQ(2, content[1].GetTimestamp());
+  }
+}
+
+
+TEST(DemultiplexerFilter, StalledOutput)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+  AppendValues(manager, "input", 0, 10);
+
+  CountingDemultiplexer filter(manager, "input");
+  filter.SetMaxPendingMessages(4);
+  filter.SetBatchSize(100);
+  filter.SetReplayHistory(true);
+  filter.Start();
+
+  // "TryStep()" is used by the scheduler pool: It must not wait for
+  // credits, and must report the filter as idle once stalled
+  const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+  bool idle;
+  ASSERT_TRUE(filter.TryStep(idle));
+  ASSERT_TRUE(idle);
+  ASSERT_EQ(4u, GetLength(manager, "output"));
+  ASSERT_EQ(10u, filter.GetConversionsCount());
+
+  ASSERT_TRUE(filter.TryStep(idle));
+  ASSERT_TRUE(idle);
+  ASSERT_EQ(4u, GetLength(manager, "output"));
+
+  ASSERT_LT((boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds(), 100);
+
+  // Pop the output: The retried messages are not converted again
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    {
+      AtomIT::TimeSeriesWriter writer(manager, "output");
+      AtomIT::TimeSeriesWriter::Transaction transaction(writer);
+      transaction.ClearContent();
+    }
+
+    ASSERT_TRUE(filter.TryStep(idle));
+  }
+
+  ASSERT_EQ(2u, GetLength(manager, "output"));
+  ASSERT_EQ(10u, filter.GetConversionsCount());
+
+  std::vector<AtomIT::Message> content;
+  ReadContent(content, manager, "output");
+  ASSERT_EQ(2u, content.size());
+  ASSERT_EQ(8, content[0].GetTimestamp());
+  ASSERT_EQ(9, content[1].GetTimestamp());
+
+  ASSERT_TRUE(filter.TryStep(idle));
+  ASSERT_TRUE(idle);
+  ASSERT_EQ(10u, filter.GetConversionsCount());
+}
+
+
+TEST(DemultiplexerFilter, WriterCache)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+  AppendValues(manager, "output", 100, 101);
+
+  CountingDemultiplexer filter(manager, "input");
+  filter.SetBatchSize(100);
+  filter.Start();
+
+  Json::Value statistics;
+  bool idle;
+
+  // The messages are rejected, as they are older than the content of
+  // the output: This must not invalidate the cached writer
+  for (int64_t i = 0; i < 3; i++)
+  {
+    AppendValues(manager, "input", i, i + 1);
+    ASSERT_TRUE(filter.TryStep(idle));
+    ASSERT_FALSE(idle);
+  }
+
+  ASSERT_EQ(1u, GetLength(manager, "output"));
+  filter.FormatStatistics(statistics);
+  ASSERT_EQ("1", statistics["writerCache"]["misses"].asString());
+  ASSERT_EQ("2", statistics["writerCache"]["hits"].asString());
+
+  // The output is deleted: Its writer must be renewed
+  manager.DeleteTimeSeries("output");
+  manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+
+  AppendValues(manager, "input", 3, 4);
+  ASSERT_TRUE(filter.TryStep(idle));
+  ASSERT_EQ(1u, GetLength(manager, "output"));
+
+  filter.FormatStatistics(statistics);
+  ASSERT_EQ("2", statistics["writerCache"]["misses"].asString());
+}
+
+
+TEST(LuaFilter, ConcurrentOrder)
+{
+  static const char* const SCRIPTS[] = {
+    "function Convert(timestamp, metadata, value)\n"
+    "  return { value = value .. '!' }\n"
+    "end\n",
+
+    "function ConvertBatch(messages)\n"
+    "  local result = {}\n"
+    "  for i, message in ipairs(messages) do\n"
+    "    result[i] = { value = message['value'] .. '!' }\n"
+    "  end\n"
+    "  return result\n"
+    "end\n"
+  };
+
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.lua"));
+
+  for (size_t script = 0; script < 2; script++)
+  {
+    Orthanc::SystemToolbox::WriteFile(std::string(SCRIPTS[script]), path.string());
+
+    AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+    manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+    manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+    AppendValues(manager, "input", 0, 100);
+
+    // The batches are much larger than the number of Lua states, and
+    // are split into chunks that are converted in parallel
+    AtomIT::LuaFilter filter("lua", manager, "input");
+    filter.SetConcurrency(3);
+    filter.ExecuteFile(path);
+    filter.SetDefaultOutputTimeSeries("output");
+    filter.SetReplayHistory(true);
+    filter.SetBatchSize(32);
+    filter.Start();
+
+    for (;;)
+    {
+      bool idle;
+      ASSERT_TRUE(filter.TryStep(idle));
+      if (idle)
+      {
+        break;
+      }
+    }
+
+    std::vector<AtomIT::Message> content;
+    ReadContent(content, manager, "output");
+    ASSERT_EQ(100u, content.size());
+
+    for (size_t i = 0; i < content.size(); i++)
+    {
+      ASSERT_EQ(static_cast<int64_t>(i), content[i].GetTimestamp());
+      ASSERT_EQ(boost::lexical_cast<std::string>(i) + "!", content[i].GetValue());
+    }
+  }
+
+  boost::filesystem::remove(path);
+}
+
+
+TEST(LuaFilter, Engine)
+{
+  // Checks that the Lua states are run by the engine that was
+  // selected at build time: With "-DENABLE_LUAJIT=ON", all the Lua
+  // filters of these unit tests are run by LuaJIT
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.lua"));
+
+  Orthanc::SystemToolbox::WriteFile(std::string(
+    "function Convert(timestamp, metadata, value)\n"
+    "  if jit == nil then\n"
+    "    return { value = 'lua' }\n"
+    "  else\n"
+    "    return { value = jit.version }\n"
+    "  end\n"
+    "end\n"), path.string());
+
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+  AppendValues(manager, "input", 0, 1);
+
+  {
+    AtomIT::LuaFilter filter("lua", manager, "input");
+    filter.SetConcurrency(2);
+    filter.ExecuteFile(path);
+    filter.SetDefaultOutputTimeSeries("output");
+    filter.SetReplayHistory(true);
+    filter.Start();
+    StepUntilIdle(filter);
+  }
+
+  boost::filesystem::remove(path);
+
+  std::vector<AtomIT::Message> content;
+  ReadContent(content, manager, "output");
+  ASSERT_EQ(1u, content.size());
+
+#if ATOMIT_ENABLE_LUAJIT == 1
+  ASSERT_EQ(std::string(AtomIT::LuaFilter::GetEngine()), content[0].GetValue());
+#else
+  ASSERT_EQ("lua", content[0].GetValue());
+  ASSERT_EQ(0u, std::string(AtomIT::LuaFilter::GetEngine()).find("Lua 5."));
+#endif
+}
+
+
+TEST(RollupFilter, NegativeTimestamps)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("count", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("sum", AtomIT::TimestampType_Sequence);
+
+  AppendValue(manager, "input", -150, "0.1");
+  AppendValue(manager, "input", -101, "0.2");
+  AppendValue(manager, "input", -100, "1");
+  AppendValue(manager, "input", -1, "2");
+  AppendValue(manager, "input", 0, "3");
+  AppendValue(manager, "input", 99, "4");
+  AppendValue(manager, "input", 100, "5");  // Opens the last bucket
+
+  AtomIT::RollupFilter filter("rollup", manager, "input", 100);
+  filter.AddOutput(AtomIT::RollupFilter::Aggregation_Count, "count");
+  filter.AddOutput(AtomIT::RollupFilter::Aggregation_Sum, "sum");
+  filter.Start();
+  StepUntilIdle(filter);
+
+  // The buckets are aligned on the multiples of the width, rounding
+  // the negative timestamps towards minus infinity
+  std::vector<AtomIT::Message> count, sum;
+  ReadContent(count, manager, "count");
+  ReadContent(sum, manager, "sum");
+
+  ASSERT_EQ(3u, count.size());
+  ASSERT_EQ(-200, count[0].GetTimestamp());
+  ASSERT_EQ("2", count[0].GetValue());
+  ASSERT_EQ(-100, count[1].GetTimestamp());
+  ASSERT_EQ("2", count[1].GetValue());
+  ASSERT_EQ(0, count[2].GetTimestamp());
+  ASSERT_EQ("2", count[2].GetValue());
+
+  // The sums are written with 17 significant digits
+  ASSERT_EQ(3u, sum.size());
+  ASSERT_EQ("0.30000000000000004", sum[0].GetValue());
+  ASSERT_EQ(0.1 + 0.2, boost::lexical_cast<double>(sum[0].GetValue()));
+  ASSERT_EQ("3", sum[1].GetValue());
+  ASSERT_EQ("7", sum[2].GetValue());
+}
+
+
+TEST(RollupFilter, TimeoutAndLateMessages)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("count", AtomIT::TimestampType_Sequence);
+
+  AtomIT::RollupFilter filter("rollup", manager, "input", 100);
+  filter.AddOutput(AtomIT::RollupFilter::Aggregation_Count, "count");
+  filter.SetFinalizationTimeout(50);
+  filter.Start();
+
+  AppendValues(manager, "input", 10, 12);
+  StepUntilIdle(filter);
+  ASSERT_EQ(0u, GetLength(manager, "count"));  // The timeout has not elapsed
+
+  boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+  StepUntilIdle(filter);
+  ASSERT_EQ(1u, GetLength(manager, "count"));
+
+  // The bucket is finalized: Its next messages are dropped
+  AppendValues(manager, "input", 12, 14);
+  AppendValues(manager, "input", 100, 101);
+  StepUntilIdle(filter);
+
+  Json::Value statistics;
+  filter.FormatStatistics(statistics);
+  ASSERT_EQ("2", statistics["lateMessages"].asString());
+  ASSERT_EQ("1", statistics["finalizedBuckets"].asString());
+
+  boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+  StepUntilIdle(filter);
+
+  std::vector<AtomIT::Message> content;
+  ReadContent(content, manager, "count");
+  ASSERT_EQ(2u, content.size());
+  ASSERT_EQ(0, content[0].GetTimestamp());
+  ASSERT_EQ("2", content[0].GetValue());
+  ASSERT_EQ(100, content[1].GetTimestamp());
+  ASSERT_EQ("1", content[1].GetValue());
+}
+
+
+TEST(RollupFilter, Resume)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("count", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("sum", AtomIT::TimestampType_Sequence);
+
+  AppendValues(manager, "input", 0, 150);
+
+  {
+    AtomIT::RollupFilter filter("rollup", manager, "input", 100);
+    filter.AddOutput(AtomIT::RollupFilter::Aggregation_Count, "count");
+    filter.AddOutput(AtomIT::RollupFilter::Aggregation_Sum, "sum");
+    filter.Start();
+    StepUntilIdle(filter);
+  }
+
+  ASSERT_EQ(1u, GetLength(manager, "count"));
+  ASSERT_EQ(1u, GetLength(manager, "sum"));
+
+  AppendValues(manager, "input", 150, 250);
+
+  {
+    // Simulate a crash between the writes to the two outputs: Only
+    // "count" receives the bucket 100
+    AtomIT::RollupFilter filter("rollup", manager, "input", 100);
+    filter.AddOutput(AtomIT::RollupFilter::Aggregation_Count, "count");
+    filter.Start();
+    StepUntilIdle(filter);
+  }
+
+  ASSERT_EQ(2u, GetLength(manager, "count"));
+  ASSERT_EQ(1u, GetLength(manager, "sum"));
+
+  AppendValues(manager, "input", 250, 301);
+
+  {
+    // The filter resumes after the last bucket written to all the
+    // outputs, i.e. it computes the bucket 100 once again, which
+    // must not be duplicated in "count"
+    AtomIT::RollupFilter filter("rollup", manager, "input", 100);
+    filter.AddOutput(AtomIT::RollupFilter::Aggregation_Count, "count");
+    filter.AddOutput(AtomIT::RollupFilter::Aggregation_Sum, "sum");
+    filter.Start();
+    StepUntilIdle(filter);
+  }
+
+  std::vector<AtomIT::Message> count, sum;
+  ReadContent(count, manager, "count");
+  ReadContent(sum, manager, "sum");
+
+  ASSERT_EQ(3u, count.size());
+  ASSERT_EQ(3u, sum.size());
+
+  for (size_t i = 0; i < 3; i++)
+  {
+    ASSERT_EQ(static_cast<int64_t>(i * 100), count[i].GetTimestamp());
+    ASSERT_EQ(static_cast<int64_t>(i * 100), sum[i].GetTimestamp());
+    ASSERT_EQ("100", count[i].GetValue());
+  }
+
+  ASSERT_EQ("4950", sum[0].GetValue());
+  ASSERT_EQ("14950", sum[1].GetValue());
+  ASSERT_EQ("24950", sum[2].GetValue());
+}
+
+
+TEST(FilterScheduler, GroupCommit)
+{
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+
+  {
+    // The filters only see the messages once their group is
+    // committed, which notifies the observers a second time
+    AtomIT::SQLiteDatabase db(path.string());
+    db.EnableGroupCommit(1000, 200);
+
+    AtomIT::GenericTimeSeriesManager manager(new SQLiteFactory(db));
+    manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+    manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+
+    CopyFilter filter(manager, "input", "output");
+    filter.Start();
+
+    AtomIT::FilterScheduler scheduler(manager, 2);
+    scheduler.AddFilter(filter);
+    scheduler.Start();
+
+    AppendValues(manager, "input", 0, 5);
+    ASSERT_TRUE(WaitLength(manager, "output", 5));
+
+    AppendValues(manager, "input", 5, 10);
+    ASSERT_TRUE(WaitLength(manager, "output", 10));
+
+    scheduler.Stop();
+  }
+
+  boost::filesystem::remove(path);
+}
+
+
+TEST(GroupCommit, Subscriber)
+{
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+
+  {
+    AtomIT::SQLiteDatabase db(path.string());
+    db.EnableGroupCommit(1000, 200);
+
+    AtomIT::GenericTimeSeriesManager manager(new SQLiteFactory(db));
+    manager.CreateTimeSeries("s", AtomIT::TimestampType_Sequence);
+
+    // Same loop as "AtomITRestApi::SubscribeTimeSeries()": The
+    // snapshot readers only see the message once its group is
+    // committed, which must wake up the subscriber
+    AtomIT::TimeSeriesReader reader(manager, "s", true);
+    AppendValue(manager, "s", 42, "hello");
+
+    const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    const boost::posix_time::ptime deadline = start + boost::posix_time::seconds(5);
+
+    std::vector<AtomIT::Message> messages;
+
+    for (;;)
+    {
+      {
+        AtomIT::TimeSeriesReader::Transaction transaction(reader);
+        transaction.Scan(messages, std::numeric_limits<int64_t>::min(),
+                         std::numeric_limits<int64_t>::max(), 100);
+      }
+
+      const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+      if (!messages.empty() ||
+          now >= deadline)
+      {
+        break;
+      }
+
+      reader.WaitModification(static_cast<unsigned int>((deadline - now).total_milliseconds()));
+    }
+
+    ASSERT_EQ(1u, messages.size());
+    ASSERT_EQ("hello", messages[0].GetValue());
+    ASSERT_LT((boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds(), 2000);
+  }
+
+  boost::filesystem::remove(path);
+}
+
+
+TEST(FilterScheduler, BatchLatency)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("slow", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("slowOutput", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("fast", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("fastOutput", AtomIT::TimestampType_Sequence);
+
+  // This filter waits 2 seconds for its batches to be filled
+  CopyFilter slow(manager, "slow", "slowOutput");
+  slow.SetBatchSize(100);
+  slow.SetBatchLatency(2000);
+  slow.Start();
+
+  CopyFilter fast(manager, "fast", "fastOutput");
+  fast.Start();
+
+  // Both filters share one single worker
+  AtomIT::FilterScheduler scheduler(manager, 1);
+  scheduler.AddFilter(slow);
+  scheduler.AddFilter(fast);
+  scheduler.Start();
+
+  // Give the worker the time to read the partial batch of "slow"
+  AppendValues(manager, "slow", 0, 1);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+  // The worker is not blocked by the partial batch
+  const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  AppendValues(manager, "fast", 0, 1);
+  ASSERT_TRUE(WaitLength(manager, "fastOutput", 1));
+  ASSERT_LT((boost::posix_time::microsec_clock::universal_time() - start).total_milliseconds(), 1000);
+  ASSERT_EQ(0u, GetLength(manager, "slowOutput"));
+
+  // The partial batch is pushed once its latency has elapsed
+  ASSERT_TRUE(WaitLength(manager, "slowOutput", 1));
+
+  scheduler.Stop();
+}
+
+
+TEST(FilterScheduler, BlockingSinks)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+
+  // The sinks that can block on the network keep their own thread
+  AtomIT::HttpPostSinkFilter sink("http", manager, "input", "http://localhost:1/");
+
+  std::string wakeup;
+  ASSERT_FALSE(sink.GetWakeupTimeSeries(wakeup));
+
+  AtomIT::FilterScheduler scheduler(manager, 1);
+  ASSERT_THROW(scheduler.AddFilter(sink), Orthanc::OrthancException);
+}
+
+
+TEST(FilterScheduler, Backoff)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("output", AtomIT::TimestampType_Sequence);
+
+  CopyFilter filter(manager, "input", "output");
+  filter.SetThrow(true);
+  filter.Start();
+
+  AtomIT::FilterScheduler scheduler(manager, 2);
+  scheduler.AddFilter(filter);
+  scheduler.Start();
+
+  AppendValues(manager, "input", 0, 5);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+
+  // Retries after 100ms, 200ms, 400ms...: A failing filter must not
+  // spin, even if its input is modified meanwhile
+  unsigned int steps = filter.GetStepsCount();
+  ASSERT_GE(steps, 2u);
+  ASSERT_LE(steps, 5u);
+  ASSERT_EQ(0u, GetLength(manager, "output"));
+
+  // The filter recovers once it stops failing
+  filter.SetThrow(false);
+  ASSERT_TRUE(WaitLength(manager, "output", 5));
+
+  scheduler.Stop();
+}
+
+
+TEST(FilterScheduler, RollupTimeout)
+{
+  AtomIT::GenericTimeSeriesManager manager(new MemoryFactory);
+  manager.CreateTimeSeries("input", AtomIT::TimestampType_Sequence);
+  manager.CreateTimeSeries("count", AtomIT::TimestampType_Sequence);
+
+  AtomIT::RollupFilter filter("rollup", manager, "input", 100);
+  filter.AddOutput(AtomIT::RollupFilter::Aggregation_Count, "count");
+  filter.SetFinalizationTimeout(100);
+  filter.SetReplayHistory(true);
+  filter.Start();
+
+  AtomIT::FilterScheduler scheduler(manager, 1);
+  scheduler.AddFilter(filter);
+  scheduler.Start();
+
+  // No message of a later bucket is received: The bucket is only
+  // finalized because the parked filter is polled
+  AppendValues(manager, "input", 0, 3);
+  ASSERT_TRUE(WaitLength(manager, "count", 1));
+
+  scheduler.Stop();
+
+  std::vector<AtomIT::Message> content;
+  ReadContent(content, manager, "count");
+  ASSERT_EQ(1u, content.size());
+  ASSERT_EQ(0, content[0].GetTimestamp());
+  ASSERT_EQ("3", content[0].GetValue());
+}
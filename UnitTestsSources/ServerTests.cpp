@@ -0,0 +1,157 @@
+/**
+ * Atom-IT - A Lightweight, RESTful microservice for IoT
+ * Copyright (C) 2017 Sebastien Jodogne, WSL S.A., Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * In addition, as a special exception, the copyright holders of this
+ * program give permission to link the code of its release with the
+ * OpenSSL project's "OpenSSL" library (or with modified versions of it
+ * that use the same license as the "OpenSSL" library), and distribute
+ * the linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL". If you
+ * modify file(s) with this exception, you may extend this exception to
+ * your version of the file(s), but you are not obligated to do so. If
+ * you do not wish to do so, delete this exception statement from your
+ * version. If you delete this exception statement from all source files
+ * in the program, then also delete it here.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../Applications/SubscribersLimiter.h"
+
+#include <gtest/gtest.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <vector>
+
+
+TEST(SubscribersLimiter, Basic)
+{
+  AtomIT::SubscribersLimiter limiter(2);
+  ASSERT_EQ(2u, limiter.GetMaxSubscribers());
+  ASSERT_EQ(0u, limiter.GetSubscribersCount());
+
+  {
+    AtomIT::SubscribersLimiter::Slot a(limiter);
+    AtomIT::SubscribersLimiter::Slot b(limiter);
+    ASSERT_TRUE(a.IsAcquired());
+    ASSERT_TRUE(b.IsAcquired());
+    ASSERT_EQ(2u, limiter.GetSubscribersCount());
+
+    {
+      // The limit is reached: Rejected without blocking, and without
+      // being counted
+      AtomIT::SubscribersLimiter::Slot c(limiter);
+      ASSERT_FALSE(c.IsAcquired());
+      ASSERT_EQ(2u, limiter.GetSubscribersCount());
+    }
+
+    ASSERT_EQ(2u, limiter.GetSubscribersCount());
+  }
+
+  ASSERT_EQ(0u, limiter.GetSubscribersCount());
+
+  {
+    AtomIT::SubscribersLimiter::Slot a(limiter);
+    ASSERT_TRUE(a.IsAcquired());
+
+    // Lowering the limit doesn't affect the pending subscriptions
+    limiter.SetMaxSubscribers(1);
+
+    AtomIT::SubscribersLimiter::Slot b(limiter);
+    ASSERT_FALSE(b.IsAcquired());
+    ASSERT_EQ(1u, limiter.GetSubscribersCount());
+  }
+
+  ASSERT_EQ(0u, limiter.GetSubscribersCount());
+
+  {
+    // Zero disables the subscriptions
+    limiter.SetMaxSubscribers(0);
+    AtomIT::SubscribersLimiter::Slot a(limiter);
+    ASSERT_FALSE(a.IsAcquired());
+  }
+}
+
+
+namespace
+{
+  class Subscriber
+  {
+  private:
+    AtomIT::SubscribersLimiter&  limiter_;
+    boost::mutex&                mutex_;
+    unsigned int&                accepted_;
+    unsigned int&                maxCount_;
+
+  public:
+    Subscriber(AtomIT::SubscribersLimiter& limiter,
+               boost::mutex& mutex,
+               unsigned int& accepted,
+               unsigned int& maxCount) :
+      limiter_(limiter),
+      mutex_(mutex),
+      accepted_(accepted),
+      maxCount_(maxCount)
+    {
+    }
+
+    void operator() ()
+    {
+      for (unsigned int i = 0; i < 100; i++)
+      {
+        AtomIT::SubscribersLimiter::Slot slot(limiter_);
+        if (slot.IsAcquired())
+        {
+          unsigned int count = limiter_.GetSubscribersCount();
+
+          {
+            boost::mutex::scoped_lock lock(mutex_);
+            accepted_++;
+            maxCount_ = std::max(maxCount_, count);
+          }
+
+          boost::this_thread::sleep(boost::posix_time::microseconds(100));
+        }
+      }
+    }
+  };
+}
+
+
+TEST(SubscribersLimiter, Concurrency)
+{
+  AtomIT::SubscribersLimiter limiter(3);
+
+  boost::mutex mutex;
+  unsigned int accepted = 0;
+  unsigned int maxCount = 0;
+
+  std::vector<boost::thread*> threads;
+  for (size_t i = 0; i < 10; i++)
+  {
+    threads.push_back(new boost::thread(Subscriber(limiter, mutex, accepted, maxCount)));
+  }
+
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i]->join();
+    delete threads[i];
+  }
+
+  ASSERT_GT(accepted, 0u);
+  ASSERT_LE(maxCount, 3u);
+  ASSERT_EQ(0u, limiter.GetSubscribersCount());
+}
@@ -30,21 +30,35 @@
 
 
 #include "../Framework/TimeSeries/GenericTimeSeriesManager.h"
+#include "../Framework/TimeSeries/TimeSeriesAccessorCache.h"
+#include "../Framework/TimeSeries/TimeSeriesAggregator.h"
+#include "../Framework/TimeSeries/TimeSeriesArchive.h"
 #include "../Framework/TimeSeries/TimeSeriesReader.h"
 #include "../Framework/TimeSeries/TimeSeriesWriter.h"
+#include "../Framework/TimeSeries/TimeSeriesWriterCache.h"
 #include "../Framework/TimeSeries/MemoryBackend/MemoryTimeSeriesBackend.h"
+#include "../Framework/TimeSeries/MemoryBackend/MetadataDictionary.h"
+#include "../Framework/TimeSeries/MemoryBackend/RingTimeSeriesContent.h"
+#include "../Framework/TimeSeries/MemoryBackend/SPSCTimeSeriesBackend.h"
+#include "../Framework/TimeSeries/SQLiteBackend/SQLiteBlock.h"
 #include "../Framework/TimeSeries/SQLiteBackend/SQLiteTimeSeriesBackend.h"
 
 #include <Core/Logging.h>
 #include <Core/OrthancException.h>
 
 #include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <limits>
 
 enum BackendType
 {
   BackendType_Memory,
-  BackendType_SQLite
+  BackendType_SQLite,
+  BackendType_Ring,
+  BackendType_SQLiteBlocked,
+  BackendType_SPSC
 };
 
 class BackendTest : public ::testing::TestWithParam<BackendType>
@@ -88,24 +102,74 @@ private:
     }
   };
 
+  class RingFactory : public FactoryBase
+  {
+  public:
+    explicit RingFactory(BackendTest& that) :
+      FactoryBase(that)
+    {
+    }
+    
+    virtual AtomIT::ITimeSeriesBackend* CreateManualTimeSeries(const std::string& name)
+    {
+      return new AtomIT::MemoryTimeSeriesBackend
+        (new AtomIT::RingTimeSeriesContent(that_.maxLength_, that_.maxSize_));
+    }
+  };
+
+  class SPSCFactory : public FactoryBase
+  {
+  public:
+    explicit SPSCFactory(BackendTest& that) :
+      FactoryBase(that)
+    {
+    }
+    
+    virtual AtomIT::ITimeSeriesBackend* CreateManualTimeSeries(const std::string& name)
+    {
+      return new AtomIT::SPSCTimeSeriesBackend(that_.maxLength_, that_.maxSize_);
+    }
+  };
+
   class SQLiteFactory : public FactoryBase
   {
   private:
-    AtomIT::SQLiteDatabase&  database_;
+    AtomIT::SQLiteDatabase&        database_;
+    unsigned int                   blockSize_;
+    AtomIT::ITimeSeriesObserver*   observer_;
     
   public:
     SQLiteFactory(BackendTest& that,
-                  AtomIT::SQLiteDatabase& database) :
+                  AtomIT::SQLiteDatabase& database,
+                  unsigned int blockSize) :
       FactoryBase(that),
-      database_(database)
+      database_(database),
+      blockSize_(blockSize),
+      observer_(NULL)
     {
     }
     
     virtual AtomIT::ITimeSeriesBackend* CreateManualTimeSeries(const std::string& name)
     {
       database_.CreateTimeSeries(name, that_.maxLength_, that_.maxSize_);
+      database_.SetBlockSize(name, blockSize_);
       return new AtomIT::SQLiteTimeSeriesBackend(database_, name);
     }
+
+    virtual void SetCommitObserver(AtomIT::ITimeSeriesObserver* observer)
+    {
+      if (observer_ != NULL)
+      {
+        database_.UnregisterObserver(*observer_);
+      }
+
+      if (observer != NULL)
+      {
+        database_.RegisterObserver(*observer);
+      }
+
+      observer_ = observer;
+    }
   };
 
   uint64_t                                         maxLength_;
@@ -127,10 +191,23 @@ public:
         factory.reset(new MemoryFactory(*this));
         break;
 
+      case BackendType_Ring:
+        factory.reset(new RingFactory(*this));
+        break;
+
+      case BackendType_SPSC:
+        factory.reset(new SPSCFactory(*this));
+        break;
+
       case BackendType_SQLite:
         sqlite_.reset(new AtomIT::SQLiteDatabase);  // Test in-memory SQLite DB
         //sqlite_.reset(new AtomIT::SQLiteDatabase("test.db"));
-        factory.reset(new SQLiteFactory(*this, *sqlite_));
+        factory.reset(new SQLiteFactory(*this, *sqlite_, 0));
+        break;
+
+      case BackendType_SQLiteBlocked:
+        sqlite_.reset(new AtomIT::SQLiteDatabase);
+        factory.reset(new SQLiteFactory(*this, *sqlite_, 3));  // Tiny blocks
         break;
 
       default:
@@ -250,7 +327,10 @@ INSTANTIATE_TEST_CASE_P(BackendTestInstances,
                         BackendTest,
                         ::testing::Values(
                           BackendType_Memory,
-                          BackendType_SQLite));
+                          BackendType_SQLite,
+                          BackendType_Ring,
+                          BackendType_SQLiteBlocked,
+                          BackendType_SPSC));
 
 
 TEST_P(BackendTest, CreateTimeSeries)
@@ -796,56 +876,1689 @@ TEST_P(BackendTest, Sequence2)
 
 
 
-static uint64_t GetLength(AtomIT::SQLiteDatabase& db,
-                          const std::string& name)
+TEST_P(BackendTest, AppendBatch)
 {
-  uint64_t length, size;  
-  AtomIT::SQLiteTimeSeriesTransaction t(db, name);
-  t.GetStatistics(length, size);
-  return length;
+  SetQuota(5, 20);
+  GetManager().CreateTimeSeries("hello", AtomIT::TimestampType_Sequence);
+  int64_t t;
+  std::string m, v;
+
+  AtomIT::TimeSeriesReader reader(GetManager(), "hello", true);
+  AtomIT::TimeSeriesWriter writer(GetManager(), "hello");
+
+  std::vector<AtomIT::Message> batch(3);
+  batch[0].SetTimestamp(10);  batch[0].SetValue("aaaa");  batch[0].SetMetadata("m0");
+  batch[1].SetTimestamp(5);   batch[1].SetValue("bbbb");  // Not after the trailer
+  batch[2].SetTimestamp(20);  batch[2].SetValue("cccc");  batch[2].SetMetadata("m2");
+
+  {
+    AtomIT::TimeSeriesWriter::Transaction transaction(writer);
+    ASSERT_EQ(2u, transaction.AppendBatch(batch));
+    ASSERT_TRUE(transaction.GetLastTimestamp(t));
+    ASSERT_EQ(20, t);
+    ASSERT_EQ(0u, transaction.AppendBatch(batch));
+  }
+
+  ASSERT_EQ(2u, GetLength("hello"));
+  ASSERT_EQ(8u, GetSize("hello"));
+  ASSERT_TRUE(CheckStatistics("hello"));
+
+  batch.resize(5);
+  for (size_t i = 0; i < batch.size(); i++)
+  {
+    batch[i].SetTimestamp(30 + i);
+    batch[i].SetMetadata("");
+    batch[i].SetValue(i == 4 ? "0123456789abcdefghijk" : "dd");  // The last one is too large
+  }
+
+  {
+    AtomIT::TimeSeriesWriter::Transaction transaction(writer);
+    ASSERT_EQ(4u, transaction.AppendBatch(batch));
+  }
+
+  // Length quota: The oldest item is evicted
+  ASSERT_EQ(5u, GetLength("hello"));
+  ASSERT_EQ(12u, GetSize("hello"));
+  ASSERT_TRUE(CheckStatistics("hello"));
+
+  {
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+    ASSERT_TRUE(transaction.SeekFirst());
+    ASSERT_TRUE(transaction.GetTimestamp(t));
+    ASSERT_EQ(20, t);
+    ASSERT_TRUE(transaction.Read(m, v));
+    ASSERT_EQ("m2", m);
+    ASSERT_EQ("cccc", v);
+    ASSERT_TRUE(transaction.SeekLast());
+    ASSERT_TRUE(transaction.GetTimestamp(t));
+    ASSERT_EQ(33, t);
+  }
+
+  batch.resize(7);
+  for (size_t i = 0; i < batch.size(); i++)
+  {
+    batch[i].SetTimestamp(100 + i);
+    batch[i].SetValue(std::string(i + 1, 'x'));
+  }
+
+  // The batch alone exceeds both quotas: Only its most recent items are kept
+  ASSERT_EQ(7u, writer.Append(batch));
+  ASSERT_EQ(3u, GetLength("hello"));
+  ASSERT_EQ(18u, GetSize("hello"));
+  ASSERT_TRUE(CheckStatistics("hello"));
+
+  {
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+    ASSERT_TRUE(transaction.SeekFirst());
+    ASSERT_TRUE(transaction.GetTimestamp(t));
+    ASSERT_EQ(104, t);
+    ASSERT_TRUE(transaction.SeekLast());
+    ASSERT_TRUE(transaction.GetTimestamp(t));
+    ASSERT_EQ(106, t);
+  }
+
+  // Sequence timestamps are generated consecutively within the batch
+  std::vector<AtomIT::Message> sequence(3);
+  ASSERT_EQ(3u, writer.Append(sequence));
+
+  {
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+    ASSERT_TRUE(transaction.SeekLast());
+    ASSERT_TRUE(transaction.GetTimestamp(t));
+    ASSERT_EQ(109, t);
+  }
+
+  ASSERT_EQ(5u, GetLength("hello"));
+  ASSERT_TRUE(CheckStatistics("hello"));
 }
 
 
-static uint64_t GetSize(AtomIT::SQLiteDatabase& db,
-                        const std::string& name)
+class StopVisitor : public AtomIT::ITimeSeriesVisitor
 {
-  uint64_t length, size;  
-  AtomIT::SQLiteTimeSeriesTransaction t(db, name);
-  t.GetStatistics(length, size);
-  return size;
+private:
+  std::vector<int64_t>  timestamps_;
+  size_t                stop_;
+
+public:
+  explicit StopVisitor(size_t stop) :
+    stop_(stop)
+  {
+  }
+
+  const std::vector<int64_t>& GetTimestamps() const
+  {
+    return timestamps_;
+  }
+
+  virtual bool Visit(int64_t timestamp,
+                     const std::string& metadata,
+                     const std::string& value)
+  {
+    timestamps_.push_back(timestamp);
+    return timestamps_.size() < stop_;
+  }
+};
+
+
+TEST_P(BackendTest, Scan)
+{
+  GetManager().CreateTimeSeries("hello", AtomIT::TimestampType_Sequence);
+
+  AtomIT::TimeSeriesReader reader(GetManager(), "hello", true);
+  AtomIT::TimeSeriesWriter writer(GetManager(), "hello");
+
+  std::vector<AtomIT::Message> messages;
+
+  {
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+    ASSERT_EQ(0u, transaction.Scan(messages, 0, 100, 0));
+    ASSERT_TRUE(messages.empty());
+  }
+
+  for (int64_t i = 0; i < 10; i++)
+  {
+    AtomIT::Message message;
+    message.SetTimestamp(10 * i);
+    message.SetMetadata("m" + boost::lexical_cast<std::string>(i));
+    message.SetValue("v" + boost::lexical_cast<std::string>(i));
+    ASSERT_TRUE(writer.Append(message));
+  }
+
+  {
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+
+    ASSERT_EQ(10u, transaction.Scan(messages, std::numeric_limits<int64_t>::min(),
+                                    std::numeric_limits<int64_t>::max(), 0));
+    ASSERT_EQ(10u, messages.size());
+    ASSERT_EQ(0, messages[0].GetTimestamp());
+    ASSERT_EQ("m0", messages[0].GetMetadata());
+    ASSERT_EQ("v0", messages[0].GetValue());
+    ASSERT_EQ(90, messages[9].GetTimestamp());
+    ASSERT_EQ("m9", messages[9].GetMetadata());
+    ASSERT_EQ("v9", messages[9].GetValue());
+
+    // The "end" bound is excluded
+    ASSERT_EQ(3u, transaction.Scan(messages, 15, 50, 0));
+    ASSERT_EQ(20, messages[0].GetTimestamp());
+    ASSERT_EQ(40, messages[2].GetTimestamp());
+
+    ASSERT_EQ(2u, transaction.Scan(messages, 15, 100, 2));
+    ASSERT_EQ(2u, messages.size());
+    ASSERT_EQ(20, messages[0].GetTimestamp());
+    ASSERT_EQ(30, messages[1].GetTimestamp());
+
+    ASSERT_EQ(1u, transaction.Scan(messages, 90, 1000, 5));
+    ASSERT_EQ(90, messages[0].GetTimestamp());
+    ASSERT_EQ(0u, transaction.Scan(messages, 91, 1000, 5));
+    ASSERT_EQ(0u, transaction.Scan(messages, 50, 50, 5));
+
+    StopVisitor visitor(4);
+    ASSERT_EQ(4u, transaction.Scan(0, 100, 0, visitor));
+    ASSERT_EQ(4u, visitor.GetTimestamps().size());
+    ASSERT_EQ(30, visitor.GetTimestamps()[3]);
+  }
 }
 
 
-TEST(SQLiteBackend, ChangeQuota)
+TEST_P(BackendTest, ReadySet)
 {
-  AtomIT::SQLiteDatabase db;
+  GetManager().CreateTimeSeries("hello", AtomIT::TimestampType_Sequence);
+  GetManager().CreateTimeSeries("world", AtomIT::TimestampType_Sequence);
 
-  db.CreateTimeSeries("world", 0, 0);
+  std::auto_ptr<AtomIT::ISeriesReadySet> ready(GetManager().CreateReadySet());
+  ASSERT_THROW(ready->Add("nope"), Orthanc::OrthancException);
+  ready->Add("hello");
+  ready->Add("world");
+  ready->Add("world");
+
+  std::set<std::string> s;
+  ASSERT_FALSE(ready->Wait(s, 10));
+  ASSERT_TRUE(s.empty());
+
+  AtomIT::TimeSeriesWriter hello(GetManager(), "hello");
+  AtomIT::TimeSeriesWriter world(GetManager(), "world");
 
-  for (unsigned int i = 0; i < 10; i++)
   {
-    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
-    ASSERT_TRUE(t.Append(i, "", "v" + boost::lexical_cast<std::string>(i)));
+    AtomIT::TimeSeriesWriter::Transaction transaction(hello);
+    ASSERT_TRUE(transaction.Append(10, "", "a"));
   }
 
-  ASSERT_EQ(10u, GetLength(db, "world"));
-  ASSERT_EQ(20u, GetSize(db, "world"));
+  ASSERT_TRUE(ready->Wait(s, 10));
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(s.find("hello") != s.end());
+  ASSERT_FALSE(ready->Wait(s, 10));
 
-  db.CreateTimeSeries("world", 0, 0);
+  {
+    AtomIT::TimeSeriesWriter::Transaction transaction(hello);
+    ASSERT_TRUE(transaction.Append(20, "", "b"));
+  }
 
-  // Change quota
-  db.CreateTimeSeries("world", 5, 0);
+  {
+    AtomIT::TimeSeriesWriter::Transaction transaction(world);
+    ASSERT_TRUE(transaction.Append(10, "", "c"));
+  }
 
-  ASSERT_EQ(5u, GetLength(db, "world"));
-  ASSERT_EQ(10u, GetSize(db, "world"));
+  ASSERT_TRUE(ready->Wait(s, 10));
+  ASSERT_EQ(2u, s.size());
 
-  db.CreateTimeSeries("world", 0, 6);
+  ready->Remove("hello");
 
-  ASSERT_EQ(3u, GetLength(db, "world"));
-  ASSERT_EQ(6u, GetSize(db, "world"));
+  {
+    AtomIT::TimeSeriesWriter::Transaction transaction(hello);
+    ASSERT_TRUE(transaction.Append(30, "", "d"));
+  }
 
-  db.CreateTimeSeries("world", 0, 4);
+  ASSERT_FALSE(ready->Wait(s, 10));
 
-  ASSERT_EQ(2u, GetLength(db, "world"));
-  ASSERT_EQ(4u, GetSize(db, "world"));
+  GetManager().DeleteTimeSeries("world");
+  ASSERT_TRUE(ready->Wait(s, 10));
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(s.find("world") != s.end());
+}
+
+
+static void PopOldest(AtomIT::GenericTimeSeriesManager* manager)
+{
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+
+  AtomIT::TimeSeriesWriter writer(*manager, "hello");
+  AtomIT::TimeSeriesWriter::Transaction transaction(writer);
+  transaction.DeleteRange(0, 2);
+}
+
+
+TEST_P(BackendTest, Credits)
+{
+  GetManager().CreateTimeSeries("hello", AtomIT::TimestampType_Sequence);
+
+  AtomIT::TimeSeriesWriter writer(GetManager(), "hello");
+
+  uint64_t length;
+  ASSERT_EQ(3u, writer.WaitForCredits(length, 3, 0));
+  ASSERT_EQ(0u, length);
+
+  {
+    AtomIT::TimeSeriesWriter::Transaction transaction(writer);
+    ASSERT_TRUE(transaction.Append(0, "", "a"));
+    ASSERT_TRUE(transaction.Append(1, "", "b"));
+    ASSERT_TRUE(transaction.Append(2, "", "c"));
+  }
+
+  ASSERT_EQ(0u, writer.WaitForCredits(length, 3, 0));
+  ASSERT_EQ(3u, length);
+  ASSERT_EQ(0u, writer.WaitForCredits(length, 3, 10));
+  ASSERT_EQ(2u, writer.WaitForCredits(length, 5, 0));
+
+  // The producer is woken up as soon as the consumer pops messages
+  boost::thread consumer(PopOldest, &GetManager());
+  ASSERT_EQ(2u, writer.WaitForCredits(length, 3, 10000));
+  ASSERT_EQ(1u, length);
+  consumer.join();
+}
+
+
+static AtomIT::Message CreateMessage(int64_t timestamp,
+                                     const std::string& value)
+{
+  AtomIT::Message message;
+  message.SetTimestamp(timestamp);
+  message.SetValue(value);
+  return message;
+}
+
+
+TEST_P(BackendTest, WriterCache)
+{
+  GetManager().CreateTimeSeries("a", AtomIT::TimestampType_Sequence);
+  GetManager().CreateTimeSeries("b", AtomIT::TimestampType_Sequence);
+  GetManager().CreateTimeSeries("c", AtomIT::TimestampType_Sequence);
+
+  ASSERT_THROW(AtomIT::TimeSeriesWriterCache(GetManager(), 0), Orthanc::OrthancException);
+
+  AtomIT::TimeSeriesWriterCache cache(GetManager(), 2);
+  ASSERT_EQ(2u, cache.GetCapacity());
+
+  size_t size;
+  uint64_t hits, misses;
+
+  ASSERT_TRUE(cache.GetWriter("a").Append(CreateMessage(0, "a0")));
+  ASSERT_TRUE(cache.GetWriter("b").Append(CreateMessage(0, "b0")));
+  ASSERT_TRUE(cache.GetWriter("a").Append(CreateMessage(1, "a1")));
+  cache.GetStatistics(size, hits, misses);
+  ASSERT_EQ(2u, size);
+  ASSERT_EQ(1u, hits);
+  ASSERT_EQ(2u, misses);
+
+  // "b" is the least recently used writer, so it is evicted by "c"
+  ASSERT_TRUE(cache.GetWriter("c").Append(CreateMessage(0, "c0")));
+  ASSERT_TRUE(cache.GetWriter("a").Append(CreateMessage(2, "a2")));
+  cache.GetStatistics(size, hits, misses);
+  ASSERT_EQ(2u, size);
+  ASSERT_EQ(2u, hits);
+  ASSERT_EQ(3u, misses);
+
+  ASSERT_TRUE(cache.GetWriter("b").Append(CreateMessage(1, "b1")));
+  cache.GetStatistics(size, hits, misses);
+  ASSERT_EQ(2u, hits);
+  ASSERT_EQ(4u, misses);
+
+  ASSERT_EQ(3u, GetLength("a"));
+  ASSERT_EQ(2u, GetLength("b"));
+  ASSERT_EQ(1u, GetLength("c"));
+
+  // A cached writer cannot append to a deleted time series (the
+  // SQLite backends keep the content of a re-created time series)
+  GetManager().DeleteTimeSeries("b");
+  GetManager().CreateTimeSeries("b", AtomIT::TimestampType_Sequence);
+  const uint64_t length = GetLength("b");
+  ASSERT_FALSE(cache.GetWriter("b").Append(CreateMessage(2, "b2")));
+  ASSERT_EQ(length, GetLength("b"));
+
+  cache.Invalidate("b");
+  ASSERT_TRUE(cache.GetWriter("b").Append(CreateMessage(2, "b2")));
+  ASSERT_EQ(length + 1, GetLength("b"));
+
+  cache.Invalidate("b");
+  GetManager().DeleteTimeSeries("b");
+  ASSERT_THROW(cache.GetWriter("b"), Orthanc::OrthancException);
+
+  cache.Clear();
+  cache.GetStatistics(size, hits, misses);
+  ASSERT_EQ(0u, size);
+}
+
+
+TEST_P(BackendTest, AccessorCache)
+{
+  GetManager().CreateTimeSeries("a", AtomIT::TimestampType_Sequence);
+  GetManager().CreateTimeSeries("b", AtomIT::TimestampType_Sequence);
+
+  AtomIT::TimeSeriesAccessorCache cache(GetManager(), 1);
+
+  size_t size;
+  uint64_t hits, misses;
+
+  AtomIT::TimeSeriesAccessorCache::WriterPointer writer = cache.GetWriter("a");
+  ASSERT_TRUE(writer->Append(CreateMessage(0, "a0")));
+  ASSERT_EQ(writer.get(), cache.GetWriter("a").get());
+
+  AtomIT::TimeSeriesAccessorCache::ReaderPointer reader = cache.GetReader("a");
+  ASSERT_EQ(reader.get(), cache.GetReader("a").get());
+  ASSERT_FALSE(reader->IsDeleted());
+
+  {
+    AtomIT::TimeSeriesReader::Transaction transaction(*reader);
+    uint64_t length, s;
+    transaction.GetStatistics(length, s);
+    ASSERT_EQ(1u, length);
+  }
+
+  cache.GetStatistics(size, hits, misses);
+  ASSERT_EQ(1u, size);
+  ASSERT_EQ(2u, hits);
+  ASSERT_EQ(2u, misses);
+
+  // Evicts "a": The evicted writer stays usable by its current user
+  cache.GetWriter("b");
+  ASSERT_NE(writer.get(), cache.GetWriter("a").get());
+  ASSERT_TRUE(writer->Append(CreateMessage(1, "a1")));
+  ASSERT_EQ(2u, GetLength("a"));
+
+  // A deleted time series is detected on the next lookup
+  writer = cache.GetWriter("a");
+  GetManager().DeleteTimeSeries("a");
+  ASSERT_TRUE(writer->IsDeleted());
+  ASSERT_THROW(cache.GetWriter("a"), Orthanc::OrthancException);
+
+  GetManager().CreateTimeSeries("a", AtomIT::TimestampType_Sequence);
+  ASSERT_NE(writer.get(), cache.GetWriter("a").get());
+  ASSERT_FALSE(cache.GetWriter("a")->IsDeleted());
+
+  cache.Invalidate("a");
+  cache.GetStatistics(size, hits, misses);
+  ASSERT_EQ(0u, size);
+
+  ASSERT_THROW(AtomIT::TimeSeriesAccessorCache(GetManager(), 0), Orthanc::OrthancException);
+}
+
+
+TEST_P(BackendTest, AccessorCacheRecency)
+{
+  GetManager().CreateTimeSeries("a", AtomIT::TimestampType_Sequence);
+  GetManager().CreateTimeSeries("b", AtomIT::TimestampType_Sequence);
+  GetManager().CreateTimeSeries("c", AtomIT::TimestampType_Sequence);
+
+  AtomIT::TimeSeriesAccessorCache cache(GetManager(), 2);
+
+  AtomIT::TimeSeriesAccessorCache::WriterPointer a = cache.GetWriter("a");
+  AtomIT::TimeSeriesAccessorCache::ReaderPointer b = cache.GetReader("b");
+
+  // Touching "a" (the oldest entry) makes "b" the least recently used
+  ASSERT_EQ(a.get(), cache.GetWriter("a").get());
+
+  // Evicts "b", not "a"
+  cache.GetWriter("c");
+  ASSERT_EQ(a.get(), cache.GetWriter("a").get());
+  ASSERT_NE(b.get(), cache.GetReader("b").get());
+
+  size_t size;
+  uint64_t hits, misses;
+  cache.GetStatistics(size, hits, misses);
+  ASSERT_EQ(2u, size);
+  ASSERT_EQ(2u, hits);
+  ASSERT_EQ(4u, misses);
+}
+
+
+static void LookupStableSeries(AtomIT::ITimeSeriesManager* manager,
+                               unsigned int* failures)
+{
+  for (unsigned int i = 0; i < 1000; i++)
+  {
+    try
+    {
+      std::auto_ptr<AtomIT::ITimeSeriesAccessor> accessor(manager->CreateAccessor("stable", false));
+    }
+    catch (Orthanc::OrthancException&)
+    {
+      (*failures)++;
+    }
+  }
+}
+
+
+TEST_P(BackendTest, ConcurrentLookups)
+{
+  GetManager().CreateTimeSeries("stable", AtomIT::TimestampType_Sequence);
+
+  unsigned int failures[4] = { 0, 0, 0, 0 };
+
+  boost::thread_group readers;
+  for (unsigned int i = 0; i < 4; i++)
+  {
+    readers.create_thread(boost::bind(LookupStableSeries, &GetManager(), &failures[i]));
+  }
+
+  // The lookups are not disturbed by the creations and deletions
+  for (unsigned int i = 0; i < 20; i++)
+  {
+    const std::string name = "volatile" + boost::lexical_cast<std::string>(i);
+    GetManager().CreateTimeSeries(name, AtomIT::TimestampType_Sequence);
+
+    {
+      AtomIT::TimeSeriesWriter writer(GetManager(), name);
+      GetManager().DeleteTimeSeries(name);
+
+      // The writer was created before the deletion
+      ASSERT_FALSE(writer.Append(CreateMessage(0, "")));
+    }
+
+    ASSERT_THROW(AtomIT::TimeSeriesWriter(GetManager(), name), Orthanc::OrthancException);
+  }
+
+  readers.join_all();
+
+  for (unsigned int i = 0; i < 4; i++)
+  {
+    ASSERT_EQ(0u, failures[i]);
+  }
+
+  std::set<std::string> names;
+  GetManager().ListTimeSeries(names);
+  ASSERT_EQ(1u, names.size());
+  ASSERT_EQ("stable", *names.begin());
+}
+
+
+TEST_P(BackendTest, Aggregate)
+{
+  double v;
+  ASSERT_TRUE(AtomIT::TimeSeriesAggregator::ParseValue(v, "42"));
+  ASSERT_DOUBLE_EQ(42.0, v);
+  ASSERT_TRUE(AtomIT::TimeSeriesAggregator::ParseValue(v, " -3.5e1\n"));
+  ASSERT_DOUBLE_EQ(-35.0, v);
+  ASSERT_FALSE(AtomIT::TimeSeriesAggregator::ParseValue(v, ""));
+  ASSERT_FALSE(AtomIT::TimeSeriesAggregator::ParseValue(v, "  "));
+  ASSERT_FALSE(AtomIT::TimeSeriesAggregator::ParseValue(v, "3x"));
+  ASSERT_FALSE(AtomIT::TimeSeriesAggregator::ParseValue(v, "nan"));
+  ASSERT_FALSE(AtomIT::TimeSeriesAggregator::ParseValue(v, "1e500"));
+
+  ASSERT_THROW(AtomIT::TimeSeriesAggregator(10, 10, 1, AtomIT::TimeSeriesAggregator::Decimation_None),
+               Orthanc::OrthancException);
+  ASSERT_THROW(AtomIT::TimeSeriesAggregator(0, 10, 0, AtomIT::TimeSeriesAggregator::Decimation_None),
+               Orthanc::OrthancException);
+
+  {
+    // The whole range of timestamps
+    AtomIT::TimeSeriesAggregator aggregator(std::numeric_limits<int64_t>::min(),
+                                            std::numeric_limits<int64_t>::max(), 2,
+                                            AtomIT::TimeSeriesAggregator::Decimation_None);
+    ASSERT_EQ(static_cast<uint64_t>(1) << 63, aggregator.GetBucketWidth());
+    ASSERT_THROW(aggregator.GetBuckets(), Orthanc::OrthancException);
+    aggregator.Finalize();
+    ASSERT_TRUE(aggregator.GetBuckets().empty());
+    ASSERT_THROW(aggregator.Finalize(), Orthanc::OrthancException);
+  }
+
+  GetManager().CreateTimeSeries("hello", AtomIT::TimestampType_Sequence);
+
+  {
+    AtomIT::TimeSeriesWriter writer(GetManager(), "hello");
+
+    for (int64_t i = 0; i < 100; i++)
+    {
+      // Timestamp 50 is not numeric, and timestamp 55 is a spike
+      std::string value = (i == 50 ? "nope" :
+                           i == 55 ? "1000" :
+                           boost::lexical_cast<std::string>(i % 10));
+      ASSERT_TRUE(writer.Append(CreateMessage(i, value)));
+    }
+  }
+
+  AtomIT::TimeSeriesReader reader(GetManager(), "hello", true);
+
+  {
+    AtomIT::TimeSeriesAggregator aggregator(0, 100, 3, AtomIT::TimeSeriesAggregator::Decimation_None);
+
+    {
+      AtomIT::TimeSeriesReader::Transaction transaction(reader);
+      ASSERT_EQ(100u, transaction.Scan(0, 100, 0, aggregator));
+    }
+
+    aggregator.Finalize();
+    ASSERT_EQ(34u, aggregator.GetBucketWidth());
+    ASSERT_EQ(1u, aggregator.GetIgnoredCount());
+
+    const std::vector<AtomIT::TimeSeriesAggregator::Bucket>& buckets = aggregator.GetBuckets();
+    ASSERT_EQ(3u, buckets.size());
+    ASSERT_EQ(0, buckets[0].start_);
+    ASSERT_EQ(34u, buckets[0].count_);
+    ASSERT_DOUBLE_EQ(0.0, buckets[0].min_);
+    ASSERT_DOUBLE_EQ(9.0, buckets[0].max_);
+    ASSERT_DOUBLE_EQ(3.0, buckets[0].last_);
+    ASSERT_EQ(33, buckets[0].lastTimestamp_);
+    ASSERT_EQ(34, buckets[1].start_);
+    ASSERT_EQ(33u, buckets[1].count_);
+    ASSERT_DOUBLE_EQ(1000.0, buckets[1].max_);
+    ASSERT_EQ(55, buckets[1].maxTimestamp_);
+    ASSERT_EQ(68, buckets[2].start_);
+    ASSERT_EQ(32u, buckets[2].count_);
+    ASSERT_DOUBLE_EQ(9.0, buckets[2].last_);
+    ASSERT_EQ(99, buckets[2].lastTimestamp_);
+    ASSERT_TRUE(aggregator.GetPoints().empty());
+  }
+
+  {
+    // Empty buckets are skipped, and the items out of the range are ignored
+    AtomIT::TimeSeriesAggregator aggregator(-100, 20, 12, AtomIT::TimeSeriesAggregator::Decimation_None);
+
+    {
+      AtomIT::TimeSeriesReader::Transaction transaction(reader);
+      transaction.Scan(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), 0, aggregator);
+    }
+
+    aggregator.Finalize();
+    ASSERT_EQ(0u, aggregator.GetIgnoredCount());
+    ASSERT_EQ(2u, aggregator.GetBuckets().size());
+    ASSERT_EQ(0, aggregator.GetBuckets()[0].start_);
+    ASSERT_DOUBLE_EQ(4.5, aggregator.GetBuckets()[0].GetMean());
+    ASSERT_EQ(10, aggregator.GetBuckets()[1].start_);
+  }
+
+  {
+    AtomIT::TimeSeriesAggregator aggregator(0, 100, 10, AtomIT::TimeSeriesAggregator::Decimation_MinMax);
+
+    {
+      AtomIT::TimeSeriesReader::Transaction transaction(reader);
+      transaction.Scan(0, 100, 0, aggregator);
+    }
+
+    aggregator.Finalize();
+
+    const std::vector<AtomIT::TimeSeriesAggregator::Point>& points = aggregator.GetPoints();
+    ASSERT_EQ(20u, points.size());
+    ASSERT_EQ(0, points[0].timestamp_);
+    ASSERT_DOUBLE_EQ(0.0, points[0].value_);
+    ASSERT_EQ(9, points[1].timestamp_);
+    ASSERT_DOUBLE_EQ(9.0, points[1].value_);
+
+    // Bucket [50, 60[, whose first item is not numeric
+    ASSERT_EQ(51, points[10].timestamp_);
+    ASSERT_DOUBLE_EQ(1.0, points[10].value_);
+    ASSERT_EQ(55, points[11].timestamp_);
+    ASSERT_DOUBLE_EQ(1000.0, points[11].value_);
+  }
+
+  {
+    AtomIT::TimeSeriesAggregator aggregator(0, 100, 10, AtomIT::TimeSeriesAggregator::Decimation_LTTB);
+
+    {
+      AtomIT::TimeSeriesReader::Transaction transaction(reader);
+      transaction.Scan(0, 100, 0, aggregator);
+    }
+
+    aggregator.Finalize();
+
+    // One point per bucket, plus the first and the last points
+    const std::vector<AtomIT::TimeSeriesAggregator::Point>& points = aggregator.GetPoints();
+    ASSERT_EQ(12u, points.size());
+    ASSERT_EQ(0, points.front().timestamp_);
+    ASSERT_EQ(99, points.back().timestamp_);
+
+    bool hasSpike = false;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+      if (i > 0)
+      {
+        ASSERT_LT(points[i - 1].timestamp_, points[i].timestamp_);
+      }
+
+      if (points[i].timestamp_ == 55)
+      {
+        ASSERT_DOUBLE_EQ(1000.0, points[i].value_);
+        hasSpike = true;
+      }
+    }
+
+    ASSERT_TRUE(hasSpike);
+  }
+}
+
+
+TEST_P(BackendTest, Archive)
+{
+  GetManager().CreateTimeSeries("hello", AtomIT::TimestampType_Sequence);
+
+  {
+    AtomIT::TimeSeriesWriter writer(GetManager(), "hello");
+
+    for (int64_t i = 0; i < 100; i++)
+    {
+      AtomIT::Message message = CreateMessage(i * i - 1000, std::string(i, 'a' + i % 26));
+      message.SetMetadata(i % 3 == 0 ? "text/plain" : "m" + boost::lexical_cast<std::string>(i));
+      ASSERT_TRUE(writer.Append(message));
+    }
+  }
+
+  std::string archive;
+
+  {
+    AtomIT::ArchiveWriter encoder(true);
+
+    AtomIT::TimeSeriesReader reader(GetManager(), "hello", true);
+    AtomIT::TimeSeriesReader::Transaction transaction(reader);
+    ASSERT_EQ(100u, transaction.Scan(std::numeric_limits<int64_t>::min(),
+                                     std::numeric_limits<int64_t>::max(), 0, encoder));
+    ASSERT_EQ(100u, encoder.GetCount());
+    encoder.Flush(archive);
+    ASSERT_EQ(0u, encoder.GetBufferSize());
+  }
+
+  {
+    // Append a second segment with extreme timestamps
+    AtomIT::ArchiveWriter encoder(false);
+    encoder.Add(std::numeric_limits<int64_t>::max(), "text/plain", "");
+    encoder.Add(std::numeric_limits<int64_t>::min(), "", "end");
+
+    std::string segment;
+    encoder.Flush(segment);
+    archive += segment;
+  }
+
+  // Decode the archive by chunks of 7 bytes
+  AtomIT::ArchiveReader decoder;
+  std::vector<AtomIT::Message> messages;
+
+  for (size_t pos = 0; pos < archive.size(); pos += 7)
+  {
+    decoder.AddChunk(archive.c_str() + pos, std::min(static_cast<size_t>(7), archive.size() - pos));
+
+    AtomIT::Message message;
+    while (decoder.ReadMessage(message))
+    {
+      messages.push_back(message);
+    }
+  }
+
+  ASSERT_TRUE(decoder.IsDone());
+  ASSERT_EQ(102u, messages.size());
+
+  for (int64_t i = 0; i < 100; i++)
+  {
+    ASSERT_EQ(i * i - 1000, messages[i].GetTimestamp());
+    ASSERT_EQ(i % 3 == 0 ? "text/plain" : "m" + boost::lexical_cast<std::string>(i),
+              messages[i].GetMetadata());
+    ASSERT_EQ(std::string(i, 'a' + i % 26), messages[i].GetValue());
+  }
+
+  ASSERT_EQ(std::numeric_limits<int64_t>::max(), messages[100].GetTimestamp());
+  ASSERT_EQ("text/plain", messages[100].GetMetadata());
+  ASSERT_TRUE(messages[100].GetValue().empty());
+  ASSERT_EQ(std::numeric_limits<int64_t>::min(), messages[101].GetTimestamp());
+  ASSERT_TRUE(messages[101].GetMetadata().empty());
+  ASSERT_EQ("end", messages[101].GetValue());
+
+  {
+    // Truncated archive
+    AtomIT::ArchiveReader truncated;
+    truncated.AddChunk(archive.c_str(), archive.size() - 1);
+
+    AtomIT::Message message;
+    size_t count = 0;
+    while (truncated.ReadMessage(message))
+    {
+      count++;
+    }
+
+    ASSERT_EQ(101u, count);
+    ASSERT_FALSE(truncated.IsDone());
+  }
+
+  {
+    std::string corrupted = archive;
+    corrupted[0] = 'X';
+
+    AtomIT::ArchiveReader reader;
+    reader.AddChunk(corrupted.c_str(), corrupted.size());
+
+    AtomIT::Message message;
+    ASSERT_THROW(reader.ReadMessage(message), Orthanc::OrthancException);
+  }
+}
+
+
+static uint64_t GetLength(AtomIT::SQLiteDatabase& db,
+                          const std::string& name)
+{
+  uint64_t length, size;  
+  AtomIT::SQLiteTimeSeriesTransaction t(db, name);
+  t.GetStatistics(length, size);
+  return length;
+}
+
+
+static uint64_t GetSize(AtomIT::SQLiteDatabase& db,
+                        const std::string& name)
+{
+  uint64_t length, size;  
+  AtomIT::SQLiteTimeSeriesTransaction t(db, name);
+  t.GetStatistics(length, size);
+  return size;
+}
+
+
+TEST(SQLiteBackend, ChangeQuota)
+{
+  AtomIT::SQLiteDatabase db;
+
+  db.CreateTimeSeries("world", 0, 0);
+
+  for (unsigned int i = 0; i < 10; i++)
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+    ASSERT_TRUE(t.Append(i, "", "v" + boost::lexical_cast<std::string>(i)));
+  }
+
+  ASSERT_EQ(10u, GetLength(db, "world"));
+  ASSERT_EQ(20u, GetSize(db, "world"));
+
+  db.CreateTimeSeries("world", 0, 0);
+
+  // Change quota
+  db.CreateTimeSeries("world", 5, 0);
+
+  ASSERT_EQ(5u, GetLength(db, "world"));
+  ASSERT_EQ(10u, GetSize(db, "world"));
+
+  db.CreateTimeSeries("world", 0, 6);
+
+  ASSERT_EQ(3u, GetLength(db, "world"));
+  ASSERT_EQ(6u, GetSize(db, "world"));
+
+  db.CreateTimeSeries("world", 0, 4);
+
+  ASSERT_EQ(2u, GetLength(db, "world"));
+  ASSERT_EQ(4u, GetSize(db, "world"));
+}
+
+
+TEST(SQLiteBackend, GroupCommit)
+{
+  AtomIT::SQLiteDatabase db;
+
+  db.CreateTimeSeries("world", 0, 0);
+  ASSERT_FALSE(db.IsGroupCommit());
+  ASSERT_TRUE(db.IsDurable(db.GetLastTicket()));
+
+  db.EnableGroupCommit(3, 1000000);  // Only commit on size
+  ASSERT_TRUE(db.IsGroupCommit());
+
+  uint64_t ticket1, ticket2, ticket3;
+
+  {
+    AtomIT::SQLiteDatabase::Transaction t(db);
+    ticket1 = t.Commit();
+  }
+
+  {
+    AtomIT::SQLiteDatabase::Transaction t(db);
+    ticket2 = t.Commit();
+  }
+
+  ASSERT_LT(ticket1, ticket2);
+  ASSERT_FALSE(db.IsDurable(ticket1));
+  ASSERT_FALSE(db.IsDurable(ticket2));
+
+  {
+    // Rollback of one transaction must not discard the pending group
+    AtomIT::SQLiteDatabase::Transaction t(db);
+    Orthanc::SQLite::Statement s(t.GetConnection(), SQLITE_FROM_HERE,
+                                 "DELETE FROM TimeSeries WHERE publicId=?");
+    s.BindString(0, "world");
+    s.Run();
+  }
+
+  {
+    AtomIT::SQLiteDatabase::Transaction t(db);
+    ASSERT_TRUE(t.HasTimeSeries("world"));
+    ticket3 = t.Commit();
+  }
+
+  db.WaitDurable(ticket3);
+  ASSERT_TRUE(db.IsDurable(ticket1));
+  ASSERT_TRUE(db.IsDurable(ticket3));
+
+  for (unsigned int i = 0; i < 10; i++)
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+    ASSERT_TRUE(t.Append(i, "", "v" + boost::lexical_cast<std::string>(i)));
+  }
+
+  // Pending messages are visible before being committed
+  ASSERT_EQ(10u, GetLength(db, "world"));
+  ASSERT_EQ(20u, GetSize(db, "world"));
+
+  db.Flush();
+  ASSERT_TRUE(db.IsDurable(db.GetLastTicket()));
+
+  db.EnableGroupCommit(1000, 10);  // Commit after 10ms
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+    ASSERT_TRUE(t.Append(10, "", "v10"));
+  }
+
+  db.WaitDurable(db.GetLastTicket());
+  ASSERT_EQ(11u, GetLength(db, "world"));
+}
+
+
+TEST(SQLiteBackend, GroupCommitFailure)
+{
+  AtomIT::SQLiteDatabase db;
+
+  db.CreateTimeSeries("world", 0, 0);
+  db.EnableGroupCommit(1000, 1000000);  // Only commit on flush
+
+  uint64_t ticket1, ticket2;
+
+  {
+    // Defer the check of the foreign keys to the final COMMIT of
+    // the group, which makes the whole group fail
+    AtomIT::SQLiteDatabase::Transaction t(db);
+    t.GetConnection().Execute("PRAGMA defer_foreign_keys=ON");
+    t.GetConnection().Execute("INSERT INTO Content VALUES(42, 0, 0, NULL, 'hello')");
+    ticket1 = t.Commit();
+  }
+
+  ASSERT_FALSE(db.IsDurable(ticket1));
+  db.Flush();
+  ASSERT_FALSE(db.IsDurable(ticket1));
+  ASSERT_THROW(db.WaitDurable(ticket1), Orthanc::OrthancException);
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+    ASSERT_TRUE(t.Append(10, "", "v10"));
+    ASSERT_EQ(ticket1 + 1, t.GetNextTicket());
+  }
+
+  ticket2 = db.GetLastTicket();
+  ASSERT_EQ(ticket1 + 1, ticket2);
+
+  db.Flush();
+  db.WaitDurable(ticket2);
+  ASSERT_TRUE(db.IsDurable(ticket2));
+  ASSERT_FALSE(db.IsDurable(ticket1));
+  ASSERT_THROW(db.WaitDurable(ticket1), Orthanc::OrthancException);
+  ASSERT_EQ(1u, GetLength(db, "world"));
+}
+
+
+TEST(SQLiteBackend, MetadataCacheRollback)
+{
+  AtomIT::SQLiteDatabase db;
+
+  db.CreateTimeSeries("world", 0, 0);
+  db.EnableGroupCommit(1000, 1000000);  // Only commit on flush
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+    ASSERT_TRUE(t.Append(10, "meta", "v10"));  // "meta" is cached
+  }
+
+  {
+    AtomIT::SQLiteDatabase::Transaction t(db);
+    t.GetConnection().Execute("PRAGMA defer_foreign_keys=ON");
+    t.GetConnection().Execute("INSERT INTO Content VALUES(42, 0, 0, NULL, 'hello')");
+    t.Commit();
+  }
+
+  db.Flush();  // The group is rolled back, including "meta"
+  ASSERT_EQ(0u, GetLength(db, "world"));
+
+  {
+    // "other" reuses the identifier that "meta" had in the rolled
+    // back group: The cache must not map "meta" to it anymore
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+    ASSERT_TRUE(t.Append(20, "other", "v20"));
+    ASSERT_TRUE(t.Append(30, "meta", "v30"));
+  }
+
+  db.Flush();
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world", true);
+
+    std::string metadata, value;
+    ASSERT_TRUE(t.Read(metadata, value, 20));
+    ASSERT_EQ("other", metadata);
+    ASSERT_TRUE(t.Read(metadata, value, 30));
+    ASSERT_EQ("meta", metadata);
+    ASSERT_EQ("v30", value);
+  }
+}
+
+
+TEST(SQLiteBackend, WriterDurability)
+{
+  class Factory : public AtomIT::ITimeSeriesFactory
+  {
+  private:
+    AtomIT::SQLiteDatabase&  database_;
+
+  public:
+    explicit Factory(AtomIT::SQLiteDatabase& database) :
+      database_(database)
+    {
+    }
+
+    virtual void ListManualTimeSeries(std::map<std::string, AtomIT::TimestampType>& target)
+    {
+      target.clear();
+      target["world"] = AtomIT::TimestampType_Sequence;
+    }
+
+    virtual AtomIT::ITimeSeriesBackend* CreateManualTimeSeries(const std::string& name)
+    {
+      database_.CreateTimeSeries(name, 0, 0);
+      return new AtomIT::SQLiteTimeSeriesBackend(database_, name);
+    }
+
+    virtual AtomIT::ITimeSeriesBackend* CreateAutoTimeSeries(AtomIT::TimestampType& timestampType,
+                                                             const std::string& name)
+    {
+      return NULL;
+    }
+  };
+
+  AtomIT::SQLiteDatabase db;
+  db.EnableGroupCommit(1000, 10);  // Commit after 10ms
+
+  AtomIT::GenericTimeSeriesManager manager(new Factory(db));
+  AtomIT::TimeSeriesWriter writer(manager, "world");
+
+  writer.WaitDurable();  // Nothing was written yet
+
+  AtomIT::Message message;
+  message.SetValue("hello");
+  ASSERT_TRUE(writer.Append(message));
+  ASSERT_FALSE(db.IsDurable(db.GetLastTicket()));
+
+  writer.WaitDurable();
+  ASSERT_TRUE(db.IsDurable(db.GetLastTicket()));
+}
+
+
+TEST(SQLiteBackend, Statistics)
+{
+  AtomIT::SQLiteDatabase db;
+
+  unsigned int count;
+  uint64_t length, size, transactions, contentions;
+  db.GetStatistics(count, length, size, transactions, contentions);
+  ASSERT_EQ(0u, count);
+  ASSERT_EQ(0u, length);
+  ASSERT_EQ(0u, size);
+  ASSERT_EQ(0u, transactions);
+  ASSERT_EQ(0u, contentions);
+
+  db.CreateTimeSeries("hello", 0, 0);
+  db.CreateTimeSeries("world", 0, 0);
+
+  for (unsigned int i = 0; i < 10; i++)
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, (i % 2) ? "hello" : "world");
+    ASSERT_TRUE(t.Append(i, "", "v" + boost::lexical_cast<std::string>(i)));
+  }
+
+  db.GetStatistics(count, length, size, transactions, contentions);
+  ASSERT_EQ(2u, count);
+  ASSERT_EQ(10u, length);
+  ASSERT_EQ(20u, size);
+  ASSERT_EQ(12u, transactions);
+  ASSERT_EQ(0u, contentions);
+}
+
+
+TEST(SQLiteBackend, ConcurrentReaders)
+{
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+
+  {
+    AtomIT::SQLiteDatabase db(path.string());
+    db.CreateTimeSeries("world", 0, 0);
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+      ASSERT_TRUE(t.Append(10, "", "hello"));
+    }
+
+    {
+      // Hold the writer lock: In-memory readers would deadlock
+      AtomIT::SQLiteDatabase::Transaction writer(db);
+
+      Orthanc::SQLite::Statement s(writer.GetConnection(), SQLITE_FROM_HERE,
+                                   "UPDATE TimeSeries SET currentLength=42");
+      s.Run();
+
+      AtomIT::SQLiteTimeSeriesTransaction t1(db, "world", true);
+      AtomIT::SQLiteTimeSeriesTransaction t2(db, "world", true);
+
+      uint64_t length, size;
+      t1.GetStatistics(length, size);
+      ASSERT_EQ(1u, length);  // The pending update is not visible
+      ASSERT_EQ(5u, size);
+
+      int64_t timestamp;
+      std::string metadata, value;
+      ASSERT_TRUE(t2.SeekFirst(timestamp));
+      ASSERT_EQ(10, timestamp);
+      ASSERT_TRUE(t2.Read(metadata, value, timestamp));
+      ASSERT_EQ("hello", value);
+    }  // Rollback of the writer
+
+    {
+      AtomIT::SQLiteTimeSeriesBackend backend(db, "world");
+      std::auto_ptr<AtomIT::ITimeSeriesBackend::ITransaction> t(backend.CreateTransaction(true));
+      ASSERT_THROW(t->Append(20, "", "nope"), Orthanc::OrthancException);
+
+      uint64_t length, size;
+      t->GetStatistics(length, size);
+      ASSERT_EQ(1u, length);
+    }
+  }
+
+  boost::filesystem::remove(path);
+  boost::filesystem::remove(path.string() + "-wal");
+  boost::filesystem::remove(path.string() + "-shm");
+}
+
+
+TEST(SQLiteBackend, GroupCommitCreation)
+{
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+
+  {
+    AtomIT::SQLiteDatabase db(path.string());
+    db.EnableGroupCommit(1000, 1000000);  // Only commit on flush
+
+    // The read-only connections must see a newly created time
+    // series, even if its group is not committed yet
+    db.CreateTimeSeries("world", 0, 0);
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+      ASSERT_TRUE(t.Append(10, "", "hello"));
+    }
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "world", true);
+
+      uint64_t length, size;
+      t.GetStatistics(length, size);
+      ASSERT_EQ(0u, length);  // The pending append is not visible
+    }
+
+    db.Flush();
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "world", true);
+
+      uint64_t length, size;
+      t.GetStatistics(length, size);
+      ASSERT_EQ(1u, length);
+    }
+  }
+
+  boost::filesystem::remove(path);
+}
+
+
+static uint64_t GetCommittedLength(AtomIT::SQLiteDatabase& db,
+                                   const std::string& name)
+{
+  uint64_t length, size;
+  AtomIT::SQLiteTimeSeriesTransaction t(db, name, true);
+  t.GetStatistics(length, size);
+  return length;
+}
+
+
+TEST(SQLiteBackend, SharedWorker)
+{
+  boost::filesystem::path path1 = (boost::filesystem::temp_directory_path() /
+                                   boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+  boost::filesystem::path path2 = (boost::filesystem::temp_directory_path() /
+                                   boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+
+  AtomIT::SQLiteWorker worker;
+  ASSERT_EQ(0u, worker.GetDatabasesCount());
+
+  {
+    AtomIT::SQLiteDatabase db1(path1.string(), worker);
+    AtomIT::SQLiteDatabase db2(path2.string(), worker);
+    ASSERT_EQ(2u, worker.GetDatabasesCount());
+
+    db1.CreateTimeSeries("world", 0, 0);
+    db2.CreateTimeSeries("world", 0, 0);
+
+    db1.EnableGroupCommit(2, 1000000);  // Only commit on size
+    db2.EnableGroupCommit(1000, 50);    // Commit after 50ms
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t1(db1, "world");
+      ASSERT_TRUE(t1.Append(i, "", "hello"));
+    }
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t2(db2, "world");
+      ASSERT_TRUE(t2.Append(0, "", "hello"));
+    }
+
+    // Both groups are committed by the single thread of the worker
+    db1.WaitDurable(db1.GetLastTicket());
+    db2.WaitDurable(db2.GetLastTicket());
+    ASSERT_EQ(2u, GetCommittedLength(db1, "world"));
+    ASSERT_EQ(1u, GetCommittedLength(db2, "world"));
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t1(db1, "world");
+      ASSERT_TRUE(t1.Append(10, "", "pending"));
+    }
+
+    ASSERT_FALSE(db1.IsDurable(db1.GetLastTicket()));
+  }  // The pending group is committed by the destructor
+
+  ASSERT_EQ(0u, worker.GetDatabasesCount());
+
+  {
+    AtomIT::SQLiteDatabase db1(path1.string());
+    ASSERT_EQ(3u, GetCommittedLength(db1, "world"));
+  }
+
+  boost::filesystem::remove(path1);
+  boost::filesystem::remove(path2);
+}
+
+
+TEST(RingBackend, WrapAround)
+{
+  AtomIT::RingTimeSeriesContent content(20, 0);
+
+  // Fill, evict and grow several times, so that the ring wraps around
+  for (int64_t i = 0; i < 100; i++)
+  {
+    ASSERT_TRUE(content.Append(i, (i % 2 == 0 ? "even" : "odd"),
+                               boost::lexical_cast<std::string>(i)));
+
+    if (i % 7 == 3)
+    {
+      content.DeleteRange(i - 1, i);  // Delete one item in the middle
+    }
+  }
+
+  uint64_t length, size;
+  content.GetStatistics(length, size);
+  ASSERT_EQ(20u, length);
+
+  int64_t timestamp;
+  ASSERT_TRUE(content.SeekFirst(timestamp));
+  ASSERT_EQ(77, timestamp);
+  ASSERT_TRUE(content.SeekLast(timestamp));
+  ASSERT_EQ(99, timestamp);
+  ASSERT_TRUE(content.SeekNearest(timestamp, 79));
+  ASSERT_EQ(80, timestamp);  // 79 was deleted, as 79 % 7 == 2
+  ASSERT_TRUE(content.SeekPrevious(timestamp, 80));
+  ASSERT_EQ(78, timestamp);
+
+  uint64_t expectedSize = 0;
+  size_t count = 0;
+  bool hasTimestamp = content.SeekFirst(timestamp);
+  while (hasTimestamp)
+  {
+    std::string metadata, value;
+    ASSERT_TRUE(content.Read(metadata, value, timestamp));
+    ASSERT_EQ(boost::lexical_cast<std::string>(timestamp), value);
+    ASSERT_EQ(timestamp % 2 == 0 ? "even" : "odd", metadata);
+    expectedSize += value.size();
+    count++;
+    hasTimestamp = content.SeekNext(timestamp, timestamp);
+  }
+
+  ASSERT_EQ(20u, count);
+  ASSERT_EQ(expectedSize, size);
+
+  content.ClearContent();
+  content.GetStatistics(length, size);
+  ASSERT_EQ(0u, length);
+  ASSERT_EQ(0u, size);
+  ASSERT_FALSE(content.Append(99, "", "nope"));  // Last timestamp is kept
+  ASSERT_TRUE(content.Append(100, "", "ok"));
+}
+
+
+TEST(MemoryBackend, MetadataDictionary)
+{
+  AtomIT::MetadataDictionary dictionary;
+
+  uint32_t a = dictionary.Acquire("text/plain");
+  uint32_t b = dictionary.Acquire("application/json");
+  ASSERT_NE(a, b);
+  ASSERT_EQ(a, dictionary.Acquire("text/plain"));
+  ASSERT_EQ(2u, dictionary.GetSize());
+  ASSERT_EQ("text/plain", dictionary.GetValue(a));
+  ASSERT_EQ("application/json", dictionary.GetValue(b));
+
+  dictionary.Release(a);
+  ASSERT_EQ(2u, dictionary.GetSize());
+  dictionary.Release(a);
+  ASSERT_EQ(1u, dictionary.GetSize());
+  ASSERT_THROW(dictionary.Release(a), Orthanc::OrthancException);
+
+  ASSERT_EQ(a, dictionary.Acquire("hello"));  // The identifier is recycled
+  ASSERT_EQ("hello", dictionary.GetValue(a));
+
+  dictionary.Clear();
+  ASSERT_EQ(0u, dictionary.GetSize());
+}
+
+
+class MessagesCollector : public AtomIT::ITimeSeriesVisitor
+{
+private:
+  std::vector<AtomIT::Message>  messages_;
+
+public:
+  const std::vector<AtomIT::Message>& GetMessages() const
+  {
+    return messages_;
+  }
+
+  virtual bool Visit(int64_t timestamp,
+                     const std::string& metadata,
+                     const std::string& value)
+  {
+    messages_.push_back(AtomIT::Message());
+    messages_.back().SetTimestamp(timestamp);
+    messages_.back().SetMetadata(metadata);
+    messages_.back().SetValue(value);
+    return true;
+  }
+};
+
+
+static unsigned int CountMetadata(AtomIT::SQLiteDatabase& db)
+{
+  AtomIT::SQLiteDatabase::Transaction t(db);
+  Orthanc::SQLite::Statement s(t.GetConnection(), SQLITE_FROM_HERE,
+                               "SELECT COUNT(*) FROM Metadata");
+  if (!s.Step())
+  {
+    throw Orthanc::OrthancException(Orthanc::ErrorCode_InternalError);
+  }
+
+  return static_cast<unsigned int>(s.ColumnInt(0));
+}
+
+
+TEST(SQLiteBackend, MetadataDictionary)
+{
+  AtomIT::SQLiteDatabase db;
+  db.CreateTimeSeries("hello", 0, 0);
+  db.CreateTimeSeries("world", 0, 0);
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "hello");
+    ASSERT_TRUE(t.Append(1, "text/plain", "a"));
+    ASSERT_TRUE(t.Append(2, "text/plain", "b"));
+    ASSERT_TRUE(t.Append(3, "", "c"));
+  }
+
+  {
+    std::vector<AtomIT::Message> messages(3);
+    messages[0].SetTimestamp(1);
+    messages[0].SetMetadata("text/plain");
+    messages[0].SetValue("d");
+    messages[1].SetTimestamp(2);
+    messages[1].SetMetadata("application/json");
+    messages[1].SetValue("e");
+    messages[2].SetTimestamp(3);
+    messages[2].SetMetadata("text/plain");
+    messages[2].SetValue("f");
+    
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+    ASSERT_EQ(3u, t.AppendBatch(messages));
+  }
+
+  // The dictionary is shared by all the time series of the database
+  ASSERT_EQ(3u, CountMetadata(db));
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+
+    std::string metadata, value;
+    ASSERT_TRUE(t.Read(metadata, value, 2));
+    ASSERT_EQ("application/json", metadata);
+    ASSERT_EQ("e", value);
+
+    MessagesCollector collector;
+    ASSERT_EQ(3u, t.Scan(0, 10, 0, collector));
+    ASSERT_EQ("text/plain", collector.GetMessages()[0].GetMetadata());
+    ASSERT_EQ("application/json", collector.GetMessages()[1].GetMetadata());
+    ASSERT_EQ("text/plain", collector.GetMessages()[2].GetMetadata());
+  }
+}
+
+
+TEST(SQLiteBackend, UpgradeMetadata)
+{
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+
+  {
+    // Database created by a version of Atom-IT without dictionary
+    Orthanc::SQLite::Connection connection;
+    connection.Open(path.string());
+    connection.Execute(
+      "CREATE TABLE GlobalProperties(property INTEGER PRIMARY KEY, value TEXT);"
+      "CREATE TABLE TimeSeries(internalId INTEGER PRIMARY KEY AUTOINCREMENT, publicId TEXT, "
+      "maxLength INTEGER, maxSize INTEGER, currentLength INTEGER, currentSize INTEGER, "
+      "lastTimestamp INTEGER);"
+      "CREATE TABLE Content(id INTEGER REFERENCES TimeSeries(internalId) ON DELETE CASCADE, "
+      "timestamp INTEGER, size INTEGER, metadata TEXT, value TEXT, PRIMARY KEY(id, timestamp));"
+      "CREATE INDEX TimeSeriesIndex ON TimeSeries(publicId);"
+      "INSERT INTO TimeSeries VALUES(1, 'hello', 0, 0, 3, 3, 30);"
+      "INSERT INTO Content VALUES(1, 10, 1, 'text/plain', 'a');"
+      "INSERT INTO Content VALUES(1, 20, 1, 'text/plain', 'b');"
+      "INSERT INTO Content VALUES(1, 30, 1, '', 'c');");
+  }
+
+  {
+    AtomIT::SQLiteDatabase db(path.string());
+    ASSERT_EQ(2u, CountMetadata(db));
+
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "hello");
+
+    MessagesCollector collector;
+    ASSERT_EQ(3u, t.Scan(0, 100, 0, collector));
+    ASSERT_EQ(20, collector.GetMessages()[1].GetTimestamp());
+    ASSERT_EQ("text/plain", collector.GetMessages()[1].GetMetadata());
+    ASSERT_EQ("b", collector.GetMessages()[1].GetValue());
+    ASSERT_EQ("", collector.GetMessages()[2].GetMetadata());
+
+    ASSERT_TRUE(t.Append(40, "text/plain", "d"));
+  }
+
+  boost::filesystem::remove(path);
+  boost::filesystem::remove(path.string() + "-wal");
+  boost::filesystem::remove(path.string() + "-shm");
+}
+
+
+TEST(SQLiteBackend, LowWaterMark)
+{
+  AtomIT::SQLiteDatabase db;
+  ASSERT_EQ(100u, db.GetLowWaterMark());
+  ASSERT_THROW(db.SetLowWaterMark(0), Orthanc::OrthancException);
+  ASSERT_THROW(db.SetLowWaterMark(101), Orthanc::OrthancException);
+
+  db.SetLowWaterMark(80);
+  db.CreateTimeSeries("hello", 10, 0);
+  db.CreateTimeSeries("world", 0, 100);
+
+  uint64_t length, size;
+  int64_t timestamp;
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "hello");
+
+    for (int64_t i = 0; i < 10; i++)
+    {
+      ASSERT_TRUE(t.Append(i, "", "a"));
+    }
+
+    t.GetStatistics(length, size);
+    ASSERT_EQ(10u, length);
+
+    // The quota is exceeded: Evict down to 80% of the quota
+    ASSERT_TRUE(t.Append(10, "", "a"));
+    t.GetStatistics(length, size);
+    ASSERT_EQ(8u, length);
+    ASSERT_TRUE(t.SeekFirst(timestamp));
+    ASSERT_EQ(3, timestamp);
+
+    // No eviction until the quota is exceeded again
+    ASSERT_TRUE(t.Append(11, "", "a"));
+    ASSERT_TRUE(t.Append(12, "", "a"));
+    t.GetStatistics(length, size);
+    ASSERT_EQ(10u, length);
+    ASSERT_TRUE(t.SeekFirst(timestamp));
+    ASSERT_EQ(3, timestamp);
+  }
+
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "world");
+
+    for (int64_t i = 0; i < 10; i++)
+    {
+      ASSERT_TRUE(t.Append(i, "", "0123456789"));
+    }
+
+    ASSERT_TRUE(t.Append(10, "", "01234"));
+    t.GetStatistics(length, size);
+    ASSERT_EQ(8u, length);
+    ASSERT_EQ(75u, size);
+  }
+
+  // Changing the quota also evicts down to the low-water mark
+  db.CreateTimeSeries("hello", 5, 0);
+  
+  {
+    AtomIT::SQLiteTimeSeriesTransaction t(db, "hello");
+    t.GetStatistics(length, size);
+    ASSERT_EQ(4u, length);
+    ASSERT_TRUE(t.SeekFirst(timestamp));
+    ASSERT_EQ(9, timestamp);
+  }
+}
+
+
+TEST(SQLiteBackend, BlockEncoding)
+{
+  AtomIT::SQLiteBlock block;
+  block.Append(std::numeric_limits<int64_t>::min(), "a", "");
+  block.Append(-10, "b", "hello");
+  block.Append(0, "a", std::string(1000, 'x'));
+  block.Append(1000, "", "world");
+  block.Append(2000, "a", "!");
+  block.Append(std::numeric_limits<int64_t>::max(), "b", "end");
+  ASSERT_THROW(block.Append(0, "", ""), Orthanc::OrthancException);
+
+  std::string encoded;
+  block.Encode(encoded);
+  ASSERT_LT(encoded.size(), 200u);  // The 1000 'x' are compressed
+
+  AtomIT::SQLiteBlock decoded;
+  decoded.Decode(encoded.c_str(), encoded.size());
+
+  ASSERT_EQ(block.GetLength(), decoded.GetLength());
+  ASSERT_EQ(block.GetSize(), decoded.GetSize());
+
+  for (size_t i = 0; i < block.GetLength(); i++)
+  {
+    ASSERT_EQ(block.GetTimestamp(i), decoded.GetTimestamp(i));
+    ASSERT_EQ(block.GetMetadata(i), decoded.GetMetadata(i));
+    ASSERT_EQ(block.GetValue(i), decoded.GetValue(i));
+  }
+
+  ASSERT_EQ(2u, decoded.LowerBound(0));
+  ASSERT_EQ(3u, decoded.UpperBound(0));
+  ASSERT_EQ(3u, decoded.LowerBound(1));
+
+  ASSERT_THROW(decoded.Decode(encoded.c_str(), encoded.size() / 2), Orthanc::OrthancException);
+}
+
+
+TEST(SQLiteBackend, BlockedLayout)
+{
+  boost::filesystem::path path = (boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("atomit-%%%%-%%%%.db"));
+
+  {
+    AtomIT::SQLiteDatabase db(path.string());
+    db.CreateTimeSeries("hello", 0, 0);
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "hello");
+
+      for (int64_t i = 0; i < 25; i++)
+      {
+        ASSERT_TRUE(t.Append(i * 10, (i % 2 == 0 ? "even" : "odd"),
+                             boost::lexical_cast<std::string>(i)));
+      }
+    }
+
+    // Pack the existing messages into 2 blocks, keeping 5 messages in the tail
+    db.SetBlockSize("hello", 10);
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "hello", true);
+
+      uint64_t length, size;
+      t.GetStatistics(length, size);
+      ASSERT_EQ(25u, length);
+
+      int64_t timestamp;
+      ASSERT_TRUE(t.SeekFirst(timestamp));  ASSERT_EQ(0, timestamp);
+      ASSERT_TRUE(t.SeekLast(timestamp));  ASSERT_EQ(240, timestamp);
+      ASSERT_TRUE(t.SeekNearest(timestamp, 95));  ASSERT_EQ(100, timestamp);
+      ASSERT_TRUE(t.SeekNext(timestamp, 90));  ASSERT_EQ(100, timestamp);
+      ASSERT_TRUE(t.SeekPrevious(timestamp, 100));  ASSERT_EQ(90, timestamp);
+      ASSERT_TRUE(t.SeekPrevious(timestamp, 205));  ASSERT_EQ(200, timestamp);
+      ASSERT_FALSE(t.SeekPrevious(timestamp, 0));
+
+      std::string metadata, value;
+      ASSERT_TRUE(t.Read(metadata, value, 130));
+      ASSERT_EQ("odd", metadata);
+      ASSERT_EQ("13", value);
+      ASSERT_FALSE(t.Read(metadata, value, 135));
+
+      MessagesCollector collector;
+      ASSERT_EQ(12u, t.Scan(55, 1000, 12, collector));
+      ASSERT_EQ(60, collector.GetMessages().front().GetTimestamp());
+      ASSERT_EQ(170, collector.GetMessages().back().GetTimestamp());
+    }
+
+    {
+      // Remove a range that spans both blocks, then evict the oldest
+      // messages, which partially removes the first remaining block
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "hello");
+      t.DeleteRange(50, 150);
+      ASSERT_TRUE(t.Append(250, "", "25"));
+
+      uint64_t length, size;
+      t.GetStatistics(length, size);
+      ASSERT_EQ(16u, length);
+
+      MessagesCollector collector;
+      ASSERT_EQ(16u, t.Scan(0, 1000, 0, collector));
+      ASSERT_EQ(40, collector.GetMessages()[4].GetTimestamp());
+      ASSERT_EQ(150, collector.GetMessages()[5].GetTimestamp());
+      ASSERT_EQ("15", collector.GetMessages()[5].GetValue());
+      ASSERT_EQ("odd", collector.GetMessages()[5].GetMetadata());
+    }
+
+    db.CreateTimeSeries("hello", 12, 0);
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "hello", true);
+
+      MessagesCollector collector;
+      ASSERT_EQ(12u, t.Scan(0, 1000, 0, collector));
+      ASSERT_EQ(40, collector.GetMessages()[0].GetTimestamp());
+      ASSERT_EQ(150, collector.GetMessages()[1].GetTimestamp());
+      ASSERT_EQ(250, collector.GetMessages()[11].GetTimestamp());
+    }
+
+    // Switch back to one row per message
+    db.SetBlockSize("hello", 0);
+
+    {
+      AtomIT::SQLiteTimeSeriesTransaction t(db, "hello", true);
+
+      MessagesCollector collector;
+      ASSERT_EQ(12u, t.Scan(0, 1000, 0, collector));
+      ASSERT_EQ(40, collector.GetMessages()[0].GetTimestamp());
+      ASSERT_EQ("4", collector.GetMessages()[0].GetValue());
+      ASSERT_EQ("even", collector.GetMessages()[0].GetMetadata());
+    }
+  }
+
+  boost::filesystem::remove(path);
+  boost::filesystem::remove(path.string() + "-wal");
+  boost::filesystem::remove(path.string() + "-shm");
+}
+
+
+static void SPSCProducer(AtomIT::SPSCTimeSeriesBackend* backend,
+                         int64_t count)
+{
+  for (int64_t i = 0; i < count; i++)
+  {
+    std::auto_ptr<AtomIT::ITimeSeriesBackend::ITransaction> t(backend->CreateTransaction(false));
+    t->Append(i, "", boost::lexical_cast<std::string>(i));
+  }
+}
+
+
+TEST(SPSCBackend, ProducerConsumer)
+{
+  static const int64_t COUNT = 100000;
+
+  AtomIT::SPSCTimeSeriesBackend backend(0, 0);
+  boost::thread producer(SPSCProducer, &backend, COUNT);
+
+  // The consumer pops the messages by batches, while the ring is
+  // concurrently filled (and grown) by the producer
+  int64_t expected = 0;
+
+  while (expected < COUNT)
+  {
+    MessagesCollector collector;
+
+    {
+      std::auto_ptr<AtomIT::ITimeSeriesBackend::ITransaction> t(backend.CreateTransaction(true));
+      t->Scan(expected, std::numeric_limits<int64_t>::max(), 100, collector);
+    }
+
+    for (size_t i = 0; i < collector.GetMessages().size(); i++)
+    {
+      ASSERT_EQ(expected, collector.GetMessages()[i].GetTimestamp());
+      ASSERT_EQ(boost::lexical_cast<std::string>(expected), collector.GetMessages()[i].GetValue());
+      expected++;
+    }
+
+    if (!collector.GetMessages().empty())
+    {
+      std::auto_ptr<AtomIT::ITimeSeriesBackend::ITransaction> t(backend.CreateTransaction(false));
+      t->DeleteRange(collector.GetMessages().front().GetTimestamp(), expected);
+    }
+  }
+
+  producer.join();
+
+  std::auto_ptr<AtomIT::ITimeSeriesBackend::ITransaction> t(backend.CreateTransaction(true));
+
+  uint64_t length, size;
+  t->GetStatistics(length, size);
+  ASSERT_EQ(0u, length);
+  ASSERT_EQ(0u, size);
+  ASSERT_THROW(t->Append(COUNT, "", ""), Orthanc::OrthancException);
+
+  int64_t last;
+  ASSERT_TRUE(t->GetLastTimestamp(last));
+  ASSERT_EQ(COUNT - 1, last);
 }
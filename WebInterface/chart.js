@@ -13,21 +13,16 @@ $(document).ready(function() {
   $('#series').text(series);
   $('#raw').attr('href', 'content.html?id=' + encodeURIComponent(series));
 
+  // Let the server decimate the time series, instead of downloading
+  // all of its content
   $.ajax({
-    url: '../series/' + series + '/content?limit=0',
+    url: '../series/' + series + '/aggregate?decimation=lttb&buckets=2000',
     cache: false,
     success: function(data) {
       var source = [];
 
-      for (var i = 0; i < data.content.length; i++) {
-        var item = data.content[i];
-
-        if (!item.binary) {
-          var value = parseFloat(item.value);
-          if (!isNaN(value)) {        
-            source.push([ item.timestamp, value ]);
-          }
-        }
+      for (var i = 0; i < data.timestamp.length; i++) {
+        source.push([ data.timestamp[i], data.value[i] ]);
       }
 
       if (source.length == 0) {